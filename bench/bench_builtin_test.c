@@ -0,0 +1,158 @@
+#include "arith.h"
+#include "conditional.h"
+#include "launcher.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Default number of evaluations per case; the external commands run a tenth as often.
+ */
+#define DEFAULT_ITERATIONS 200000
+
+/**
+ * @brief How many times fewer the external binaries are launched than the builtins are run.
+ */
+#define EXTERNAL_DIVISOR 10
+
+/**
+ * @brief Nanoseconds per second.
+ */
+#define NSEC_PER_SEC 1000000000.0
+
+/**
+ * @brief Nanoseconds per microsecond.
+ */
+#define NSEC_PER_USEC 1000.0
+
+/**
+ * @brief Largest number of words in a benchmarked command.
+ */
+#define MAX_WORDS 10
+
+/**
+ * @brief A command measured in-process and as an external binary.
+ */
+typedef struct
+{
+    const char* label;           /**< What the case measures. */
+    char* external[MAX_WORDS];   /**< The external command, NULL terminated. */
+    char* expression[MAX_WORDS]; /**< The words given to conditional_evaluate(), NULL terminated. */
+    const char* arithmetic;      /**< An expression for arith_evaluate() instead, or NULL. */
+} bench_case;
+
+/**
+ * @brief The cases measured.
+ */
+static bench_case cases[] = {
+    {"test -f", {"test", "-f", "/etc/passwd", NULL}, {"-f", "/etc/passwd", NULL}, NULL},
+    {"test -x", {"test", "-x", "/bin/sh", NULL}, {"-x", "/bin/sh", NULL}, NULL},
+    {"test string", {"test", "abc", "=", "abd", NULL}, {"abc", "=", "abd", NULL}, NULL},
+    {"test integer", {"test", "42", "-lt", "1000", "-a", "1", "-ne", "2", NULL},
+     {"42", "-lt", "1000", "-a", "1", "-ne", "2", NULL}, NULL},
+    {"arithmetic", {"expr", "7", "*", "6", "+", "1", NULL}, {NULL}, "7 * 6 + 1"},
+};
+
+/**
+ * @brief Returns the current monotonic time in nanoseconds.
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * @brief Evaluates a case in-process `iterations` times and returns the mean latency in microseconds.
+ */
+static double bench_builtin(const bench_case* c, int iterations)
+{
+    int argc = 0;
+    while (c->expression[argc] != NULL)
+    {
+        argc++;
+    }
+    volatile int64_t sink = 0;
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++)
+    {
+        if (c->arithmetic != NULL)
+        {
+            int64_t value;
+            arith_evaluate(c->arithmetic, strlen(c->arithmetic), &value);
+            sink += value;
+        }
+        else
+        {
+            sink += conditional_evaluate("test", argc, (char**)c->expression, 0);
+        }
+    }
+    (void)sink;
+    return (now_ns() - start) / iterations / NSEC_PER_USEC;
+}
+
+/**
+ * @brief Launches a case's external command `iterations` times and returns the mean latency in microseconds.
+ */
+static double bench_external(const bench_case* c, int iterations)
+{
+    // expr prints its result: send it nowhere
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (null_fd == -1)
+    {
+        perror("open");
+        return -1;
+    }
+    launch_spec spec;
+    launch_spec_init(&spec, c->external);
+    launch_spec_add_dup2(&spec, null_fd, STDOUT_FILENO);
+
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++)
+    {
+        pid_t pid = launch_command(&spec);
+        if (pid == -1)
+        {
+            close(null_fd);
+            return -1;
+        }
+        waitpid(pid, NULL, 0);
+    }
+    close(null_fd);
+    return (now_ns() - start) / iterations / NSEC_PER_USEC;
+}
+
+/**
+ * @brief Compares the `test` and `$(( ))` builtins with the external test and expr binaries.
+ *
+ * Usage: bench_builtin_test [iterations]
+ */
+int main(int argc, char* argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    if (iterations < EXTERNAL_DIVISOR)
+    {
+        fprintf(stderr, "Usage: %s [iterations >= %d]\n", argv[0], EXTERNAL_DIVISOR);
+        return 1;
+    }
+
+    printf("%-14s %12s %12s %10s\n", "case", "builtin us", "external us", "speedup");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        double builtin = bench_builtin(&cases[i], iterations);
+        double external = bench_external(&cases[i], iterations / EXTERNAL_DIVISOR);
+        if (external < 0)
+        {
+            return 1;
+        }
+        printf("%-14s %12.3f %12.1f %9.0fx\n", cases[i].label, builtin, external, external / builtin);
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "history.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief Default number of entries in the synthetic history.
+ */
+#define DEFAULT_ENTRIES 1000000
+
+/**
+ * @brief Searches timed per query.
+ */
+#define SEARCH_ROUNDS 100
+
+/**
+ * @brief Nanoseconds per second.
+ */
+#define NSEC_PER_SEC 1000000000.0
+
+/**
+ * @brief Nanoseconds per microsecond.
+ */
+#define NSEC_PER_USEC 1000.0
+
+/**
+ * @brief Commands the synthetic history cycles through, each with a counter appended.
+ */
+static const char* sample_commands[] = {
+    "git commit -am 'fix build'", "make -j8 all", "ls -la /var/log", "grep -rn TODO src", "cd ~/projects/myshell",
+    "ssh build@ci.example.org",   "vim README.md", "docker ps -a",   "cat /proc/loadavg", "ps aux | grep sleep",
+};
+
+/**
+ * @brief Queries searched: common, rare, absent and too short for the index.
+ */
+static const char* queries[] = {"make", "ssh build@ci", "not in history", "ls"};
+
+/**
+ * @brief Returns the current monotonic time in nanoseconds.
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * @brief Measures loading a large history file and reverse searching it.
+ *
+ * Usage: bench_history [entries] [file]
+ *
+ * The file is written once, then reopened: opening maps it, the first search
+ * builds the trigram index, and later searches from the newest entry show the
+ * latency of every keystroke of a Ctrl-R search.
+ */
+int main(int argc, char* argv[])
+{
+    long count = argc > 1 ? atol(argv[1]) : DEFAULT_ENTRIES;
+    const char* path = argc > 2 ? argv[2] : "/tmp/bench_history";
+    size_t num_samples = sizeof(sample_commands) / sizeof(sample_commands[0]);
+
+    remove(path);
+    if (history_open(path) == -1)
+    {
+        return 1;
+    }
+    char text[128];
+    for (long i = 0; i < count; i++)
+    {
+        int len = snprintf(text, sizeof(text), "%s # %ld", sample_commands[(size_t)i % num_samples], i);
+        if (history_add(text, (size_t)len, 0, (uint32_t)(i % 1000), i) == -1)
+        {
+            fprintf(stderr, "history_add failed at entry %ld\n", i);
+            return 1;
+        }
+    }
+    history_close();
+
+    double start = now_ns();
+    if (history_open(path) == -1)
+    {
+        return 1;
+    }
+    double load = now_ns() - start;
+    start = now_ns();
+    history_search("bui", 3, history_count());
+    double build = now_ns() - start;
+    printf("%zu entries: load %.2f ms, index build %.2f ms\n", history_count(), load / 1e6, build / 1e6);
+
+    printf("%-16s %12s %12s\n", "query", "match", "us/search");
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++)
+    {
+        long match = -1;
+        start = now_ns();
+        for (int round = 0; round < SEARCH_ROUNDS; round++)
+        {
+            match = history_search(queries[q], strlen(queries[q]), history_count());
+        }
+        double per_search = (now_ns() - start) / SEARCH_ROUNDS;
+        printf("%-16s %12ld %12.2f\n", queries[q], match, per_search / NSEC_PER_USEC);
+    }
+    history_close();
+    remove(path);
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "arena.h"
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief Default number of synthetic lines parsed when no corpus is given.
+ */
+#define DEFAULT_LINES 200000
+
+/**
+ * @brief Nanoseconds per second.
+ */
+#define NSEC_PER_SEC 1000000000.0
+
+/**
+ * @brief Lines the synthetic corpus cycles through.
+ */
+static const char* sample_lines[] = {
+    "ls -l /tmp",
+    "cat file.txt | grep -v '^#' | sort | uniq -c > counts.txt",
+    "make -j4 && ./run_tests || echo \"tests failed\"",
+    "CC=gcc CFLAGS='-O2 -g' ./configure --prefix=/usr/local 2> configure.log",
+    "cd build; cmake .. ; make & echo started",
+    "find . -name '*.c' | xargs wc -l | tail -n 1 >> stats.txt",
+};
+
+/**
+ * @brief Returns the current monotonic time in nanoseconds.
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * @brief Measures parse throughput and allocations per line.
+ *
+ * Usage: bench_parse [corpus_file | line_count]
+ *
+ * Every line is parsed into the same arena, which is reset in between, as the
+ * shell does. Without a corpus file a mix of typical lines is used.
+ */
+int main(int argc, char* argv[])
+{
+    FILE* corpus = NULL;
+    long line_count = DEFAULT_LINES;
+    if (argc > 1)
+    {
+        corpus = fopen(argv[1], "r");
+        if (corpus == NULL)
+        {
+            line_count = atol(argv[1]);
+        }
+    }
+
+    arena a;
+    arena_init(&a);
+    char* line = NULL;
+    size_t capacity = 0;
+    long parsed = 0;
+    long errors = 0;
+    double elapsed = 0;
+
+    for (long i = 0; corpus != NULL || i < line_count; i++)
+    {
+        const char* text;
+        size_t len;
+        if (corpus != NULL)
+        {
+            ssize_t read = getline(&line, &capacity, corpus);
+            if (read == -1)
+            {
+                break;
+            }
+            text = line;
+            len = (size_t)read;
+        }
+        else
+        {
+            text = sample_lines[i % (sizeof(sample_lines) / sizeof(sample_lines[0]))];
+            len = strlen(text);
+        }
+
+        node* root;
+        double start = now_ns();
+        parse_status status = parse_line(&a, text, len, &root);
+        arena_reset(&a);
+        elapsed += now_ns() - start;
+
+        parsed++;
+        errors += status == PARSE_ERROR || status == PARSE_INCOMPLETE;
+    }
+
+    if (parsed == 0)
+    {
+        fprintf(stderr, "bench_parse: no input\n");
+        return 1;
+    }
+    printf("lines:              %ld (%ld not parsed)\n", parsed, errors);
+    printf("ns/line:            %.1f\n", elapsed / parsed);
+    printf("arena allocs/line:  %.2f\n", (double)a.allocations / parsed);
+    printf("mallocs/line:       %.6f (%zu total)\n", (double)a.mallocs / parsed, a.mallocs);
+
+    free(line);
+    arena_free(&a);
+    if (corpus != NULL)
+    {
+        fclose(corpus);
+    }
+    return 0;
+}
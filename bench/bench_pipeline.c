@@ -0,0 +1,209 @@
+#define _GNU_SOURCE
+#include "pipe.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Default number of pipeline stages, producer and consumer included.
+ */
+#define DEFAULT_STAGES 4
+
+/**
+ * @brief Default amount of data pushed through the pipeline, in MiB.
+ */
+#define DEFAULT_MEGABYTES 1024
+
+/**
+ * @brief Size of the buffer every stage reads and writes with, the same as GNU cat.
+ */
+#define IO_BUFFER_SIZE (128 * 1024)
+
+/**
+ * @brief Bytes per MiB.
+ */
+#define BYTES_PER_MB (1024 * 1024)
+
+/**
+ * @brief Nanoseconds per second.
+ */
+#define NSEC_PER_SEC 1000000000.0
+
+/**
+ * @brief Pipe capacities measured besides the system maximum; 0 is the kernel default.
+ */
+static const long pipe_sizes[] = {0, 256 * 1024, 1024 * 1024};
+
+/**
+ * @brief Returns the current monotonic time in nanoseconds.
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * @brief Writes `total` bytes to `fd`.
+ */
+static void produce(int fd, long long total, char* buffer)
+{
+    memset(buffer, 'x', IO_BUFFER_SIZE);
+    while (total > 0)
+    {
+        ssize_t n = write(fd, buffer, total < IO_BUFFER_SIZE ? (size_t)total : IO_BUFFER_SIZE);
+        if (n <= 0)
+        {
+            perror("write");
+            _exit(1);
+        }
+        total -= n;
+    }
+}
+
+/**
+ * @brief Copies `in` to `out` until end of file, like a `cat` stage.
+ */
+static void relay(int in, int out, char* buffer)
+{
+    ssize_t n;
+    while ((n = read(in, buffer, IO_BUFFER_SIZE)) > 0)
+    {
+        for (ssize_t done = 0; done < n;)
+        {
+            ssize_t w = write(out, buffer + done, (size_t)(n - done));
+            if (w <= 0)
+            {
+                perror("write");
+                _exit(1);
+            }
+            done += w;
+        }
+    }
+}
+
+/**
+ * @brief Runs one pipeline and prints its throughput and the context switches of its stages.
+ *
+ * Stage 0 produces the data, the middle stages relay it and the last one,
+ * the benchmark itself, drains it.
+ */
+static int bench_pipeline(int stages, long long total, long pipe_size)
+{
+    static char buffer[IO_BUFFER_SIZE];
+    struct rusage before;
+    getrusage(RUSAGE_CHILDREN, &before);
+    struct rusage self_before;
+    getrusage(RUSAGE_SELF, &self_before);
+
+    long capacity = PIPE_DEFAULT_SIZE;
+    int input = -1;
+    double start = now_ns();
+    for (int i = 0; i < stages - 1; i++)
+    {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1)
+        {
+            perror("pipe");
+            return -1;
+        }
+        if (pipe_size > 0)
+        {
+            capacity = pipe_set_size(fds[0], pipe_size);
+        }
+
+        pid_t pid = fork();
+        if (pid == -1)
+        {
+            perror("fork");
+            return -1;
+        }
+        if (pid == 0)
+        {
+            close(fds[0]);
+            if (i == 0)
+            {
+                produce(fds[1], total, buffer);
+            }
+            else
+            {
+                relay(input, fds[1], buffer);
+            }
+            _exit(0);
+        }
+        close(fds[1]);
+        if (input != -1)
+        {
+            close(input);
+        }
+        input = fds[0];
+    }
+
+    long long received = 0;
+    ssize_t n;
+    while ((n = read(input, buffer, IO_BUFFER_SIZE)) > 0)
+    {
+        received += n;
+    }
+    close(input);
+    while (wait(NULL) > 0)
+    {
+    }
+    double seconds = (now_ns() - start) / NSEC_PER_SEC;
+
+    struct rusage after;
+    getrusage(RUSAGE_CHILDREN, &after);
+    struct rusage self_after;
+    getrusage(RUSAGE_SELF, &self_after);
+    long voluntary = (after.ru_nvcsw - before.ru_nvcsw) + (self_after.ru_nvcsw - self_before.ru_nvcsw);
+    long involuntary = (after.ru_nivcsw - before.ru_nivcsw) + (self_after.ru_nivcsw - self_before.ru_nivcsw);
+
+    if (received != total)
+    {
+        fprintf(stderr, "received %lld of %lld bytes\n", received, total);
+        return -1;
+    }
+    printf("%-12ld %12.1f %12ld %12ld\n", capacity, (double)total / BYTES_PER_MB / seconds, voluntary, involuntary);
+    return 0;
+}
+
+/**
+ * @brief Measures pipeline throughput at several pipe capacities.
+ *
+ * Usage: bench_pipeline [stages] [megabytes]
+ *
+ * Every capacity is set the way the shell sets MYSHELL_PIPE_SIZE, so sizes
+ * above /proc/sys/fs/pipe-max-size show up as the size actually granted.
+ */
+int main(int argc, char* argv[])
+{
+    int stages = argc > 1 ? atoi(argv[1]) : DEFAULT_STAGES;
+    long long megabytes = argc > 2 ? atoll(argv[2]) : DEFAULT_MEGABYTES;
+    if (stages < 2 || megabytes <= 0)
+    {
+        fprintf(stderr, "Usage: %s [stages >= 2] [megabytes]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%lld MiB through %d stages, %d KiB reads and writes\n", megabytes, stages, IO_BUFFER_SIZE / 1024);
+    printf("%-12s %12s %12s %12s\n", "pipe bytes", "MB/s", "voluntary", "involuntary");
+    for (size_t i = 0; i < sizeof(pipe_sizes) / sizeof(pipe_sizes[0]); i++)
+    {
+        if (bench_pipeline(stages, megabytes * BYTES_PER_MB, pipe_sizes[i]) == -1)
+        {
+            return 1;
+        }
+    }
+    if (pipe_max_size() > pipe_sizes[sizeof(pipe_sizes) / sizeof(pipe_sizes[0]) - 1])
+    {
+        return bench_pipeline(stages, megabytes * BYTES_PER_MB, pipe_max_size()) == -1;
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include "script_cache.h"
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/**
+ * @brief Default number of lines in the synthetic script.
+ */
+#define DEFAULT_LINES 100000
+
+/**
+ * @brief Runs timed for each configuration.
+ */
+#define RUNS 5
+
+/**
+ * @brief Nanoseconds per second.
+ */
+#define NSEC_PER_SEC 1000000000.0
+
+/**
+ * @brief Nanoseconds per millisecond.
+ */
+#define NSEC_PER_MSEC 1000000.0
+
+/**
+ * @brief Where the cache files are written.
+ */
+#define CACHE_DIR "/tmp/bench_script_cache"
+
+/**
+ * @brief Lines the synthetic script cycles through.
+ *
+ * They run in the shell itself, or are skipped by `||`, so parsing is not
+ * hidden behind process creation.
+ */
+static const char* sample_lines[] = {
+    "BENCH_A=value_%ld BENCH_B=\"quoted $BENCH_A and ${HOME}\"",
+    "BENCH_C=${BENCH_MISSING:-fallback} && BENCH_D='single quoted' || BENCH_E=never",
+    "# a comment, line %ld",
+    "BENCH_OK=1 || grep -v '^#' /etc/passwd | sort -t: -k3 -n | uniq -c > /tmp/bench_never_%ld.txt",
+    "BENCH_F=x; BENCH_G=y; BENCH_H=z",
+    "    # an indented comment explaining the next step",
+    "BENCH_I=\"multi\nline\" && BENCH_J=%ld",
+};
+
+extern char** environ;
+
+/**
+ * @brief Returns the current monotonic time in nanoseconds.
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * @brief Runs `shell script` to completion and returns how long it took, in milliseconds.
+ */
+static double run_shell(const char* shell, const char* script)
+{
+    char* argv[] = {(char*)shell, (char*)script, NULL};
+    double start = now_ns();
+    pid_t pid;
+    if (posix_spawn(&pid, shell, NULL, NULL, argv, environ) != 0)
+    {
+        perror("posix_spawn");
+        exit(1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "%s %s failed\n", shell, script);
+        exit(1);
+    }
+    return (now_ns() - start) / NSEC_PER_MSEC;
+}
+
+/**
+ * @brief Returns the mean time of RUNS runs, in milliseconds.
+ */
+static double mean_run(const char* shell, const char* script)
+{
+    double total = 0;
+    for (int i = 0; i < RUNS; i++)
+    {
+        total += run_shell(shell, script);
+    }
+    return total / RUNS;
+}
+
+/**
+ * @brief Measures running a large script with and without the parsed script cache.
+ *
+ * Usage: bench_script_cache [lines] [shell]
+ *
+ * The shell (./myshell by default) is started for every run, so the times
+ * include its startup, reading the script and running it. The first run with
+ * the cache parses the script and writes the cache; the others load it.
+ */
+int main(int argc, char* argv[])
+{
+    long lines = argc > 1 ? atol(argv[1]) : DEFAULT_LINES;
+    const char* shell = argc > 2 ? argv[2] : "./myshell";
+    const char* script = "/tmp/bench_script_cache.sh";
+    size_t num_samples = sizeof(sample_lines) / sizeof(sample_lines[0]);
+
+    FILE* fp = fopen(script, "w");
+    if (fp == NULL)
+    {
+        perror("fopen");
+        return 1;
+    }
+    for (long i = 0; i < lines; i++)
+    {
+        fprintf(fp, sample_lines[(size_t)i % num_samples], i);
+        fputc('\n', fp);
+    }
+    fclose(fp);
+
+    setenv("USER", getenv("USER") != NULL ? getenv("USER") : "bench", 0);
+    setenv("PROJECT_ROOT", "/tmp", 0);
+    if (system("rm -rf " CACHE_DIR) != 0)
+    {
+        return 1;
+    }
+
+    unsetenv(SCRIPT_CACHE_ENV);
+    double uncached = mean_run(shell, script);
+    setenv(SCRIPT_CACHE_ENV, CACHE_DIR, 1);
+    double first = run_shell(shell, script);
+    double cached = mean_run(shell, script);
+
+    printf("%ld lines, mean of %d runs\n", lines, RUNS);
+    printf("%-24s %10.2f ms\n", "no cache", uncached);
+    printf("%-24s %10.2f ms\n", "cache miss (writes it)", first);
+    printf("%-24s %10.2f ms\n", "cache hit", cached);
+    printf("speedup                  %10.2fx\n", uncached / cached);
+
+    remove(script);
+    return 0;
+}
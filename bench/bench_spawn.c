@@ -0,0 +1,120 @@
+#include "forkserver.h"
+#include "launcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Default number of launches per backend.
+ */
+#define DEFAULT_ITERATIONS 2000
+
+/**
+ * @brief Default resident ballast, in MiB, to emulate a shell that has grown.
+ */
+#define DEFAULT_BALLAST_MB 256
+
+/**
+ * @brief Bytes per MiB.
+ */
+#define BYTES_PER_MB (1024 * 1024)
+
+/**
+ * @brief Nanoseconds per second.
+ */
+#define NSEC_PER_SEC 1000000000.0
+
+/**
+ * @brief Nanoseconds per microsecond.
+ */
+#define NSEC_PER_USEC 1000.0
+
+/**
+ * @brief Returns the current monotonic time in nanoseconds.
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * @brief Launches `/bin/true` `iterations` times and returns the mean latency in microseconds.
+ */
+static double bench_backend(launch_backend backend, int iterations)
+{
+    char* argv[] = {"true", NULL};
+    launch_spec spec;
+    launch_spec_init(&spec, argv);
+    launch_set_backend(backend);
+
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++)
+    {
+        pid_t pid = launch_command(&spec);
+        if (pid == -1)
+        {
+            return -1;
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return (now_ns() - start) / iterations / NSEC_PER_USEC;
+}
+
+/**
+ * @brief Measures launch + wait latency of every backend.
+ *
+ * Usage: bench_spawn [iterations] [ballast_mb]
+ *
+ * The ballast is touched so it is resident; fork has to copy its page tables,
+ * while vfork and posix_spawn share the parent's address space until exec, and
+ * the fork server, started before the ballast, forks its own small one.
+ */
+int main(int argc, char* argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    long ballast_mb = argc > 2 ? atol(argv[2]) : DEFAULT_BALLAST_MB;
+    static const char* names[] = {"fork", "vfork", "posix_spawn", "forkserver"};
+    static const launch_backend backends[] = {LAUNCH_BACKEND_FORK, LAUNCH_BACKEND_VFORK, LAUNCH_BACKEND_POSIX_SPAWN,
+                                              LAUNCH_BACKEND_FORKSERVER};
+
+    if (iterations <= 0 || ballast_mb < 0)
+    {
+        fprintf(stderr, "Usage: %s [iterations] [ballast_mb]\n", argv[0]);
+        return 1;
+    }
+
+    // Like the shell, start the fork server before growing
+    if (forkserver_start() == -1)
+    {
+        return 1;
+    }
+
+    char* ballast = NULL;
+    if (ballast_mb > 0)
+    {
+        ballast = malloc(ballast_mb * BYTES_PER_MB);
+        if (ballast == NULL)
+        {
+            perror("malloc");
+            return 1;
+        }
+        memset(ballast, 1, ballast_mb * BYTES_PER_MB);
+    }
+
+    printf("%d launches of /bin/true with %ld MiB resident\n", iterations, ballast_mb);
+    printf("%-12s %12s\n", "backend", "us/launch");
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+    {
+        printf("%-12s %12.1f\n", names[i], bench_backend(backends[i], iterations));
+    }
+
+    forkserver_stop();
+    free(ballast);
+    return 0;
+}
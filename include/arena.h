@@ -0,0 +1,103 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * @brief A chunk of memory owned by an arena.
+ */
+typedef struct arena_block
+{
+    struct arena_block* next; /**< Previously filled block. */
+    size_t size;              /**< Usable bytes in `data`. */
+    size_t used;              /**< Bytes handed out so far. */
+    _Alignas(max_align_t) char data[]; /**< The memory itself, aligned for any object. */
+} arena_block;
+
+/**
+ * @brief Bump allocator whose allocations are all released together.
+ *
+ * Used for per-line data (tokens, AST nodes, argument vectors): everything is
+ * freed by a single arena_reset() once the line has executed.
+ */
+typedef struct
+{
+    arena_block* head;  /**< Block currently being filled. */
+    size_t allocations; /**< arena_alloc() calls since the arena was created. */
+    size_t mallocs;     /**< Blocks requested from malloc since the arena was created. */
+} arena;
+
+/**
+ * @brief A position in an arena, to release everything allocated after it.
+ */
+typedef struct
+{
+    arena_block* block; /**< The block being filled at that point. */
+    size_t used;        /**< Bytes it had handed out. */
+} arena_mark;
+
+/**
+ * @brief Initializes an empty arena. No memory is allocated until first use.
+ *
+ * @param a The arena to initialize.
+ */
+void arena_init(arena* a);
+
+/**
+ * @brief Allocates `size` bytes aligned for any object type.
+ *
+ * Exits the shell if memory is exhausted, as there is no sensible way to
+ * continue parsing or executing the line.
+ *
+ * @param a The arena to allocate from.
+ * @param size The number of bytes.
+ * @return void* The allocated memory.
+ */
+void* arena_alloc(arena* a, size_t size);
+
+/**
+ * @brief Copies `len` bytes of `str` into the arena and NUL terminates them.
+ *
+ * @param a The arena to allocate from.
+ * @param str The bytes to copy.
+ * @param len The number of bytes.
+ * @return char* The NUL terminated copy.
+ */
+char* arena_strndup(arena* a, const char* str, size_t len);
+
+/**
+ * @brief Returns the current position of an arena.
+ *
+ * @param a The arena.
+ * @return arena_mark The position, for arena_rewind().
+ */
+arena_mark arena_get_mark(const arena* a);
+
+/**
+ * @brief Releases everything allocated since `mark` was taken.
+ *
+ * Lets loops reuse the same memory for every iteration instead of growing the
+ * line's arena without bound.
+ *
+ * @param a The arena.
+ * @param mark A position taken from this arena, not released since.
+ */
+void arena_rewind(arena* a, arena_mark mark);
+
+/**
+ * @brief Releases every allocation at once.
+ *
+ * The largest block is kept so that steady-state lines do not call malloc.
+ *
+ * @param a The arena to reset.
+ */
+void arena_reset(arena* a);
+
+/**
+ * @brief Releases every block owned by the arena.
+ *
+ * @param a The arena to free.
+ */
+void arena_free(arena* a);
+
+#endif // ARENA_H
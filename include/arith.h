@@ -0,0 +1,29 @@
+#ifndef ARITH_H
+#define ARITH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Deepest nesting of parentheses and variables holding expressions in an arithmetic expression.
+ */
+#define ARITH_MAX_DEPTH 64
+
+/**
+ * @brief Evaluates an arithmetic expression, as found between `$((` and `))`.
+ *
+ * Integers are 64 bit and wrap around on overflow. Decimal, octal (`017`)
+ * and hexadecimal (`0x1f`) constants are understood, as are the C operators
+ * from `,` down to unary ones, plus `**`. A variable holding an expression
+ * is evaluated in turn; an unset or empty one is 0. Assignments (`=`, `+=`,
+ * ...) go through expand_assign(); operands skipped by `&&`, `||` or `?:`
+ * are parsed but neither evaluated nor assigned.
+ *
+ * @param text The expression, whose parameters were expanded already.
+ * @param len The length of the expression.
+ * @param result Receives the value.
+ * @return int 0 on success, -1 on error (reported on stderr).
+ */
+int arith_evaluate(const char* text, size_t len, int64_t* result);
+
+#endif // ARITH_H
@@ -0,0 +1,90 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <stddef.h>
+
+/**
+ * @brief The builtin may run as a stage of a pipeline.
+ */
+#define BUILTIN_PIPELINE_SAFE 0x1
+
+/**
+ * @brief The builtin reads or changes state of the shell process (directory, variables, jobs),
+ * so a concurrent batch script runs it alone, after everything started before it.
+ */
+#define BUILTIN_SHELL_STATE 0x4
+
+/**
+ * @brief Value of `max_args` for builtins taking any number of arguments.
+ */
+#define BUILTIN_ANY_ARGS (-1)
+
+/**
+ * @brief Handler of a builtin command.
+ *
+ * @param argc The number of arguments, including the command name.
+ * @param argv The NULL terminated argument vector.
+ * @return int The exit status of the builtin.
+ */
+typedef int (*builtin_handler)(int argc, char** argv);
+
+/**
+ * @brief A command implemented by the shell itself.
+ */
+typedef struct
+{
+    const char* name;        /**< Name the command is invoked by. */
+    builtin_handler handler; /**< Function implementing it. */
+    int min_args;            /**< Minimum number of arguments, not counting the name. */
+    int max_args;            /**< Maximum number of arguments, or BUILTIN_ANY_ARGS. */
+    unsigned int flags;      /**< BUILTIN_* flags. */
+    const char* usage;       /**< Usage line printed when the arguments are invalid. */
+} builtin;
+
+/**
+ * @brief Adds a module's builtins to the registry.
+ *
+ * The table must outlive the registry (a static array). Registering rebuilds the
+ * perfect hash used by builtin_find().
+ *
+ * @param table The builtins to register.
+ * @param count The number of entries in `table`.
+ * @return int 0 on success, -1 on a duplicate name or a full registry.
+ */
+int builtin_register(const builtin* table, size_t count);
+
+/**
+ * @brief Looks up a builtin by name with a single probe.
+ *
+ * @param name The start of the command name (need not be NUL terminated).
+ * @param len The length of the name.
+ * @return const builtin* The builtin, or NULL if `name` is not a builtin.
+ */
+const builtin* builtin_find(const char* name, size_t len);
+
+/**
+ * @brief Validates the argument count and runs a builtin.
+ *
+ * @param cmd The builtin to run.
+ * @param argc The number of arguments, including the command name.
+ * @param argv The NULL terminated argument vector.
+ * @return int The exit status of the builtin, 2 on a usage error.
+ */
+int builtin_run(const builtin* cmd, int argc, char** argv);
+
+/**
+ * @brief Returns the number of registered builtins.
+ *
+ * @return size_t The number of builtins.
+ */
+size_t builtin_count(void);
+
+/**
+ * @brief Returns a registered builtin by index, in registration order.
+ *
+ * @param index A value below builtin_count().
+ * @return const builtin* The builtin.
+ */
+const builtin* builtin_get(size_t index);
+
+#endif // BUILTINS_H
@@ -1,6 +1,8 @@
 #ifndef COMMANDS_H
 #define COMMANDS_H
 
+#include "parser.h"
+
 /**
  * @brief Changes the current directory to `directory`.
  *
@@ -22,7 +24,8 @@ void clr(void);
 /**
  * @brief Displays `comment` on the screen followed by a new line.
  *
- * Supports environment variables using `$`.
+ * Variables (`$NAME`, `${NAME:-default}`, `$?`, ...) are expanded as in a
+ * here-document, and the line is written with a single writev().
  *
  * @param comment The comment or environment variable to display.
  * @return int 0 if the command was successful, -1 on error.
@@ -36,9 +39,55 @@ int echo(const char* comment);
  */
 void quit(void);
 
+/**
+ * @brief Describes how each name would be interpreted if used as a command.
+ *
+ * Reports shell functions, builtins, commands cached by `hash` and executables found in `PATH`.
+ *
+ * @param args The NULL terminated argument vector, starting with "type".
+ * @return int 0 if every name was found, 1 otherwise.
+ */
+int type_command(char** args);
+
+/**
+ * @brief Registers the core shell builtins (cd, echo, quit, ...) in the builtin registry.
+ */
+void commands_register_builtins(void);
+
+/**
+ * @brief Parses and executes `len` bytes of `text`.
+ *
+ * Nothing is run when the text is incomplete (open quote, trailing `|` or
+ * `&&`), so the caller can append the next line and try again.
+ *
+ * @param text The command text; it does not need to be NUL terminated.
+ * @param len The length of the text.
+ * @return parse_status PARSE_INCOMPLETE if more input is needed, otherwise the parse outcome.
+ */
+parse_status execute_command_text(const char* text, size_t len);
+
+/**
+ * @brief Executes a command line parsed beforehand, as execute_command_text() would.
+ *
+ * @param a The arena for the temporary data of the execution.
+ * @param root The root of the line's AST.
+ * @return int The exit status of the line.
+ */
+int execute_command_tree(arena* a, const node* root);
+
+/**
+ * @brief Returns the exit status of the last command line run by execute_command_text().
+ *
+ * @return int The status, 2 after a syntax error.
+ */
+int command_last_status(void);
+
 /**
  * @brief Executes a command entered by the user.
  *
+ * The line is parsed into an AST (lists, `&&`, `||`, pipelines, redirections,
+ * assignments and quoting) and executed. It may be of any length.
+ *
  * @param input The command entered by the user.
  */
 void execute_command(char* input);
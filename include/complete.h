@@ -0,0 +1,61 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include "arena.h"
+#include <stddef.h>
+
+/**
+ * @brief Candidates for the word being completed.
+ */
+typedef struct
+{
+    const char** items; /**< The candidates, sorted and without duplicates. */
+    size_t count;       /**< Number of candidates. */
+    size_t capacity;    /**< Allocated entries of `items`. */
+    arena names;        /**< Storage of the candidates' text. */
+} complete_list;
+
+/**
+ * @brief Prepares an empty list of candidates.
+ *
+ * @param list The list.
+ */
+void complete_list_init(complete_list* list);
+
+/**
+ * @brief Releases a list of candidates.
+ *
+ * @param list The list.
+ */
+void complete_list_free(complete_list* list);
+
+/**
+ * @brief Completes the word that ends at `pos`.
+ *
+ * A word in command position without a slash completes to builtins and to
+ * the executables of `PATH`. Those come from a sorted index built on first use
+ * and rebuilt only when inotify reports a change in a `PATH` directory or
+ * `PATH` itself changes. Any other word completes to file names, read with
+ * getdents64; directories get a trailing slash and hidden files are shown only
+ * for a prefix starting with a dot.
+ *
+ * @param line The command line.
+ * @param pos Where the cursor is.
+ * @param list Receives the candidates; each replaces the text from the returned offset to `pos`.
+ * @return size_t The offset in `line` where the replaced text starts.
+ */
+size_t complete(const char* line, size_t pos, complete_list* list);
+
+/**
+ * @brief Returns how many times the `PATH` index was built.
+ *
+ * @return unsigned long The number of scans of the `PATH` directories.
+ */
+unsigned long complete_path_scans(void);
+
+/**
+ * @brief Drops the `PATH` index and its inotify watches.
+ */
+void complete_shutdown(void);
+
+#endif // COMPLETE_H
@@ -0,0 +1,28 @@
+#ifndef CONDITIONAL_H
+#define CONDITIONAL_H
+
+/**
+ * @brief Exit status of `test` when its expression is malformed.
+ */
+#define CONDITIONAL_ERROR 2
+
+/**
+ * @brief Evaluates the expression of `test`, `[` or `[[`.
+ *
+ * Files are tested with fstatat() and faccessat() (`-e -f -d -s -L -r -w
+ * -x ...`, `-nt -ot -ef`), strings with `= != < > -n -z` and integers with
+ * `-eq -ne -lt -le -gt -ge`; expressions combine with `!`, parentheses and
+ * `-a`/`-o`. In the extended form (`[[`), `&&` and `||` combine instead,
+ * the right side of `==` and `!=` is a pattern and `=~` matches an extended
+ * regular expression. The words were expanded already, so a quoted pattern
+ * is a pattern all the same.
+ *
+ * @param name The command name, used in error messages.
+ * @param argc The number of words of the expression.
+ * @param argv The words of the expression, without the command name or closing bracket.
+ * @param extended Non-zero for `[[`.
+ * @return int 0 if the expression is true, 1 if it is false, CONDITIONAL_ERROR if it is malformed.
+ */
+int conditional_evaluate(const char* name, int argc, char** argv, int extended);
+
+#endif // CONDITIONAL_H
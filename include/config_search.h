@@ -32,4 +32,9 @@ void list_config_files(const char *directory);
  */
 int is_config_file(const char *file_name);
 
+/**
+ * @brief Registra los comandos de búsqueda de configuración en el registro de builtins.
+ */
+void config_search_register_builtins(void);
+
 #endif // CONFIG_SEARCH_H
@@ -0,0 +1,79 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "parser.h"
+
+/**
+ * @brief Deepest nesting of function calls, so runaway recursion fails instead of overflowing the stack.
+ */
+#define CONTROL_MAX_FUNCTION_DEPTH 1000
+
+/**
+ * @brief Defines (or redefines) a shell function.
+ *
+ * The definition is copied, with the source text it points into, so it
+ * outlives the line it was parsed from.
+ *
+ * @param definition A NODE_FUNCTION node.
+ * @return int 0 on success, 1 on error.
+ */
+int control_define_function(const node* definition);
+
+/**
+ * @brief Looks up a shell function.
+ *
+ * @param name The NUL terminated function name.
+ * @return const node* The function's body, or NULL if no function has that name.
+ */
+const node* control_find_function(const char* name);
+
+/**
+ * @brief Checks whether a `break`, `continue` or `return` is unwinding, so that lists stop running commands.
+ *
+ * @return int Non-zero while one is.
+ */
+int control_pending(void);
+
+/**
+ * @brief Notes that a loop starts, so `break` and `continue` are allowed.
+ */
+void control_enter_loop(void);
+
+/**
+ * @brief Notes that a loop ended.
+ */
+void control_leave_loop(void);
+
+/**
+ * @brief Decides whether a loop stops after its condition or body ran.
+ *
+ * A `break` or `continue` aimed at this loop is consumed; one aimed at an
+ * outer loop, or a `return`, keeps unwinding.
+ *
+ * @return int 1 if the loop must stop, 0 to go on with the next iteration.
+ */
+int control_loop_stop(void);
+
+/**
+ * @brief Notes that a function call starts: `return` is allowed and loops of the caller are out of reach.
+ *
+ * @return int The caller's loop depth, to pass to control_leave_function(), or -1 if calls are nested
+ * CONTROL_MAX_FUNCTION_DEPTH deep already (reported on stderr).
+ */
+int control_enter_function(void);
+
+/**
+ * @brief Notes that a function call ended, consuming a pending `return`.
+ *
+ * @param loop_depth The value control_enter_function() returned.
+ * @param status The status of the function's last command.
+ * @return int The function's exit status: the one given to `return`, else `status`.
+ */
+int control_leave_function(int loop_depth, int status);
+
+/**
+ * @brief Registers the control flow builtins (break, continue, return, true, false, :) in the builtin registry.
+ */
+void control_register_builtins(void);
+
+#endif // CONTROL_H
@@ -0,0 +1,45 @@
+#ifndef EDITOR_H
+#define EDITOR_H
+
+#include <stddef.h>
+
+/**
+ * @brief Largest reverse search query, in bytes.
+ */
+#define EDITOR_QUERY_MAX 256
+
+/**
+ * @brief Milliseconds to wait for the rest of an escape sequence before taking ESC as a key.
+ */
+#define EDITOR_ESCAPE_TIMEOUT_MS 50
+
+/**
+ * @brief Terminal width assumed when it cannot be queried.
+ */
+#define EDITOR_DEFAULT_COLUMNS 80
+
+/**
+ * @brief Returns whether the line editor can be used: standard input and output
+ * are terminals and TERM is not "dumb".
+ *
+ * @return int Non-zero if it can.
+ */
+int editor_usable(void);
+
+/**
+ * @brief Reads a line with the terminal in raw mode.
+ *
+ * Editing keys: Left/Right (Ctrl-B/F), Home/End (Ctrl-A/E), Backspace,
+ * Delete, Ctrl-K, Ctrl-U and Ctrl-W; Up/Down (Ctrl-P/N) walk the history and
+ * Ctrl-R starts a reverse incremental search through it. Tab completes
+ * commands and file names, listing the candidates when pressed twice. Ctrl-C
+ * discards the line, Ctrl-L clears the screen and Ctrl-D on an empty line ends
+ * input. A line longer than the terminal scrolls horizontally.
+ *
+ * @param prompt The prompt, which may contain color escapes.
+ * @param prompt_len The length of `prompt`.
+ * @return char* The line without its newline (to be freed), or NULL at end of input.
+ */
+char* editor_read_line(const char* prompt, size_t prompt_len);
+
+#endif // EDITOR_H
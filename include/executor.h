@@ -0,0 +1,183 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include "arena.h"
+#include "builtins.h"
+#include "jobs.h"
+#include "launcher.h"
+#include "parser.h"
+#include <sys/types.h>
+
+/**
+ * @brief Exit status reported when a command cannot be found or started.
+ */
+#define STATUS_NOT_FOUND 127
+
+/**
+ * @brief Lowest descriptor used to keep the shell's own descriptors while a builtin is redirected.
+ */
+#define SAVED_FD_MIN 10
+
+/**
+ * @brief A shell descriptor replaced by an in-process redirection.
+ */
+typedef struct
+{
+    int fd;    /**< The redirected descriptor. */
+    int saved; /**< Close-on-exec copy of its previous file, or -1 if it was closed. */
+} saved_fd;
+
+/**
+ * @brief Runs a parsed command line.
+ *
+ * @param a The arena holding the line; temporary data (argument vectors) is allocated from it too.
+ * @param n The root of the AST.
+ * @return int The exit status of the last command that ran.
+ */
+int execute_node(arena* a, const node* n);
+
+/**
+ * @brief Finds the source text a node was parsed from, for job listings and reports.
+ *
+ * @param n The node.
+ * @param start Widened to the first character of the node; must start out NULL.
+ * @param end Widened to one past the last character; must start out NULL.
+ */
+void node_span(const node* n, const char** start, const char** end);
+
+/**
+ * @brief Records launched processes as a job, announcing it if it runs in the background.
+ *
+ * SIGCHLD must be blocked (jobs_block_sigchld()) from before the processes
+ * were launched, so none of them can be reaped before it is recorded.
+ *
+ * @param n The command the processes run, whose source text names the job.
+ * @param pids The processes, in pipeline order.
+ * @param num_pids The number of processes (at least one).
+ * @param background Non-zero for a background job.
+ * @return job* The new job.
+ */
+job* register_job(const node* n, const pid_t* pids, size_t num_pids, int background);
+
+/**
+ * @brief Records launched processes as a job, then announces it or waits for it.
+ *
+ * SIGCHLD must be blocked (jobs_block_sigchld()) from before the processes
+ * were launched, so none of them can be reaped before it is recorded.
+ *
+ * @param n The command the processes run, whose source text names the job.
+ * @param pids The processes, in pipeline order.
+ * @param num_pids The number of processes (at least one).
+ * @param background Non-zero to leave the job running in the background.
+ * @return int 0 for a background job, otherwise the exit status of the last process.
+ */
+int track_job(const node* n, const pid_t* pids, size_t num_pids, int background);
+
+/**
+ * @brief Runs a builtin in a forked copy of the shell, without exec.
+ *
+ * The child applies the dup2 actions of `spec`, joins `spec->pgid` and closes
+ * `close_fds` (close-on-exec does not apply since nothing is exec'd).
+ *
+ * @param cmd The builtin to run.
+ * @param argv The NULL terminated argument vector.
+ * @param spec The file actions and process group.
+ * @param close_fds Descriptors the child must not keep open.
+ * @param num_close The number of entries in `close_fds`.
+ * @return pid_t The child's PID, or -1 on error.
+ */
+pid_t fork_builtin(const builtin* cmd, char** argv, const launch_spec* spec, const int* close_fds, int num_close);
+
+/**
+ * @brief Runs any command in a forked copy of the shell, like fork_builtin().
+ *
+ * @param a The arena holding `n`.
+ * @param n The command to run.
+ * @param spec The file actions and process group (its argv is unused).
+ * @param close_fds Descriptors the child must not keep open.
+ * @param num_close The number of entries in `close_fds`.
+ * @return pid_t The child's PID, or -1 on error.
+ */
+pid_t fork_subshell(arena* a, const node* n, const launch_spec* spec, const int* close_fds, int num_close);
+
+/**
+ * @brief Runs a builtin in the shell process with the command's `NAME=value` prefixes exported meanwhile.
+ *
+ * @param a The arena to allocate from.
+ * @param cmd The builtin to run.
+ * @param command The NODE_SIMPLE node it comes from.
+ * @param argv The argument vector built from `command`.
+ * @return int The builtin's exit status.
+ */
+int run_builtin(arena* a, const builtin* cmd, const node* command, char** argv);
+
+/**
+ * @brief Builds the NULL terminated argument vector of a simple command.
+ *
+ * Words are split into fields by expand_fields(), so the vector may be empty
+ * (argv[0] NULL) when every word expanded to nothing. The words of a `[[`
+ * command are not split, so each stays one argument, and the right side of
+ * `=`, `==` and `!=` keeps its quoting as an expand_pattern_arena() pattern.
+ *
+ * @param a The arena to allocate from.
+ * @param command A NODE_SIMPLE node with at least one word.
+ * @return char** The argument vector, or NULL if an expansion failed (the command must not run).
+ */
+char** build_argv(arena* a, const node* command);
+
+/**
+ * @brief Builds the environment of a simple command with its `NAME=value` prefixes applied.
+ *
+ * @param a The arena to allocate from.
+ * @param command A NODE_SIMPLE node.
+ * @return char** The environment, or NULL if the command has no assignments.
+ */
+char** build_envp(arena* a, const node* command);
+
+/**
+ * @brief Opens the redirection targets of a simple command and adds the matching dup2 actions.
+ *
+ * Relative targets are resolved against `PROJECT_ROOT`. Descriptors are opened
+ * close-on-exec and stored in `opened`, which must hold `num_redirections`
+ * entries; the caller closes them once the child is started.
+ *
+ * @param a The arena to allocate from.
+ * @param command A NODE_SIMPLE node.
+ * @param spec The launch specification receiving the actions.
+ * @param opened Receives the opened descriptors.
+ * @return int The number of descriptors opened, or -1 on error (nothing is left open).
+ */
+int open_redirections(arena* a, const node* command, launch_spec* spec, int* opened);
+
+/**
+ * @brief Applies redirections to the shell's own descriptors.
+ *
+ * Used to run builtins, functions and compound commands without forking. Each
+ * redirected descriptor is first saved above SAVED_FD_MIN; on error everything
+ * done so far is undone.
+ *
+ * @param a The arena to allocate from.
+ * @param redirections The redirections of a simple or compound command.
+ * @param num_redirections The number of redirections.
+ * @param saved Receives the saved descriptors; must hold `num_redirections` entries.
+ * @return int The number of entries stored in `saved`, or -1 on error (nothing is left redirected).
+ */
+int redirect_shell_fds(arena* a, const redirection* redirections, size_t num_redirections, saved_fd* saved);
+
+/**
+ * @brief Puts back the descriptors saved by redirect_shell_fds(), in reverse order.
+ *
+ * @param saved The saved descriptors.
+ * @param count The number of entries.
+ */
+void restore_shell_fds(const saved_fd* saved, int count);
+
+/**
+ * @brief Closes descriptors returned by open_redirections().
+ *
+ * @param opened The descriptors.
+ * @param count The number of descriptors.
+ */
+void close_redirections(const int* opened, int count);
+
+#endif // EXECUTOR_H
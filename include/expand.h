@@ -0,0 +1,244 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "arena.h"
+#include "parser.h"
+#include <stddef.h>
+
+/**
+ * @brief Bytes allocated the first time an expansion buffer grows.
+ */
+#define EXPAND_INITIAL_CAPACITY 256
+
+/**
+ * @brief A growable output buffer that expansions are appended to.
+ *
+ * Zero-initialized, it is empty and owns no memory. Running out of memory is
+ * fatal, as it is for arenas, so appending never fails.
+ */
+typedef struct
+{
+    char* data;      /**< The text, NUL terminated once anything was appended. */
+    size_t len;      /**< Length of the text. */
+    size_t capacity; /**< Bytes allocated for `data`. */
+} expand_buffer;
+
+/**
+ * @brief Positional parameters replaced by expand_push_positional(), to be put back.
+ */
+typedef struct
+{
+    char** args; /**< The parameters. */
+    int count;   /**< Their number. */
+} expand_positional;
+
+/**
+ * @brief Makes room for `len` more bytes and a NUL after the text of a buffer, without changing the text.
+ *
+ * The caller may then write up to `capacity - len - 1` bytes at `data + len` and add them to `len`.
+ *
+ * @param b The buffer.
+ * @param len The number of bytes to make room for.
+ */
+void expand_buffer_reserve(expand_buffer* b, size_t len);
+
+/**
+ * @brief Appends `len` bytes of `text` to a buffer.
+ *
+ * @param b The buffer.
+ * @param text The text to append.
+ * @param len Its length.
+ */
+void expand_buffer_append(expand_buffer* b, const char* text, size_t len);
+
+/**
+ * @brief Releases the memory of a buffer and empties it.
+ *
+ * @param b The buffer.
+ */
+void expand_buffer_free(expand_buffer* b);
+
+/**
+ * @brief Expands a shell word and removes its quotes, appending the result to a buffer.
+ *
+ * `$NAME`, `${NAME}`, `${NAME:-default}`, `$?`, `$$`, `$#`, `$0` to `$9`,
+ * `${10}`..., `$@` and `$*` are expanded outside single quotes; the default
+ * of `${NAME:-default}` is itself expanded, and only used when NAME is unset
+ * or empty. `$@` and `$*` join the positional parameters with spaces.
+ * Variables are looked up among the shell's own first, then in the
+ * environment. Unset variables expand to nothing. `$(( expression ))`
+ * expands to the value of the expression (see arith_evaluate()), and
+ * `$(command)` to the output of the command without its trailing newlines
+ * (see substitute_command()).
+ *
+ * @param out The buffer to append to.
+ * @param start The first character of the word.
+ * @param len The length of the word.
+ */
+void expand_word(expand_buffer* out, const char* start, size_t len);
+
+/**
+ * @brief Expands a shell word into a NUL terminated string allocated from an arena.
+ *
+ * @param a The arena.
+ * @param start The first character of the word.
+ * @param len The length of the word.
+ * @return char* The expanded word.
+ */
+char* expand_word_arena(arena* a, const char* start, size_t len);
+
+/**
+ * @brief Expands a shell word into an fnmatch(3) pattern allocated from an arena.
+ *
+ * Like expand_word_arena(), except that the pattern characters of quoted
+ * parts are escaped with a backslash, so that they match literally.
+ *
+ * @param a The arena.
+ * @param start The first character of the word.
+ * @param len The length of the word.
+ * @return char* The pattern.
+ */
+char* expand_pattern_arena(arena* a, const char* start, size_t len);
+
+/**
+ * @brief Expands the words of a command into fields, its argument vector.
+ *
+ * Unlike expand_word(), the results of unquoted expansions are split at
+ * blanks, an unquoted expansion to nothing is no field at all, and `"$@"`
+ * gives one field per positional parameter.
+ *
+ * @param a The arena to allocate the fields from.
+ * @param words The words.
+ * @param num_words The number of words.
+ * @param num_fields Receives the number of fields.
+ * @return char** The NULL terminated fields.
+ */
+char** expand_fields(arena* a, const word* words, size_t num_words, size_t* num_fields);
+
+/**
+ * @brief Expands the text of a here-document, appending it to a buffer.
+ *
+ * Quotes are kept; a backslash only escapes `$`, `` ` ``, `\` and a newline.
+ *
+ * @param out The buffer to append to.
+ * @param start The first character of the text.
+ * @param len The length of the text.
+ */
+void expand_heredoc(expand_buffer* out, const char* start, size_t len);
+
+/**
+ * @brief Looks up the value of a variable, the shell's own variables first.
+ *
+ * @param name The name, not necessarily NUL terminated.
+ * @param len The length of the name.
+ * @param value_len Receives the length of the value.
+ * @return const char* The value (valid until the variable changes), or NULL if it is not set.
+ */
+const char* expand_lookup(const char* name, size_t len, size_t* value_len);
+
+/**
+ * @brief Sets a variable from an assignment (`NAME=value`).
+ *
+ * A variable declared with `local` keeps its value in the shell; any other
+ * goes to the environment, so commands started later see it.
+ *
+ * @param name The NUL terminated name.
+ * @param value The NUL terminated value.
+ * @return int 0 on success, -1 on error.
+ */
+int expand_assign(const char* name, const char* value);
+
+/**
+ * @brief Sets a variable in the shell, or in the environment if it is already exported there.
+ *
+ * Used for loop variables, which commands do not need to see.
+ *
+ * @param name The NUL terminated name.
+ * @param value The NUL terminated value.
+ * @return int 0 on success, -1 on error.
+ */
+int expand_set(const char* name, const char* value);
+
+/**
+ * @brief Checks whether a variable is one of the shell's own, not exported.
+ *
+ * @param name The NUL terminated name.
+ * @return int 1 if it is, 0 otherwise.
+ */
+int expand_is_local(const char* name);
+
+/**
+ * @brief Records the exit status `$?` expands to.
+ *
+ * @param status The status of the command that just finished.
+ */
+void expand_set_status(int status);
+
+/**
+ * @brief Returns the exit status recorded by expand_set_status().
+ *
+ * @return int The status `$?` expands to.
+ */
+int expand_status(void);
+
+/**
+ * @brief Returns the exit status of the last `$(...)` expanded since the previous call, and forgets it.
+ *
+ * A command made only of assignments exits with that status.
+ *
+ * @return int The status, or -1 if no command substitution was expanded.
+ */
+int expand_take_substitution_status(void);
+
+/**
+ * @brief Tells whether an expansion failed since the last call, such as `$((1/0))`, and forgets it.
+ *
+ * The error was reported on stderr; the command the word belongs to must not run.
+ *
+ * @return int 1 if an expansion failed, 0 otherwise.
+ */
+int expand_take_error(void);
+
+/**
+ * @brief Records the process ID `$$` expands to, which subshells inherit.
+ *
+ * Must be called by the shell itself before forking anything.
+ */
+void expand_init(void);
+
+/**
+ * @brief Replaces the positional parameters, for the duration of a function call.
+ *
+ * @param args The new parameters, which must outlive the call.
+ * @param count Their number.
+ * @param previous Receives the parameters to restore with expand_pop_positional().
+ */
+void expand_push_positional(char** args, int count, expand_positional* previous);
+
+/**
+ * @brief Restores the positional parameters replaced by expand_push_positional().
+ *
+ * @param previous The parameters it saved.
+ */
+void expand_pop_positional(const expand_positional* previous);
+
+/**
+ * @brief Enters the variable scope of a function: `local` now saves what it changes.
+ *
+ * @return size_t A mark to pass to expand_pop_scope().
+ */
+size_t expand_push_scope(void);
+
+/**
+ * @brief Leaves a function's variable scope, restoring every variable `local` changed in it.
+ *
+ * @param mark The value expand_push_scope() returned.
+ */
+void expand_pop_scope(size_t mark);
+
+/**
+ * @brief Registers the variable builtins (local, export, unset, shift) in the builtin registry.
+ */
+void expand_register_builtins(void);
+
+#endif // EXPAND_H
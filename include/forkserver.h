@@ -0,0 +1,69 @@
+#ifndef FORKSERVER_H
+#define FORKSERVER_H
+
+#include "launcher.h"
+#include <sys/types.h>
+
+/**
+ * @brief Largest spawn request (path, arguments and environment), in bytes.
+ *
+ * Larger requests are launched directly by the shell instead.
+ */
+#define FORKSERVER_MAX_MESSAGE (64 * 1024)
+
+/**
+ * @brief Largest number of descriptors passed with a request: the three
+ * standard ones, the working directory and one per file action.
+ */
+#define FORKSERVER_MAX_FDS (4 + LAUNCH_MAX_ACTIONS)
+
+/**
+ * @brief Starts the fork server.
+ *
+ * The server is a copy of the process made now, while it is still small, that
+ * creates children on request. Each child is created with CLONE_PARENT, so it
+ * is a child of the shell (which waits for it and receives its SIGCHLD) but is
+ * forked from the server's small address space instead of the shell's. Calling
+ * it again while the server runs does nothing.
+ *
+ * @return int 0 on success, -1 on error.
+ */
+int forkserver_start(void);
+
+/**
+ * @brief Stops the fork server and waits for it to exit.
+ */
+void forkserver_stop(void);
+
+/**
+ * @brief Drops the connection to the fork server without stopping it.
+ *
+ * A forked copy of the shell must call this: the server's children become
+ * children of the server's parent, which is not the copy.
+ */
+void forkserver_detach(void);
+
+/**
+ * @brief Returns whether the fork server is running and usable by this process.
+ *
+ * @return int Non-zero if it is.
+ */
+int forkserver_running(void);
+
+/**
+ * @brief Has the fork server launch `spec`.
+ *
+ * The request carries the path, arguments, environment and process group, and
+ * passes the shell's standard descriptors and those of the `dup2` actions with
+ * SCM_RIGHTS. The server answers once the child has exec'd or failed to, so a
+ * failed exec is reported (and its child reaped) like with posix_spawn.
+ *
+ * @param spec The process to launch.
+ * @param path The resolved executable.
+ * @param error Where to store the error number on failure; EMSGSIZE if the
+ * request is too large and ENOTCONN if the server is gone.
+ * @return pid_t The child's PID, or -1 on error.
+ */
+pid_t forkserver_launch(const launch_spec* spec, const char* path, int* error);
+
+#endif // FORKSERVER_H
@@ -0,0 +1,33 @@
+#ifndef HEREDOC_H
+#define HEREDOC_H
+
+#include "parser.h"
+#include <limits.h>
+
+/**
+ * @brief Largest here-document written to a pipe; larger ones go to a memfd.
+ *
+ * A pipe holds at least PIPE_BUF bytes, so the shell can fill it before the
+ * command starts reading without ever blocking.
+ */
+#define HEREDOC_PIPE_MAX PIPE_BUF
+
+/**
+ * @brief Name of the memfds holding here-documents, as shown in /proc/PID/fd.
+ */
+#define HEREDOC_MEMFD_NAME "myshell-heredoc"
+
+/**
+ * @brief Returns a descriptor to read the text of a here-document or here-string from.
+ *
+ * The text is expanded by expand_heredoc() when the here-document's
+ * delimiter was not quoted; a here-string is expanded like any other word.
+ * Small texts go through a pipe; larger ones are written into a memfd that is
+ * then sealed, so nothing touches the file system.
+ *
+ * @param r A REDIR_HEREDOC or REDIR_HERESTRING redirection.
+ * @return int A close-on-exec descriptor positioned at the start of the text, or -1 on error.
+ */
+int heredoc_open(const redirection* r);
+
+#endif // HEREDOC_H
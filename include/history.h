@@ -0,0 +1,121 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Environment variable naming the history file.
+ */
+#define HISTORY_ENV "MYSHELL_HISTORY"
+
+/**
+ * @brief History file under `$HOME` when HISTORY_ENV is not set.
+ */
+#define HISTORY_DEFAULT_FILE ".myshell_history"
+
+/**
+ * @brief Magic number at the start of the history file.
+ */
+#define HISTORY_FILE_MAGIC "MYSHIST1"
+
+/**
+ * @brief Magic number at the start of every record, to find the end of a torn file.
+ */
+#define HISTORY_RECORD_MAGIC 0x48495354u
+
+/**
+ * @brief Entries `history` lists when no count is given.
+ */
+#define HISTORY_DEFAULT_LIST 20
+
+/**
+ * @brief A command line from the history.
+ */
+typedef struct
+{
+    const char* text;     /**< The command, not NUL terminated. */
+    uint32_t len;         /**< Length of `text`. */
+    int32_t status;       /**< Its exit status. */
+    uint32_t duration_ms; /**< How long it ran, in milliseconds. */
+    int64_t started;      /**< When it started, in seconds since the epoch. */
+} history_entry;
+
+/**
+ * @brief Loads a history file and appends to it from now on.
+ *
+ * The file is a header followed by append-only records. It is memory-mapped,
+ * so loading a large history copies nothing: entries point into the mapping.
+ * A torn record at the end (a crash during a write) is cut off. Any history
+ * already open is closed first.
+ *
+ * @param path The file, created if missing, or NULL to keep the history in memory only.
+ * @return int 0 on success, -1 on error (the history then stays in memory only).
+ */
+int history_open(const char* path);
+
+/**
+ * @brief Returns the history file of the interactive shell: HISTORY_ENV, else `$HOME/.myshell_history`.
+ *
+ * @param buffer Where to build the path.
+ * @param size The size of `buffer`.
+ * @return const char* The path, or NULL if neither variable is set.
+ */
+const char* history_default_path(char* buffer, size_t size);
+
+/**
+ * @brief Appends a command to the history and to its file with a single write.
+ *
+ * @param text The command, without its newline.
+ * @param len The length of `text`.
+ * @param status Its exit status.
+ * @param duration_ms How long it ran.
+ * @param started When it started, in seconds since the epoch.
+ * @return int 0 on success, -1 on error.
+ */
+int history_add(const char* text, size_t len, int status, uint32_t duration_ms, int64_t started);
+
+/**
+ * @brief Returns the number of entries, oldest first.
+ *
+ * @return size_t The number of entries.
+ */
+size_t history_count(void);
+
+/**
+ * @brief Returns an entry.
+ *
+ * @param index The entry, 0 being the oldest.
+ * @return const history_entry* The entry, or NULL if `index` is out of range.
+ */
+const history_entry* history_get(size_t index);
+
+/**
+ * @brief Finds the newest entry before `before` that contains `query`.
+ *
+ * Queries of three bytes or more go through a trigram index: only the entries
+ * holding the query's rarest trigram are checked. The index is built on the
+ * first search and kept up to date as entries are added.
+ *
+ * @param query The text to look for.
+ * @param len The length of `query`.
+ * @param before Search entries older than this one (history_count() for all).
+ * @return long The index of the entry, or -1 if none matches.
+ */
+long history_search(const char* query, size_t len, size_t before);
+
+/**
+ * @brief Releases the history and its mapping.
+ */
+void history_close(void);
+
+/**
+ * @brief Registers `history` in the builtin registry.
+ *
+ * `history [-n count] [-s ms]` lists the last entries (HISTORY_DEFAULT_LIST by
+ * default) with their exit status and duration; `-s` keeps only those that
+ * ran for at least `ms` milliseconds.
+ */
+void history_register_builtins(void);
+
+#endif // HISTORY_H
@@ -0,0 +1,235 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <signal.h>
+#include <stddef.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * @brief Offset added to a signal number to form an exit status.
+ */
+#define SIGNAL_STATUS_BASE 128
+
+/**
+ * @brief State of a job or of one of its processes.
+ */
+typedef enum
+{
+    JOB_RUNNING, /**< At least one process is running. */
+    JOB_STOPPED, /**< Every live process is stopped. */
+    JOB_DONE,    /**< Every process has exited or been killed. */
+} job_state;
+
+/**
+ * @brief A process belonging to a job.
+ */
+typedef struct
+{
+    pid_t pid;             /**< Process ID. */
+    job_state state;       /**< Last state reported by the kernel. */
+    int status;            /**< Exit status (128 + signal number if killed), valid once JOB_DONE. */
+    struct rusage usage;   /**< Resources used by the process, valid once JOB_DONE. */
+    struct timespec ended; /**< CLOCK_MONOTONIC time the process was reaped, valid once JOB_DONE. */
+} job_process;
+
+/**
+ * @brief A pipeline or command started by the shell.
+ */
+typedef struct job
+{
+    int id;                   /**< Job number shown as `[id]`. */
+    pid_t pgid;               /**< Process group, or 0 if the job runs in the shell's group. */
+    job_state state;          /**< Aggregated state of the processes. */
+    int status;               /**< Exit status of the last process, valid once JOB_DONE. */
+    int foreground;           /**< Non-zero while the shell waits for the job. */
+    int notified;             /**< Non-zero once the current state has been reported. */
+    struct timespec started;  /**< CLOCK_MONOTONIC time the job was created. */
+    struct timespec ended;    /**< CLOCK_MONOTONIC time the last process was reaped. */
+    struct rusage usage;      /**< Resources used by the processes reaped so far. */
+    char* command;            /**< Command text, for `jobs` and notices. */
+    job_process* procs;       /**< Processes, in pipeline order. */
+    size_t num_procs;         /**< Number of entries in `procs`. */
+    size_t capacity;          /**< Allocated entries in `procs`. */
+    struct job* next_changed; /**< Next job whose state changed since the last notice. */
+    int queued;               /**< Non-zero while the job is on the changed list. */
+} job;
+
+/**
+ * @brief Sets up job control: every job gets its own process group.
+ *
+ * When the shell owns its controlling terminal, foreground jobs are given the
+ * terminal while they run. An interactive shell also moves into its own
+ * process group and waits until it is in the foreground.
+ *
+ * @param interactive Non-zero for the interactive shell.
+ */
+void job_control_init(int interactive);
+
+/**
+ * @brief Blocks SIGCHLD, so the table can be changed without racing the handler.
+ *
+ * Must be held from launching a process until job_add_process() has recorded
+ * it, or its exit status could be reaped before anyone knows it belongs to a job.
+ *
+ * @param old Receives the previous signal mask.
+ */
+void jobs_block_sigchld(sigset_t* old);
+
+/**
+ * @brief Restores the mask saved by jobs_block_sigchld().
+ *
+ * @param old The mask to restore.
+ */
+void jobs_restore_sigmask(const sigset_t* old);
+
+/**
+ * @brief Creates a job with the next free number. SIGCHLD must be blocked.
+ *
+ * @param command The command text (need not be NUL terminated).
+ * @param len The length of the command text.
+ * @param foreground Non-zero if the shell is going to wait for the job.
+ * @return job* The new job.
+ */
+job* job_create(const char* command, size_t len, int foreground);
+
+/**
+ * @brief Records a launched process in a job. SIGCHLD must be blocked.
+ *
+ * @param j The job.
+ * @param pid The process ID.
+ * @param pgid The process group the process was placed in (the job's), 0 for the shell's.
+ */
+void job_add_process(job* j, pid_t pid, pid_t pgid);
+
+/**
+ * @brief Records a stage of a job that ran in the shell itself and already finished, so that its status
+ * takes its place in `PIPESTATUS`. SIGCHLD must be blocked.
+ *
+ * @param j The job.
+ * @param status The stage's exit status.
+ */
+void job_add_finished(job* j, int status);
+
+/**
+ * @brief Removes a job and frees it. SIGCHLD must be blocked.
+ *
+ * @param j The job.
+ */
+void job_remove(job* j);
+
+/**
+ * @brief Looks up the job a process belongs to in constant time.
+ *
+ * @param pid A process ID (a process group leader finds its job too).
+ * @return job* The job, or NULL if the process is unknown.
+ */
+job* job_find_by_pid(pid_t pid);
+
+/**
+ * @brief Looks up a job by number.
+ *
+ * @param id The job number.
+ * @return job* The job, or NULL if there is none.
+ */
+job* job_find_by_id(int id);
+
+/**
+ * @brief Resolves a job specification: `%n`, `%%`, `%+`, `%-` or a PID.
+ *
+ * @param spec The specification, or NULL for the current job.
+ * @return job* The job, or NULL (an error is printed).
+ */
+job* job_from_spec(const char* spec);
+
+/**
+ * @brief Returns the job in the foreground, if any.
+ *
+ * @return job* The job the shell is waiting for, or NULL.
+ */
+job* job_foreground(void);
+
+/**
+ * @brief Prints `[id] pid` for a job just started in the background.
+ *
+ * @param j The job.
+ */
+void job_announce(const job* j);
+
+/**
+ * @brief Waits in the foreground until a job finishes or stops. SIGCHLD must be blocked.
+ *
+ * Only the job's own processes are collected, through pidfds on an epoll set
+ * (or waitpid() per process on kernels without pidfd_open). The job's process
+ * group owns the terminal meanwhile. A finished job is removed after its
+ * per-process statuses are saved for jobs_last_pipestatus() and `PIPESTATUS`;
+ * a stopped one stays in the table for `fg` and `bg`.
+ *
+ * @param j The job.
+ * @return int The job's exit status, or 128 + signal number if it was stopped.
+ */
+int job_wait(job* j);
+
+/**
+ * @brief Returns the processes of the last foreground job that finished.
+ *
+ * @param count Receives the number of processes.
+ * @return const job_process* The processes in pipeline order, with statuses and rusage.
+ */
+const job_process* jobs_last_pipestatus(size_t* count);
+
+/**
+ * @brief Returns how many foreground jobs have finished, to tell whether jobs_last_pipestatus() changed.
+ *
+ * @return unsigned long The number of foreground jobs that finished since the shell started.
+ */
+unsigned long jobs_finished_count(void);
+
+/**
+ * @brief Sends a signal to every process of a job.
+ *
+ * @param j The job.
+ * @param sig The signal.
+ * @return int 0 on success, -1 on error.
+ */
+int job_signal(const job* j, int sig);
+
+/**
+ * @brief Reaps children and updates their jobs; safe to call from the SIGCHLD handler.
+ *
+ * @param block Non-zero to wait for at least one state change.
+ * @return int The number of state changes collected, or -1 if there are no children.
+ */
+int jobs_reap(int block);
+
+/**
+ * @brief Reports finished and newly stopped background jobs and drops the finished ones.
+ *
+ * Called before the prompt is printed. In batch mode, `verbose` is zero and
+ * finished jobs are dropped silently.
+ *
+ * @param verbose Non-zero to print a notice for every change.
+ */
+void jobs_notify(int verbose);
+
+/**
+ * @brief Forgets every job without touching the processes (used by forked subshells).
+ *
+ * The subshell also gives up the terminal and the parent's wait descriptors.
+ */
+void jobs_forget_all(void);
+
+/**
+ * @brief Returns the number of jobs in the table.
+ *
+ * @return size_t The number of jobs.
+ */
+size_t jobs_count(void);
+
+/**
+ * @brief Registers `jobs`, `fg`, `bg`, `wait`, `kill` and `pipestatus` in the builtin registry.
+ */
+void jobs_register_builtins(void);
+
+#endif // JOBS_H
@@ -0,0 +1,171 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <sys/types.h>
+
+/**
+ * @brief Maximum number of file actions a single launch can carry.
+ *
+ * Pipe and redirection descriptors are created with `O_CLOEXEC`, so a stage only
+ * needs a handful of `dup2` actions onto the standard descriptors.
+ */
+#define LAUNCH_MAX_ACTIONS 8
+
+/**
+ * @brief Keep the child in the shell's process group.
+ */
+#define LAUNCH_PGID_INHERIT (-1)
+
+/**
+ * @brief Highest CPU number plus one a launch policy can pin to, the size of the kernel's `cpu_set_t`.
+ */
+#define LAUNCH_MAX_CPUS 1024
+
+/**
+ * @brief Bits in one word of launch_policy::cpus.
+ */
+#define LAUNCH_CPU_WORD_BITS (8 * (int)sizeof(unsigned long))
+
+/**
+ * @brief The launch policy restricts the CPUs the child runs on.
+ */
+#define LAUNCH_POLICY_CPUS 0x1
+
+/**
+ * @brief The launch policy lowers (or raises) the child's scheduling priority.
+ */
+#define LAUNCH_POLICY_NICE 0x2
+
+/**
+ * @brief The launch policy sets the child's I/O scheduling class and level.
+ */
+#define LAUNCH_POLICY_IOPRIO 0x4
+
+/**
+ * @brief Scheduling settings applied in a child before it execs; children it starts inherit them.
+ */
+typedef struct
+{
+    unsigned int flags;                                          /**< LAUNCH_POLICY_* bits of the settings used. */
+    unsigned long cpus[LAUNCH_MAX_CPUS / LAUNCH_CPU_WORD_BITS]; /**< CPUs allowed, one bit each. */
+    int nice;                                                    /**< Added to the niceness, as nice(1) does. */
+    int ioprio;                                                  /**< Value given to ioprio_set(2). */
+} launch_policy;
+
+/**
+ * @brief Mechanism used to create child processes.
+ */
+typedef enum
+{
+    LAUNCH_BACKEND_POSIX_SPAWN, /**< posix_spawn(3), clone(CLONE_VM|CLONE_VFORK) inside glibc. */
+    LAUNCH_BACKEND_VFORK,       /**< vfork(2) followed by the file actions and exec. */
+    LAUNCH_BACKEND_FORK,        /**< Plain fork(2), the historical behaviour. */
+    LAUNCH_BACKEND_FORKSERVER,  /**< A small helper forked at startup creates the children (see forkserver.h). */
+} launch_backend;
+
+/**
+ * @brief Kind of file action applied in the child before exec.
+ */
+typedef enum
+{
+    LAUNCH_ACTION_DUP2,
+    LAUNCH_ACTION_CLOSE,
+} launch_action_type;
+
+/**
+ * @brief A single file action, mirroring posix_spawn_file_actions_t entries.
+ */
+typedef struct
+{
+    launch_action_type type; /**< What to do. */
+    int fd;                  /**< Source descriptor (or descriptor to close). */
+    int target_fd;           /**< Destination descriptor for LAUNCH_ACTION_DUP2. */
+} launch_action;
+
+/**
+ * @brief Description of a process to launch.
+ */
+typedef struct
+{
+    char* const* argv;                          /**< NULL terminated argument vector. */
+    char* const* envp;                          /**< Environment of the child, NULL for the shell's own. */
+    launch_action actions[LAUNCH_MAX_ACTIONS];  /**< File actions applied in order. */
+    int num_actions;                            /**< Number of used entries in `actions`. */
+    pid_t pgid;                                 /**< LAUNCH_PGID_INHERIT, 0 for a new group, or a group to join. */
+    const launch_policy* policy;                /**< Scheduling settings for the child, or NULL. */
+} launch_spec;
+
+/**
+ * @brief Initializes a launch specification for `argv`.
+ *
+ * @param spec The specification to initialize.
+ * @param argv The NULL terminated argument vector of the command.
+ */
+void launch_spec_init(launch_spec* spec, char* const* argv);
+
+/**
+ * @brief Appends a `dup2(fd, target_fd)` action to the specification.
+ *
+ * @param spec The specification to modify.
+ * @param fd The source descriptor.
+ * @param target_fd The descriptor it should become in the child.
+ * @return int 0 on success, -1 if the action table is full.
+ */
+int launch_spec_add_dup2(launch_spec* spec, int fd, int target_fd);
+
+/**
+ * @brief Appends a `close(fd)` action to the specification.
+ *
+ * @param spec The specification to modify.
+ * @param fd The descriptor to close in the child.
+ * @return int 0 on success, -1 if the action table is full.
+ */
+int launch_spec_add_close(launch_spec* spec, int fd);
+
+/**
+ * @brief Applies a launch policy to the calling process.
+ *
+ * Only system calls are made, so a vfork child can call it.
+ *
+ * @param policy The settings to apply.
+ * @return int 0 on success, -1 with errno set if a setting was refused.
+ */
+int launch_policy_apply(const launch_policy* policy);
+
+/**
+ * @brief Starts the process described by `spec` without waiting for it.
+ *
+ * A launch with a policy uses vfork(2) under the posix_spawn and fork
+ * server backends, which have no way to run code in the child before exec.
+ *
+ * Errors (including a failed exec) are reported on stderr.
+ *
+ * @param spec The process to launch.
+ * @return pid_t The child's PID, or -1 on error.
+ */
+pid_t launch_command(const launch_spec* spec);
+
+/**
+ * @brief Selects the backend used by subsequent launches.
+ *
+ * @param backend The backend to use.
+ */
+void launch_set_backend(launch_backend backend);
+
+/**
+ * @brief Returns the backend currently in use.
+ *
+ * @return launch_backend The active backend.
+ */
+launch_backend launch_get_backend(void);
+
+/**
+ * @brief Parses a backend name ("posix_spawn", "vfork", "fork" or "forkserver").
+ *
+ * @param name The name to parse.
+ * @param backend Where to store the parsed backend.
+ * @return int 0 on success, -1 if the name is unknown.
+ */
+int launch_backend_from_name(const char* name, launch_backend* backend);
+
+#endif // LAUNCHER_H
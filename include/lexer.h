@@ -0,0 +1,126 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "arena.h"
+#include <stddef.h>
+
+/**
+ * @brief Kinds of tokens produced by the lexer.
+ */
+typedef enum
+{
+    TOKEN_WORD,      /**< A word, possibly containing quotes and escapes. */
+    TOKEN_PIPE,      /**< `|` */
+    TOKEN_AND_IF,    /**< `&&` */
+    TOKEN_OR_IF,     /**< `||` */
+    TOKEN_SEMI,      /**< `;` */
+    TOKEN_DSEMI,     /**< `;;`, ending a `case` item */
+    TOKEN_AMP,       /**< `&` */
+    TOKEN_LESS,      /**< `<` */
+    TOKEN_GREAT,     /**< `>` */
+    TOKEN_DGREAT,    /**< `>>` */
+    TOKEN_DLESS,     /**< `<<` */
+    TOKEN_DLESSDASH, /**< `<<-` */
+    TOKEN_TLESS,     /**< `<<<` */
+    TOKEN_LPAREN,    /**< `(` */
+    TOKEN_RPAREN,    /**< `)` */
+    TOKEN_NEWLINE,   /**< End of a line inside multi-line input. */
+    TOKEN_EOF,       /**< End of input. */
+    TOKEN_ERROR,     /**< Unterminated quote or escape. */
+} token_type;
+
+/**
+ * @brief Value of `io_number` when the operator had no explicit descriptor.
+ */
+#define TOKEN_NO_IO_NUMBER (-1)
+
+/**
+ * @brief A token: a slice of the input, nothing is copied.
+ */
+typedef struct
+{
+    token_type type;   /**< Kind of token. */
+    const char* start; /**< First character of the token in the input. */
+    size_t len;        /**< Length of the token. */
+    int io_number;     /**< Descriptor written before a redirection operator (`2>`), or TOKEN_NO_IO_NUMBER. */
+} token;
+
+/**
+ * @brief Lexer state: a cursor over the input.
+ */
+typedef struct
+{
+    const char* pos; /**< Next character to read. */
+    const char* end; /**< One past the last character. */
+} lexer;
+
+/**
+ * @brief Initializes a lexer over `len` bytes of `text`.
+ *
+ * @param lex The lexer to initialize.
+ * @param text The input (need not be NUL terminated).
+ * @param len The length of the input.
+ */
+void lexer_init(lexer* lex, const char* text, size_t len);
+
+/**
+ * @brief Returns the next token of the input.
+ *
+ * Blanks and `#` comments are skipped. A TOKEN_ERROR token means the input
+ * ended inside a quote or after a backslash, so more input could complete it.
+ *
+ * @param lex The lexer.
+ * @return token The next token.
+ */
+token lexer_next(lexer* lex);
+
+/**
+ * @brief Reads the body of a here-document, which starts at the lexer position.
+ *
+ * The body runs up to a line holding only `delimiter`, which is consumed too.
+ * With `strip_tabs` (`<<-`) the delimiter line may start with tabs.
+ *
+ * @param lex The lexer, positioned after the newline that ends the here-document's command.
+ * @param delimiter The delimiter, quotes removed.
+ * @param delimiter_len The length of `delimiter`.
+ * @param strip_tabs Non-zero to allow tabs before the delimiter.
+ * @param body Receives the first character of the body.
+ * @param body_len Receives the length of the body, up to and including its last newline.
+ * @return int 0 on success, -1 if the input ends before the delimiter line.
+ */
+int lexer_heredoc(lexer* lex, const char* delimiter, size_t delimiter_len, int strip_tabs, const char** body,
+                  size_t* body_len);
+
+/**
+ * @brief Finds the `}` that closes a `${` parameter expansion.
+ *
+ * Nested `${...}`, quotes and backslash escapes inside the braces are skipped.
+ *
+ * @param p The first character after the `${`.
+ * @param end One past the last character of the input.
+ * @return const char* The closing brace, or NULL if the input ends first.
+ */
+const char* lexer_parameter_end(const char* p, const char* end);
+
+/**
+ * @brief Finds the `)` that closes a `$(`, such as the outer one of `$(( ))`.
+ *
+ * Nested parentheses, quotes and backslash escapes are skipped.
+ *
+ * @param p The first character after the `$(`.
+ * @param end One past the last character of the input.
+ * @return const char* The closing parenthesis, or NULL if the input ends first.
+ */
+const char* lexer_substitution_end(const char* p, const char* end);
+
+/**
+ * @brief Removes quotes and backslash escapes from a word.
+ *
+ * @param a The arena to allocate the result from.
+ * @param start The first character of the word.
+ * @param len The length of the word.
+ * @return char* The NUL terminated unquoted word.
+ */
+char* lexer_unquote(arena* a, const char* start, size_t len);
+
+#endif // LEXER_H
@@ -1,6 +1,8 @@
 #ifndef MONITOR_H
 #define MONITOR_H
 
+#include <sys/types.h>
+
 /**
  * @brief Start the monitor process.
  */
@@ -26,4 +28,17 @@ void status_monitor();
  */
 void config_monitor();
 
+/**
+ * @brief Returns the PID of the monitor if it is running, without printing anything.
+ *
+ * @param project_root The directory holding `monitor.pid`.
+ * @return pid_t The monitor's PID, or 0 if it is not running.
+ */
+pid_t monitor_running_pid(const char* project_root);
+
+/**
+ * @brief Register the monitor commands in the builtin registry.
+ */
+void monitor_register_builtins(void);
+
 #endif // MONITOR_H
@@ -0,0 +1,118 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "arena.h"
+#include "jobs.h"
+#include "parser.h"
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * @brief Exit status of a `parallel` task killed by its timeout, as with timeout(1).
+ */
+#define PARALLEL_TIMEOUT_STATUS 124
+
+/**
+ * @brief Largest exit status of `parallel`, which otherwise counts the failed tasks.
+ */
+#define PARALLEL_MAX_FAILURES 101
+
+/**
+ * @brief Milliseconds a timed out task gets between SIGTERM and SIGKILL.
+ */
+#define PARALLEL_KILL_GRACE_MS 1000
+
+/**
+ * @brief One command run by a parallel_run.
+ */
+typedef struct
+{
+    job* j;                   /**< The task's job, NULL once collected. */
+    int out_fd;               /**< Captured standard output (a memfd), -1 once written. */
+    int err_fd;               /**< Captured standard error (a memfd), -1 once written. */
+    int status;               /**< Exit status, valid once `j` is NULL. */
+    int written;              /**< Non-zero once the output has been written. */
+    int signals_sent;         /**< 0, or 1 after SIGTERM and 2 after SIGKILL on timeout. */
+    struct timespec deadline; /**< When the next timeout signal is due, if a timeout is set. */
+} parallel_task;
+
+/**
+ * @brief Commands running concurrently, at most `max_running` at a time.
+ *
+ * Each task's standard output and error are captured and written in one piece
+ * when it finishes, so lines never interleave. `tasks` only holds the window of
+ * tasks whose output has not been written yet, so memory does not grow with
+ * the number of commands.
+ */
+typedef struct
+{
+    long max_running;     /**< Largest number of tasks running at once. */
+    int keep_order;       /**< Non-zero to write outputs in the order the tasks were started. */
+    long timeout_ms;      /**< Per-task time limit, 0 for none. */
+    parallel_task* tasks; /**< Tasks not yet written, oldest first. */
+    size_t first;         /**< First live entry of `tasks`. */
+    size_t count;         /**< One past the last live entry of `tasks`. */
+    size_t capacity;      /**< Allocated entries in `tasks`. */
+    long running;         /**< Tasks started but not collected. */
+    int failures;         /**< Tasks that failed to start or exited with a non-zero status. */
+    int interrupted;      /**< Non-zero once SIGINT was received while waiting. */
+    int devnull;          /**< `/dev/null`, the standard input of every task. */
+} parallel_run;
+
+/**
+ * @brief Prepares a run.
+ *
+ * @param run The run to initialize.
+ * @param max_running The largest number of concurrent tasks, or 0 for one per CPU the shell may use.
+ * @param keep_order Non-zero to write outputs in start order.
+ * @param timeout_ms Per-task time limit in milliseconds, 0 for none.
+ * @return int 0 on success, -1 on error.
+ */
+int parallel_init(parallel_run* run, long max_running, int keep_order, long timeout_ms);
+
+/**
+ * @brief Starts a command as a task, first waiting for a free slot.
+ *
+ * Plain external commands go through the launcher; builtins, pipelines and
+ * lists run in a forked copy of the shell. Outputs of tasks that finished
+ * meanwhile are written.
+ *
+ * @param run The run.
+ * @param a The arena holding `n`; it may be reset once this returns.
+ * @param n The parsed command.
+ * @param command The command text, naming the task's job.
+ * @param len The length of `command`.
+ * @return int 0 if the task was started, -1 if it could not be or the run was interrupted.
+ */
+int parallel_start(parallel_run* run, arena* a, const node* n, const char* command, size_t len);
+
+/**
+ * @brief Waits for every task and writes their outputs (a barrier).
+ *
+ * @param run The run.
+ * @return int 0, or -1 if the run was interrupted.
+ */
+int parallel_wait(parallel_run* run);
+
+/**
+ * @brief Waits for every task and releases the run.
+ *
+ * @param run The run.
+ * @return int The number of failed tasks (at most PARALLEL_MAX_FAILURES), or 128 + SIGINT if interrupted.
+ */
+int parallel_finish(parallel_run* run);
+
+/**
+ * @brief Registers `parallel` in the builtin registry.
+ *
+ * `parallel [-j N] [-k] [-t seconds] 'command {}' [::: item...]` runs the
+ * command once per item (one line of standard input each when there is no
+ * `:::`), with `{}` replaced by the quoted item, or the item appended when the
+ * command has no `{}`. At most N tasks run at once, by default one per CPU
+ * the shell may run on. Each task's output is captured and written in one
+ * piece when it finishes, in input order with `-k`. The exit status is the
+ * number of failed tasks, at most PARALLEL_MAX_FAILURES.
+ */
+void parallel_register_builtins(void);
+
+#endif // PARALLEL_H
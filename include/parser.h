@@ -0,0 +1,181 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "arena.h"
+#include <stddef.h>
+
+/**
+ * @brief A word of the command line, as a slice of the input (quotes included).
+ */
+typedef struct
+{
+    const char* start; /**< First character of the word. */
+    size_t len;        /**< Length of the word. */
+} word;
+
+/**
+ * @brief Kinds of redirections.
+ */
+typedef enum
+{
+    REDIR_INPUT,      /**< `[n]<file` */
+    REDIR_OUTPUT,     /**< `[n]>file` */
+    REDIR_APPEND,     /**< `[n]>>file` */
+    REDIR_HEREDOC,    /**< `[n]<<delimiter` or `[n]<<-delimiter`, with the body on the following lines */
+    REDIR_HERESTRING, /**< `[n]<<<word` */
+} redirection_type;
+
+/**
+ * @brief A redirection attached to a command.
+ */
+typedef struct
+{
+    redirection_type type; /**< Kind of redirection. */
+    int fd;                /**< Descriptor being redirected. */
+    word target;           /**< File name, here-string or here-document delimiter. */
+    word body;             /**< Here-document text, delimiter line excluded (REDIR_HEREDOC only). */
+    int expand;            /**< Non-zero if `$VAR` is expanded in the body: the delimiter was not quoted. */
+    int strip_tabs;        /**< Non-zero for `<<-`: leading tabs are removed from every line of the body. */
+} redirection;
+
+/**
+ * @brief Kinds of AST nodes.
+ */
+typedef enum
+{
+    NODE_SIMPLE,   /**< A command with its arguments, assignments and redirections. */
+    NODE_PIPELINE, /**< Commands connected with `|`. */
+    NODE_AND,      /**< `left && right` */
+    NODE_OR,       /**< `left || right` */
+    NODE_LIST,     /**< Commands separated by `;`, `&` or newlines. */
+    NODE_IF,       /**< `if condition; then body; [elif ...;] [else else_part;] fi` */
+    NODE_WHILE,    /**< `while condition; do body; done` */
+    NODE_UNTIL,    /**< `until condition; do body; done` */
+    NODE_FOR,      /**< `for name [in words]; do body; done` */
+    NODE_CASE,     /**< `case name in pattern) body;; ... esac`, the subject word being `name` */
+    NODE_GROUP,    /**< `{ body; }` */
+    NODE_FUNCTION, /**< `name() body` or `function name body`: defines a function. */
+} node_type;
+
+typedef struct node node;
+
+/**
+ * @brief How a pipeline prefixed with the `time` keyword reports its resource usage.
+ */
+typedef enum
+{
+    TIME_NONE, /**< Not timed. */
+    TIME_TEXT, /**< `time`: a human readable table on stderr. */
+    TIME_JSON, /**< `time -j`: one JSON object per line on stderr, for logs. */
+} time_format;
+
+/**
+ * @brief An entry of a NODE_LIST.
+ */
+typedef struct
+{
+    node* command;  /**< The and-or list to run. */
+    int background; /**< Non-zero if it was terminated by `&`. */
+} list_item;
+
+/**
+ * @brief An entry of a NODE_CASE.
+ */
+typedef struct
+{
+    word* patterns;      /**< The patterns separated by `|`. */
+    size_t num_patterns; /**< Number of entries in `patterns`. */
+    node* body;          /**< The list run when a pattern matches; it may have no items. */
+} case_item;
+
+/**
+ * @brief A node of the command AST. Every node lives in the parser's arena.
+ */
+struct node
+{
+    node_type type; /**< Selects the member of the union. */
+    union
+    {
+        struct
+        {
+            word* words;                /**< Command name and arguments. */
+            size_t num_words;           /**< Number of entries in `words`. */
+            word* assignments;          /**< `NAME=value` words preceding the command name. */
+            size_t num_assignments;     /**< Number of entries in `assignments`. */
+            redirection* redirections;  /**< Redirections in source order. */
+            size_t num_redirections;    /**< Number of entries in `redirections`. */
+        } simple;
+        struct
+        {
+            node** stages;     /**< The commands, left to right. */
+            size_t num_stages; /**< Number of entries in `stages`. */
+            time_format timed; /**< Set by a leading `time` keyword. */
+        } pipeline;
+        struct
+        {
+            node* left;  /**< Runs first. */
+            node* right; /**< Runs depending on the status of `left`. */
+        } binary;
+        struct
+        {
+            list_item* items; /**< The commands, in order. */
+            size_t num_items; /**< Number of entries in `items`. */
+        } list;
+        struct
+        {
+            word source;               /**< The whole command, from its first reserved word to its last one. */
+            node* condition;           /**< NODE_IF, NODE_WHILE, NODE_UNTIL: the list whose status is tested. */
+            node* body;                /**< The list run, or the function's command for NODE_FUNCTION. */
+            node* else_part;           /**< NODE_IF: the `else` list, a NODE_IF for `elif`, or NULL. */
+            word name;                 /**< Loop variable, function name or case subject. */
+            word* words;               /**< NODE_FOR: the words after `in`. */
+            size_t num_words;          /**< Number of entries in `words`. */
+            int has_words;             /**< NODE_FOR: non-zero if `in` was given, else "$@" is used. */
+            case_item* items;          /**< NODE_CASE: the items, in order. */
+            size_t num_items;          /**< Number of entries in `items`. */
+            redirection* redirections; /**< Redirections following the closing keyword, applied to the whole command. */
+            size_t num_redirections;   /**< Number of entries in `redirections`. */
+        } compound;
+    };
+};
+
+/**
+ * @brief Outcome of parsing a line.
+ */
+typedef enum
+{
+    PARSE_OK,         /**< A command was parsed. */
+    PARSE_EMPTY,      /**< The input only contained blanks or comments. */
+    PARSE_INCOMPLETE, /**< The input ended early (open quote, trailing `|` or `&&`, unclosed `if`...). */
+    PARSE_ERROR,      /**< Syntax error, reported on stderr. */
+} parse_status;
+
+/**
+ * @brief Parses `len` bytes of `text` into a command AST.
+ *
+ * Tokens are slices of `text`, so it must outlive the returned tree. All nodes
+ * are allocated from `a`.
+ *
+ * @param a The arena to allocate nodes from.
+ * @param text The input.
+ * @param len The length of the input.
+ * @param result Where to store the root node when PARSE_OK is returned.
+ * @return parse_status The outcome.
+ */
+parse_status parse_line(arena* a, const char* text, size_t len, node** result);
+
+/**
+ * @brief Like parse_line(), but syntax errors are not reported.
+ *
+ * For parsing ahead of execution, where an error is reported later, when the
+ * line is reached.
+ *
+ * @param a The arena to allocate nodes from.
+ * @param text The input.
+ * @param len The length of the input.
+ * @param result Where to store the root node when PARSE_OK is returned.
+ * @return parse_status The outcome.
+ */
+parse_status parse_line_quiet(arena* a, const char* text, size_t len, node** result);
+
+#endif // PARSER_H
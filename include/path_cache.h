@@ -0,0 +1,61 @@
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+/**
+ * @brief Resolves a command name to the executable `execvp` would run.
+ *
+ * Names containing a slash are returned unchanged. Other names are looked up in
+ * the cache first and, on a miss, searched in every `PATH` entry. The cache is
+ * dropped whenever `PATH` changes.
+ *
+ * @param name The command name.
+ * @return const char* The resolved path (valid until the next cache call), or NULL if not found.
+ */
+const char* path_cache_resolve(const char* name);
+
+/**
+ * @brief Looks a command name up in the cache without searching `PATH`.
+ *
+ * @param name The command name.
+ * @return const char* The cached path, or NULL if the name is not cached.
+ */
+const char* path_cache_peek(const char* name);
+
+/**
+ * @brief Removes a single command from the cache (e.g. its binary disappeared).
+ *
+ * @param name The command name.
+ */
+void path_cache_forget(const char* name);
+
+/**
+ * @brief Removes every command from the cache.
+ */
+void path_cache_clear(void);
+
+/**
+ * @brief Returns the number of lookups answered from the cache.
+ *
+ * @return unsigned long The hit counter.
+ */
+unsigned long path_cache_hits(void);
+
+/**
+ * @brief Returns the number of lookups that had to search `PATH`.
+ *
+ * @return unsigned long The miss counter.
+ */
+unsigned long path_cache_misses(void);
+
+/**
+ * @brief The `hash` builtin.
+ *
+ * `hash` lists the cached commands with their hit counts, `hash -r` empties the
+ * cache and `hash name...` resolves and caches the given names.
+ *
+ * @param args The NULL terminated argument vector, starting with "hash".
+ * @return int 0 on success, 1 if a name could not be found.
+ */
+int hash_command(char** args);
+
+#endif // PATH_CACHE_H
@@ -1,11 +1,64 @@
 #ifndef PIPE_H
 #define PIPE_H
 
+#include "arena.h"
+#include "parser.h"
+
+/**
+ * @brief Environment variable holding the capacity of the pipes created for a pipeline.
+ *
+ * A byte count, optionally followed by `K` or `M`. It is read for every
+ * pipeline, so a bare `MYSHELL_PIPE_SIZE=1M` line changes it for the pipelines
+ * that follow. Unset keeps the kernel default (64 KiB).
+ */
+#define PIPE_SIZE_ENV "MYSHELL_PIPE_SIZE"
+
+/**
+ * @brief File holding the largest capacity an unprivileged process may give a pipe.
+ */
+#define PIPE_MAX_SIZE_PATH "/proc/sys/fs/pipe-max-size"
+
+/**
+ * @brief Capacity of a pipe left at the kernel default.
+ */
+#define PIPE_DEFAULT_SIZE (64 * 1024)
+
+/**
+ * @brief Parses a pipe capacity such as `65536`, `256K` or `1M`.
+ *
+ * @param text The text to parse.
+ * @return long The capacity in bytes, or -1 if the text is not a positive size.
+ */
+long pipe_size_parse(const char* text);
+
+/**
+ * @brief Returns the limit from PIPE_MAX_SIZE_PATH, read once.
+ *
+ * @return long The limit in bytes, or -1 if it could not be read.
+ */
+long pipe_max_size(void);
+
+/**
+ * @brief Resizes a pipe with F_SETPIPE_SZ, falling back to smaller sizes.
+ *
+ * The request is clamped to pipe_max_size(). If the kernel still refuses
+ * (the user's pipe page quota is exhausted), the size is halved until it is
+ * accepted or reaches PIPE_DEFAULT_SIZE.
+ *
+ * @param fd Either end of the pipe.
+ * @param size The requested capacity in bytes.
+ * @return long The capacity the pipe ended up with, or -1 on error.
+ */
+long pipe_set_size(int fd, long size);
+
 /**
  * @brief This function is used to execute piped commands
  *
- * @param input: The input string containing the piped commands
+ * @param a: The arena holding the parsed line
+ * @param pipeline: A NODE_PIPELINE node with at least two stages
+ * @param background: Non-zero to return without waiting for the stages
+ * @return int: The exit status of the last stage
  */
-void execute_piped_commands(char* input);
+int execute_piped_commands(arena* a, const node* pipeline, int background);
 
 #endif // PIPE_H
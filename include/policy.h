@@ -0,0 +1,46 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include "launcher.h"
+
+/**
+ * @brief Environment variable holding the policy of background jobs, in the prefix syntax (`nice 10 ionice idle`).
+ */
+#define POLICY_BACKGROUND_ENV "MYSHELL_BACKGROUND_POLICY"
+
+/**
+ * @brief Niceness increment of `nice` without a number, as in nice(1).
+ */
+#define POLICY_DEFAULT_NICE 10
+
+/**
+ * @brief Strips the scheduling prefixes of a command.
+ *
+ * The prefixes are `pin CPUS` (a list such as `0-3,6`), `nice [-n] N`
+ * (`nice` alone adds POLICY_DEFAULT_NICE) and `ionice CLASS[:LEVEL]`, with
+ * CLASS `realtime`, `best-effort` or `idle` (or 1 to 3, as in ionice(1)) and
+ * LEVEL 0 to 7. A prefix only counts as one when a command follows it, so
+ * `nice` alone still runs nice(1), and when no function has its name.
+ *
+ * @param argv The expanded argument vector.
+ * @param policy Receives the settings of the prefixes found; its flags are 0 if there were none.
+ * @return char** The argument vector of the command itself, or NULL after reporting an invalid prefix.
+ */
+char** policy_strip_prefixes(char** argv, launch_policy* policy);
+
+/**
+ * @brief Returns the policy of background jobs, read from POLICY_BACKGROUND_ENV.
+ *
+ * @return const launch_policy* The policy, or NULL if none is set (or it is invalid, which is reported once).
+ */
+const launch_policy* policy_background(void);
+
+/**
+ * @brief Fills the settings `policy` leaves unset from `defaults`.
+ *
+ * @param policy The policy to complete.
+ * @param defaults The settings to take, or NULL.
+ */
+void policy_merge(launch_policy* policy, const launch_policy* defaults);
+
+#endif // POLICY_H
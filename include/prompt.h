@@ -0,0 +1,98 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+
+#include <linux/limits.h>
+#include <stddef.h>
+
+/**
+ * @brief Environment variable listing the prompt's segments, separated by commas.
+ */
+#define PROMPT_ENV "MYSHELL_PROMPT"
+
+/**
+ * @brief Segments shown when PROMPT_ENV is not set: `user@host:cwd$ `.
+ */
+#define PROMPT_DEFAULT "user,host,cwd"
+
+/**
+ * @brief Largest number of segments in a prompt.
+ */
+#define PROMPT_MAX_SEGMENTS 16
+
+/**
+ * @brief Largest text of a segment, colors included.
+ */
+#define PROMPT_SEGMENT_MAX (PATH_MAX + 64)
+
+/**
+ * @brief Largest prompt.
+ */
+#define PROMPT_MAX (PROMPT_MAX_SEGMENTS * PROMPT_SEGMENT_MAX)
+
+/**
+ * @brief Milliseconds the prompt waits for its background segments before using their previous values.
+ */
+#define PROMPT_ASYNC_DEADLINE_MS 20
+
+/**
+ * @brief The working directory changed, or how it is shown.
+ */
+#define PROMPT_EVENT_CWD 0x1
+
+/**
+ * @brief A job was created or removed.
+ */
+#define PROMPT_EVENT_JOBS 0x2
+
+/**
+ * @brief A command line finished, with a new exit status.
+ */
+#define PROMPT_EVENT_STATUS 0x4
+
+/**
+ * @brief Sets up the prompt from a list of segments.
+ *
+ * The segments are `user`, `host` and `cwd`, computed once or when an event
+ * invalidates them; `status` (the last exit status, when not 0) and `jobs`
+ * (the number of jobs, when any), also cached until an event; and `load` (the
+ * load average) and `monitor` (the monitor's PID, when it runs), which read
+ * files and are computed on a background thread.
+ *
+ * @param spec Segment names separated by commas, or NULL for PROMPT_DEFAULT.
+ * @param username The user shown by the `user` segment.
+ * @param hostname The host shown by the `host` segment.
+ * @return int 0 on success, -1 on an unknown segment (the default prompt is used then).
+ */
+int prompt_init(const char* spec, const char* username, const char* hostname);
+
+/**
+ * @brief Marks the segments depending on `events` as stale. Async-signal-safe.
+ *
+ * @param events PROMPT_EVENT_* flags.
+ */
+void prompt_invalidate(unsigned int events);
+
+/**
+ * @brief Builds the prompt text.
+ *
+ * Stale cached segments are recomputed. The background segments are refreshed,
+ * waiting at most PROMPT_ASYNC_DEADLINE_MS for them; a segment that is not
+ * ready by then keeps its previous value, so input is never held up.
+ *
+ * @param buffer Where to store the NUL terminated prompt.
+ * @param size The size of `buffer`.
+ * @return size_t The length of the prompt.
+ */
+size_t prompt_format(char* buffer, size_t size);
+
+/**
+ * @brief Writes the prompt to standard output with a single write(2).
+ */
+void prompt_render(void);
+
+/**
+ * @brief Stops the background thread and forgets the segments.
+ */
+void prompt_shutdown(void);
+
+#endif // PROMPT_H
@@ -0,0 +1,89 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stddef.h>
+
+/**
+ * @brief Initial size of the read buffer used for scripts.
+ *
+ * The buffer only grows when a single command is longer than it, so memory
+ * use does not depend on the length of the script.
+ */
+#define SCRIPT_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Streams lines out of a file descriptor through a reusable buffer.
+ *
+ * Lines are returned as slices of the buffer, without copying, and stay valid
+ * until the next call to script_reader_next().
+ */
+typedef struct
+{
+    int fd;          /**< Descriptor being read. */
+    char* buffer;    /**< Read buffer. */
+    size_t capacity; /**< Size of `buffer`. */
+    size_t start;    /**< First byte of the command being assembled. */
+    size_t scan;     /**< First byte not yet returned as part of a line. */
+    size_t end;      /**< One past the last byte read. */
+    int eof;         /**< Non-zero once read() reported end of file. */
+} script_reader;
+
+/**
+ * @brief Initializes a reader over `fd`.
+ *
+ * @param reader The reader to initialize.
+ * @param fd The descriptor to read; it is not closed by the reader.
+ * @return int 0 on success, -1 on error.
+ */
+int script_reader_init(script_reader* reader, int fd);
+
+/**
+ * @brief Returns the command being assembled extended with the next line.
+ *
+ * With `keep` zero the previous text is dropped first; with `keep` non-zero
+ * the next line is appended to it, which is how commands spanning several
+ * lines (open quotes, trailing `|`) are read.
+ *
+ * @param reader The reader.
+ * @param keep Whether to keep the text returned by the previous call.
+ * @param text Receives the start of the text.
+ * @param len Receives the length of the text, newline included.
+ * @return int 1 if text was returned, 0 at end of input, -1 on error.
+ */
+int script_reader_next(script_reader* reader, int keep, const char** text, size_t* len);
+
+/**
+ * @brief Releases the reader's buffer.
+ *
+ * @param reader The reader.
+ */
+void script_reader_free(script_reader* reader);
+
+/**
+ * @brief Executes the commands of a script file as they are read.
+ *
+ * There is no limit on the number or length of lines, and each command runs
+ * before the rest of the file is read. When SCRIPT_CACHE_ENV is set, the
+ * script is run by script_cache_run() instead, if it can be.
+ *
+ * @param path The script to run.
+ * @return int 0 on success, 1 if the file could not be read.
+ */
+int run_script(const char* path);
+
+/**
+ * @brief Executes the commands of a script file, up to `max_running` of them at a time.
+ *
+ * Commands run as forked tasks with their output captured and written in
+ * script order. A command that must run in the shell itself (assignments,
+ * BUILTIN_SHELL_STATE builtins such as `cd` or `wait`, background jobs) is a
+ * barrier: it runs once every command before it has finished, so a bare
+ * `wait` line separates stages of the script.
+ *
+ * @param path The script to run.
+ * @param max_running The largest number of concurrent commands, 0 for one per CPU.
+ * @return int 0 on success, 1 if the file could not be read.
+ */
+int run_script_concurrently(const char* path, long max_running);
+
+#endif // SCRIPT_H
@@ -0,0 +1,47 @@
+#ifndef SCRIPT_CACHE_H
+#define SCRIPT_CACHE_H
+
+#include <stdint.h>
+
+/**
+ * @brief Environment variable naming the directory where parsed scripts are cached.
+ *
+ * Scripts are only cached when it is set.
+ */
+#define SCRIPT_CACHE_ENV "MYSHELL_SCRIPT_CACHE"
+
+/**
+ * @brief Magic number at the start of a cache file; changes whenever the format does.
+ */
+#define SCRIPT_CACHE_MAGIC "MYSHAST2"
+
+/**
+ * @brief Extension of the cache files.
+ */
+#define SCRIPT_CACHE_SUFFIX ".ast"
+
+/**
+ * @brief Largest script that is cached: offsets into it are stored in 32 bits.
+ */
+#define SCRIPT_CACHE_MAX_SIZE UINT32_MAX
+
+/**
+ * @brief Runs a script from its cached AST, parsing and caching it first if needed.
+ *
+ * The cache file is named after the script's real path and records the
+ * script's size, modification time and a hash of its content; the script is
+ * memory-mapped and the AST's words point into it, so a valid cache lets the
+ * script run without being tokenized. A missing, stale or corrupt cache is
+ * silently replaced by a full parse, whose result is written to a new cache
+ * file.
+ *
+ * Commands run one after the other, as with run_script().
+ *
+ * @param path The script to run.
+ * @param cache_dir The directory holding the cache files.
+ * @return int 0 once the script ran, 1 on a read error, or -1 if it cannot be
+ * run this way (not a regular file, too large, syntax errors) and nothing ran.
+ */
+int script_cache_run(const char* path, const char* cache_dir);
+
+#endif // SCRIPT_CACHE_H
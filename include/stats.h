@@ -0,0 +1,93 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief Number of buckets of a latency histogram.
+ *
+ * Buckets are log-linear: every power of two of nanoseconds is split into
+ * STATS_SUB_BUCKETS buckets, so a percentile is off by at most 25%.
+ */
+#define STATS_BUCKETS 256
+
+/**
+ * @brief Buckets per power of two.
+ */
+#define STATS_SUB_BUCKETS 4
+
+/**
+ * @brief Phases of the shell's own work that are timed.
+ */
+typedef enum
+{
+    STAT_READ,     /**< Reading a command line from a script. */
+    STAT_PARSE,    /**< Parsing a command line. */
+    STAT_BUILTIN,  /**< Running a builtin in the shell. */
+    STAT_SPAWN,    /**< Creating a process (posix_spawn, vfork or fork). */
+    STAT_RUN,      /**< A foreground job, from its creation until its last process was reaped. */
+    STAT_PROMPT,   /**< Rendering the interactive prompt. */
+    STAT_COMPLETE, /**< Completing a word on Tab. */
+    STAT_PHASES,   /**< Number of phases. */
+} stat_phase;
+
+/**
+ * @brief Returns the CLOCK_MONOTONIC time in nanoseconds.
+ *
+ * @return uint64_t The current time.
+ */
+uint64_t stats_now(void);
+
+/**
+ * @brief Adds a sample to a phase's histogram. Lock-free and async-signal-safe.
+ *
+ * @param phase The phase.
+ * @param ns The duration in nanoseconds.
+ */
+void stats_record(stat_phase phase, uint64_t ns);
+
+/**
+ * @brief Adds the time elapsed since `start` (from stats_now()) to a phase's histogram.
+ *
+ * @param phase The phase.
+ * @param start When the phase started.
+ */
+void stats_record_since(stat_phase phase, uint64_t start);
+
+/**
+ * @brief Returns the number of samples of a phase.
+ *
+ * @param phase The phase.
+ * @return uint64_t The number of samples.
+ */
+uint64_t stats_count(stat_phase phase);
+
+/**
+ * @brief Estimates a percentile of a phase from its histogram.
+ *
+ * @param phase The phase.
+ * @param percentile The percentile, between 0 and 100.
+ * @return uint64_t The upper bound of the bucket holding it, in nanoseconds (0 without samples).
+ */
+uint64_t stats_percentile(stat_phase phase, double percentile);
+
+/**
+ * @brief Writes every phase's count, p50, p99, max and mean.
+ *
+ * @param out Where to write.
+ * @param json Non-zero for a single JSON object, zero for a table.
+ */
+void stats_print(FILE* out, int json);
+
+/**
+ * @brief Clears every histogram.
+ */
+void stats_reset(void);
+
+/**
+ * @brief Registers `shellstats [-j] [-r]` in the builtin registry.
+ */
+void stats_register_builtins(void);
+
+#endif // STATS_H
@@ -0,0 +1,39 @@
+#ifndef SUBSTITUTE_H
+#define SUBSTITUTE_H
+
+#include "expand.h"
+#include <stddef.h>
+
+/**
+ * @brief Capacity asked for the pipe a substituted command writes to, so it rarely blocks on a slow reader.
+ */
+#define SUBSTITUTE_PIPE_SIZE (1024 * 1024)
+
+/**
+ * @brief Smallest free space read() is given when draining the pipe; the buffer doubles to keep it.
+ */
+#define SUBSTITUTE_READ_MIN (64 * 1024)
+
+/**
+ * @brief Name of the memfd capturing the output of builtins, as shown in /proc/PID/fd.
+ */
+#define SUBSTITUTE_MEMFD_NAME "myshell-substitution"
+
+/**
+ * @brief Runs the command of a `$(...)` and appends its output, without trailing newlines, to `out`.
+ *
+ * A single builtin that leaves the shell's state alone (echo, type, test,
+ * ...) runs in the shell process, its standard output pointed at a memfd
+ * that is then read back: nothing is forked, and its arguments are
+ * expanded by the shell itself. Anything else runs in a forked
+ * copy of the shell writing to a pipe, which is drained with large reads
+ * straight into `out`.
+ *
+ * @param text The command text, between the parentheses.
+ * @param len The length of the text.
+ * @param out The buffer receiving the output.
+ * @return int The exit status of the command.
+ */
+int substitute_command(const char* text, size_t len, expand_buffer* out);
+
+#endif // SUBSTITUTE_H
@@ -0,0 +1,40 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "parser.h"
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/**
+ * @brief What is known when a timed pipeline starts.
+ */
+typedef struct
+{
+    struct timespec start;  /**< CLOCK_MONOTONIC time the pipeline started. */
+    struct rusage self;     /**< The shell's own usage, for stages that run in the shell. */
+    unsigned long finished; /**< jobs_finished_count() at the start. */
+} time_mark;
+
+/**
+ * @brief Records the start of a timed pipeline.
+ *
+ * @param mark Receives the starting point.
+ */
+void time_mark_start(time_mark* mark);
+
+/**
+ * @brief Reports the resources used by a pipeline that just finished, in total and per stage.
+ *
+ * Stages that ran as processes are measured with the rusage the kernel returned
+ * when they were reaped; a stage that ran in the shell (a builtin) is charged
+ * with the shell's own usage meanwhile. Wall times are CLOCK_MONOTONIC.
+ *
+ * @param out Where to write the report.
+ * @param mark The starting point.
+ * @param pipeline The NODE_PIPELINE node, whose `timed` member selects the format.
+ * @param status The pipeline's exit status.
+ */
+void time_report(FILE* out, const time_mark* mark, const node* pipeline, int status);
+
+#endif // TIMING_H
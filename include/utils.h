@@ -21,6 +21,21 @@
  */
 #define COLOR_DIR "\033[1;36m"
 
+/**
+ * @brief Color for a failed exit status (red).
+ */
+#define COLOR_STATUS "\033[1;31m"
+
+/**
+ * @brief Color for the number of jobs (yellow).
+ */
+#define COLOR_JOBS "\033[1;33m"
+
+/**
+ * @brief Color for the monitor (green).
+ */
+#define COLOR_MONITOR "\033[1;32m"
+
 /**
  * @brief Global variable to control the path view mode.
  *
@@ -33,13 +48,4 @@ extern int show_full_path;
  */
 void toggle_path_view();
 
-/**
- * @brief Print the command prompt with colors.
- *
- * @param username The username to display.
- * @param hostname The hostname to display.
- * @param cwd The current working directory to display.
- */
-void print_colored_prompt(const char* username, const char* hostname, const char* cwd);
-
 #endif // UTILS_H
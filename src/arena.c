@@ -0,0 +1,115 @@
+#include "arena.h"
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Size of the first block of an arena.
+ */
+#define ARENA_MIN_BLOCK 4096
+
+/**
+ * @brief Alignment of every allocation.
+ */
+#define ARENA_ALIGNMENT alignof(max_align_t)
+
+void arena_init(arena* a)
+{
+    a->head = NULL;
+    a->allocations = 0;
+    a->mallocs = 0;
+}
+
+/**
+ * @brief Pushes a new block able to hold at least `size` bytes.
+ */
+static arena_block* arena_grow(arena* a, size_t size)
+{
+    size_t block_size = a->head != NULL ? a->head->size * 2 : ARENA_MIN_BLOCK;
+    while (block_size < size)
+    {
+        block_size *= 2;
+    }
+
+    arena_block* block = malloc(sizeof(arena_block) + block_size);
+    if (block == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    block->next = a->head;
+    block->size = block_size;
+    block->used = 0;
+    a->head = block;
+    a->mallocs++;
+    return block;
+}
+
+void* arena_alloc(arena* a, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    arena_block* block = a->head;
+    if (block == NULL || block->size - block->used < size)
+    {
+        block = arena_grow(a, size);
+    }
+    void* ptr = block->data + block->used;
+    block->used += size;
+    a->allocations++;
+    return ptr;
+}
+
+char* arena_strndup(arena* a, const char* str, size_t len)
+{
+    char* copy = arena_alloc(a, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+arena_mark arena_get_mark(const arena* a)
+{
+    arena_mark mark = {a->head, a->head != NULL ? a->head->used : 0};
+    return mark;
+}
+
+void arena_rewind(arena* a, arena_mark mark)
+{
+    while (a->head != mark.block)
+    {
+        arena_block* next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+    if (a->head != NULL)
+    {
+        a->head->used = mark.used;
+    }
+}
+
+void arena_reset(arena* a)
+{
+    if (a->head == NULL)
+    {
+        return;
+    }
+
+    // Blocks double in size, so the head is the largest one
+    arena_block* block = a->head->next;
+    while (block != NULL)
+    {
+        arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+    a->head->next = NULL;
+    a->head->used = 0;
+}
+
+void arena_free(arena* a)
+{
+    arena_reset(a);
+    free(a->head);
+    a->head = NULL;
+}
@@ -0,0 +1,506 @@
+#include "arith.h"
+#include "expand.h"
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Longest variable name an expression can assign to.
+ */
+#define ARITH_NAME_MAX 256
+
+/**
+ * @brief Room for the decimal text of a 64 bit integer, with its sign and NUL.
+ */
+#define ARITH_TEXT_MAX 24
+
+/**
+ * @brief An expression being evaluated.
+ */
+typedef struct
+{
+    const char* p;     /**< The next character to read. */
+    const char* end;   /**< One past the last character of the expression. */
+    int skip;          /**< Non-zero inside an operand `&&`, `||` or `?:` does not evaluate. */
+    int depth;         /**< Nesting of parentheses and variables evaluated as expressions. */
+    const char* error; /**< The first error met, or NULL. */
+} arith_parser;
+
+/**
+ * @brief A binary operator.
+ */
+typedef struct
+{
+    const char* text; /**< Its spelling. */
+    size_t len;       /**< Length of the spelling. */
+    int precedence;   /**< Higher binds tighter. */
+    int compound;     /**< Non-zero if `op=` is an assignment operator. */
+} binary_operator;
+
+/**
+ * @brief Binary operators, longer spellings first so that `<<` is not read as `<`.
+ */
+static const binary_operator binary_operators[] = {
+    {"**", 2, 11, 0}, {"<<", 2, 8, 1}, {">>", 2, 8, 1}, {"<=", 2, 7, 0}, {">=", 2, 7, 0}, {"==", 2, 6, 0},
+    {"!=", 2, 6, 0},  {"&&", 2, 2, 0}, {"||", 2, 1, 0}, {"*", 1, 10, 1}, {"/", 1, 10, 1}, {"%", 1, 10, 1},
+    {"+", 1, 9, 1},   {"-", 1, 9, 1},  {"<", 1, 7, 0},  {">", 1, 7, 0},  {"&", 1, 5, 1},  {"^", 1, 4, 1},
+    {"|", 1, 3, 1},
+};
+
+/**
+ * @brief Precedence of `**`, the only right associative binary operator.
+ */
+#define POWER_PRECEDENCE 11
+
+static int64_t parse_comma(arith_parser* ap);
+static int64_t parse_assignment(arith_parser* ap);
+
+/**
+ * @brief Records an error, keeping the first one.
+ *
+ * @return int64_t 0, the value of the failed operand.
+ */
+static int64_t fail(arith_parser* ap, const char* message)
+{
+    if (ap->error == NULL)
+    {
+        ap->error = message;
+    }
+    ap->p = ap->end;
+    return 0;
+}
+
+/**
+ * @brief Skips blanks and newlines.
+ */
+static void skip_blanks(arith_parser* ap)
+{
+    while (ap->p < ap->end && isspace((unsigned char)*ap->p))
+    {
+        ap->p++;
+    }
+}
+
+/**
+ * @brief Consumes `text` if the expression continues with it.
+ */
+static int accept(arith_parser* ap, const char* text)
+{
+    size_t len = strlen(text);
+    skip_blanks(ap);
+    if ((size_t)(ap->end - ap->p) >= len && memcmp(ap->p, text, len) == 0)
+    {
+        ap->p += len;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Measures the variable name at `p`.
+ *
+ * @return size_t Its length, 0 if no name starts there.
+ */
+static size_t name_length(const char* p, const char* end)
+{
+    if (p >= end || !(isalpha((unsigned char)*p) || *p == '_'))
+    {
+        return 0;
+    }
+    size_t len = 1;
+    while (p + len < end && (isalnum((unsigned char)p[len]) || p[len] == '_'))
+    {
+        len++;
+    }
+    return len;
+}
+
+/**
+ * @brief Computes `left op right` with wrapping 64 bit arithmetic.
+ */
+static int64_t apply(arith_parser* ap, const binary_operator* op, int64_t left, int64_t right)
+{
+    uint64_t a = (uint64_t)left;
+    uint64_t b = (uint64_t)right;
+    switch (op->text[0])
+    {
+    case '*':
+        if (op->len == 1)
+        {
+            return (int64_t)(a * b);
+        }
+        if (right < 0)
+        {
+            return ap->skip ? 0 : fail(ap, "exponent less than 0");
+        }
+        {
+            // Exponentiation by squaring
+            uint64_t power = 1;
+            for (; b != 0; b >>= 1, a *= a)
+            {
+                if (b & 1)
+                {
+                    power *= a;
+                }
+            }
+            return (int64_t)power;
+        }
+    case '/':
+    case '%':
+        if (right == 0)
+        {
+            return ap->skip ? 0 : fail(ap, "division by 0");
+        }
+        if (right == -1)
+        {
+            // INT64_MIN / -1 overflows: wrap around instead of trapping
+            return op->text[0] == '/' ? (int64_t)(0 - a) : 0;
+        }
+        return op->text[0] == '/' ? left / right : left % right;
+    case '+':
+        return (int64_t)(a + b);
+    case '-':
+        return (int64_t)(a - b);
+    case '<':
+        if (op->len == 2 && op->text[1] == '<')
+        {
+            return (int64_t)(a << (b & 63));
+        }
+        return op->len == 2 ? left <= right : left < right;
+    case '>':
+        if (op->len == 2 && op->text[1] == '>')
+        {
+            return left >> (b & 63);
+        }
+        return op->len == 2 ? left >= right : left > right;
+    case '=':
+        return left == right;
+    case '!':
+        return left != right;
+    case '&':
+        return op->len == 2 ? (left && right) : (int64_t)(a & b);
+    case '^':
+        return (int64_t)(a ^ b);
+    default:
+        return op->len == 2 ? (left || right) : (int64_t)(a | b);
+    }
+}
+
+/**
+ * @brief Reads a constant: decimal, octal with a leading 0 or hexadecimal with a leading 0x.
+ */
+static int64_t parse_constant(arith_parser* ap)
+{
+    unsigned base = 10;
+    if (*ap->p == '0' && ap->p + 1 < ap->end && (ap->p[1] == 'x' || ap->p[1] == 'X'))
+    {
+        base = 16;
+        ap->p += 2;
+    }
+    else if (*ap->p == '0')
+    {
+        base = 8;
+    }
+    uint64_t value = 0;
+    while (ap->p < ap->end && (isalnum((unsigned char)*ap->p) || *ap->p == '_'))
+    {
+        int c = tolower((unsigned char)*ap->p);
+        unsigned digit = isdigit(c) ? (unsigned)(c - '0') : (unsigned)(c - 'a' + 10);
+        if (!isxdigit(c) || digit >= base)
+        {
+            return fail(ap, "value too great for base");
+        }
+        value = value * base + digit;
+        ap->p++;
+    }
+    return (int64_t)value;
+}
+
+/**
+ * @brief Gives the value of a variable: its text evaluated as an expression, 0 if unset or empty.
+ */
+static int64_t variable_value(arith_parser* ap, const char* name, size_t len)
+{
+    size_t value_len;
+    const char* value = expand_lookup(name, len, &value_len);
+    if (value == NULL || value_len == 0)
+    {
+        return 0;
+    }
+    if (ap->depth >= ARITH_MAX_DEPTH)
+    {
+        return fail(ap, "expression recursion level exceeded");
+    }
+    arith_parser inner = {value, value + value_len, ap->skip, ap->depth + 1, NULL};
+    int64_t result = parse_comma(&inner);
+    skip_blanks(&inner);
+    if (inner.error == NULL && inner.p < inner.end)
+    {
+        inner.error = "syntax error in expression";
+    }
+    return inner.error != NULL ? fail(ap, inner.error) : result;
+}
+
+/**
+ * @brief Stores the value of an assignment, unless the operand is skipped.
+ *
+ * @return int64_t The value stored.
+ */
+static int64_t assign(arith_parser* ap, const char* name, size_t len, int64_t value)
+{
+    if (ap->skip || ap->error != NULL)
+    {
+        return value;
+    }
+    if (len >= ARITH_NAME_MAX)
+    {
+        return fail(ap, "variable name too long");
+    }
+    char name_text[ARITH_NAME_MAX];
+    char value_text[ARITH_TEXT_MAX];
+    memcpy(name_text, name, len);
+    name_text[len] = '\0';
+    snprintf(value_text, sizeof(value_text), "%" PRId64, value);
+    if (expand_assign(name_text, value_text) == -1)
+    {
+        return fail(ap, "assignment failed");
+    }
+    return value;
+}
+
+/**
+ * @brief Parses an operand: a constant, a variable with optional `++`/`--`, or a parenthesized expression.
+ */
+static int64_t parse_operand(arith_parser* ap)
+{
+    skip_blanks(ap);
+    if (ap->p >= ap->end)
+    {
+        return fail(ap, "operand expected");
+    }
+    if (isdigit((unsigned char)*ap->p))
+    {
+        return parse_constant(ap);
+    }
+    size_t len = name_length(ap->p, ap->end);
+    if (len > 0)
+    {
+        const char* name = ap->p;
+        ap->p += len;
+        int64_t value = variable_value(ap, name, len);
+        if (accept(ap, "++"))
+        {
+            assign(ap, name, len, (int64_t)((uint64_t)value + 1));
+        }
+        else if (accept(ap, "--"))
+        {
+            assign(ap, name, len, (int64_t)((uint64_t)value - 1));
+        }
+        return value;
+    }
+    if (accept(ap, "("))
+    {
+        if (++ap->depth > ARITH_MAX_DEPTH)
+        {
+            return fail(ap, "expression recursion level exceeded");
+        }
+        int64_t value = parse_comma(ap);
+        ap->depth--;
+        if (!accept(ap, ")"))
+        {
+            return fail(ap, "missing `)'");
+        }
+        return value;
+    }
+    return fail(ap, "operand expected");
+}
+
+/**
+ * @brief Parses the unary operators `+ - ! ~` and prefix `++`/`--`, then an operand.
+ */
+static int64_t parse_unary(arith_parser* ap)
+{
+    skip_blanks(ap);
+    if (ap->p + 1 < ap->end && (ap->p[0] == '+' || ap->p[0] == '-') && ap->p[1] == ap->p[0])
+    {
+        const char* before = ap->p;
+        ap->p += 2;
+        skip_blanks(ap);
+        size_t len = name_length(ap->p, ap->end);
+        if (len > 0)
+        {
+            const char* name = ap->p;
+            ap->p += len;
+            uint64_t value = (uint64_t)variable_value(ap, name, len);
+            return assign(ap, name, len, (int64_t)(*before == '+' ? value + 1 : value - 1));
+        }
+        // `--1` is two minus signs
+        ap->p = before;
+    }
+    if (accept(ap, "+"))
+    {
+        return parse_unary(ap);
+    }
+    if (accept(ap, "-"))
+    {
+        return (int64_t)(0 - (uint64_t)parse_unary(ap));
+    }
+    if (accept(ap, "!"))
+    {
+        return !parse_unary(ap);
+    }
+    if (accept(ap, "~"))
+    {
+        return ~parse_unary(ap);
+    }
+    return parse_operand(ap);
+}
+
+/**
+ * @brief Finds the binary operator the expression continues with.
+ *
+ * @return const binary_operator* The operator, or NULL if none follows (an assignment operator is none).
+ */
+static const binary_operator* peek_binary(arith_parser* ap)
+{
+    skip_blanks(ap);
+    size_t left = (size_t)(ap->end - ap->p);
+    for (size_t i = 0; i < sizeof(binary_operators) / sizeof(binary_operators[0]); i++)
+    {
+        const binary_operator* op = &binary_operators[i];
+        if (left >= op->len && memcmp(ap->p, op->text, op->len) == 0)
+        {
+            int assignment = op->compound && left > op->len && ap->p[op->len] == '=';
+            return assignment ? NULL : op;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Parses binary operators binding at least as tight as `min_precedence`, by precedence climbing.
+ */
+static int64_t parse_binary(arith_parser* ap, int min_precedence)
+{
+    int64_t left = parse_unary(ap);
+    const binary_operator* op;
+    while ((op = peek_binary(ap)) != NULL && op->precedence >= min_precedence)
+    {
+        ap->p += op->len;
+        // The right operand of `&&` and `||` is only evaluated when it decides the result
+        int skipped = (op->precedence == 2 && !left) || (op->precedence == 1 && left);
+        ap->skip += skipped;
+        int64_t right = parse_binary(ap, op->precedence == POWER_PRECEDENCE ? op->precedence : op->precedence + 1);
+        ap->skip -= skipped;
+        left = skipped ? (op->precedence == 1) : apply(ap, op, left, right);
+    }
+    return left;
+}
+
+/**
+ * @brief Parses `condition ? then : else`, evaluating only the chosen branch.
+ */
+static int64_t parse_conditional(arith_parser* ap)
+{
+    int64_t condition = parse_binary(ap, 1);
+    if (!accept(ap, "?"))
+    {
+        return condition;
+    }
+    ap->skip += !condition;
+    int64_t then_value = parse_assignment(ap);
+    ap->skip -= !condition;
+    if (!accept(ap, ":"))
+    {
+        return fail(ap, "`:' expected for conditional expression");
+    }
+    ap->skip += !!condition;
+    int64_t else_value = parse_conditional(ap);
+    ap->skip -= !!condition;
+    return condition ? then_value : else_value;
+}
+
+/**
+ * @brief Parses `name = value` or `name op= value`, else a conditional expression.
+ */
+static int64_t parse_assignment(arith_parser* ap)
+{
+    skip_blanks(ap);
+    const char* start = ap->p;
+    size_t len = name_length(ap->p, ap->end);
+    if (len > 0)
+    {
+        ap->p += len;
+        skip_blanks(ap);
+        const binary_operator* op = peek_binary(ap);
+        if (op == NULL && ap->p < ap->end)
+        {
+            // peek_binary() refuses `op=`: see which one it was
+            for (size_t i = 0; i < sizeof(binary_operators) / sizeof(binary_operators[0]); i++)
+            {
+                const binary_operator* candidate = &binary_operators[i];
+                if (candidate->compound && (size_t)(ap->end - ap->p) > candidate->len &&
+                    memcmp(ap->p, candidate->text, candidate->len) == 0 && ap->p[candidate->len] == '=')
+                {
+                    op = candidate;
+                    break;
+                }
+            }
+            if (op != NULL || (*ap->p == '=' && (ap->p + 1 >= ap->end || ap->p[1] != '=')))
+            {
+                ap->p += (op != NULL ? op->len : 0) + 1;
+                int64_t value = parse_assignment(ap);
+                if (op != NULL)
+                {
+                    value = apply(ap, op, variable_value(ap, start, len), value);
+                }
+                return assign(ap, start, len, value);
+            }
+        }
+        ap->p = start;
+    }
+    return parse_conditional(ap);
+}
+
+/**
+ * @brief Parses expressions separated by commas; the last one gives the value.
+ */
+static int64_t parse_comma(arith_parser* ap)
+{
+    int64_t value = parse_assignment(ap);
+    while (accept(ap, ","))
+    {
+        value = parse_assignment(ap);
+    }
+    return value;
+}
+
+int arith_evaluate(const char* text, size_t len, int64_t* result)
+{
+    arith_parser ap = {text, text + len, 0, 0, NULL};
+    skip_blanks(&ap);
+    // An empty expression is 0
+    int64_t value = ap.p < ap.end ? parse_comma(&ap) : 0;
+    skip_blanks(&ap);
+    if (ap.error == NULL && ap.p < ap.end)
+    {
+        ap.error = "syntax error in expression";
+    }
+    if (ap.error != NULL)
+    {
+        const char* end = text + len;
+        while (end > text && isspace((unsigned char)end[-1]))
+        {
+            end--;
+        }
+        while (text < end && isspace((unsigned char)*text))
+        {
+            text++;
+        }
+        fprintf(stderr, "%.*s: %s\n", (int)(end - text), text, ap.error);
+        return -1;
+    }
+    *result = value;
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include "builtins.h"
+#include "commands.h"
+#include "config_search.h"
+#include "control.h"
+#include "expand.h"
+#include "history.h"
+#include "jobs.h"
+#include "monitor.h"
+#include "parallel.h"
+#include "stats.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Maximum number of builtins the registry holds.
+ */
+#define MAX_BUILTINS 128
+
+/**
+ * @brief Number of slots in the perfect hash table (a power of two).
+ */
+#define BUILTIN_SLOTS 256
+
+/**
+ * @brief Number of seeds tried before giving up on a collision free table.
+ */
+#define MAX_SEED_ATTEMPTS 100000
+
+/**
+ * @brief FNV-1a 32 bit offset basis.
+ */
+#define FNV_OFFSET 2166136261U
+
+/**
+ * @brief FNV-1a 32 bit prime.
+ */
+#define FNV_PRIME 16777619U
+
+/**
+ * @brief Multiplier of the final avalanche step (from MurmurHash3).
+ */
+#define MIX_MULTIPLIER 0x85ebca6bU
+
+/**
+ * @brief Registered builtins, in registration order.
+ */
+static const builtin* registered[MAX_BUILTINS];
+
+/**
+ * @brief Number of entries in `registered`.
+ */
+static size_t num_registered = 0;
+
+/**
+ * @brief Perfect hash table: every registered name owns exactly one slot.
+ */
+static const builtin* slots[BUILTIN_SLOTS];
+
+/**
+ * @brief Seed for which no two registered names collide.
+ */
+static uint32_t hash_seed = 0;
+
+/**
+ * @brief Whether the modules have registered their builtins yet.
+ */
+static int initialized = 0;
+
+/**
+ * @brief Functions through which each module registers its builtins.
+ */
+static void (*const providers[])(void) = {
+    commands_register_builtins,
+    monitor_register_builtins,
+    config_search_register_builtins,
+    jobs_register_builtins,
+    parallel_register_builtins,
+    stats_register_builtins,
+    history_register_builtins,
+    expand_register_builtins,
+    control_register_builtins,
+};
+
+static uint32_t builtin_hash(uint32_t seed, const char* name, size_t len)
+{
+    uint32_t hash = FNV_OFFSET ^ seed;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= FNV_PRIME;
+    }
+    // Final avalanche so that nearby seeds give unrelated layouts
+    hash ^= hash >> 16;
+    hash *= MIX_MULTIPLIER;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+/**
+ * @brief Searches for a seed that places every registered name in its own slot.
+ *
+ * C has no compile-time evaluation for this, so the search runs once, when the
+ * modules register, and lookups after that are a single probe.
+ */
+static int rebuild_slots(void)
+{
+    for (uint32_t seed = 0; seed < MAX_SEED_ATTEMPTS; seed++)
+    {
+        int collision = 0;
+        memset(slots, 0, sizeof(slots));
+        for (size_t i = 0; i < num_registered && !collision; i++)
+        {
+            const builtin* cmd = registered[i];
+            size_t slot = builtin_hash(seed, cmd->name, strlen(cmd->name)) & (BUILTIN_SLOTS - 1);
+            if (slots[slot] != NULL)
+            {
+                collision = 1;
+            }
+            slots[slot] = cmd;
+        }
+        if (!collision)
+        {
+            hash_seed = seed;
+            return 0;
+        }
+    }
+    fprintf(stderr, "builtins: no collision free layout found\n");
+    return -1;
+}
+
+static void builtins_init(void)
+{
+    if (initialized)
+    {
+        return;
+    }
+    initialized = 1;
+    for (size_t i = 0; i < sizeof(providers) / sizeof(providers[0]); i++)
+    {
+        providers[i]();
+    }
+}
+
+int builtin_register(const builtin* table, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (num_registered >= MAX_BUILTINS)
+        {
+            fprintf(stderr, "builtins: registry full, %s not registered\n", table[i].name);
+            return -1;
+        }
+        for (size_t j = 0; j < num_registered; j++)
+        {
+            if (strcmp(registered[j]->name, table[i].name) == 0)
+            {
+                fprintf(stderr, "builtins: %s registered twice\n", table[i].name);
+                return -1;
+            }
+        }
+        registered[num_registered++] = &table[i];
+    }
+    return rebuild_slots();
+}
+
+const builtin* builtin_find(const char* name, size_t len)
+{
+    builtins_init();
+    const builtin* cmd = slots[builtin_hash(hash_seed, name, len) & (BUILTIN_SLOTS - 1)];
+    if (cmd != NULL && strncmp(cmd->name, name, len) == 0 && cmd->name[len] == '\0')
+    {
+        return cmd;
+    }
+    return NULL;
+}
+
+int builtin_run(const builtin* cmd, int argc, char** argv)
+{
+    int num_args = argc - 1;
+    if (num_args < cmd->min_args || (cmd->max_args != BUILTIN_ANY_ARGS && num_args > cmd->max_args))
+    {
+        fprintf(stderr, "Usage: %s\n", cmd->usage);
+        return 2;
+    }
+    return cmd->handler(argc, argv);
+}
+
+size_t builtin_count(void)
+{
+    builtins_init();
+    return num_registered;
+}
+
+const builtin* builtin_get(size_t index)
+{
+    builtins_init();
+    return index < num_registered ? registered[index] : NULL;
+}
@@ -1,8 +1,16 @@
+#include "arith.h"
+#include "builtins.h"
 #include "commands.h"
-#include "monitor.h"
-#include "pipe.h"
+#include "conditional.h"
+#include "control.h"
+#include "executor.h"
+#include "expand.h"
+#include "jobs.h"
+#include "parser.h"
+#include "path_cache.h"
+#include "prompt.h"
+#include "stats.h"
 #include "utils.h"
-#include "config_search.h"
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/limits.h>
@@ -12,58 +20,39 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 /**
- * @brief Size of the input buffer.
+ * @brief Exit status of a command line with a syntax error, as in other shells.
  */
-#define INPUT_SIZE 1024
+#define SYNTAX_ERROR_STATUS 2
 
 /**
- * @brief Actual job ID.
+ * @brief Pieces `echo` writes with a single writev(); longer lines take several calls.
  */
-static int job_id = 1;
+#define ECHO_IOV_BATCH 128
 
 /**
- * @brief PID of the foreground process.
+ * @brief Exit status of the last command line.
  */
-static pid_t foreground_pid = -1;
-
-/**
- * @brief File permissions for output redirection.
- */
-#define FILE_PERMISSIONS 0644
-
-/**
- * @brief Offset to get the next character after the last slash.
- */
-#define NEXT_CHAR 1
+static int last_status = 0;
 
 void signal_handler(int sig)
 {
-    if (foreground_pid > 0)
+    job* foreground = job_foreground();
+    if (foreground != NULL)
     {
-        kill(foreground_pid, sig);
+        job_signal(foreground, sig);
     }
 }
 
 void sigchld_handler(int sig)
 {
-    int saved_errno = errno;
-    pid_t pid;
-    int status;
-
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0)
-    {
-        if (WIFSTOPPED(status))
-        {
-            printf("Proceso con PID %d detenido\n", pid);
-            foreground_pid = -1;
-        }
-    }
-
-    errno = saved_errno;
+    (void)sig;
+    // Statuses are recorded in the job table and reported at the next prompt
+    jobs_reap(0);
 }
 
 void setup_signal_handlers()
@@ -141,6 +130,7 @@ int cd(const char* directory)
         perror("cd");
         return -1;
     }
+    prompt_invalidate(PROMPT_EVENT_CWD);
 
     // update OLDPWD
     if (oldpwd != NULL)
@@ -167,327 +157,267 @@ void clr(void)
     printf("\033[H\033[J");
 }
 
-int echo(const char* comment)
+/**
+ * @brief Writes every piece of `iov`, resuming after short writes.
+ *
+ * @return int 0 on success, -1 on error.
+ */
+static int write_pieces(int fd, struct iovec* iov, int count)
 {
-    char* env;
-    char* ptr = (char*)comment;
-    char* start = NULL;
-    char* end = NULL;
-    char* buffer = NULL;
-    size_t len = 0;
-
-    while (*ptr != '\0')
+    while (count > 0)
     {
-        if (*ptr == '$')
+        ssize_t written = writev(fd, iov, count);
+        if (written == -1)
         {
-            start = ptr + 1;
-            end = start;
-
-            while (*end != '\0' && *end != ' ')
+            if (errno == EINTR)
             {
-                end++;
+                continue;
             }
-
-            len = end - start;
-            buffer = (char*)malloc(len + 1);
-            if (buffer == NULL)
-            {
-                perror("malloc");
-                return -1;
-            }
-
-            strncpy(buffer, start, len);
-            buffer[len] = '\0';
-
-            env = getenv(buffer);
-            if (env != NULL)
-            {
-                printf("%s", env);
-            }
-            else
-            {
-                fprintf(stderr, "echo: %s: variable not set\n", buffer);
-            }
-
-            free(buffer);
-            ptr = end;
+            perror("writev");
+            return -1;
         }
-        else
+        while (count > 0 && (size_t)written >= iov->iov_len)
         {
-            printf("%c", *ptr);
-            ptr++;
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
         }
     }
-
-    printf("\n");
-
     return 0;
 }
 
+int echo(const char* comment)
+{
+    static expand_buffer text;
+    text.len = 0;
+    expand_heredoc(&text, comment, strlen(comment));
+
+    // Whatever stdio still holds was printed first
+    fflush(stdout);
+    struct iovec iov[2] = {{text.data, text.len}, {"\n", 1}};
+    return write_pieces(fileno(stdout), iov, 2);
+}
+
 void quit(void)
 {
     exit(0);
 }
 
-void execute_command(char* input)
+int type_command(char** args)
 {
-    const char* project_root = getenv("PROJECT_ROOT");
-    if (project_root == NULL)
-    {
-        fprintf(stderr, "Error: PROJECT_ROOT environment variable is not set.\n");
-        return;
-    }
-
-    // Remove the newline character from the input
-    input[strcspn(input, "\n")] = 0;
-
-    // Handle the 'togglepath' command
-    if (strcmp(input, "togglepath") == 0)
-    {
-        toggle_path_view();
-        return;
-    }
+    int status = 0;
 
-    // Handle the 'cd' command
-    if (strncmp(input, "cd", 2) == 0)
+    for (int i = 1; args[i] != NULL; i++)
     {
-        char* directory = input + 3;
-        cd(directory);
-        return;
-    }
+        if (control_find_function(args[i]) != NULL)
+        {
+            printf("%s is a function\n", args[i]);
+            continue;
+        }
+        if (builtin_find(args[i], strlen(args[i])) != NULL)
+        {
+            printf("%s is a shell builtin\n", args[i]);
+            continue;
+        }
 
-    // Handle the 'clr' command
-    if (strcmp(input, "clr") == 0)
-    {
-        clr();
-        return;
+        const char* cached = strchr(args[i], '/') == NULL ? path_cache_peek(args[i]) : NULL;
+        const char* path = cached != NULL ? cached : path_cache_resolve(args[i]);
+        if (path == NULL)
+        {
+            fprintf(stderr, "type: %s: not found\n", args[i]);
+            status = 1;
+        }
+        else if (cached != NULL)
+        {
+            printf("%s is hashed (%s)\n", args[i], path);
+        }
+        else
+        {
+            printf("%s is %s\n", args[i], path);
+        }
     }
+    return status;
+}
 
-    // Handle the 'quit' command
-    if (strcmp(input, "quit") == 0)
-    {
-        quit();
-        return;
-    }
+static int togglepath_builtin(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    toggle_path_view();
+    prompt_invalidate(PROMPT_EVENT_CWD);
+    return 0;
+}
 
-    // Handle the 'start_monitor' command
-    if (strcmp(input, "start_monitor") == 0)
-    {
-        start_monitor();
-        return;
-    }
+static int cd_builtin(int argc, char** argv)
+{
+    return cd(argc > 1 ? argv[1] : NULL) == 0 ? 0 : 1;
+}
 
-    // Handle the 'stop_monitor' command
-    if (strcmp(input, "stop_monitor") == 0)
-    {
-        stop_monitor();
-        return;
-    }
+static int clr_builtin(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    clr();
+    return 0;
+}
 
-    // Handle the 'update_monitor' command
-    if (strcmp(input, "update_monitor") == 0)
-    {
-        update_monitor();
-        return;
-    }
+static int quit_builtin(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    quit();
+    return 0;
+}
 
-    // Handle the 'status_monitor' command
-    if (strcmp(input, "status_monitor") == 0)
+static int echo_builtin(int argc, char** argv)
+{
+    // The arguments are already expanded: write them with single spaces, without copying them
+    fflush(stdout);
+    struct iovec iov[ECHO_IOV_BATCH];
+    int count = 0;
+    for (int i = 1; i < argc; i++)
     {
-        status_monitor();
-        return;
+        if (count + 2 > ECHO_IOV_BATCH)
+        {
+            if (write_pieces(fileno(stdout), iov, count) == -1)
+            {
+                return 1;
+            }
+            count = 0;
+        }
+        iov[count++] = (struct iovec){argv[i], strlen(argv[i])};
+        iov[count++] = (struct iovec){i + 1 < argc ? " " : "\n", 1};
     }
-
-    // Handle the 'config_monitor' command
-    if (strcmp(input, "config_monitor") == 0)
+    if (argc == 1)
     {
-        config_monitor();
-        return;
+        iov[count++] = (struct iovec){"\n", 1};
     }
+    return write_pieces(fileno(stdout), iov, count) == 0 ? 0 : 1;
+}
 
-    // Handle the 'search_config' command
-    if (strncmp(input, "search_config", 13) == 0) {
-        char* input_copy = strdup(input);
-        if (input_copy == NULL) {
-            perror("strdup");
-            return;
-        }
-
-        char* directory = strtok(input_copy + 14, " ");
-        char* extension = strtok(NULL, " ");
-        if (directory && extension) {
-            search_config_files(directory, extension);
-        } else {
-            fprintf(stderr, "Uso: search_config <directorio> <extensión>\n");
-        }
-
-        free(input_copy);
-        return;
-    }
+static int hash_builtin(int argc, char** argv)
+{
+    (void)argc;
+    return hash_command(argv);
+}
 
-    // Handle the 'list_config' command
-    if (strncmp(input, "list_config", 11) == 0) {
-        char* input_copy = strdup(input);
-        if (input_copy == NULL) {
-            perror("strdup");
-            return;
-        }
+static int type_builtin(int argc, char** argv)
+{
+    (void)argc;
+    return type_command(argv);
+}
 
-        char* directory = strtok(input_copy + 12, " ");
-        if (directory) {
-            list_config_files(directory);
-        } else {
-            fprintf(stderr, "Usage: list_config <directory>\n");
-        }
+static int test_builtin(int argc, char** argv)
+{
+    return conditional_evaluate(argv[0], argc - 1, argv + 1, 0);
+}
 
-        free(input_copy);
-        return;
-    }
-    
-    // Check for pipes
-    if (strchr(input, '|') != NULL)
+/**
+ * @brief Runs `[ expression ]` or `[[ expression ]]`, whose last word must close the bracket.
+ */
+static int bracket_builtin(int argc, char** argv)
+{
+    int extended = strcmp(argv[0], "[[") == 0;
+    const char* close = extended ? "]]" : "]";
+    if (strcmp(argv[argc - 1], close) != 0)
     {
-        execute_piped_commands(input);
-        return;
+        fprintf(stderr, "%s: missing `%s'\n", argv[0], close);
+        return CONDITIONAL_ERROR;
     }
+    return conditional_evaluate(argv[0], argc - 2, argv + 1, extended);
+}
 
-    // Check for redirections
-    char* input_file = NULL;
-    char* output_file = NULL;
-    char* command_part = input;
-    char* token;
-
-    // Identify redirections and separate the command part
-    while ((token = strpbrk(command_part, "<>")) != NULL)
+/**
+ * @brief Evaluates each argument as an arithmetic expression; the status tells whether the last one was non-zero.
+ */
+static int let_builtin(int argc, char** argv)
+{
+    int64_t value = 0;
+    for (int i = 1; i < argc; i++)
     {
-        if (*token == '<')
+        if (arith_evaluate(argv[i], strlen(argv[i]), &value) == -1)
         {
-            *token = '\0';
-            input_file = strtok(token + NEXT_CHAR, " ");
-        }
-        else if (*token == '>')
-        {
-            *token = '\0';
-            output_file = strtok(token + NEXT_CHAR, " ");
+            return 1;
         }
     }
+    return value != 0 ? 0 : 1;
+}
 
-    // Split the command part into arguments
-    char* args[INPUT_SIZE / 2 + 1];
-    int i = 0;
-    token = strtok(command_part, " ");
-    while (token != NULL)
-    {
-        args[i++] = token;
-        token = strtok(NULL, " ");
-    }
-    args[i] = NULL;
+/**
+ * @brief Builtins implemented in this module.
+ */
+static const builtin command_builtins[] = {
+    {"togglepath", togglepath_builtin, 0, 0, BUILTIN_SHELL_STATE, "togglepath"},
+    {"cd", cd_builtin, 0, 1, BUILTIN_SHELL_STATE, "cd <directory>"},
+    {"clr", clr_builtin, 0, 0, BUILTIN_PIPELINE_SAFE, "clr"},
+    {"quit", quit_builtin, 0, 0, BUILTIN_SHELL_STATE, "quit"},
+    {"echo", echo_builtin, 0, BUILTIN_ANY_ARGS, BUILTIN_PIPELINE_SAFE, "echo [word]..."},
+    {"hash", hash_builtin, 0, BUILTIN_ANY_ARGS, BUILTIN_PIPELINE_SAFE | BUILTIN_SHELL_STATE, "hash [-r] [name...]"},
+    {"type", type_builtin, 1, BUILTIN_ANY_ARGS, BUILTIN_PIPELINE_SAFE, "type name..."},
+    {"test", test_builtin, 0, BUILTIN_ANY_ARGS, BUILTIN_PIPELINE_SAFE, "test [expression]"},
+    {"[", bracket_builtin, 1, BUILTIN_ANY_ARGS, BUILTIN_PIPELINE_SAFE, "[ [expression] ]"},
+    {"let", let_builtin, 1, BUILTIN_ANY_ARGS, BUILTIN_PIPELINE_SAFE | BUILTIN_SHELL_STATE, "let expression..."},
+    {"[[", bracket_builtin, 1, BUILTIN_ANY_ARGS, BUILTIN_PIPELINE_SAFE, "[[ expression ]]"},
+};
+
+void commands_register_builtins(void)
+{
+    builtin_register(command_builtins, sizeof(command_builtins) / sizeof(command_builtins[0]));
+}
 
-    // Check if the command should be executed in the background
-    int background = 0;
-    if (i > 0 && strcmp(args[i - 1], "&") == 0)
-    {
-        background = 1;
-        args[i - 1] = NULL;
-    }
+int command_last_status(void)
+{
+    return last_status;
+}
 
-    // Handle redirection
-    int input_fd = -1;
-    int output_fd = -1;
-    if (input_file != NULL)
-    {
-        char absolute_input_file[PATH_MAX];
-        snprintf(absolute_input_file, sizeof(absolute_input_file), "%s/%s", project_root, input_file);
-        input_fd = open(absolute_input_file, O_RDONLY);
-        if (input_fd == -1)
-        {
-            perror("open input file");
-            return;
-        }
-    }
-    if (output_file != NULL)
+int execute_command_tree(arena* a, const node* root)
+{
+    last_status = execute_node(a, root);
+    prompt_invalidate(PROMPT_EVENT_STATUS);
+    return last_status;
+}
+
+parse_status execute_command_text(const char* text, size_t len)
+{
+    // Zero-initialized, which is the state arena_init() leaves
+    static arena line_arena;
+
+    const char* project_root = getenv("PROJECT_ROOT");
+    if (project_root == NULL)
     {
-        char absolute_output_file[PATH_MAX];
-        snprintf(absolute_output_file, sizeof(absolute_output_file), "%s/%s", project_root, output_file);
-        output_fd = open(absolute_output_file, O_WRONLY | O_CREAT | O_TRUNC, FILE_PERMISSIONS);
-        if (output_fd == -1)
-        {
-            perror("open output file");
-            return;
-        }
+        fprintf(stderr, "Error: PROJECT_ROOT environment variable is not set.\n");
+        return PARSE_ERROR;
     }
 
-    pid_t pid = fork();
-    if (pid == -1)
+    node* root = NULL;
+    uint64_t parse_start = stats_now();
+    parse_status status = parse_line(&line_arena, text, len, &root);
+    stats_record_since(STAT_PARSE, parse_start);
+    if (status == PARSE_OK)
     {
-        perror("fork");
-        return;
+        execute_command_tree(&line_arena, root);
     }
-    else if (pid == 0)
+    else if (status == PARSE_ERROR)
     {
-        // Redirect input and output if necessary
-        if (input_fd != -1)
-        {
-            if (dup2(input_fd, STDIN_FILENO) == -1)
-            {
-                perror("dup2 input");
-                exit(EXIT_FAILURE);
-            }
-            close(input_fd);
-        }
-        if (output_fd != -1)
-        {
-            if (dup2(output_fd, STDOUT_FILENO) == -1)
-            {
-                perror("dup2 output");
-                exit(EXIT_FAILURE);
-            }
-            close(output_fd);
-        }
+        last_status = SYNTAX_ERROR_STATUS;
+        expand_set_status(last_status);
+        prompt_invalidate(PROMPT_EVENT_STATUS);
+    }
 
-        // Handle the 'echo' command
-        if (strncmp(args[0], "echo", 4) == 0)
-        {
-            // Concatenate the remaining arguments to form the comment
-            char comment[INPUT_SIZE] = "";
-            for (int j = 1; args[j] != NULL; j++)
-            {
-                strcat(comment, args[j]);
-                if (args[j + 1] != NULL)
-                {
-                    strcat(comment, " ");
-                }
-            }
-            echo(comment);
-            exit(0);
-        }
+    // Everything the line needed lives in the arena
+    arena_reset(&line_arena);
+    return status;
+}
 
-        // Handle external commands
-        if (execvp(args[0], args) == -1)
-        {
-            perror("execvp");
-            exit(EXIT_FAILURE);
-        }
-    }
-    else
+void execute_command(char* input)
+{
+    if (execute_command_text(input, strlen(input)) == PARSE_INCOMPLETE)
     {
-        if (background)
-        {
-            printf("[%d] %d\n", job_id++, pid);
-        }
-        else
-        {
-            foreground_pid = pid; // Update the PID of the foreground process
-            int status;
-            if (waitpid(pid, &status, WUNTRACED) == -1)
-            {
-                perror("waitpid");
-            }
-            if (WIFSTOPPED(status))
-            {
-                printf("Proceso con PID %d detenido\n", pid);
-            }
-            foreground_pid = -1; // Restart the PID of the foreground process
-        }
+        fprintf(stderr, "syntax error: unexpected end of input\n");
     }
 }
@@ -0,0 +1,468 @@
+#define _GNU_SOURCE
+#include "complete.h"
+#include "builtins.h"
+#include "path_cache.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief `PATH` used when the variable is not set, as for execvp(3).
+ */
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+/**
+ * @brief Size of the buffer directory entries are read into.
+ */
+#define DIRENT_BUFFER_SIZE 32768
+
+/**
+ * @brief Size of the buffer inotify events are drained into.
+ */
+#define EVENT_BUFFER_SIZE 4096
+
+/**
+ * @brief Candidates allocated for a list at first.
+ */
+#define INITIAL_CAPACITY 64
+
+/**
+ * @brief Changes to a `PATH` directory that may add or remove an executable.
+ */
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/**
+ * @brief Characters that end a command and start another.
+ */
+#define COMMAND_SEPARATORS "|;&("
+
+/**
+ * @brief Characters that end a word.
+ */
+#define WORD_BREAKS " \t|;&()<>"
+
+/**
+ * @brief A directory entry as returned by getdents64(2).
+ */
+struct linux_dirent64
+{
+    uint64_t d_ino;          /**< Inode number. */
+    int64_t d_off;           /**< Offset of the next entry. */
+    unsigned short d_reclen; /**< Size of this entry. */
+    unsigned char d_type;    /**< File type, DT_UNKNOWN if the file system does not say. */
+    char d_name[];           /**< NUL terminated name. */
+};
+
+/**
+ * @brief Called for every entry of a directory; returns -1 to stop.
+ */
+typedef int (*entry_visitor)(int dir_fd, const char* name, unsigned char type, void* data);
+
+/**
+ * @brief The index: names of the `PATH` executables, sorted.
+ */
+static complete_list executables = {0};
+
+/**
+ * @brief The `PATH` the index was built from, or NULL before the first build.
+ */
+static char* indexed_path = NULL;
+
+/**
+ * @brief Whether a change was seen since the index was built.
+ */
+static int index_stale = 1;
+
+/**
+ * @brief inotify instance watching the `PATH` directories, or -1.
+ */
+static int inotify_fd = -1;
+
+/**
+ * @brief Builds of the index.
+ */
+static unsigned long scans = 0;
+
+void complete_list_init(complete_list* list)
+{
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    arena_init(&list->names);
+}
+
+void complete_list_free(complete_list* list)
+{
+    free(list->items);
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    arena_free(&list->names);
+}
+
+/**
+ * @brief Adds a candidate made of `len` bytes of `text` followed by `suffix`.
+ *
+ * @return int 0 on success, -1 on error.
+ */
+static int list_add(complete_list* list, const char* text, size_t len, const char* suffix)
+{
+    if (list->count == list->capacity)
+    {
+        size_t capacity = list->capacity == 0 ? INITIAL_CAPACITY : list->capacity * 2;
+        const char** grown = realloc(list->items, capacity * sizeof(*grown));
+        if (grown == NULL)
+        {
+            perror("realloc");
+            return -1;
+        }
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    size_t suffix_len = strlen(suffix);
+    char* copy = arena_alloc(&list->names, len + suffix_len + 1);
+    memcpy(copy, text, len);
+    memcpy(copy + len, suffix, suffix_len + 1);
+    list->items[list->count++] = copy;
+    return 0;
+}
+
+/**
+ * @brief Orders candidates for qsort(3).
+ */
+static int compare_names(const void* a, const void* b)
+{
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/**
+ * @brief Sorts the candidates and drops duplicates.
+ */
+static void list_sort(complete_list* list)
+{
+    if (list->count == 0)
+    {
+        return;
+    }
+    qsort(list->items, list->count, sizeof(*list->items), compare_names);
+    size_t kept = 1;
+    for (size_t i = 1; i < list->count; i++)
+    {
+        if (strcmp(list->items[i], list->items[kept - 1]) != 0)
+        {
+            list->items[kept++] = list->items[i];
+        }
+    }
+    list->count = kept;
+}
+
+/**
+ * @brief Calls `visit` for every entry of a directory but "." and "..", reading them with getdents64(2).
+ *
+ * @return int 0 on success, -1 if the directory cannot be read.
+ */
+static int for_each_entry(int dir_fd, entry_visitor visit, void* data)
+{
+    _Alignas(struct linux_dirent64) char buffer[DIRENT_BUFFER_SIZE];
+    while (1)
+    {
+        long n = syscall(SYS_getdents64, dir_fd, buffer, sizeof(buffer));
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return n == 0 ? 0 : -1;
+        }
+        for (long offset = 0; offset < n;)
+        {
+            const struct linux_dirent64* entry = (const struct linux_dirent64*)(buffer + offset);
+            offset += entry->d_reclen;
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            {
+                continue;
+            }
+            if (visit(dir_fd, name, entry->d_type, data) == -1)
+            {
+                return 0;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Adds an entry of a `PATH` directory to the index if it is an executable file.
+ */
+static int add_executable(int dir_fd, const char* name, unsigned char type, void* data)
+{
+    (void)data;
+    if (type != DT_REG && type != DT_LNK && type != DT_UNKNOWN)
+    {
+        return 0;
+    }
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, 0) == 0 && S_ISREG(st.st_mode) && (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)))
+    {
+        return list_add(&executables, name, strlen(name), "");
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads pending inotify events and marks the index stale if there were any.
+ *
+ * Commands whose directory changed are also dropped from the PATH cache, so
+ * that a binary installed earlier in `PATH` takes over right away.
+ */
+static void drain_events(void)
+{
+    if (inotify_fd == -1)
+    {
+        return;
+    }
+    _Alignas(struct inotify_event) char buffer[EVENT_BUFFER_SIZE];
+    ssize_t n;
+    while ((n = read(inotify_fd, buffer, sizeof(buffer))) > 0 || (n == -1 && errno == EINTR))
+    {
+        for (ssize_t offset = 0; offset < n;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+            offset += (ssize_t)(sizeof(*event) + event->len);
+            if (event->len > 0)
+            {
+                path_cache_forget(event->name);
+            }
+            else if (event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                path_cache_clear();
+            }
+            index_stale = 1;
+        }
+    }
+}
+
+/**
+ * @brief Watches every directory of `path_env` and lists its executables into the index.
+ */
+static void build_index(const char* path_env)
+{
+    free(indexed_path);
+    indexed_path = strdup(path_env);
+    executables.count = 0;
+    arena_reset(&executables.names);
+    if (inotify_fd != -1)
+    {
+        close(inotify_fd);
+    }
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1)
+    {
+        perror("inotify_init1");
+    }
+
+    // Watches come first: a change during the scan is seen by the next lookup
+    for (const char* dir = path_env; *dir != '\0';)
+    {
+        size_t len = strcspn(dir, ":");
+        char path[PATH_MAX];
+        // Relative entries depend on the working directory and are not indexed
+        if (dir[0] == '/' && len < sizeof(path))
+        {
+            memcpy(path, dir, len);
+            path[len] = '\0';
+            if (inotify_fd != -1)
+            {
+                inotify_add_watch(inotify_fd, path, WATCH_MASK | IN_ONLYDIR);
+            }
+            int dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dir_fd != -1)
+            {
+                for_each_entry(dir_fd, add_executable, NULL);
+                close(dir_fd);
+            }
+        }
+        dir += len;
+        dir += *dir == ':';
+    }
+    list_sort(&executables);
+    // Without inotify every lookup rescans
+    index_stale = inotify_fd == -1;
+    scans++;
+}
+
+/**
+ * @brief Adds the executables and builtins starting with `prefix`.
+ */
+static void complete_command(const char* prefix, size_t len, complete_list* list)
+{
+    const char* path_env = getenv("PATH");
+    if (path_env == NULL)
+    {
+        path_env = DEFAULT_PATH;
+    }
+    drain_events();
+    if (index_stale || indexed_path == NULL || strcmp(indexed_path, path_env) != 0)
+    {
+        build_index(path_env);
+    }
+
+    // The first name not before the prefix, then every name that starts with it
+    size_t low = 0;
+    size_t high = executables.count;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (strncmp(executables.items[mid], prefix, len) < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    for (size_t i = low; i < executables.count && strncmp(executables.items[i], prefix, len) == 0; i++)
+    {
+        list_add(list, executables.items[i], strlen(executables.items[i]), "");
+    }
+    for (size_t i = 0; i < builtin_count(); i++)
+    {
+        const char* name = builtin_get(i)->name;
+        if (strncmp(name, prefix, len) == 0)
+        {
+            list_add(list, name, strlen(name), "");
+        }
+    }
+}
+
+/**
+ * @brief What file completion looks for.
+ */
+typedef struct
+{
+    complete_list* list; /**< Where candidates go. */
+    const char* word;    /**< The word up to its last slash, kept in candidates. */
+    size_t dir_len;      /**< Length of that part. */
+    const char* prefix;  /**< What the names must start with. */
+    size_t prefix_len;   /**< Length of `prefix`. */
+} file_query;
+
+/**
+ * @brief Adds a directory entry that matches a file query.
+ */
+static int add_file(int dir_fd, const char* name, unsigned char type, void* data)
+{
+    const file_query* query = data;
+    if (strncmp(name, query->prefix, query->prefix_len) != 0 || (name[0] == '.' && query->prefix[0] != '.'))
+    {
+        return 0;
+    }
+    int is_dir = type == DT_DIR;
+    if (type == DT_LNK || type == DT_UNKNOWN)
+    {
+        struct stat st;
+        is_dir = fstatat(dir_fd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+    }
+    size_t name_len = strlen(name);
+    char candidate[PATH_MAX];
+    if (query->dir_len + name_len >= sizeof(candidate))
+    {
+        return 0;
+    }
+    memcpy(candidate, query->word, query->dir_len);
+    memcpy(candidate + query->dir_len, name, name_len);
+    return list_add(query->list, candidate, query->dir_len + name_len, is_dir ? "/" : "");
+}
+
+/**
+ * @brief Adds the files that complete `word`, which may name a directory and starts with `~/` for the home directory.
+ */
+static void complete_file(const char* word, size_t len, complete_list* list)
+{
+    const char* slash = memrchr(word, '/', len);
+    size_t dir_len = slash != NULL ? (size_t)(slash - word) + 1 : 0;
+    char dir[PATH_MAX];
+    const char* home = getenv("HOME");
+    int written;
+    if (dir_len == 0)
+    {
+        written = snprintf(dir, sizeof(dir), ".");
+    }
+    else if (word[0] == '~' && dir_len >= 2 && word[1] == '/' && home != NULL)
+    {
+        written = snprintf(dir, sizeof(dir), "%s/%.*s", home, (int)(dir_len - 2), word + 2);
+    }
+    else
+    {
+        written = snprintf(dir, sizeof(dir), "%.*s", (int)dir_len, word);
+    }
+    if (written < 0 || (size_t)written >= sizeof(dir))
+    {
+        return;
+    }
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1)
+    {
+        return;
+    }
+    file_query query = {list, word, dir_len, word + dir_len, len - dir_len};
+    for_each_entry(dir_fd, add_file, &query);
+    close(dir_fd);
+}
+
+size_t complete(const char* line, size_t pos, complete_list* list)
+{
+    size_t start = pos;
+    while (start > 0 && strchr(WORD_BREAKS, line[start - 1]) == NULL)
+    {
+        start--;
+    }
+    size_t before = start;
+    while (before > 0 && (line[before - 1] == ' ' || line[before - 1] == '\t'))
+    {
+        before--;
+    }
+    const char* word = line + start;
+    size_t len = pos - start;
+    int command_position = before == 0 || strchr(COMMAND_SEPARATORS, line[before - 1]) != NULL;
+
+    if (command_position && memchr(word, '/', len) == NULL)
+    {
+        complete_command(word, len, list);
+    }
+    else
+    {
+        complete_file(word, len, list);
+    }
+    list_sort(list);
+    return start;
+}
+
+unsigned long complete_path_scans(void)
+{
+    return scans;
+}
+
+void complete_shutdown(void)
+{
+    complete_list_free(&executables);
+    free(indexed_path);
+    indexed_path = NULL;
+    index_stale = 1;
+    if (inotify_fd != -1)
+    {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+}
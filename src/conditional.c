@@ -0,0 +1,346 @@
+#include "conditional.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Letters of the unary operators (`-e`, `-f`, ...).
+ */
+#define UNARY_OPERATORS "abcdefghknprstuwxzGLOS"
+
+/**
+ * @brief An expression being evaluated.
+ */
+typedef struct
+{
+    const char* name; /**< The command name, for error messages. */
+    char** argv;      /**< The words of the expression. */
+    int argc;         /**< The number of words. */
+    int pos;          /**< The next word to read. */
+    int extended;     /**< Non-zero for `[[`. */
+    int error;        /**< Non-zero once an error was reported. */
+} cond_parser;
+
+static int parse_or(cond_parser* cp);
+
+/**
+ * @brief Reports an error, once.
+ *
+ * @return int 0, the value of the failed expression.
+ */
+static int fail(cond_parser* cp, const char* subject, const char* message)
+{
+    if (!cp->error)
+    {
+        if (subject != NULL)
+        {
+            fprintf(stderr, "%s: %s: %s\n", cp->name, subject, message);
+        }
+        else
+        {
+            fprintf(stderr, "%s: %s\n", cp->name, message);
+        }
+        cp->error = 1;
+    }
+    cp->pos = cp->argc;
+    return 0;
+}
+
+/**
+ * @brief Checks whether the word at `index` exists and is `text`.
+ */
+static int word_is(const cond_parser* cp, int index, const char* text)
+{
+    return index < cp->argc && strcmp(cp->argv[index], text) == 0;
+}
+
+/**
+ * @brief Checks whether a word is a binary operator.
+ */
+static int is_binary(const cond_parser* cp, const char* word)
+{
+    static const char* const operators[] = {"=",   "==",  "!=",  "<",   ">",   "-eq", "-ne",
+                                            "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef"};
+    for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++)
+    {
+        if (strcmp(word, operators[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return cp->extended && strcmp(word, "=~") == 0;
+}
+
+/**
+ * @brief Checks whether a word is a unary operator.
+ */
+static int is_unary(const char* word)
+{
+    return word[0] == '-' && word[1] != '\0' && word[2] == '\0' && strchr(UNARY_OPERATORS, word[1]) != NULL;
+}
+
+/**
+ * @brief Reads an integer operand, with optional blanks around it.
+ */
+static long long integer(cond_parser* cp, const char* text)
+{
+    char* rest;
+    errno = 0;
+    long long value = strtoll(text, &rest, 10);
+    while (*rest == ' ' || *rest == '\t')
+    {
+        rest++;
+    }
+    if (rest == text || *rest != '\0' || errno == ERANGE)
+    {
+        return fail(cp, text, "integer expression expected");
+    }
+    return value;
+}
+
+/**
+ * @brief Compares modification times: negative if `a` is older than `b`.
+ */
+static int compare_mtime(const struct stat* a, const struct stat* b)
+{
+    if (a->st_mtim.tv_sec != b->st_mtim.tv_sec)
+    {
+        return a->st_mtim.tv_sec < b->st_mtim.tv_sec ? -1 : 1;
+    }
+    return (a->st_mtim.tv_nsec > b->st_mtim.tv_nsec) - (a->st_mtim.tv_nsec < b->st_mtim.tv_nsec);
+}
+
+/**
+ * @brief Evaluates `left op right`.
+ */
+static int binary(cond_parser* cp, const char* left, const char* op, const char* right)
+{
+    if (op[0] != '-')
+    {
+        if (strcmp(op, "=~") == 0)
+        {
+            regex_t regex;
+            if (regcomp(&regex, right, REG_EXTENDED | REG_NOSUB) != 0)
+            {
+                return fail(cp, right, "invalid regular expression");
+            }
+            int matches = regexec(&regex, left, 0, NULL, 0) == 0;
+            regfree(&regex);
+            return matches;
+        }
+        int negate = op[0] == '!';
+        if (op[0] == '<' || op[0] == '>')
+        {
+            int order = strcmp(left, right);
+            return op[0] == '<' ? order < 0 : order > 0;
+        }
+        int equal = cp->extended ? fnmatch(right, left, 0) == 0 : strcmp(left, right) == 0;
+        return equal != negate;
+    }
+
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0)
+    {
+        struct stat a;
+        struct stat b;
+        int has_a = fstatat(AT_FDCWD, left, &a, 0) == 0;
+        int has_b = fstatat(AT_FDCWD, right, &b, 0) == 0;
+        if (op[1] == 'e')
+        {
+            return has_a && has_b && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+        }
+        // A file is newer than one that does not exist
+        if (op[1] == 'n')
+        {
+            return has_a && (!has_b || compare_mtime(&a, &b) > 0);
+        }
+        return has_b && (!has_a || compare_mtime(&a, &b) < 0);
+    }
+
+    long long a = integer(cp, left);
+    long long b = integer(cp, right);
+    switch (op[1] << 8 | op[2])
+    {
+    case 'e' << 8 | 'q':
+        return a == b;
+    case 'n' << 8 | 'e':
+        return a != b;
+    case 'l' << 8 | 't':
+        return a < b;
+    case 'l' << 8 | 'e':
+        return a <= b;
+    case 'g' << 8 | 't':
+        return a > b;
+    default:
+        return a >= b;
+    }
+}
+
+/**
+ * @brief Evaluates `-op operand`.
+ */
+static int unary(cond_parser* cp, char op, const char* operand)
+{
+    switch (op)
+    {
+    case 'n':
+        return operand[0] != '\0';
+    case 'z':
+        return operand[0] == '\0';
+    case 't':
+        return isatty((int)integer(cp, operand));
+    case 'r':
+        return faccessat(AT_FDCWD, operand, R_OK, AT_EACCESS) == 0;
+    case 'w':
+        return faccessat(AT_FDCWD, operand, W_OK, AT_EACCESS) == 0;
+    case 'x':
+        return faccessat(AT_FDCWD, operand, X_OK, AT_EACCESS) == 0;
+    default:
+        break;
+    }
+
+    struct stat st;
+    int link = op == 'L' || op == 'h';
+    if (fstatat(AT_FDCWD, operand, &st, link ? AT_SYMLINK_NOFOLLOW : 0) == -1)
+    {
+        return 0;
+    }
+    switch (op)
+    {
+    case 'b':
+        return S_ISBLK(st.st_mode);
+    case 'c':
+        return S_ISCHR(st.st_mode);
+    case 'd':
+        return S_ISDIR(st.st_mode);
+    case 'f':
+        return S_ISREG(st.st_mode);
+    case 'g':
+        return (st.st_mode & S_ISGID) != 0;
+    case 'h':
+    case 'L':
+        return S_ISLNK(st.st_mode);
+    case 'k':
+        return (st.st_mode & S_ISVTX) != 0;
+    case 'p':
+        return S_ISFIFO(st.st_mode);
+    case 's':
+        return st.st_size > 0;
+    case 'u':
+        return (st.st_mode & S_ISUID) != 0;
+    case 'G':
+        return st.st_gid == getegid();
+    case 'O':
+        return st.st_uid == geteuid();
+    case 'S':
+        return S_ISSOCK(st.st_mode);
+    default:
+        // -a and -e: the file exists
+        return 1;
+    }
+}
+
+/**
+ * @brief Parses a primary: a binary or unary test, a parenthesized expression or a string.
+ */
+static int parse_primary(cond_parser* cp)
+{
+    int left = cp->argc - cp->pos;
+    if (left <= 0)
+    {
+        return fail(cp, NULL, "argument expected");
+    }
+    char** w = cp->argv + cp->pos;
+    // A binary operator wins, so that `[ -n = -n ]` compares two strings
+    if (left >= 3 && is_binary(cp, w[1]))
+    {
+        cp->pos += 3;
+        return binary(cp, w[0], w[1], w[2]);
+    }
+    if (left >= 2 && strcmp(w[0], "(") == 0)
+    {
+        cp->pos++;
+        int value = parse_or(cp);
+        if (!word_is(cp, cp->pos, ")"))
+        {
+            return fail(cp, NULL, "`)' expected");
+        }
+        cp->pos++;
+        return value;
+    }
+    if (left >= 2 && is_unary(w[0]))
+    {
+        cp->pos += 2;
+        return unary(cp, w[0][1], w[1]);
+    }
+    cp->pos++;
+    return w[0][0] != '\0';
+}
+
+/**
+ * @brief Parses `! expression`, or a primary.
+ */
+static int parse_not(cond_parser* cp)
+{
+    int left = cp->argc - cp->pos;
+    if (left >= 2 && word_is(cp, cp->pos, "!") && !(left >= 3 && is_binary(cp, cp->argv[cp->pos + 1])))
+    {
+        cp->pos++;
+        return !parse_not(cp);
+    }
+    return parse_primary(cp);
+}
+
+/**
+ * @brief Parses expressions joined by `-a` (`&&` for `[[`).
+ */
+static int parse_and(cond_parser* cp)
+{
+    const char* op = cp->extended ? "&&" : "-a";
+    int value = parse_not(cp);
+    while (word_is(cp, cp->pos, op))
+    {
+        cp->pos++;
+        // Both sides are parsed; only the needed one matters
+        int right = parse_not(cp);
+        value = value && right;
+    }
+    return value;
+}
+
+/**
+ * @brief Parses expressions joined by `-o` (`||` for `[[`).
+ */
+static int parse_or(cond_parser* cp)
+{
+    const char* op = cp->extended ? "||" : "-o";
+    int value = parse_and(cp);
+    while (word_is(cp, cp->pos, op))
+    {
+        cp->pos++;
+        int right = parse_and(cp);
+        value = value || right;
+    }
+    return value;
+}
+
+int conditional_evaluate(const char* name, int argc, char** argv, int extended)
+{
+    if (argc == 0)
+    {
+        // An empty expression is false
+        return 1;
+    }
+    cond_parser cp = {name, argv, argc, 0, extended, 0};
+    int value = parse_or(&cp);
+    if (!cp.error && cp.pos < argc)
+    {
+        fail(&cp, argv[cp.pos], "unexpected argument");
+    }
+    return cp.error ? CONDITIONAL_ERROR : !value;
+}
@@ -8,6 +8,7 @@
 #include <limits.h>
 #include <time.h>
 #include "config_search.h"
+#include "builtins.h"
 
 #define COLOR_RESET "\033[0m"
 #define COLOR_RED "\033[31m"
@@ -117,4 +118,28 @@ void search_config_files(const char *directory, const char *extension) {
         }
     }
     closedir(dir);
-}
\ No newline at end of file
+}
+
+static int search_config_builtin(int argc, char **argv) {
+    (void)argc;
+    search_config_files(argv[1], argv[2]);
+    return 0;
+}
+
+static int list_config_builtin(int argc, char **argv) {
+    (void)argc;
+    list_config_files(argv[1]);
+    return 0;
+}
+
+/**
+ * @brief Builtins exploring configuration files.
+ */
+static const builtin config_search_builtins[] = {
+    {"search_config", search_config_builtin, 2, 2, BUILTIN_PIPELINE_SAFE, "search_config <directory> <extension>"},
+    {"list_config", list_config_builtin, 1, 1, BUILTIN_PIPELINE_SAFE, "list_config <directory>"},
+};
+
+void config_search_register_builtins(void) {
+    builtin_register(config_search_builtins, sizeof(config_search_builtins) / sizeof(config_search_builtins[0]));
+}
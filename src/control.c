@@ -0,0 +1,525 @@
+#include "control.h"
+#include "builtins.h"
+#include "expand.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Initial number of entries in the function table.
+ */
+#define INITIAL_FUNCTIONS 8
+
+/**
+ * @brief What is unwinding the commands being run.
+ */
+typedef enum
+{
+    CONTROL_NONE,     /**< Nothing: commands run normally. */
+    CONTROL_BREAK,    /**< `break`: leaving `levels` loops. */
+    CONTROL_CONTINUE, /**< `continue`: leaving `levels - 1` loops, then the next iteration. */
+    CONTROL_RETURN,   /**< `return`: leaving the function. */
+} control_kind;
+
+/**
+ * @brief A shell function, owning a copy of its definition.
+ */
+typedef struct
+{
+    char* name;       /**< The function's name. */
+    arena memory;     /**< Holds the copied nodes and source text. */
+    const node* body; /**< The compound command run by a call. */
+} function;
+
+/**
+ * @brief Defined functions, searched linearly: scripts define few of them.
+ */
+static function* functions = NULL;
+
+/**
+ * @brief Number of entries in `functions`.
+ */
+static size_t num_functions = 0;
+
+/**
+ * @brief Number of entries allocated for `functions`.
+ */
+static size_t functions_capacity = 0;
+
+/**
+ * @brief Definitions replaced while a function was running, freed once no function is.
+ */
+static arena* retired = NULL;
+
+/**
+ * @brief Number of entries in `retired`.
+ */
+static size_t num_retired = 0;
+
+/**
+ * @brief What is unwinding, if anything.
+ */
+static control_kind pending = CONTROL_NONE;
+
+/**
+ * @brief Loops still to leave for the pending `break` or `continue`.
+ */
+static int levels = 0;
+
+/**
+ * @brief Status given to the pending `return`.
+ */
+static int return_status = 0;
+
+/**
+ * @brief Number of loops running in the current function (or outside any).
+ */
+static int loop_depth = 0;
+
+/**
+ * @brief Number of function calls running.
+ */
+static int function_depth = 0;
+
+/**
+ * @brief Maps words of the source text to the copy made for a function.
+ */
+typedef struct
+{
+    const char* from; /**< Start of the original text. */
+    char* to;         /**< Start of the copy. */
+} relocation;
+
+/**
+ * @brief Widens [`*start`, `*end`) to cover a word, if it has any text.
+ */
+static void extend_range(const word* w, const char** start, const char** end)
+{
+    if (w->start == NULL)
+    {
+        return;
+    }
+    if (*start == NULL || w->start < *start)
+    {
+        *start = w->start;
+    }
+    if (*end == NULL || w->start + w->len > *end)
+    {
+        *end = w->start + w->len;
+    }
+}
+
+static void redirections_range(const redirection* r, size_t count, const char** start, const char** end)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        extend_range(&r[i].target, start, end);
+        extend_range(&r[i].body, start, end);
+    }
+}
+
+/**
+ * @brief Finds the source text a tree points into, here-document bodies included.
+ */
+static void text_range(const node* n, const char** start, const char** end)
+{
+    if (n == NULL)
+    {
+        return;
+    }
+    switch (n->type)
+    {
+    case NODE_SIMPLE:
+        for (size_t i = 0; i < n->simple.num_words; i++)
+        {
+            extend_range(&n->simple.words[i], start, end);
+        }
+        for (size_t i = 0; i < n->simple.num_assignments; i++)
+        {
+            extend_range(&n->simple.assignments[i], start, end);
+        }
+        redirections_range(n->simple.redirections, n->simple.num_redirections, start, end);
+        break;
+    case NODE_PIPELINE:
+        for (size_t i = 0; i < n->pipeline.num_stages; i++)
+        {
+            text_range(n->pipeline.stages[i], start, end);
+        }
+        break;
+    case NODE_AND:
+    case NODE_OR:
+        text_range(n->binary.left, start, end);
+        text_range(n->binary.right, start, end);
+        break;
+    case NODE_LIST:
+        for (size_t i = 0; i < n->list.num_items; i++)
+        {
+            text_range(n->list.items[i].command, start, end);
+        }
+        break;
+    default:
+        text_range(n->compound.condition, start, end);
+        text_range(n->compound.body, start, end);
+        text_range(n->compound.else_part, start, end);
+        extend_range(&n->compound.source, start, end);
+        extend_range(&n->compound.name, start, end);
+        for (size_t i = 0; i < n->compound.num_words; i++)
+        {
+            extend_range(&n->compound.words[i], start, end);
+        }
+        for (size_t i = 0; i < n->compound.num_items; i++)
+        {
+            for (size_t j = 0; j < n->compound.items[i].num_patterns; j++)
+            {
+                extend_range(&n->compound.items[i].patterns[j], start, end);
+            }
+            text_range(n->compound.items[i].body, start, end);
+        }
+        redirections_range(n->compound.redirections, n->compound.num_redirections, start, end);
+        break;
+    }
+}
+
+static word relocate(const relocation* r, word w)
+{
+    if (w.start != NULL)
+    {
+        w.start = r->to + (w.start - r->from);
+    }
+    return w;
+}
+
+static word* copy_words(arena* a, const relocation* r, const word* words, size_t count)
+{
+    word* copy = arena_alloc(a, (count + 1) * sizeof(word));
+    for (size_t i = 0; i < count; i++)
+    {
+        copy[i] = relocate(r, words[i]);
+    }
+    return copy;
+}
+
+static redirection* copy_redirections(arena* a, const relocation* r, const redirection* redirections, size_t count)
+{
+    redirection* copy = arena_alloc(a, (count + 1) * sizeof(redirection));
+    for (size_t i = 0; i < count; i++)
+    {
+        copy[i] = redirections[i];
+        copy[i].target = relocate(r, redirections[i].target);
+        copy[i].body = relocate(r, redirections[i].body);
+    }
+    return copy;
+}
+
+/**
+ * @brief Copies a tree into an arena, pointing its words into the copied text.
+ */
+static node* copy_node(arena* a, const relocation* r, const node* n)
+{
+    if (n == NULL)
+    {
+        return NULL;
+    }
+    node* copy = arena_alloc(a, sizeof(node));
+    *copy = *n;
+    switch (n->type)
+    {
+    case NODE_SIMPLE:
+        copy->simple.words = copy_words(a, r, n->simple.words, n->simple.num_words);
+        copy->simple.assignments = copy_words(a, r, n->simple.assignments, n->simple.num_assignments);
+        copy->simple.redirections = copy_redirections(a, r, n->simple.redirections, n->simple.num_redirections);
+        break;
+    case NODE_PIPELINE:
+        copy->pipeline.stages = arena_alloc(a, n->pipeline.num_stages * sizeof(node*));
+        for (size_t i = 0; i < n->pipeline.num_stages; i++)
+        {
+            copy->pipeline.stages[i] = copy_node(a, r, n->pipeline.stages[i]);
+        }
+        break;
+    case NODE_AND:
+    case NODE_OR:
+        copy->binary.left = copy_node(a, r, n->binary.left);
+        copy->binary.right = copy_node(a, r, n->binary.right);
+        break;
+    case NODE_LIST:
+        copy->list.items = arena_alloc(a, (n->list.num_items + 1) * sizeof(list_item));
+        for (size_t i = 0; i < n->list.num_items; i++)
+        {
+            copy->list.items[i].command = copy_node(a, r, n->list.items[i].command);
+            copy->list.items[i].background = n->list.items[i].background;
+        }
+        break;
+    default:
+        copy->compound.condition = copy_node(a, r, n->compound.condition);
+        copy->compound.body = copy_node(a, r, n->compound.body);
+        copy->compound.else_part = copy_node(a, r, n->compound.else_part);
+        copy->compound.source = relocate(r, n->compound.source);
+        copy->compound.name = relocate(r, n->compound.name);
+        copy->compound.words = copy_words(a, r, n->compound.words, n->compound.num_words);
+        copy->compound.items = arena_alloc(a, (n->compound.num_items + 1) * sizeof(case_item));
+        for (size_t i = 0; i < n->compound.num_items; i++)
+        {
+            const case_item* item = &n->compound.items[i];
+            copy->compound.items[i].patterns = copy_words(a, r, item->patterns, item->num_patterns);
+            copy->compound.items[i].num_patterns = item->num_patterns;
+            copy->compound.items[i].body = copy_node(a, r, item->body);
+        }
+        copy->compound.redirections =
+            copy_redirections(a, r, n->compound.redirections, n->compound.num_redirections);
+        break;
+    }
+    return copy;
+}
+
+/**
+ * @brief Returns the entry of a function, or NULL if it is not defined.
+ */
+static function* find_function(const char* name, size_t len)
+{
+    for (size_t i = 0; i < num_functions; i++)
+    {
+        if (strncmp(functions[i].name, name, len) == 0 && functions[i].name[len] == '\0')
+        {
+            return &functions[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Releases a definition that a running function may still be executing, once it no longer can.
+ */
+static void retire(arena* memory)
+{
+    if (function_depth == 0)
+    {
+        arena_free(memory);
+        return;
+    }
+    arena* grown = realloc(retired, (num_retired + 1) * sizeof(arena));
+    if (grown == NULL)
+    {
+        // Leaked rather than freed under a running function
+        perror("realloc");
+        return;
+    }
+    retired = grown;
+    retired[num_retired++] = *memory;
+}
+
+int control_define_function(const node* definition)
+{
+    const word* name = &definition->compound.name;
+    function* f = find_function(name->start, name->len);
+    if (f == NULL)
+    {
+        if (num_functions == functions_capacity)
+        {
+            size_t new_capacity = functions_capacity == 0 ? INITIAL_FUNCTIONS : functions_capacity * 2;
+            function* grown = realloc(functions, new_capacity * sizeof(function));
+            if (grown == NULL)
+            {
+                perror("realloc");
+                return 1;
+            }
+            functions = grown;
+            functions_capacity = new_capacity;
+        }
+        f = &functions[num_functions];
+        f->name = strndup(name->start, name->len);
+        if (f->name == NULL)
+        {
+            perror("strndup");
+            return 1;
+        }
+        num_functions++;
+    }
+    else
+    {
+        retire(&f->memory);
+    }
+
+    arena_init(&f->memory);
+    const char* start = NULL;
+    const char* end = NULL;
+    text_range(definition->compound.body, &start, &end);
+    relocation r = {start, arena_strndup(&f->memory, start != NULL ? start : "", (size_t)(end - start))};
+    f->body = copy_node(&f->memory, &r, definition->compound.body);
+    return 0;
+}
+
+const node* control_find_function(const char* name)
+{
+    if (num_functions == 0)
+    {
+        // Most scripts define none: commands are not compared against anything
+        return NULL;
+    }
+    function* f = find_function(name, strlen(name));
+    return f != NULL ? f->body : NULL;
+}
+
+int control_pending(void)
+{
+    return pending != CONTROL_NONE;
+}
+
+void control_enter_loop(void)
+{
+    loop_depth++;
+}
+
+void control_leave_loop(void)
+{
+    loop_depth--;
+}
+
+int control_loop_stop(void)
+{
+    switch (pending)
+    {
+    case CONTROL_BREAK:
+        if (--levels == 0)
+        {
+            pending = CONTROL_NONE;
+        }
+        return 1;
+    case CONTROL_CONTINUE:
+        if (--levels == 0)
+        {
+            pending = CONTROL_NONE;
+            return 0;
+        }
+        return 1;
+    case CONTROL_RETURN:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+int control_enter_function(void)
+{
+    if (function_depth == CONTROL_MAX_FUNCTION_DEPTH)
+    {
+        fprintf(stderr, "maximum function nesting level exceeded (%d)\n", CONTROL_MAX_FUNCTION_DEPTH);
+        return -1;
+    }
+    int caller_loops = loop_depth;
+    loop_depth = 0;
+    function_depth++;
+    return caller_loops;
+}
+
+int control_leave_function(int caller_loops, int status)
+{
+    if (pending == CONTROL_RETURN)
+    {
+        pending = CONTROL_NONE;
+        status = return_status;
+    }
+    loop_depth = caller_loops;
+    if (--function_depth == 0)
+    {
+        for (size_t i = 0; i < num_retired; i++)
+        {
+            arena_free(&retired[i]);
+        }
+        num_retired = 0;
+    }
+    return status;
+}
+
+/**
+ * @brief Parses the optional numeric argument of break, continue and return.
+ *
+ * @return int 0 after reporting an invalid one, 1 otherwise.
+ */
+static int numeric_argument(int argc, char** argv, long fallback, long minimum, long* value)
+{
+    *value = fallback;
+    if (argc < 2)
+    {
+        return 1;
+    }
+    char* end = NULL;
+    *value = strtol(argv[1], &end, 10);
+    if (end == argv[1] || *end != '\0' || *value < minimum)
+    {
+        fprintf(stderr, "%s: %s: numeric argument required\n", argv[0], argv[1]);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief `break [n]` and `continue [n]`: leave the n innermost loops, or go on with the next iteration of the
+ * n-th one.
+ */
+static int loop_builtin(int argc, char** argv)
+{
+    long n;
+    if (!numeric_argument(argc, argv, 1, 1, &n))
+    {
+        return 1;
+    }
+    if (loop_depth == 0)
+    {
+        fprintf(stderr, "%s: only meaningful in a loop\n", argv[0]);
+        return 1;
+    }
+    pending = argv[0][0] == 'b' ? CONTROL_BREAK : CONTROL_CONTINUE;
+    levels = n < loop_depth ? (int)n : loop_depth;
+    return 0;
+}
+
+/**
+ * @brief `return [n]`: leaves the running function with status n, by default the last command's.
+ */
+static int return_builtin(int argc, char** argv)
+{
+    long n;
+    if (!numeric_argument(argc, argv, expand_status(), 0, &n))
+    {
+        return 1;
+    }
+    if (function_depth == 0)
+    {
+        fprintf(stderr, "%s: can only return from a function\n", argv[0]);
+        return 1;
+    }
+    pending = CONTROL_RETURN;
+    return_status = (int)(n & 0xff);
+    return return_status;
+}
+
+static int true_builtin(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    return 0;
+}
+
+static int false_builtin(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    return 1;
+}
+
+/**
+ * @brief Builtins implemented in this module.
+ */
+static const builtin control_builtins[] = {
+    {"break", loop_builtin, 0, 1, BUILTIN_SHELL_STATE, "break [n]"},
+    {"continue", loop_builtin, 0, 1, BUILTIN_SHELL_STATE, "continue [n]"},
+    {"return", return_builtin, 0, 1, BUILTIN_SHELL_STATE, "return [n]"},
+    {"true", true_builtin, 0, BUILTIN_ANY_ARGS, BUILTIN_PIPELINE_SAFE, "true"},
+    {"false", false_builtin, 0, BUILTIN_ANY_ARGS, BUILTIN_PIPELINE_SAFE, "false"},
+    {":", true_builtin, 0, BUILTIN_ANY_ARGS, BUILTIN_PIPELINE_SAFE, ":"},
+};
+
+void control_register_builtins(void)
+{
+    builtin_register(control_builtins, sizeof(control_builtins) / sizeof(control_builtins[0]));
+}
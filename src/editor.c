@@ -0,0 +1,792 @@
+#define _GNU_SOURCE
+#include "editor.h"
+#include "complete.h"
+#include "history.h"
+#include "stats.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+/**
+ * @brief The control key for a letter.
+ */
+#define CTRL_KEY(c) ((c) & 0x1f)
+
+/**
+ * @brief The escape key, which also starts terminal sequences.
+ */
+#define KEY_ESCAPE 27
+
+/**
+ * @brief The key most terminals send for Backspace.
+ */
+#define KEY_BACKSPACE 127
+
+/**
+ * @brief Bytes allocated for a line at first.
+ */
+#define INITIAL_CAPACITY 128
+
+/**
+ * @brief Keys decoded from escape sequences, outside the range of bytes.
+ */
+enum
+{
+    KEY_UP = 1000,
+    KEY_DOWN,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+};
+
+/**
+ * @brief The line being edited.
+ */
+typedef struct
+{
+    char* buf;            /**< The text, NUL terminated. */
+    size_t len;           /**< Length of the text. */
+    size_t capacity;      /**< Allocated bytes of `buf`. */
+    size_t pos;           /**< Cursor position, in bytes. */
+    const char* prompt;   /**< The prompt. */
+    size_t prompt_len;    /**< Length of `prompt`. */
+    size_t prompt_width;  /**< Columns the prompt takes. */
+    size_t history_index; /**< Entry shown, history_count() for the new line. */
+    char* saved;          /**< The new line while history entries are shown. */
+    int last_key;         /**< The key handled before this one. */
+} line_state;
+
+/**
+ * @brief Writes all of `len` bytes to standard output.
+ */
+static void write_all(const char* text, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(STDOUT_FILENO, text, len);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return;
+        }
+        text += n;
+        len -= (size_t)n;
+    }
+}
+
+/**
+ * @brief Returns whether a byte continues a UTF-8 character.
+ */
+static int is_continuation(char c)
+{
+    return ((unsigned char)c & 0xC0) == 0x80;
+}
+
+/**
+ * @brief Returns the columns `len` bytes of UTF-8 text take, one per character.
+ */
+static size_t text_width(const char* text, size_t len)
+{
+    size_t width = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        width += !is_continuation(text[i]);
+    }
+    return width;
+}
+
+/**
+ * @brief Returns the columns a prompt takes, skipping its escape sequences.
+ */
+static size_t prompt_width(const char* prompt, size_t len)
+{
+    size_t width = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (prompt[i] == KEY_ESCAPE && i + 1 < len && prompt[i + 1] == '[')
+        {
+            // CSI: parameters up to a final byte in @..~
+            i += 2;
+            while (i < len && (prompt[i] < '@' || prompt[i] > '~'))
+            {
+                i++;
+            }
+            continue;
+        }
+        width += !is_continuation(prompt[i]);
+    }
+    return width;
+}
+
+/**
+ * @brief Returns the width of the terminal.
+ */
+static size_t terminal_columns(void)
+{
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
+    {
+        return EDITOR_DEFAULT_COLUMNS;
+    }
+    return ws.ws_col;
+}
+
+/**
+ * @brief Reads a byte, retrying after signals.
+ *
+ * @return int The byte, or -1 at end of input or on error.
+ */
+static int read_byte(void)
+{
+    unsigned char c;
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, &c, 1)) == -1 && errno == EINTR)
+    {
+    }
+    return n == 1 ? c : -1;
+}
+
+/**
+ * @brief Reads a byte if one arrives within EDITOR_ESCAPE_TIMEOUT_MS.
+ *
+ * @return int The byte, or -1 if none came.
+ */
+static int read_byte_soon(void)
+{
+    struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    int ready;
+    while ((ready = poll(&pfd, 1, EDITOR_ESCAPE_TIMEOUT_MS)) == -1 && errno == EINTR)
+    {
+    }
+    return ready == 1 ? read_byte() : -1;
+}
+
+/**
+ * @brief Reads a key, decoding the escape sequences of arrows, Home, End and Delete.
+ *
+ * @return int The byte or KEY_* code, or -1 at end of input.
+ */
+static int read_key(void)
+{
+    int c = read_byte();
+    if (c != KEY_ESCAPE)
+    {
+        return c;
+    }
+    int first = read_byte_soon();
+    if (first != '[' && first != 'O')
+    {
+        return KEY_ESCAPE;
+    }
+    int second = read_byte_soon();
+    if (first == '[' && second >= '0' && second <= '9')
+    {
+        // ESC [ n ~
+        if (read_byte_soon() != '~')
+        {
+            return KEY_ESCAPE;
+        }
+        switch (second)
+        {
+        case '1':
+        case '7':
+            return KEY_HOME;
+        case '3':
+            return KEY_DELETE;
+        case '4':
+        case '8':
+            return KEY_END;
+        default:
+            return KEY_ESCAPE;
+        }
+    }
+    switch (second)
+    {
+    case 'A':
+        return KEY_UP;
+    case 'B':
+        return KEY_DOWN;
+    case 'C':
+        return KEY_RIGHT;
+    case 'D':
+        return KEY_LEFT;
+    case 'H':
+        return KEY_HOME;
+    case 'F':
+        return KEY_END;
+    default:
+        return KEY_ESCAPE;
+    }
+}
+
+/**
+ * @brief Makes room for `extra` more bytes.
+ *
+ * @return int 0 on success, -1 on error.
+ */
+static int reserve(line_state* s, size_t extra)
+{
+    if (s->len + extra + 1 <= s->capacity)
+    {
+        return 0;
+    }
+    size_t capacity = s->capacity;
+    while (s->len + extra + 1 > capacity)
+    {
+        capacity *= 2;
+    }
+    char* grown = realloc(s->buf, capacity);
+    if (grown == NULL)
+    {
+        perror("realloc");
+        return -1;
+    }
+    s->buf = grown;
+    s->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Replaces the text with `len` bytes of `text` and puts the cursor at its end.
+ */
+static void set_text(line_state* s, const char* text, size_t len)
+{
+    s->len = 0;
+    if (reserve(s, len) == -1)
+    {
+        s->buf[0] = '\0';
+        s->pos = 0;
+        return;
+    }
+    memcpy(s->buf, text, len);
+    s->len = len;
+    s->buf[len] = '\0';
+    s->pos = len;
+}
+
+/**
+ * @brief Redraws the prompt and the visible part of the line in a single write.
+ */
+static void refresh_line(const line_state* s)
+{
+    size_t columns = terminal_columns();
+    size_t available = columns > s->prompt_width + 1 ? columns - s->prompt_width - 1 : 1;
+
+    // Scroll so the cursor stays visible
+    size_t start = 0;
+    while (text_width(s->buf + start, s->pos - start) > available)
+    {
+        start++;
+        while (start < s->pos && is_continuation(s->buf[start]))
+        {
+            start++;
+        }
+    }
+    size_t end = start;
+    for (size_t width = 0; end < s->len;)
+    {
+        size_t next = end + 1;
+        while (next < s->len && is_continuation(s->buf[next]))
+        {
+            next++;
+        }
+        if (++width > available)
+        {
+            break;
+        }
+        end = next;
+    }
+
+    size_t size = s->prompt_len + (end - start) + 64;
+    char* out = malloc(size);
+    if (out == NULL)
+    {
+        return;
+    }
+    size_t len = 0;
+    out[len++] = '\r';
+    memcpy(out + len, s->prompt, s->prompt_len);
+    len += s->prompt_len;
+    memcpy(out + len, s->buf + start, end - start);
+    len += end - start;
+    len += (size_t)snprintf(out + len, size - len, "\x1b[0K\r");
+    size_t column = s->prompt_width + text_width(s->buf + start, s->pos - start);
+    if (column > 0)
+    {
+        len += (size_t)snprintf(out + len, size - len, "\x1b[%zuC", column);
+    }
+    write_all(out, len);
+    free(out);
+}
+
+/**
+ * @brief Inserts a byte at the cursor.
+ */
+static void insert_byte(line_state* s, char c)
+{
+    if (reserve(s, 1) == -1)
+    {
+        return;
+    }
+    memmove(s->buf + s->pos + 1, s->buf + s->pos, s->len - s->pos + 1);
+    s->buf[s->pos++] = c;
+    s->len++;
+}
+
+/**
+ * @brief Inserts `len` bytes of text at the cursor.
+ */
+static void insert_text(line_state* s, const char* text, size_t len)
+{
+    if (reserve(s, len) == -1)
+    {
+        return;
+    }
+    memmove(s->buf + s->pos + len, s->buf + s->pos, s->len - s->pos + 1);
+    memcpy(s->buf + s->pos, text, len);
+    s->pos += len;
+    s->len += len;
+}
+
+/**
+ * @brief Removes the bytes between `from` and `to` and puts the cursor at `from`.
+ */
+static void delete_range(line_state* s, size_t from, size_t to)
+{
+    memmove(s->buf + from, s->buf + to, s->len - to + 1);
+    s->len -= to - from;
+    s->pos = from;
+}
+
+/**
+ * @brief Returns the start of the character before `pos`.
+ */
+static size_t previous_char(const line_state* s, size_t pos)
+{
+    if (pos == 0)
+    {
+        return 0;
+    }
+    pos--;
+    while (pos > 0 && is_continuation(s->buf[pos]))
+    {
+        pos--;
+    }
+    return pos;
+}
+
+/**
+ * @brief Returns the start of the character after the one at `pos`.
+ */
+static size_t next_char(const line_state* s, size_t pos)
+{
+    if (pos >= s->len)
+    {
+        return s->len;
+    }
+    pos++;
+    while (pos < s->len && is_continuation(s->buf[pos]))
+    {
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Shows the history entry `index`, or the new line when it is history_count().
+ */
+static void show_history(line_state* s, size_t index)
+{
+    size_t count = history_count();
+    if (s->history_index == count && index != count)
+    {
+        free(s->saved);
+        s->saved = strdup(s->buf);
+    }
+    s->history_index = index;
+    if (index == count)
+    {
+        set_text(s, s->saved != NULL ? s->saved : "", s->saved != NULL ? strlen(s->saved) : 0);
+        return;
+    }
+    const history_entry* entry = history_get(index);
+    set_text(s, entry->text, entry->len);
+}
+
+/**
+ * @brief Draws the reverse search line.
+ */
+static void refresh_search(const char* query, size_t query_len, long match, int failing)
+{
+    const history_entry* entry = match >= 0 ? history_get((size_t)match) : NULL;
+    size_t size = query_len + (entry != NULL ? entry->len : 0) + 64;
+    char* out = malloc(size);
+    if (out == NULL)
+    {
+        return;
+    }
+    int len = snprintf(out, size, "\r%s`%.*s': %.*s\x1b[0K", failing ? "(failing reverse-i-search)" : "(reverse-i-search)",
+                       (int)query_len, query, entry != NULL ? (int)entry->len : 0, entry != NULL ? entry->text : "");
+    if (len > 0)
+    {
+        write_all(out, (size_t)len < size ? (size_t)len : size - 1);
+    }
+    free(out);
+}
+
+/**
+ * @brief Runs a reverse incremental search (Ctrl-R).
+ *
+ * Typing narrows the query, Ctrl-R again finds an older match and Backspace
+ * widens it. Ctrl-G or Ctrl-C restore the line; Escape keeps the match for
+ * editing; any other key keeps it and is then handled as usual.
+ *
+ * @return int The key that ended the search and must still be handled, or 0.
+ */
+static int reverse_search(line_state* s)
+{
+    char query[EDITOR_QUERY_MAX];
+    size_t query_len = 0;
+    long match = -1;
+    int failing = 0;
+    size_t count = history_count();
+    refresh_search(query, query_len, match, failing);
+    while (1)
+    {
+        int key = read_key();
+        if (key == CTRL_KEY('r'))
+        {
+            long older = match >= 0 ? history_search(query, query_len, (size_t)match) : -1;
+            failing = older < 0;
+            match = older >= 0 ? older : match;
+        }
+        else if (key == KEY_BACKSPACE || key == CTRL_KEY('h'))
+        {
+            if (query_len > 0)
+            {
+                query_len--;
+            }
+            match = history_search(query, query_len, count);
+            failing = match < 0 && query_len > 0;
+        }
+        else if (key >= ' ' && key < KEY_BACKSPACE && query_len < sizeof(query))
+        {
+            query[query_len++] = (char)key;
+            // The current match may still contain the longer query
+            long found = history_search(query, query_len, match >= 0 ? (size_t)match + 1 : count);
+            failing = found < 0;
+            match = found >= 0 ? found : match;
+        }
+        else if (key == CTRL_KEY('g') || key == CTRL_KEY('c') || key == -1)
+        {
+            refresh_line(s);
+            return key == -1 ? -1 : 0;
+        }
+        else
+        {
+            if (match >= 0)
+            {
+                const history_entry* entry = history_get((size_t)match);
+                set_text(s, entry->text, entry->len);
+                s->history_index = count;
+            }
+            refresh_line(s);
+            return key == KEY_ESCAPE ? 0 : key;
+        }
+        refresh_search(query, query_len, match, failing);
+    }
+}
+
+/**
+ * @brief Returns the part of a candidate that is listed: its last path component.
+ */
+static const char* candidate_name(const char* item)
+{
+    size_t len = strlen(item);
+    // A directory keeps its trailing slash
+    const char* slash = len > 1 ? memrchr(item, '/', len - 1) : NULL;
+    return slash != NULL ? slash + 1 : item;
+}
+
+/**
+ * @brief Prints the candidates of a completion in columns, below the line.
+ */
+static void show_candidates(const complete_list* list)
+{
+    size_t width = 0;
+    size_t size = 1;
+    for (size_t i = 0; i < list->count; i++)
+    {
+        size_t len = strlen(candidate_name(list->items[i]));
+        width = len > width ? len : width;
+        size += len + 1;
+    }
+    width += 2;
+    size_t columns = terminal_columns() / width;
+    columns = columns > 0 ? columns : 1;
+    size_t rows = (list->count + columns - 1) / columns;
+    char* out = malloc(size + list->count * width + rows);
+    if (out == NULL)
+    {
+        return;
+    }
+    size_t len = 0;
+    out[len++] = '\n';
+    for (size_t row = 0; row < rows; row++)
+    {
+        // Down the columns, as ls(1) does
+        for (size_t column = 0; column < columns; column++)
+        {
+            size_t i = column * rows + row;
+            if (i >= list->count)
+            {
+                break;
+            }
+            const char* name = candidate_name(list->items[i]);
+            size_t name_len = strlen(name);
+            memcpy(out + len, name, name_len);
+            len += name_len;
+            if (column + 1 < columns && i + rows < list->count)
+            {
+                memset(out + len, ' ', width - name_len);
+                len += width - name_len;
+            }
+        }
+        out[len++] = '\n';
+    }
+    write_all(out, len);
+    free(out);
+}
+
+/**
+ * @brief Completes the word before the cursor (Tab).
+ *
+ * A single candidate replaces the word, followed by a space unless it is a
+ * directory. Several candidates extend the word to their common prefix; when
+ * there is none to add, a second Tab lists them.
+ */
+static void complete_word(line_state* s)
+{
+    uint64_t start_time = stats_now();
+    complete_list list;
+    complete_list_init(&list);
+    size_t start = complete(s->buf, s->pos, &list);
+    stats_record_since(STAT_COMPLETE, start_time);
+
+    size_t typed = s->pos - start;
+    size_t common = list.count > 0 ? strlen(list.items[0]) : 0;
+    for (size_t i = 1; i < list.count; i++)
+    {
+        size_t same = 0;
+        while (same < common && list.items[i][same] == list.items[0][same])
+        {
+            same++;
+        }
+        common = same;
+    }
+
+    if (list.count == 0)
+    {
+        write_all("\a", 1);
+    }
+    else if (common > typed || list.count == 1)
+    {
+        delete_range(s, start, s->pos);
+        insert_text(s, list.items[0], common);
+        if (list.count == 1 && list.items[0][common - 1] != '/')
+        {
+            insert_byte(s, ' ');
+        }
+    }
+    else if (s->last_key == '\t')
+    {
+        show_candidates(&list);
+    }
+    else
+    {
+        write_all("\a", 1);
+    }
+    complete_list_free(&list);
+}
+
+int editor_usable(void)
+{
+    const char* term = getenv("TERM");
+    return isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) && (term == NULL || strcmp(term, "dumb") != 0);
+}
+
+/**
+ * @brief Handles one key.
+ *
+ * @return int 1 when the line is complete, -1 at end of input, 0 to keep editing.
+ */
+static int handle_key(line_state* s, int key)
+{
+    switch (key)
+    {
+    case -1:
+        return -1;
+    case '\r':
+    case '\n':
+        return 1;
+    case CTRL_KEY('c'):
+        write_all("^C", 2);
+        set_text(s, "", 0);
+        return 1;
+    case CTRL_KEY('d'):
+        if (s->len == 0)
+        {
+            return -1;
+        }
+        delete_range(s, s->pos, next_char(s, s->pos));
+        break;
+    case KEY_DELETE:
+        delete_range(s, s->pos, next_char(s, s->pos));
+        break;
+    case KEY_BACKSPACE:
+    case CTRL_KEY('h'):
+        delete_range(s, previous_char(s, s->pos), s->pos);
+        break;
+    case KEY_LEFT:
+    case CTRL_KEY('b'):
+        s->pos = previous_char(s, s->pos);
+        break;
+    case KEY_RIGHT:
+    case CTRL_KEY('f'):
+        s->pos = next_char(s, s->pos);
+        break;
+    case KEY_HOME:
+    case CTRL_KEY('a'):
+        s->pos = 0;
+        break;
+    case KEY_END:
+    case CTRL_KEY('e'):
+        s->pos = s->len;
+        break;
+    case CTRL_KEY('k'):
+        delete_range(s, s->pos, s->len);
+        break;
+    case CTRL_KEY('u'):
+        delete_range(s, 0, s->pos);
+        break;
+    case CTRL_KEY('w'):
+    {
+        size_t from = s->pos;
+        while (from > 0 && s->buf[from - 1] == ' ')
+        {
+            from--;
+        }
+        while (from > 0 && s->buf[from - 1] != ' ')
+        {
+            from--;
+        }
+        delete_range(s, from, s->pos);
+        break;
+    }
+    case KEY_UP:
+    case CTRL_KEY('p'):
+        if (s->history_index > 0)
+        {
+            show_history(s, s->history_index - 1);
+        }
+        break;
+    case KEY_DOWN:
+    case CTRL_KEY('n'):
+        if (s->history_index < history_count())
+        {
+            show_history(s, s->history_index + 1);
+        }
+        break;
+    case '\t':
+        complete_word(s);
+        break;
+    case CTRL_KEY('l'):
+        write_all("\x1b[H\x1b[2J", 7);
+        break;
+    case CTRL_KEY('r'):
+    {
+        int next = reverse_search(s);
+        return next != 0 ? handle_key(s, next) : 0;
+    }
+    default:
+        if (key >= ' ' && key < KEY_BACKSPACE)
+        {
+            insert_byte(s, (char)key);
+        }
+        else if (key > KEY_BACKSPACE && key < KEY_UP)
+        {
+            // Bytes of UTF-8 characters
+            insert_byte(s, (char)key);
+        }
+        break;
+    }
+    refresh_line(s);
+    return 0;
+}
+
+char* editor_read_line(const char* prompt, size_t prompt_len)
+{
+    struct termios saved;
+    if (tcgetattr(STDIN_FILENO, &saved) == -1)
+    {
+        perror("tcgetattr");
+        return NULL;
+    }
+    struct termios raw = saved;
+    raw.c_iflag &= ~(tcflag_t)(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    // Ctrl-C and Ctrl-Z are keys while editing; output processing stays on
+    raw.c_lflag &= ~(tcflag_t)(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == -1)
+    {
+        perror("tcsetattr");
+        return NULL;
+    }
+
+    line_state s = {0};
+    s.capacity = INITIAL_CAPACITY;
+    s.buf = malloc(s.capacity);
+    if (s.buf == NULL)
+    {
+        perror("malloc");
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &saved);
+        return NULL;
+    }
+    s.buf[0] = '\0';
+    s.prompt = prompt;
+    s.prompt_len = prompt_len;
+    s.prompt_width = prompt_width(prompt, prompt_len);
+    s.history_index = history_count();
+
+    // Whatever was printed before (job notices) must come first
+    fflush(stdout);
+    refresh_line(&s);
+    int result = 0;
+    while (result == 0)
+    {
+        int key = read_key();
+        result = handle_key(&s, key);
+        s.last_key = key;
+    }
+    write_all("\n", 1);
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &saved);
+    free(s.saved);
+    if (result == -1)
+    {
+        free(s.buf);
+        return NULL;
+    }
+    return s.buf;
+}
@@ -0,0 +1,935 @@
+#include "executor.h"
+#include "builtins.h"
+#include "commands.h"
+#include "control.h"
+#include "expand.h"
+#include "forkserver.h"
+#include "heredoc.h"
+#include "jobs.h"
+#include "pipe.h"
+#include "policy.h"
+#include "stats.h"
+#include "timing.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <signal.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/**
+ * @brief File permissions for output redirection.
+ */
+#define FILE_PERMISSIONS 0644
+
+extern char** environ;
+
+/**
+ * @brief The word a `for` loop without `in` iterates over.
+ */
+static const word all_arguments = {"\"$@\"", 4};
+
+/**
+ * @brief Checks whether a word of `[[` is an operator matching its left side against a pattern.
+ */
+static int is_pattern_operator(const word* w)
+{
+    return (w->len == 1 && w->start[0] == '=') ||
+           (w->len == 2 && (memcmp(w->start, "==", 2) == 0 || memcmp(w->start, "!=", 2) == 0));
+}
+
+char** build_argv(arena* a, const node* command)
+{
+    const word* words = command->simple.words;
+    size_t num_words = command->simple.num_words;
+    expand_take_error();
+    char** argv;
+    if (words[0].len != 2 || memcmp(words[0].start, "[[", 2) != 0)
+    {
+        size_t argc;
+        argv = expand_fields(a, words, num_words, &argc);
+    }
+    else
+    {
+        // The words of `[[` are not split: an empty operand stays an operand
+        argv = arena_alloc(a, (num_words + 1) * sizeof(char*));
+        for (size_t i = 0; i < num_words; i++)
+        {
+            // The right side of = == != is a pattern, whose quoted parts match literally
+            argv[i] = i > 0 && is_pattern_operator(&words[i - 1])
+                          ? expand_pattern_arena(a, words[i].start, words[i].len)
+                          : expand_word_arena(a, words[i].start, words[i].len);
+        }
+        argv[num_words] = NULL;
+    }
+    return expand_take_error() ? NULL : argv;
+}
+
+/**
+ * @brief Returns the length of the `NAME` part of a `NAME=value` word.
+ */
+static size_t assignment_name_length(const word* w)
+{
+    return (size_t)((const char*)memchr(w->start, '=', w->len) - w->start);
+}
+
+/**
+ * @brief Builds the `NAME=value` string of an assignment with its value expanded.
+ */
+static char* assignment_string(arena* a, const word* w)
+{
+    size_t name_len = assignment_name_length(w);
+    char* value = expand_word_arena(a, w->start + name_len + 1, w->len - name_len - 1);
+    size_t value_len = strlen(value);
+    char* result = arena_alloc(a, name_len + value_len + 2);
+    memcpy(result, w->start, name_len + 1);
+    memcpy(result + name_len + 1, value, value_len + 1);
+    return result;
+}
+
+char** build_envp(arena* a, const node* command)
+{
+    size_t num_assignments = command->simple.num_assignments;
+    if (num_assignments == 0)
+    {
+        return NULL;
+    }
+
+    size_t env_count = 0;
+    while (environ[env_count] != NULL)
+    {
+        env_count++;
+    }
+
+    char** envp = arena_alloc(a, (env_count + num_assignments + 1) * sizeof(char*));
+    size_t n = 0;
+    for (size_t i = 0; i < env_count; i++)
+    {
+        // Drop variables the command overrides
+        int overridden = 0;
+        for (size_t j = 0; j < num_assignments && !overridden; j++)
+        {
+            const word* w = &command->simple.assignments[j];
+            size_t name_len = assignment_name_length(w);
+            overridden = strncmp(environ[i], w->start, name_len + 1) == 0;
+        }
+        if (!overridden)
+        {
+            envp[n++] = environ[i];
+        }
+    }
+    for (size_t j = 0; j < num_assignments; j++)
+    {
+        envp[n++] = assignment_string(a, &command->simple.assignments[j]);
+    }
+    envp[n] = NULL;
+    return envp;
+}
+
+/**
+ * @brief Sets the variables of a command made only of assignments (`NAME=value`).
+ */
+static int apply_assignments(arena* a, const node* command)
+{
+    expand_take_error();
+    for (size_t i = 0; i < command->simple.num_assignments; i++)
+    {
+        char* assignment = assignment_string(a, &command->simple.assignments[i]);
+        if (expand_take_error())
+        {
+            return 1;
+        }
+        char* equals = strchr(assignment, '=');
+        *equals = '\0';
+        if (expand_assign(assignment, equals + 1) == -1)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void close_redirections(const int* opened, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        close(opened[i]);
+    }
+}
+
+/**
+ * @brief Opens the target of a redirection, or the text of a here-document, close-on-exec.
+ *
+ * @return int The descriptor, or -1 on error (reported on stderr).
+ */
+static int open_target(arena* a, const redirection* r)
+{
+    if (r->type == REDIR_HEREDOC || r->type == REDIR_HERESTRING)
+    {
+        return heredoc_open(r);
+    }
+    const char* project_root = getenv("PROJECT_ROOT");
+    char* target = expand_word_arena(a, r->target.start, r->target.len);
+    char path[PATH_MAX];
+    if (target[0] != '/' && project_root != NULL)
+    {
+        snprintf(path, sizeof(path), "%s/%s", project_root, target);
+    }
+    else
+    {
+        snprintf(path, sizeof(path), "%s", target);
+    }
+
+    int fd;
+    if (r->type == REDIR_INPUT)
+    {
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    else
+    {
+        int mode = r->type == REDIR_APPEND ? O_APPEND : O_TRUNC;
+        fd = open(path, O_WRONLY | O_CREAT | mode | O_CLOEXEC, FILE_PERMISSIONS);
+    }
+    if (fd == -1)
+    {
+        perror(r->type == REDIR_INPUT ? "open input file" : "open output file");
+    }
+    return fd;
+}
+
+int open_redirections(arena* a, const node* command, launch_spec* spec, int* opened)
+{
+    int count = 0;
+
+    for (size_t i = 0; i < command->simple.num_redirections; i++)
+    {
+        const redirection* r = &command->simple.redirections[i];
+        int fd = open_target(a, r);
+        if (fd == -1)
+        {
+            close_redirections(opened, count);
+            return -1;
+        }
+        opened[count++] = fd;
+        if (spec != NULL && launch_spec_add_dup2(spec, fd, r->fd) == -1)
+        {
+            close_redirections(opened, count);
+            return -1;
+        }
+    }
+    return count;
+}
+
+void restore_shell_fds(const saved_fd* saved, int count)
+{
+    // Whatever the command wrote must reach the redirection target, not the restored descriptor
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = count - 1; i >= 0; i--)
+    {
+        if (saved[i].saved != -1)
+        {
+            dup2(saved[i].saved, saved[i].fd);
+            close(saved[i].saved);
+        }
+        else
+        {
+            close(saved[i].fd);
+        }
+    }
+    clearerr(stdin);
+}
+
+int redirect_shell_fds(arena* a, const redirection* redirections, size_t num_redirections, saved_fd* saved)
+{
+    fflush(stdout);
+    fflush(stderr);
+
+    // One redirection at a time: opening the next target can then never land on
+    // a descriptor an earlier redirection already set up.
+    int count = 0;
+    for (size_t i = 0; i < num_redirections; i++)
+    {
+        const redirection* r = &redirections[i];
+        int fd = open_target(a, r);
+        if (fd == -1)
+        {
+            restore_shell_fds(saved, count);
+            return -1;
+        }
+        if (fd == r->fd)
+        {
+            // The descriptor was closed and open() reused it: close it again afterwards
+            saved[count].fd = r->fd;
+            saved[count].saved = -1;
+            count++;
+            fcntl(fd, F_SETFD, 0);
+            continue;
+        }
+
+        saved[count].fd = r->fd;
+        saved[count].saved = fcntl(r->fd, F_DUPFD_CLOEXEC, SAVED_FD_MIN);
+        if (saved[count].saved == -1 && errno != EBADF)
+        {
+            perror("fcntl");
+            close(fd);
+            restore_shell_fds(saved, count);
+            return -1;
+        }
+        count++;
+        if (dup2(fd, r->fd) == -1)
+        {
+            perror("dup2");
+            close(fd);
+            restore_shell_fds(saved, count);
+            return -1;
+        }
+        close(fd);
+    }
+    return count;
+}
+
+/**
+ * @brief Widens [`*start`, `*end`) to cover a word.
+ */
+static void extend_span(const word* w, const char** start, const char** end)
+{
+    if (*start == NULL || w->start < *start)
+    {
+        *start = w->start;
+    }
+    if (*end == NULL || w->start + w->len > *end)
+    {
+        *end = w->start + w->len;
+    }
+}
+
+void node_span(const node* n, const char** start, const char** end)
+{
+    switch (n->type)
+    {
+    case NODE_SIMPLE:
+        for (size_t i = 0; i < n->simple.num_assignments; i++)
+        {
+            extend_span(&n->simple.assignments[i], start, end);
+        }
+        for (size_t i = 0; i < n->simple.num_words; i++)
+        {
+            extend_span(&n->simple.words[i], start, end);
+        }
+        for (size_t i = 0; i < n->simple.num_redirections; i++)
+        {
+            extend_span(&n->simple.redirections[i].target, start, end);
+        }
+        break;
+    case NODE_PIPELINE:
+        for (size_t i = 0; i < n->pipeline.num_stages; i++)
+        {
+            node_span(n->pipeline.stages[i], start, end);
+        }
+        break;
+    case NODE_AND:
+    case NODE_OR:
+        node_span(n->binary.left, start, end);
+        node_span(n->binary.right, start, end);
+        break;
+    case NODE_LIST:
+        for (size_t i = 0; i < n->list.num_items; i++)
+        {
+            node_span(n->list.items[i].command, start, end);
+        }
+        break;
+    default:
+        extend_span(&n->compound.source, start, end);
+        for (size_t i = 0; i < n->compound.num_redirections; i++)
+        {
+            extend_span(&n->compound.redirections[i].target, start, end);
+        }
+        break;
+    }
+}
+
+job* register_job(const node* n, const pid_t* pids, size_t num_pids, int background)
+{
+    const char* start = NULL;
+    const char* end = NULL;
+    node_span(n, &start, &end);
+
+    job* j = job_create(start, start != NULL ? (size_t)(end - start) : 0, !background);
+    for (size_t i = 0; i < num_pids; i++)
+    {
+        // The first process leads the job's process group
+        job_add_process(j, pids[i], pids[0]);
+    }
+    if (background)
+    {
+        job_announce(j);
+    }
+    return j;
+}
+
+int track_job(const node* n, const pid_t* pids, size_t num_pids, int background)
+{
+    job* j = register_job(n, pids, num_pids, background);
+    return background ? 0 : job_wait(j);
+}
+
+/**
+ * @brief Forks a copy of the shell set up like a launched command: its own job table, `spec`'s
+ * process group and descriptors, default signals.
+ *
+ * @return pid_t 0 in the child, the child's PID in the parent, or -1 on error.
+ */
+static pid_t fork_shell(const launch_spec* spec, const int* close_fds, int num_close)
+{
+    // Anything still buffered would otherwise be written by both processes
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("fork");
+        return -1;
+    }
+    else if (pid == 0)
+    {
+        jobs_forget_all();
+        forkserver_detach();
+        if (spec->pgid != LAUNCH_PGID_INHERIT)
+        {
+            setpgid(0, spec->pgid);
+        }
+        if (spec->policy != NULL && launch_policy_apply(spec->policy) == -1)
+        {
+            perror("policy");
+            exit(EXIT_FAILURE);
+        }
+        // Behave like an external command: default signals, nothing blocked
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+
+        // Redirect input and output if necessary
+        for (int i = 0; i < spec->num_actions; i++)
+        {
+            if (dup2(spec->actions[i].fd, spec->actions[i].target_fd) == -1)
+            {
+                perror("dup2");
+                exit(EXIT_FAILURE);
+            }
+        }
+        // There is no exec to close them, and open pipe ends would hold off EOF for other stages
+        close_redirections(close_fds, num_close);
+        return 0;
+    }
+    if (spec->pgid != LAUNCH_PGID_INHERIT)
+    {
+        // Also set from the parent, so the group exists before anyone signals it
+        setpgid(pid, spec->pgid);
+    }
+    return pid;
+}
+
+pid_t fork_builtin(const builtin* cmd, char** argv, const launch_spec* spec, const int* close_fds, int num_close)
+{
+    pid_t pid = fork_shell(spec, close_fds, num_close);
+    if (pid == 0)
+    {
+        int argc = 0;
+        while (argv[argc] != NULL)
+        {
+            argc++;
+        }
+        int status = builtin_run(cmd, argc, argv);
+        fflush(stdout);
+        exit(status);
+    }
+    return pid;
+}
+
+pid_t fork_subshell(arena* a, const node* n, const launch_spec* spec, const int* close_fds, int num_close)
+{
+    pid_t pid = fork_shell(spec, close_fds, num_close);
+    if (pid == 0)
+    {
+        int status = execute_node(a, n);
+        fflush(stdout);
+        exit(status);
+    }
+    return pid;
+}
+
+/**
+ * @brief Runs `n` in a forked copy of the shell and reports it as a background job.
+ */
+static int run_in_background_subshell(arena* a, const node* n)
+{
+    const launch_policy* policy = policy_background();
+    sigset_t old;
+    jobs_block_sigchld(&old);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("fork");
+        jobs_restore_sigmask(&old);
+        return 1;
+    }
+    else if (pid == 0)
+    {
+        // The subshell waits for its own children only
+        jobs_forget_all();
+        forkserver_detach();
+        setpgid(0, 0);
+        if (policy != NULL && launch_policy_apply(policy) == -1)
+        {
+            perror("policy");
+            exit(EXIT_FAILURE);
+        }
+        jobs_restore_sigmask(&old);
+        int status = execute_node(a, n);
+        fflush(stdout);
+        exit(status);
+    }
+    setpgid(pid, pid);
+    int status = track_job(n, &pid, 1, 1);
+    jobs_restore_sigmask(&old);
+    return status;
+}
+
+/**
+ * @brief The `NAME=value` prefixes of a command run in the shell, exported while it runs.
+ */
+typedef struct
+{
+    char** names; /**< The variables set. */
+    char** saved; /**< Their previous values, NULL for those that were not set. */
+    size_t count; /**< Number of entries in `names` and `saved`. */
+} exported_prefixes;
+
+/**
+ * @brief Exports the `NAME=value` prefixes of a command, saving the values they replace.
+ */
+static void export_prefixes(arena* a, const node* command, exported_prefixes* e)
+{
+    e->count = command->simple.num_assignments;
+    e->names = arena_alloc(a, (e->count + 1) * sizeof(char*));
+    e->saved = arena_alloc(a, (e->count + 1) * sizeof(char*));
+
+    for (size_t i = 0; i < e->count; i++)
+    {
+        char* assignment = assignment_string(a, &command->simple.assignments[i]);
+        char* equals = strchr(assignment, '=');
+        *equals = '\0';
+        const char* old = getenv(assignment);
+        e->names[i] = assignment;
+        e->saved[i] = old != NULL ? arena_strndup(a, old, strlen(old)) : NULL;
+        setenv(assignment, equals + 1, 1);
+    }
+}
+
+/**
+ * @brief Puts back the variables export_prefixes() replaced.
+ */
+static void restore_prefixes(const exported_prefixes* e)
+{
+    for (size_t i = 0; i < e->count; i++)
+    {
+        if (e->saved[i] != NULL)
+        {
+            setenv(e->names[i], e->saved[i], 1);
+        }
+        else
+        {
+            unsetenv(e->names[i]);
+        }
+    }
+}
+
+int run_builtin(arena* a, const builtin* cmd, const node* command, char** argv)
+{
+    exported_prefixes prefixes;
+    export_prefixes(a, command, &prefixes);
+
+    int argc = 0;
+    while (argv[argc] != NULL)
+    {
+        argc++;
+    }
+    uint64_t builtin_start = stats_now();
+    int status = builtin_run(cmd, argc, argv);
+    stats_record_since(STAT_BUILTIN, builtin_start);
+
+    restore_prefixes(&prefixes);
+    return status;
+}
+
+/**
+ * @brief Calls a shell function in the shell process, with `argv` as its positional parameters.
+ */
+static int call_function(arena* a, const node* body, const node* command, char** argv)
+{
+    int caller_loops = control_enter_function();
+    if (caller_loops == -1)
+    {
+        return 1;
+    }
+    int argc = 0;
+    while (argv[argc] != NULL)
+    {
+        argc++;
+    }
+    exported_prefixes prefixes;
+    export_prefixes(a, command, &prefixes);
+    expand_positional previous;
+    expand_push_positional(argv + 1, argc - 1, &previous);
+    size_t scope = expand_push_scope();
+
+    int status = execute_node(a, body);
+
+    expand_pop_scope(scope);
+    expand_pop_positional(&previous);
+    restore_prefixes(&prefixes);
+    return control_leave_function(caller_loops, status);
+}
+
+/**
+ * @brief Runs a function (or else a builtin) in a forked copy of the shell, with the argument vector
+ * already expanded: for a background call, or one that needs its own scheduling policy.
+ *
+ * @return pid_t The child's PID, or -1 on error.
+ */
+static pid_t fork_call(arena* a, const node* function, const builtin* cmd, const node* command, char** argv,
+                       const launch_spec* spec, const int* close_fds, int num_close)
+{
+    pid_t pid = fork_shell(spec, close_fds, num_close);
+    if (pid == 0)
+    {
+        int status = function != NULL ? call_function(a, function, command, argv) : run_builtin(a, cmd, command, argv);
+        fflush(stdout);
+        exit(status);
+    }
+    return pid;
+}
+
+/**
+ * @brief Runs a single command, in the foreground or in the background.
+ */
+static int execute_simple(arena* a, const node* command, int background)
+{
+    expand_take_substitution_status();
+    char** argv = NULL;
+    if (command->simple.num_words > 0 && (argv = build_argv(a, command)) == NULL)
+    {
+        // A failed expansion fails the command without running it
+        return 1;
+    }
+    if (argv == NULL || argv[0] == NULL)
+    {
+        // Only assignments and redirections: set the variables, create the files
+        int* opened = arena_alloc(a, (command->simple.num_redirections + 1) * sizeof(int));
+        int count = open_redirections(a, command, NULL, opened);
+        if (count == -1)
+        {
+            return 1;
+        }
+        close_redirections(opened, count);
+        int status = apply_assignments(a, command);
+        // `x=$(cmd)` exits with the status of cmd
+        int substituted = expand_take_substitution_status();
+        return status == 0 && substituted != -1 ? substituted : status;
+    }
+
+    launch_policy policy;
+    argv = policy_strip_prefixes(argv, &policy);
+    if (argv == NULL)
+    {
+        return 2;
+    }
+    if (background)
+    {
+        policy_merge(&policy, policy_background());
+    }
+
+    const node* function = control_find_function(argv[0]);
+    const builtin* cmd = function == NULL ? builtin_find(argv[0], strlen(argv[0])) : NULL;
+    // A scheduling policy must not stick to the shell, and a background call runs beside it: both are
+    // forked below, without expanding the words again
+    if ((function != NULL || cmd != NULL) && policy.flags == 0 && !background)
+    {
+        // No fork: redirect the shell's own descriptors around the builtin or function
+        saved_fd* saved = arena_alloc(a, (command->simple.num_redirections + 1) * sizeof(saved_fd));
+        int count = redirect_shell_fds(a, command->simple.redirections, command->simple.num_redirections, saved);
+        if (count == -1)
+        {
+            return 1;
+        }
+        int status = function != NULL ? call_function(a, function, command, argv) : run_builtin(a, cmd, command, argv);
+        restore_shell_fds(saved, count);
+        return status;
+    }
+
+    launch_spec spec;
+    launch_spec_init(&spec, argv);
+    expand_take_error();
+    spec.envp = build_envp(a, command);
+    if (expand_take_error())
+    {
+        return 1;
+    }
+    spec.pgid = 0;
+    spec.policy = policy.flags != 0 ? &policy : NULL;
+
+    int* opened = arena_alloc(a, (command->simple.num_redirections + 1) * sizeof(int));
+    int count = open_redirections(a, command, &spec, opened);
+    if (count == -1)
+    {
+        return 1;
+    }
+
+    sigset_t old;
+    jobs_block_sigchld(&old);
+    uint64_t spawn_start = stats_now();
+    pid_t pid = function != NULL || cmd != NULL ? fork_call(a, function, cmd, command, argv, &spec, opened, count)
+                                                : launch_command(&spec);
+    stats_record_since(STAT_SPAWN, spawn_start);
+
+    // The child owns its copies of the redirection targets now
+    close_redirections(opened, count);
+
+    int status = pid != -1 ? track_job(command, &pid, 1, background) : STATUS_NOT_FOUND;
+    jobs_restore_sigmask(&old);
+    return status;
+}
+
+/**
+ * @brief Runs `if`: the body when the condition succeeds, else the else part.
+ */
+static int execute_if(arena* a, const node* n)
+{
+    int status = execute_node(a, n->compound.condition);
+    if (control_pending())
+    {
+        return status;
+    }
+    if (status == 0)
+    {
+        return execute_node(a, n->compound.body);
+    }
+    return n->compound.else_part != NULL ? execute_node(a, n->compound.else_part) : 0;
+}
+
+/**
+ * @brief Runs `while` or `until`, reusing the arena memory of each iteration for the next one.
+ */
+static int execute_while(arena* a, const node* n)
+{
+    int status = 0;
+    arena_mark mark = arena_get_mark(a);
+    control_enter_loop();
+    while (1)
+    {
+        arena_rewind(a, mark);
+        int condition = execute_node(a, n->compound.condition);
+        if (control_loop_stop() || (condition == 0) != (n->type == NODE_WHILE))
+        {
+            break;
+        }
+        status = execute_node(a, n->compound.body);
+        if (control_loop_stop())
+        {
+            break;
+        }
+    }
+    control_leave_loop();
+    return status;
+}
+
+/**
+ * @brief Runs `for`, assigning each field of the words (or each positional parameter) to the variable in turn.
+ */
+static int execute_for(arena* a, const node* n)
+{
+    size_t count;
+    char** values = n->compound.has_words ? expand_fields(a, n->compound.words, n->compound.num_words, &count)
+                                          : expand_fields(a, &all_arguments, 1, &count);
+    char* name = arena_strndup(a, n->compound.name.start, n->compound.name.len);
+
+    int status = 0;
+    arena_mark mark = arena_get_mark(a);
+    control_enter_loop();
+    for (size_t i = 0; i < count; i++)
+    {
+        arena_rewind(a, mark);
+        if (expand_set(name, values[i]) == -1)
+        {
+            status = 1;
+            break;
+        }
+        status = execute_node(a, n->compound.body);
+        if (control_loop_stop())
+        {
+            break;
+        }
+    }
+    control_leave_loop();
+    return status;
+}
+
+/**
+ * @brief Runs `case`: the body of the first item with a pattern matching the subject.
+ */
+static int execute_case(arena* a, const node* n)
+{
+    char* subject = expand_word_arena(a, n->compound.name.start, n->compound.name.len);
+    for (size_t i = 0; i < n->compound.num_items; i++)
+    {
+        const case_item* item = &n->compound.items[i];
+        for (size_t j = 0; j < item->num_patterns; j++)
+        {
+            char* pattern = expand_pattern_arena(a, item->patterns[j].start, item->patterns[j].len);
+            if (fnmatch(pattern, subject, 0) == 0)
+            {
+                return execute_node(a, item->body);
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs a compound command in the shell process, or defines a function.
+ *
+ * Redirections of the compound command apply to everything it runs.
+ */
+static int execute_compound(arena* a, const node* n)
+{
+    if (n->type == NODE_FUNCTION)
+    {
+        return control_define_function(n);
+    }
+
+    saved_fd* saved = arena_alloc(a, (n->compound.num_redirections + 1) * sizeof(saved_fd));
+    int count = n->compound.num_redirections > 0
+                    ? redirect_shell_fds(a, n->compound.redirections, n->compound.num_redirections, saved)
+                    : 0;
+    if (count == -1)
+    {
+        return 1;
+    }
+
+    int status;
+    switch (n->type)
+    {
+    case NODE_IF:
+        status = execute_if(a, n);
+        break;
+    case NODE_WHILE:
+    case NODE_UNTIL:
+        status = execute_while(a, n);
+        break;
+    case NODE_FOR:
+        status = execute_for(a, n);
+        break;
+    case NODE_CASE:
+        status = execute_case(a, n);
+        break;
+    default:
+        status = execute_node(a, n->compound.body);
+        break;
+    }
+
+    if (n->compound.num_redirections > 0)
+    {
+        restore_shell_fds(saved, count);
+    }
+    return status;
+}
+
+/**
+ * @brief Runs one command of a pipeline: a simple command, a compound command or a function definition.
+ */
+static int execute_stage(arena* a, const node* command, int background)
+{
+    if (command->type == NODE_SIMPLE)
+    {
+        return execute_simple(a, command, background);
+    }
+    if (background && command->type != NODE_FUNCTION)
+    {
+        return run_in_background_subshell(a, command);
+    }
+    return execute_compound(a, command);
+}
+
+/**
+ * @brief Runs a pipeline, handing multi-stage pipelines to execute_piped_commands().
+ */
+static int execute_pipeline(arena* a, const node* pipeline, int background)
+{
+    if (pipeline->pipeline.timed != TIME_NONE && !background)
+    {
+        time_mark mark;
+        time_mark_start(&mark);
+        int status = pipeline->pipeline.num_stages == 1 ? execute_stage(a, pipeline->pipeline.stages[0], 0)
+                                                        : execute_piped_commands(a, pipeline, 0);
+        time_report(stderr, &mark, pipeline, status);
+        return status;
+    }
+    if (pipeline->pipeline.num_stages == 1)
+    {
+        return execute_stage(a, pipeline->pipeline.stages[0], background);
+    }
+    return execute_piped_commands(a, pipeline, background);
+}
+
+int execute_node(arena* a, const node* n)
+{
+    int status = 0;
+
+    switch (n->type)
+    {
+    case NODE_SIMPLE:
+        return execute_simple(a, n, 0);
+    case NODE_PIPELINE:
+        return execute_pipeline(a, n, 0);
+    case NODE_AND:
+        status = execute_node(a, n->binary.left);
+        expand_set_status(status);
+        return status == 0 && !control_pending() ? execute_node(a, n->binary.right) : status;
+    case NODE_OR:
+        status = execute_node(a, n->binary.left);
+        expand_set_status(status);
+        return status != 0 && !control_pending() ? execute_node(a, n->binary.right) : status;
+    case NODE_LIST:
+        // A break, continue or return skips the rest of the list
+        for (size_t i = 0; i < n->list.num_items && !control_pending(); i++)
+        {
+            const list_item* item = &n->list.items[i];
+            if (!item->background)
+            {
+                status = execute_node(a, item->command);
+            }
+            else if (item->command->type == NODE_PIPELINE)
+            {
+                status = execute_pipeline(a, item->command, 1);
+            }
+            else
+            {
+                status = run_in_background_subshell(a, item->command);
+            }
+            // `$?` in the next command sees this one's status
+            expand_set_status(status);
+        }
+        return status;
+    default:
+        return execute_compound(a, n);
+    }
+}
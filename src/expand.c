@@ -0,0 +1,1181 @@
+#include "expand.h"
+#include "arith.h"
+#include "builtins.h"
+#include "lexer.h"
+#include "substitute.h"
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief Initial number of slots in the variable table (a power of two).
+ */
+#define INITIAL_CAPACITY 32
+
+/**
+ * @brief The table grows once more than LOAD_NUMERATOR / LOAD_DENOMINATOR of its slots are used.
+ */
+#define LOAD_NUMERATOR 7
+
+/**
+ * @brief Denominator of the maximum load factor.
+ */
+#define LOAD_DENOMINATOR 10
+
+/**
+ * @brief FNV-1a 64 bit offset basis.
+ */
+#define FNV_OFFSET 14695981039346656037ULL
+
+/**
+ * @brief FNV-1a 64 bit prime.
+ */
+#define FNV_PRIME 1099511628211ULL
+
+/**
+ * @brief Room for the decimal text of an int or a pid, with its sign and NUL.
+ */
+#define NUMBER_TEXT_MAX 24
+
+/**
+ * @brief Initial number of entries in the stack of values saved by `local` inside functions.
+ */
+#define INITIAL_SAVED_CAPACITY 8
+
+/**
+ * @brief Characters unquoted expansions are split at.
+ */
+#define FIELD_SEPARATORS " \t\n"
+
+/**
+ * @brief Characters fnmatch(3) treats as pattern syntax, escaped when they come from quotes.
+ */
+#define PATTERN_CHARACTERS "*?[\\"
+
+/**
+ * @brief What `$0` expands to.
+ */
+#define SHELL_NAME "myshell"
+
+extern char** environ;
+
+/**
+ * @brief Where a piece of text being expanded appears, which decides what is special in it.
+ */
+typedef enum
+{
+    CONTEXT_WORD,    /**< An unquoted part of a word: quotes are removed. */
+    CONTEXT_QUOTED,  /**< Inside double quotes. */
+    CONTEXT_HEREDOC, /**< The body of a here-document: quotes are plain text. */
+} context;
+
+/**
+ * @brief Fields being cut out of words by expand_fields().
+ *
+ * Finished fields are NUL terminated in the output buffer, one after the other.
+ */
+typedef struct
+{
+    size_t count; /**< Number of finished fields. */
+    int pending;  /**< Non-zero if the field being built must be kept, even if empty (it was quoted). */
+} field_state;
+
+/**
+ * @brief The state of a variable before `local` changed it inside a function.
+ */
+typedef struct
+{
+    char* name;      /**< The variable's name. */
+    char* value;     /**< Its value as a shell variable, or NULL if it was not one. */
+    char* env_value; /**< Its value in the environment, or NULL if it was not exported. */
+} saved_variable;
+
+/**
+ * @brief A shell variable, not exported to the commands the shell starts.
+ */
+typedef struct
+{
+    char* name;       /**< NUL terminated name, NULL for an empty slot. */
+    size_t name_len;  /**< Length of the name. */
+    char* value;      /**< NUL terminated value. */
+    size_t value_len; /**< Length of the value. */
+} variable;
+
+/**
+ * @brief Open addressing table of the shell variables, with linear probing.
+ */
+static variable* table = NULL;
+
+/**
+ * @brief Number of slots in `table`.
+ */
+static size_t capacity = 0;
+
+/**
+ * @brief Number of used slots in `table`.
+ */
+static size_t count = 0;
+
+/**
+ * @brief Exit status of the last command, which `$?` expands to.
+ */
+static int last_status = 0;
+
+/**
+ * @brief Text of the exit status `$?` expands to.
+ */
+static char status_text[NUMBER_TEXT_MAX] = "0";
+
+/**
+ * @brief Process ID `$$` expands to, 0 until expand_init() runs.
+ */
+static pid_t shell_pid = 0;
+
+/**
+ * @brief Positional parameters `$1`, `$2`... of the running function.
+ */
+static char** positional = NULL;
+
+/**
+ * @brief Number of entries in `positional`.
+ */
+static int num_positional = 0;
+
+/**
+ * @brief Number of function scopes entered; `local` only saves variables inside one.
+ */
+static int scope_depth = 0;
+
+/**
+ * @brief Variables to restore when function scopes end, innermost last.
+ */
+static saved_variable* saved = NULL;
+
+/**
+ * @brief Number of entries in `saved`.
+ */
+static size_t num_saved = 0;
+
+/**
+ * @brief Number of entries allocated for `saved`.
+ */
+static size_t saved_capacity = 0;
+
+/**
+ * @brief Reused by expand_word_arena(), so expanding arguments allocates nothing once it has grown.
+ */
+static expand_buffer scratch;
+
+/**
+ * @brief A scratch buffer lent to substituted commands while the caller's is in use, kept to be reused.
+ */
+static expand_buffer spare_scratch;
+
+/**
+ * @brief Receives the output of command substitutions, kept to be reused.
+ */
+static expand_buffer spare_output;
+
+/**
+ * @brief Exit status of the last command substitution since expand_take_substitution_status(), or -1.
+ */
+static int substitution_status = -1;
+
+/**
+ * @brief Non-zero once an expansion failed, until expand_take_error().
+ */
+static int expansion_error = 0;
+
+/**
+ * @brief Non-zero while expanding a pattern: quoted text is escaped to match literally.
+ */
+static int quoting_pattern = 0;
+
+void expand_buffer_reserve(expand_buffer* b, size_t len)
+{
+    if (b->len + len + 1 > b->capacity)
+    {
+        size_t new_capacity = b->capacity == 0 ? EXPAND_INITIAL_CAPACITY : b->capacity;
+        while (new_capacity < b->len + len + 1)
+        {
+            new_capacity *= 2;
+        }
+        char* data = realloc(b->data, new_capacity);
+        if (data == NULL)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        b->data = data;
+        b->capacity = new_capacity;
+    }
+}
+
+void expand_buffer_append(expand_buffer* b, const char* text, size_t len)
+{
+    expand_buffer_reserve(b, len);
+    memcpy(b->data + b->len, text, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+void expand_buffer_free(expand_buffer* b)
+{
+    free(b->data);
+    b->data = NULL;
+    b->len = 0;
+    b->capacity = 0;
+}
+
+static uint64_t hash_name(const char* name, size_t len)
+{
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief Returns the slot holding a variable, or the empty slot where it would go.
+ */
+static size_t find_slot(const char* name, size_t len)
+{
+    size_t mask = capacity - 1;
+    size_t i = hash_name(name, len) & mask;
+    while (table[i].name != NULL && (table[i].name_len != len || memcmp(table[i].name, name, len) != 0))
+    {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/**
+ * @brief Returns a shell variable, or NULL if there is none with that name.
+ */
+static variable* find_variable(const char* name, size_t len)
+{
+    if (count == 0)
+    {
+        return NULL;
+    }
+    variable* v = &table[find_slot(name, len)];
+    return v->name != NULL ? v : NULL;
+}
+
+static int grow_table(void)
+{
+    size_t new_capacity = capacity == 0 ? INITIAL_CAPACITY : capacity * 2;
+    variable* new_table = calloc(new_capacity, sizeof(variable));
+    if (new_table == NULL)
+    {
+        perror("calloc");
+        return -1;
+    }
+
+    variable* old_table = table;
+    size_t old_capacity = capacity;
+    table = new_table;
+    capacity = new_capacity;
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_table[i].name != NULL)
+        {
+            table[find_slot(old_table[i].name, old_table[i].name_len)] = old_table[i];
+        }
+    }
+    free(old_table);
+    return 0;
+}
+
+/**
+ * @brief Creates or updates a shell variable.
+ */
+static int set_variable(const char* name, const char* value)
+{
+    size_t name_len = strlen(name);
+    if ((count + 1) * LOAD_DENOMINATOR > capacity * LOAD_NUMERATOR && grow_table() == -1)
+    {
+        return -1;
+    }
+    size_t value_len = strlen(value);
+    char* copy = malloc(value_len + 1);
+    if (copy == NULL)
+    {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(copy, value, value_len + 1);
+
+    variable* v = &table[find_slot(name, name_len)];
+    if (v->name == NULL)
+    {
+        v->name = strdup(name);
+        if (v->name == NULL)
+        {
+            perror("strdup");
+            free(copy);
+            return -1;
+        }
+        v->name_len = name_len;
+        count++;
+    }
+    free(v->value);
+    v->value = copy;
+    v->value_len = value_len;
+    return 0;
+}
+
+/**
+ * @brief Removes a shell variable, if there is one.
+ */
+static void unset_variable(const char* name)
+{
+    size_t len = strlen(name);
+    if (find_variable(name, len) == NULL)
+    {
+        return;
+    }
+
+    size_t mask = capacity - 1;
+    size_t i = find_slot(name, len);
+    free(table[i].name);
+    free(table[i].value);
+    table[i].name = NULL;
+    table[i].value = NULL;
+    count--;
+
+    // Backward shift deletion keeps probe sequences intact without tombstones
+    size_t j = i;
+    while (1)
+    {
+        j = (j + 1) & mask;
+        if (table[j].name == NULL)
+        {
+            break;
+        }
+        size_t home = hash_name(table[j].name, table[j].name_len) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            table[i] = table[j];
+            table[j].name = NULL;
+            table[j].value = NULL;
+            i = j;
+        }
+    }
+}
+
+const char* expand_lookup(const char* name, size_t len, size_t* value_len)
+{
+    variable* v = find_variable(name, len);
+    if (v != NULL)
+    {
+        *value_len = v->value_len;
+        return v->value;
+    }
+    // Compared in place: the name needs no NUL terminated copy
+    for (char** entry = environ; entry != NULL && *entry != NULL; entry++)
+    {
+        if (strncmp(*entry, name, len) == 0 && (*entry)[len] == '=')
+        {
+            const char* value = *entry + len + 1;
+            *value_len = strlen(value);
+            return value;
+        }
+    }
+    return NULL;
+}
+
+int expand_assign(const char* name, const char* value)
+{
+    if (expand_is_local(name))
+    {
+        return set_variable(name, value);
+    }
+    if (setenv(name, value, 1) == -1)
+    {
+        perror("setenv");
+        return -1;
+    }
+    return 0;
+}
+
+int expand_set(const char* name, const char* value)
+{
+    if (getenv(name) == NULL)
+    {
+        return set_variable(name, value);
+    }
+    if (setenv(name, value, 1) == -1)
+    {
+        perror("setenv");
+        return -1;
+    }
+    return 0;
+}
+
+int expand_is_local(const char* name)
+{
+    return find_variable(name, strlen(name)) != NULL;
+}
+
+int expand_take_substitution_status(void)
+{
+    int status = substitution_status;
+    substitution_status = -1;
+    return status;
+}
+
+int expand_take_error(void)
+{
+    int error = expansion_error;
+    expansion_error = 0;
+    return error;
+}
+
+void expand_set_status(int status)
+{
+    last_status = status;
+    snprintf(status_text, sizeof(status_text), "%d", status);
+}
+
+int expand_status(void)
+{
+    return last_status;
+}
+
+void expand_init(void)
+{
+    shell_pid = getpid();
+}
+
+void expand_push_positional(char** args, int count, expand_positional* previous)
+{
+    previous->args = positional;
+    previous->count = num_positional;
+    positional = args;
+    num_positional = count;
+}
+
+void expand_pop_positional(const expand_positional* previous)
+{
+    positional = previous->args;
+    num_positional = previous->count;
+}
+
+size_t expand_push_scope(void)
+{
+    scope_depth++;
+    return num_saved;
+}
+
+static char* copy_or_null(const char* text)
+{
+    char* copy = text != NULL ? strdup(text) : NULL;
+    if (text != NULL && copy == NULL)
+    {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    return copy;
+}
+
+/**
+ * @brief Records the current state of a variable, to be restored when the innermost scope ends.
+ */
+static void save_variable(const char* name, size_t len)
+{
+    if (num_saved == saved_capacity)
+    {
+        size_t new_capacity = saved_capacity == 0 ? INITIAL_SAVED_CAPACITY : saved_capacity * 2;
+        saved_variable* grown = realloc(saved, new_capacity * sizeof(saved_variable));
+        if (grown == NULL)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        saved = grown;
+        saved_capacity = new_capacity;
+    }
+    variable* v = find_variable(name, len);
+    saved_variable* s = &saved[num_saved++];
+    s->name = copy_or_null(name);
+    s->value = copy_or_null(v != NULL ? v->value : NULL);
+    s->env_value = copy_or_null(getenv(name));
+}
+
+void expand_pop_scope(size_t mark)
+{
+    // Newest first, so a variable made local twice ends up with its oldest value
+    while (num_saved > mark)
+    {
+        saved_variable* s = &saved[--num_saved];
+        if (s->value != NULL)
+        {
+            set_variable(s->name, s->value);
+        }
+        else
+        {
+            unset_variable(s->name);
+        }
+        if (s->env_value != NULL)
+        {
+            setenv(s->name, s->env_value, 1);
+        }
+        free(s->name);
+        free(s->value);
+        free(s->env_value);
+    }
+    scope_depth--;
+}
+
+/**
+ * @brief Returns the length of the variable name at the start of `text`, 0 if there is none.
+ */
+static size_t name_length(const char* text, const char* end)
+{
+    if (text >= end || !(isalpha((unsigned char)*text) || *text == '_'))
+    {
+        return 0;
+    }
+    size_t len = 1;
+    while (text + len < end && (isalnum((unsigned char)text[len]) || text[len] == '_'))
+    {
+        len++;
+    }
+    return len;
+}
+
+/**
+ * @brief Like name_length(), but also accepts the special parameters `?`, `$`, `#`, `@`, `*` and
+ * positional parameters: one digit, or any number of them between braces.
+ */
+static size_t parameter_length(const char* text, const char* end, int braced)
+{
+    if (text < end && *text != '\0' && strchr("?$#@*", *text) != NULL)
+    {
+        return 1;
+    }
+    if (text < end && isdigit((unsigned char)*text))
+    {
+        size_t len = 1;
+        while (braced && text + len < end && isdigit((unsigned char)text[len]))
+        {
+            len++;
+        }
+        return len;
+    }
+    return name_length(text, end);
+}
+
+/**
+ * @brief Joins the positional parameters with spaces, for `$*` and `$@` where fields are not split.
+ */
+static const char* joined_positional(size_t* value_len)
+{
+    static expand_buffer joined;
+    joined.len = 0;
+    expand_buffer_append(&joined, "", 0);
+    for (int i = 0; i < num_positional; i++)
+    {
+        if (i > 0)
+        {
+            expand_buffer_append(&joined, " ", 1);
+        }
+        expand_buffer_append(&joined, positional[i], strlen(positional[i]));
+    }
+    *value_len = joined.len;
+    return joined.data;
+}
+
+/**
+ * @brief Returns the value of a parameter whose name is `len` bytes of `name`, or NULL if it is unset.
+ */
+static const char* parameter_value(const char* name, size_t len, size_t* value_len)
+{
+    if (*name == '?')
+    {
+        *value_len = strlen(status_text);
+        return status_text;
+    }
+    if (isdigit((unsigned char)*name))
+    {
+        long index = strtol(name, NULL, 10);
+        const char* value = index == 0 ? SHELL_NAME : (index <= num_positional ? positional[index - 1] : NULL);
+        *value_len = value != NULL ? strlen(value) : 0;
+        return value;
+    }
+    if (*name == '#')
+    {
+        static char count_text[NUMBER_TEXT_MAX];
+        *value_len = (size_t)snprintf(count_text, sizeof(count_text), "%d", num_positional);
+        return count_text;
+    }
+    if (*name == '@' || *name == '*')
+    {
+        return joined_positional(value_len);
+    }
+    if (*name == '$')
+    {
+        // Formatted on use: a subshell expands the pid of the shell it was forked from
+        static char pid_text[NUMBER_TEXT_MAX];
+        *value_len = (size_t)snprintf(pid_text, sizeof(pid_text), "%ld", (long)(shell_pid != 0 ? shell_pid : getpid()));
+        return pid_text;
+    }
+    return expand_lookup(name, len, value_len);
+}
+
+static void expand_span(expand_buffer* out, const char* p, const char* end, context ctx, field_state* fields);
+
+/**
+ * @brief Terminates the field being built.
+ */
+static void end_field(expand_buffer* out, field_state* fields)
+{
+    expand_buffer_append(out, "", 1);
+    fields->count++;
+    fields->pending = 0;
+}
+
+/**
+ * @brief Appends text that came from a quoted part of a word, escaping its pattern characters in a pattern.
+ */
+static void append_quoted(expand_buffer* out, const char* text, size_t len)
+{
+    if (!quoting_pattern)
+    {
+        expand_buffer_append(out, text, len);
+        return;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if (text[i] != '\0' && strchr(PATTERN_CHARACTERS, text[i]) != NULL)
+        {
+            expand_buffer_append(out, "\\", 1);
+        }
+        expand_buffer_append(out, text + i, 1);
+    }
+}
+
+/**
+ * @brief Appends the value of an unquoted expansion, splitting it into fields at blanks.
+ */
+static void append_split(expand_buffer* out, field_state* fields, const char* value, size_t len)
+{
+    const char* end = value + len;
+    while (value < end)
+    {
+        size_t run = strcspn(value, FIELD_SEPARATORS);
+        run = run < (size_t)(end - value) ? run : (size_t)(end - value);
+        if (run > 0)
+        {
+            expand_buffer_append(out, value, run);
+            fields->pending = 1;
+            value += run;
+        }
+        else
+        {
+            if (fields->pending)
+            {
+                end_field(out, fields);
+            }
+            value++;
+        }
+    }
+}
+
+/**
+ * @brief Appends the value of an expansion, split into fields when it is unquoted and fields are being cut.
+ */
+static void append_value(expand_buffer* out, const char* value, size_t len, context ctx, field_state* fields)
+{
+    if (fields != NULL && ctx == CONTEXT_WORD)
+    {
+        append_split(out, fields, value, len);
+        return;
+    }
+    if (ctx == CONTEXT_QUOTED)
+    {
+        append_quoted(out, value, len);
+    }
+    else
+    {
+        expand_buffer_append(out, value, len);
+    }
+    if (fields != NULL && len > 0)
+    {
+        fields->pending = 1;
+    }
+}
+
+/**
+ * @brief Appends `"$@"`: every positional parameter is a field of its own.
+ */
+static void append_quoted_positional(expand_buffer* out, field_state* fields)
+{
+    for (int i = 0; i < num_positional; i++)
+    {
+        if (i > 0)
+        {
+            end_field(out, fields);
+        }
+        expand_buffer_append(out, positional[i], strlen(positional[i]));
+        fields->pending = 1;
+    }
+}
+
+/**
+ * @brief Expands `$(( expression ))`, whose inner text runs from `p` to `end`.
+ *
+ * Parameters in the expression are expanded first, into the output buffer
+ * past what it holds, so that nested expressions need no buffer of their
+ * own; the expression text is then replaced by its value.
+ */
+static void expand_arithmetic(expand_buffer* out, const char* p, const char* end, context ctx, field_state* fields)
+{
+    size_t mark = out->len;
+    // The expression is not a pattern, even within one
+    int pattern = quoting_pattern;
+    quoting_pattern = 0;
+    expand_span(out, p, end, CONTEXT_HEREDOC, NULL);
+    quoting_pattern = pattern;
+    int64_t value;
+    const char* text = out->data != NULL ? out->data + mark : "";
+    int failed = arith_evaluate(text, out->len - mark, &value) == -1;
+    out->len = mark;
+    if (failed)
+    {
+        expand_set_status(1);
+        expansion_error = 1;
+        return;
+    }
+    char digits[NUMBER_TEXT_MAX];
+    int len = snprintf(digits, sizeof(digits), "%" PRId64, value);
+    append_value(out, digits, (size_t)len, ctx, fields);
+}
+
+/**
+ * @brief Moves `b` into `*spare`, freeing what `*spare` held, so a buffer's memory is reused by the next user.
+ */
+static void keep_spare(expand_buffer* spare, expand_buffer b)
+{
+    expand_buffer_free(spare);
+    *spare = b;
+}
+
+/**
+ * @brief Expands `$(command)`, whose command text runs from `p` to `end`, to the command's output.
+ *
+ * The command may expand words in the shell process, which uses the
+ * scratch buffer the caller may be filling: it gets a buffer of its own
+ * while it runs.
+ */
+static void expand_substitution(expand_buffer* out, const char* p, const char* end, context ctx,
+                                field_state* fields)
+{
+    expand_buffer caller_scratch = scratch;
+    scratch = spare_scratch;
+    scratch.len = 0;
+    spare_scratch = (expand_buffer){NULL, 0, 0};
+    expand_buffer output = spare_output;
+    output.len = 0;
+    spare_output = (expand_buffer){NULL, 0, 0};
+    int pattern = quoting_pattern;
+    quoting_pattern = 0;
+    // The errors of the command's own expansions are the command's
+    int error = expansion_error;
+
+    int status = substitute_command(p, (size_t)(end - p), &output);
+
+    quoting_pattern = pattern;
+    expansion_error = error;
+    keep_spare(&spare_scratch, scratch);
+    scratch = caller_scratch;
+    substitution_status = status;
+    expand_set_status(status);
+    append_value(out, output.data != NULL ? output.data : "", output.len, ctx, fields);
+    keep_spare(&spare_output, output);
+}
+
+/**
+ * @brief Expands the parameter at `p`, which points at a `$`.
+ *
+ * @return const char* The first character after the expansion.
+ */
+static const char* expand_parameter(expand_buffer* out, const char* p, const char* end, context ctx,
+                                    field_state* fields)
+{
+    const char* name = p + 1;
+    size_t value_len;
+    const char* value;
+    size_t len = parameter_length(name, end, 0);
+    if (len > 0)
+    {
+        if (*name == '@' && ctx == CONTEXT_QUOTED && fields != NULL)
+        {
+            append_quoted_positional(out, fields);
+        }
+        else if ((value = parameter_value(name, len, &value_len)) != NULL)
+        {
+            append_value(out, value, value_len, ctx, fields);
+        }
+        return name + len;
+    }
+
+    if (name + 1 < end && name[0] == '(' && name[1] == '(')
+    {
+        const char* close = lexer_substitution_end(name + 1, end);
+        if (close != NULL && close[-1] == ')' && close - 1 > name + 1)
+        {
+            expand_arithmetic(out, name + 2, close - 1, ctx, fields);
+            return close + 1;
+        }
+    }
+    if (name < end && *name == '(')
+    {
+        const char* close = lexer_substitution_end(name + 1, end);
+        if (close != NULL)
+        {
+            expand_substitution(out, name + 1, close, ctx, fields);
+            return close + 1;
+        }
+    }
+
+    const char* close = name < end && *name == '{' ? lexer_parameter_end(name + 1, end) : NULL;
+    if (close != NULL && (len = parameter_length(++name, close, 1)) > 0)
+    {
+        const char* rest = name + len;
+        int with_default = close - rest >= 2 && rest[0] == ':' && rest[1] == '-';
+        if (rest == close || with_default)
+        {
+            value = parameter_value(name, len, &value_len);
+            if (value != NULL && value_len > 0)
+            {
+                if (*name == '@' && ctx == CONTEXT_QUOTED && fields != NULL)
+                {
+                    append_quoted_positional(out, fields);
+                }
+                else
+                {
+                    append_value(out, value, value_len, ctx, fields);
+                }
+            }
+            else if (with_default)
+            {
+                expand_span(out, rest + 2, close, ctx, fields);
+            }
+            return close + 1;
+        }
+    }
+
+    // Not an expansion: the dollar sign is plain text
+    expand_buffer_append(out, p, 1);
+    if (fields != NULL)
+    {
+        fields->pending = 1;
+    }
+    return p + 1;
+}
+
+/**
+ * @brief Checks whether a character starts something other than plain text in a context.
+ */
+static int is_special(char c, context ctx)
+{
+    return c == '$' || c == '\\' || (ctx == CONTEXT_WORD && (c == '\'' || c == '"'));
+}
+
+/**
+ * @brief Expands `p` up to `end` in the given context, appending the result to `out`.
+ *
+ * With `fields`, unquoted expansions are split into fields; without it, the
+ * result is a single piece of text.
+ */
+static void expand_span(expand_buffer* out, const char* p, const char* end, context ctx, field_state* fields)
+{
+    // Characters a backslash escapes inside double quotes and here-documents
+    const char* escapable = ctx == CONTEXT_QUOTED ? "$`\"\\\n" : "$`\\\n";
+    while (p < end)
+    {
+        if (*p == '$')
+        {
+            p = expand_parameter(out, p, end, ctx, fields);
+            continue;
+        }
+        if (fields != NULL)
+        {
+            // Anything but an expansion is kept in the field, even empty quotes
+            fields->pending = 1;
+        }
+        if (*p == '\\')
+        {
+            if (p + 1 < end && (ctx == CONTEXT_WORD || (p[1] != '\0' && strchr(escapable, p[1]) != NULL)))
+            {
+                // An escaped newline joins the lines
+                if (p[1] != '\n')
+                {
+                    append_quoted(out, p + 1, 1);
+                }
+                p += 2;
+            }
+            else
+            {
+                expand_buffer_append(out, p++, 1);
+            }
+        }
+        else if (*p == '\'')
+        {
+            const char* close = memchr(p + 1, '\'', (size_t)(end - p - 1));
+            close = close != NULL ? close : end;
+            append_quoted(out, p + 1, (size_t)(close - p - 1));
+            p = close < end ? close + 1 : end;
+        }
+        else if (*p == '"')
+        {
+            const char* close = p + 1;
+            while (close < end && *close != '"')
+            {
+                const char* inner = NULL;
+                if (*close == '$' && close + 1 < end && close[1] == '(')
+                {
+                    // A quote inside `$(( ))` does not end the string
+                    inner = lexer_substitution_end(close + 2, end);
+                }
+                close = inner != NULL ? inner + 1 : close + ((*close == '\\' && close + 1 < end) ? 2 : 1);
+            }
+            close = close < end ? close : end;
+            expand_span(out, p + 1, close, CONTEXT_QUOTED, fields);
+            p = close < end ? close + 1 : end;
+        }
+        else
+        {
+            // Runs of plain text are copied at once
+            const char* plain = p;
+            while (p < end && !is_special(*p, ctx))
+            {
+                p++;
+            }
+            if (ctx == CONTEXT_QUOTED)
+            {
+                append_quoted(out, plain, (size_t)(p - plain));
+            }
+            else
+            {
+                expand_buffer_append(out, plain, (size_t)(p - plain));
+            }
+        }
+    }
+}
+
+void expand_word(expand_buffer* out, const char* start, size_t len)
+{
+    expand_span(out, start, start + len, CONTEXT_WORD, NULL);
+    // Terminated even when the word expanded to nothing
+    expand_buffer_append(out, "", 0);
+}
+
+char* expand_word_arena(arena* a, const char* start, size_t len)
+{
+    size_t i = 0;
+    while (i < len && !is_special(start[i], CONTEXT_WORD))
+    {
+        i++;
+    }
+    if (i == len)
+    {
+        // Nothing to expand or remove, the common case
+        return arena_strndup(a, start, len);
+    }
+    scratch.len = 0;
+    expand_word(&scratch, start, len);
+    return arena_strndup(a, scratch.data, scratch.len);
+}
+
+char* expand_pattern_arena(arena* a, const char* start, size_t len)
+{
+    quoting_pattern = 1;
+    char* pattern = expand_word_arena(a, start, len);
+    quoting_pattern = 0;
+    return pattern;
+}
+
+char** expand_fields(arena* a, const word* words, size_t num_words, size_t* num_fields)
+{
+    field_state fields = {0, 0};
+    scratch.len = 0;
+    for (size_t i = 0; i < num_words; i++)
+    {
+        const char* start = words[i].start;
+        size_t len = words[i].len;
+        if (len == 4 && memcmp(start, "\"$@\"", 4) == 0 && num_positional == 0)
+        {
+            // "$@" without parameters is no field at all, not an empty one
+            continue;
+        }
+        expand_span(&scratch, start, start + len, CONTEXT_WORD, &fields);
+        if (fields.pending)
+        {
+            end_field(&scratch, &fields);
+        }
+    }
+
+    char* text = arena_alloc(a, scratch.len + 1);
+    memcpy(text, scratch.data != NULL ? scratch.data : "", scratch.len);
+    char** argv = arena_alloc(a, (fields.count + 1) * sizeof(char*));
+    for (size_t i = 0; i < fields.count; i++)
+    {
+        argv[i] = text;
+        text += strlen(text) + 1;
+    }
+    argv[fields.count] = NULL;
+    *num_fields = fields.count;
+    return argv;
+}
+
+void expand_heredoc(expand_buffer* out, const char* start, size_t len)
+{
+    expand_span(out, start, start + len, CONTEXT_HEREDOC, NULL);
+    expand_buffer_append(out, "", 0);
+}
+
+/**
+ * @brief Checks that an argument of a variable builtin starts with a valid name.
+ *
+ * @return size_t The length of the name, or 0 after reporting an invalid one.
+ */
+static size_t checked_name(const char* builtin_name, const char* arg)
+{
+    const char* end = arg + strlen(arg);
+    size_t len = name_length(arg, end);
+    if (len == 0 || (arg[len] != '\0' && arg[len] != '='))
+    {
+        fprintf(stderr, "%s: `%s': not a valid identifier\n", builtin_name, arg);
+        return 0;
+    }
+    return len;
+}
+
+/**
+ * @brief `local NAME[=value]...`: makes variables the shell's own, hidden from the commands it starts.
+ *
+ * A variable keeps its current value unless a new one is given. Inside a
+ * function, its previous state comes back when the function returns.
+ */
+static int local_builtin(int argc, char** argv)
+{
+    int status = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        size_t len = checked_name(argv[0], argv[i]);
+        if (len == 0)
+        {
+            status = 1;
+            continue;
+        }
+        char* equals = argv[i][len] == '=' ? argv[i] + len : NULL;
+        argv[i][len] = '\0';
+        if (scope_depth > 0)
+        {
+            save_variable(argv[i], len);
+        }
+        size_t value_len;
+        const char* value = equals != NULL ? equals + 1 : expand_lookup(argv[i], len, &value_len);
+        if (set_variable(argv[i], value != NULL ? value : "") == -1)
+        {
+            status = 1;
+        }
+        unsetenv(argv[i]);
+    }
+    return status;
+}
+
+/**
+ * @brief `export NAME[=value]...`: moves variables to the environment.
+ */
+static int export_builtin(int argc, char** argv)
+{
+    int status = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        size_t len = checked_name(argv[0], argv[i]);
+        if (len == 0)
+        {
+            status = 1;
+            continue;
+        }
+        char* equals = argv[i][len] == '=' ? argv[i] + len : NULL;
+        argv[i][len] = '\0';
+        variable* v = find_variable(argv[i], len);
+        const char* value = equals != NULL ? equals + 1 : (v != NULL ? v->value : NULL);
+        if (value != NULL && setenv(argv[i], value, 1) == -1)
+        {
+            perror("setenv");
+            status = 1;
+        }
+        unset_variable(argv[i]);
+    }
+    return status;
+}
+
+/**
+ * @brief `unset NAME...`: removes variables from the shell and the environment.
+ */
+static int unset_builtin(int argc, char** argv)
+{
+    int status = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        size_t len = checked_name(argv[0], argv[i]);
+        if (len > 0 && argv[i][len] != '\0')
+        {
+            fprintf(stderr, "%s: `%s': not a valid identifier\n", argv[0], argv[i]);
+            len = 0;
+        }
+        if (len == 0)
+        {
+            status = 1;
+            continue;
+        }
+        unset_variable(argv[i]);
+        unsetenv(argv[i]);
+    }
+    return status;
+}
+
+/**
+ * @brief `shift [n]`: drops the first n positional parameters (1 by default).
+ */
+static int shift_builtin(int argc, char** argv)
+{
+    char* end = NULL;
+    long n = argc > 1 ? strtol(argv[1], &end, 10) : 1;
+    if ((argc > 1 && (*end != '\0' || end == argv[1])) || n < 0 || n > num_positional)
+    {
+        fprintf(stderr, "%s: %s: shift count out of range\n", argv[0], argc > 1 ? argv[1] : "1");
+        return 1;
+    }
+    positional += n;
+    num_positional -= (int)n;
+    return 0;
+}
+
+/**
+ * @brief Builtins implemented in this module.
+ */
+static const builtin expand_builtins[] = {
+    {"local", local_builtin, 1, BUILTIN_ANY_ARGS, BUILTIN_SHELL_STATE, "local NAME[=value]..."},
+    {"export", export_builtin, 1, BUILTIN_ANY_ARGS, BUILTIN_SHELL_STATE, "export NAME[=value]..."},
+    {"unset", unset_builtin, 1, BUILTIN_ANY_ARGS, BUILTIN_SHELL_STATE, "unset NAME..."},
+    {"shift", shift_builtin, 0, 1, BUILTIN_SHELL_STATE, "shift [n]"},
+};
+
+void expand_register_builtins(void)
+{
+    builtin_register(expand_builtins, sizeof(expand_builtins) / sizeof(expand_builtins[0]));
+}
@@ -0,0 +1,538 @@
+#define _GNU_SOURCE
+#include "forkserver.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @brief Exit status of a child whose exec failed.
+ */
+#define EXEC_FAILURE_STATUS 127
+
+/**
+ * @brief Number of standard descriptors passed with every request.
+ */
+#define NUM_STD_FDS 3
+
+extern char** environ;
+
+/**
+ * @brief Fixed part of a spawn request. The path, then `argc` arguments and
+ * `envc` environment entries follow as NUL terminated strings.
+ */
+typedef struct
+{
+    pid_t pgid;                      /**< Group the child joins, 0 for a new one. */
+    int cwd;                         /**< Index of the passed descriptor of the shell's working directory. */
+    mode_t umask;                    /**< The shell's file mode creation mask. */
+    int num_ops;                     /**< Used entries of `targets` and `sources`. */
+    int targets[FORKSERVER_MAX_FDS]; /**< Descriptor each operation sets up in the child. */
+    int sources[FORKSERVER_MAX_FDS]; /**< Index of the passed descriptor it becomes, or -1 to close it. */
+    size_t argc;                     /**< Number of arguments. */
+    size_t envc;                     /**< Number of environment entries. */
+} spawn_request;
+
+/**
+ * @brief The server's answer to a spawn request.
+ */
+typedef struct
+{
+    pid_t pid; /**< The child, or -1 if it could not be created. */
+    int error; /**< 0, or the error that kept the child from being created or exec'ing. */
+} spawn_reply;
+
+/**
+ * @brief The shell's end of the socket, -1 when there is no server.
+ */
+static int server_fd = -1;
+
+/**
+ * @brief The server process, -1 when there is none.
+ */
+static pid_t server_pid = -1;
+
+/**
+ * @brief Non-zero in a forked copy of the shell, which must not use or start a server.
+ */
+static int detached = 0;
+
+/**
+ * @brief Signals the server ignores, so keys typed at the terminal do not stop it.
+ * Its children get their default action back.
+ */
+static const int terminal_signals[] = {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU, SIGPIPE};
+
+/**
+ * @brief Number of entries in terminal_signals.
+ */
+#define NUM_TERMINAL_SIGNALS (sizeof(terminal_signals) / sizeof(terminal_signals[0]))
+
+/**
+ * @brief Child side of a spawn: sets up the descriptors, working directory, umask, group and signals, then execs.
+ *
+ * The child was created with a raw clone, so only async-signal-safe calls are
+ * made. Errors are written to `status_fd`, which exec closes on success.
+ */
+static void spawn_child(const spawn_request* request, const int* fds, const char* path, char** argv, char** envp,
+                        int status_fd)
+{
+    for (size_t i = 0; i < NUM_TERMINAL_SIGNALS; i++)
+    {
+        signal(terminal_signals[i], SIG_DFL);
+    }
+    int failed = 0;
+    for (int i = 0; i < request->num_ops && !failed; i++)
+    {
+        int source = request->sources[i];
+        if (source == -1)
+        {
+            close(request->targets[i]);
+        }
+        else
+        {
+            failed = dup2(fds[source], request->targets[i]) == -1;
+        }
+    }
+    // The server stayed where the shell started: the child moves to where the shell is now
+    failed = failed || fchdir(fds[request->cwd]) == -1;
+    umask(request->umask);
+    if (!failed && setpgid(0, request->pgid) == 0)
+    {
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        execve(path, argv, envp);
+    }
+    int error = errno;
+    if (write(status_fd, &error, sizeof(error)) == -1)
+    {
+        // Nothing else can be done; the server reads EOF and reports success
+    }
+    _exit(EXEC_FAILURE_STATUS);
+}
+
+/**
+ * @brief Creates the child of a request as a child of the shell and waits until it exec'd.
+ */
+static spawn_reply spawn(const spawn_request* request, const int* fds, const char* path, char** argv, char** envp)
+{
+    spawn_reply reply = {-1, 0};
+    int status_pipe[2];
+    if (pipe2(status_pipe, O_CLOEXEC) == -1)
+    {
+        reply.error = errno;
+        return reply;
+    }
+
+    // CLONE_PARENT: the shell, not the server, is the parent that waits for it
+    pid_t pid = (pid_t)syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL);
+    if (pid == 0)
+    {
+        close(status_pipe[0]);
+        spawn_child(request, fds, path, argv, envp, status_pipe[1]);
+    }
+    reply.error = pid == -1 ? errno : 0;
+    close(status_pipe[1]);
+    if (pid != -1)
+    {
+        int child_error;
+        ssize_t n;
+        while ((n = read(status_pipe[0], &child_error, sizeof(child_error))) == -1 && errno == EINTR)
+        {
+        }
+        if (n == sizeof(child_error))
+        {
+            reply.error = child_error;
+        }
+    }
+    close(status_pipe[0]);
+    reply.pid = pid;
+    return reply;
+}
+
+/**
+ * @brief Splits `count` NUL terminated strings off `*cursor`, storing them in `out`.
+ *
+ * @return int 0 on success, -1 if the payload ends first.
+ */
+static int split_strings(char** cursor, const char* end, char** out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        char* nul = memchr(*cursor, '\0', (size_t)(end - *cursor));
+        if (nul == NULL)
+        {
+            return -1;
+        }
+        out[i] = *cursor;
+        *cursor = nul + 1;
+    }
+    out[count] = NULL;
+    return 0;
+}
+
+/**
+ * @brief Handles one request: parses it, moves the passed descriptors out of the
+ * way of the targets, spawns the child and answers.
+ */
+static void serve_request(int sock, const spawn_request* request, char* payload, size_t len, int* fds, int num_fds)
+{
+    spawn_reply reply = {-1, EINVAL};
+    char** argv = NULL;
+    char** envp = NULL;
+    char* cursor = memchr(payload, '\0', len);
+    int valid = cursor != NULL && request->num_ops >= 0 && request->num_ops <= FORKSERVER_MAX_FDS &&
+                request->cwd >= 0 && request->cwd < num_fds && request->argc > 0 &&
+                request->argc + request->envc <= len;
+
+    // Passed descriptors must not be overwritten before they are used
+    int lowest = NUM_STD_FDS;
+    for (int i = 0; valid && i < request->num_ops; i++)
+    {
+        valid = request->sources[i] >= -1 && request->sources[i] < num_fds && request->targets[i] >= 0;
+        if (request->targets[i] >= lowest)
+        {
+            lowest = request->targets[i] + 1;
+        }
+    }
+    for (int i = 0; valid && i < num_fds; i++)
+    {
+        int moved = fcntl(fds[i], F_DUPFD_CLOEXEC, lowest);
+        if (moved == -1)
+        {
+            reply.error = errno;
+            valid = 0;
+            break;
+        }
+        close(fds[i]);
+        fds[i] = moved;
+    }
+
+    if (valid)
+    {
+        argv = malloc((request->argc + 1) * sizeof(char*));
+        envp = malloc((request->envc + 1) * sizeof(char*));
+        reply.error = ENOMEM;
+    }
+    if (argv != NULL && envp != NULL)
+    {
+        cursor++;
+        const char* end = payload + len;
+        if (split_strings(&cursor, end, argv, request->argc) == 0 &&
+            split_strings(&cursor, end, envp, request->envc) == 0)
+        {
+            reply = spawn(request, fds, payload, argv, envp);
+        }
+        else
+        {
+            reply.error = EINVAL;
+        }
+    }
+    free(argv);
+    free(envp);
+    for (int i = 0; i < num_fds; i++)
+    {
+        close(fds[i]);
+    }
+    while (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) == -1 && errno == EINTR)
+    {
+    }
+}
+
+/**
+ * @brief The server's loop: one request per message until the shell closes its end.
+ */
+static void serve(int sock)
+{
+    static char payload[FORKSERVER_MAX_MESSAGE];
+    while (1)
+    {
+        spawn_request request;
+        struct iovec iov[2] = {{&request, sizeof(request)}, {payload, sizeof(payload)}};
+        union
+        {
+            char buffer[CMSG_SPACE(sizeof(int) * FORKSERVER_MAX_FDS)];
+            struct cmsghdr align;
+        } control;
+        struct msghdr msg = {0};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        msg.msg_control = control.buffer;
+        msg.msg_controllen = sizeof(control.buffer);
+
+        ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return;
+        }
+
+        int fds[FORKSERVER_MAX_FDS];
+        int num_fds = 0;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                num_fds = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                memcpy(fds, CMSG_DATA(cmsg), (size_t)num_fds * sizeof(int));
+            }
+        }
+        if ((size_t)n < sizeof(request) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0)
+        {
+            request.num_ops = -1;
+            n = sizeof(request);
+        }
+        serve_request(sock, &request, payload, (size_t)n - sizeof(request), fds, num_fds);
+    }
+}
+
+int forkserver_start(void)
+{
+    if (server_fd != -1)
+    {
+        return 0;
+    }
+    if (detached)
+    {
+        return -1;
+    }
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+    {
+        perror("socketpair");
+        return -1;
+    }
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("fork");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    else if (pid == 0)
+    {
+        close(sv[0]);
+        // Do not outlive the shell, even if it is killed before closing its end
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parent)
+        {
+            _exit(EXIT_SUCCESS);
+        }
+        for (size_t i = 0; i < NUM_TERMINAL_SIGNALS; i++)
+        {
+            signal(terminal_signals[i], SIG_IGN);
+        }
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        serve(sv[1]);
+        _exit(EXIT_SUCCESS);
+    }
+    close(sv[1]);
+    server_fd = sv[0];
+    server_pid = pid;
+    return 0;
+}
+
+void forkserver_stop(void)
+{
+    if (server_fd == -1)
+    {
+        return;
+    }
+    close(server_fd);
+    server_fd = -1;
+    // The server exits once it reads EOF; the shell may have reaped it already
+    while (waitpid(server_pid, NULL, 0) == -1 && errno == EINTR)
+    {
+    }
+    server_pid = -1;
+}
+
+void forkserver_detach(void)
+{
+    if (server_fd != -1)
+    {
+        close(server_fd);
+    }
+    server_fd = -1;
+    server_pid = -1;
+    detached = 1;
+}
+
+int forkserver_running(void)
+{
+    return server_fd != -1;
+}
+
+/**
+ * @brief Appends a NUL terminated string to the request payload.
+ *
+ * @return int 0 on success, -1 if it does not fit.
+ */
+static int append_string(char* payload, size_t* len, const char* text)
+{
+    size_t size = strlen(text) + 1;
+    if (size > FORKSERVER_MAX_MESSAGE - *len)
+    {
+        return -1;
+    }
+    memcpy(payload + *len, text, size);
+    *len += size;
+    return 0;
+}
+
+/**
+ * @brief Forgets a server that stopped answering.
+ */
+static void lose_server(int* error)
+{
+    forkserver_stop();
+    *error = ENOTCONN;
+}
+
+pid_t forkserver_launch(const launch_spec* spec, const char* path, int* error)
+{
+    static char payload[FORKSERVER_MAX_MESSAGE];
+    if (server_fd == -1)
+    {
+        *error = ENOTCONN;
+        return -1;
+    }
+
+    spawn_request request;
+    memset(&request, 0, sizeof(request));
+    request.pgid = spec->pgid == LAUNCH_PGID_INHERIT ? getpgrp() : spec->pgid;
+    request.umask = umask(0);
+    umask(request.umask);
+
+    // The child starts in the shell's current directory, with its current standard descriptors
+    int cwd_fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd_fd == -1)
+    {
+        // Launched directly by the shell instead
+        *error = ENOTCONN;
+        return -1;
+    }
+    int fds[FORKSERVER_MAX_FDS];
+    int num_fds = 0;
+    request.cwd = num_fds;
+    fds[num_fds++] = cwd_fd;
+    for (int fd = 0; fd < NUM_STD_FDS; fd++)
+    {
+        request.targets[request.num_ops] = fd;
+        if (fcntl(fd, F_GETFD) == -1)
+        {
+            request.sources[request.num_ops++] = -1;
+            continue;
+        }
+        fds[num_fds] = fd;
+        request.sources[request.num_ops++] = num_fds++;
+    }
+    for (int i = 0; i < spec->num_actions; i++)
+    {
+        const launch_action* action = &spec->actions[i];
+        if (action->type == LAUNCH_ACTION_DUP2)
+        {
+            request.targets[request.num_ops] = action->target_fd;
+            fds[num_fds] = action->fd;
+            request.sources[request.num_ops++] = num_fds++;
+        }
+        else
+        {
+            request.targets[request.num_ops] = action->fd;
+            request.sources[request.num_ops++] = -1;
+        }
+    }
+
+    size_t len = 0;
+    int fits = append_string(payload, &len, path) == 0;
+    for (char* const* arg = spec->argv; fits && *arg != NULL; arg++)
+    {
+        fits = append_string(payload, &len, *arg) == 0;
+        request.argc++;
+    }
+    for (char* const* entry = spec->envp != NULL ? spec->envp : environ; fits && *entry != NULL; entry++)
+    {
+        fits = append_string(payload, &len, *entry) == 0;
+        request.envc++;
+    }
+    if (!fits)
+    {
+        close(cwd_fd);
+        *error = EMSGSIZE;
+        return -1;
+    }
+
+    struct iovec iov[2] = {{&request, sizeof(request)}, {payload, len}};
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(int) * FORKSERVER_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    if (num_fds > 0)
+    {
+        msg.msg_control = control.buffer;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)num_fds);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)num_fds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (size_t)num_fds);
+    }
+
+    ssize_t n;
+    while ((n = sendmsg(server_fd, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+    {
+    }
+    close(cwd_fd);
+    if (n == -1)
+    {
+        if (errno == EMSGSIZE || errno == ENOBUFS)
+        {
+            *error = EMSGSIZE;
+        }
+        else
+        {
+            lose_server(error);
+        }
+        return -1;
+    }
+
+    spawn_reply reply;
+    while ((n = recv(server_fd, &reply, sizeof(reply), 0)) == -1 && errno == EINTR)
+    {
+    }
+    if (n != sizeof(reply))
+    {
+        lose_server(error);
+        return -1;
+    }
+    if (reply.pid != -1 && reply.error != 0)
+    {
+        // Like posix_spawn, a failed exec is an error and leaves no child behind
+        waitpid(reply.pid, NULL, 0);
+        reply.pid = -1;
+    }
+    *error = reply.error;
+    return reply.pid;
+}
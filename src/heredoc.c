@@ -0,0 +1,128 @@
+#define _GNU_SOURCE
+#include "heredoc.h"
+#include "expand.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * @brief Seals of a filled memfd: its size and content are final.
+ */
+#define HEREDOC_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)
+
+/**
+ * @brief Copies a here-document body, applying `<<-` tab stripping and expansion.
+ */
+static void copy_body(const redirection* r, expand_buffer* out)
+{
+    const char* p = r->body.start;
+    const char* end = p + r->body.len;
+    while (p < end)
+    {
+        while (r->strip_tabs && p < end && *p == '\t')
+        {
+            p++;
+        }
+        const char* newline = memchr(p, '\n', (size_t)(end - p));
+        const char* line_end = newline != NULL ? newline + 1 : end;
+        if (r->expand)
+        {
+            expand_heredoc(out, p, (size_t)(line_end - p));
+        }
+        else
+        {
+            expand_buffer_append(out, p, (size_t)(line_end - p));
+        }
+        p = line_end;
+    }
+}
+
+/**
+ * @brief Copies the text of a here-document or here-string to `out`.
+ */
+static void copy_text(const redirection* r, expand_buffer* out)
+{
+    if (r->type == REDIR_HEREDOC)
+    {
+        copy_body(r, out);
+        return;
+    }
+    // A here-string ends with a newline, like a one-line here-document
+    expand_word(out, r->target.start, r->target.len);
+    expand_buffer_append(out, "\n", 1);
+}
+
+/**
+ * @brief Writes a small text into a pipe and returns its read end.
+ */
+static int open_pipe(const char* text, size_t len)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1)
+    {
+        perror("pipe2");
+        return -1;
+    }
+    // Fits in the pipe buffer: never blocks, and the reader sees EOF after it
+    ssize_t written;
+    while ((written = write(fds[1], text, len)) == -1 && errno == EINTR)
+    {
+    }
+    close(fds[1]);
+    if (written != (ssize_t)len)
+    {
+        perror("write");
+        close(fds[0]);
+        return -1;
+    }
+    return fds[0];
+}
+
+/**
+ * @brief Copies a large text into the pages of a memfd, then seals it.
+ */
+static int open_memfd(const char* text, size_t len)
+{
+    int fd = memfd_create(HEREDOC_MEMFD_NAME, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1)
+    {
+        perror("memfd_create");
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)len) == -1)
+    {
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+    char* pages = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (pages == MAP_FAILED)
+    {
+        perror("mmap");
+        close(fd);
+        return -1;
+    }
+    memcpy(pages, text, len);
+    munmap(pages, len);
+    // Once sealed, the command reading the text can neither change nor resize it
+    if (fcntl(fd, F_ADD_SEALS, HEREDOC_SEALS) == -1)
+    {
+        perror("fcntl");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int heredoc_open(const redirection* r)
+{
+    // Expanded once into a reused buffer, then handed over in a single copy
+    static expand_buffer text;
+    text.len = 0;
+    copy_text(r, &text);
+    return text.len <= HEREDOC_PIPE_MAX ? open_pipe(text.data, text.len) : open_memfd(text.data, text.len);
+}
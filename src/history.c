@@ -0,0 +1,627 @@
+#define _GNU_SOURCE
+#include "history.h"
+#include "builtins.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Records start on multiples of this many bytes.
+ */
+#define RECORD_ALIGN 8
+
+/**
+ * @brief Length of the file header (HISTORY_FILE_MAGIC without its NUL).
+ */
+#define HEADER_LEN (sizeof(HISTORY_FILE_MAGIC) - 1)
+
+/**
+ * @brief Entries allocated the first time one is added.
+ */
+#define INITIAL_CAPACITY 1024
+
+/**
+ * @brief Slots of the trigram index when it is created; always a power of two.
+ */
+#define INDEX_INITIAL_SLOTS 4096
+
+/**
+ * @brief Length of the substrings indexed.
+ */
+#define TRIGRAM_LEN 3
+
+/**
+ * @brief Milliseconds per second.
+ */
+#define MSEC_PER_SEC 1000.0
+
+/**
+ * @brief Fixed part of a record in the history file; the command follows, padded to RECORD_ALIGN.
+ */
+typedef struct
+{
+    uint32_t magic;       /**< HISTORY_RECORD_MAGIC. */
+    uint32_t len;         /**< Length of the command. */
+    int64_t started;      /**< When it started, in seconds since the epoch. */
+    uint32_t duration_ms; /**< How long it ran. */
+    int32_t status;       /**< Its exit status. */
+} history_record;
+
+/**
+ * @brief The entries holding one trigram, oldest first.
+ */
+typedef struct
+{
+    uint32_t key;      /**< The trigram plus one, 0 for an empty slot. */
+    uint32_t count;    /**< Used entries of `ids`. */
+    uint32_t capacity; /**< Allocated entries of `ids`. */
+    uint32_t* ids;     /**< Indexes of the entries. */
+} posting_list;
+
+/**
+ * @brief Every entry, oldest first.
+ */
+static history_entry* entries = NULL;
+
+/**
+ * @brief Number of entries.
+ */
+static size_t num_entries = 0;
+
+/**
+ * @brief Allocated entries.
+ */
+static size_t capacity = 0;
+
+/**
+ * @brief Entries whose text lives in the mapping; the later ones were allocated.
+ */
+static size_t num_mapped = 0;
+
+/**
+ * @brief The history file as it was when opened, or NULL.
+ */
+static char* mapping = NULL;
+
+/**
+ * @brief Length of `mapping`.
+ */
+static size_t mapping_len = 0;
+
+/**
+ * @brief The history file, opened for appending, or -1.
+ */
+static int history_fd = -1;
+
+/**
+ * @brief Open addressing table of posting lists, NULL until the first indexed search.
+ */
+static posting_list* slots = NULL;
+
+/**
+ * @brief Entries of `slots`.
+ */
+static size_t num_slots = 0;
+
+/**
+ * @brief Used entries of `slots`.
+ */
+static size_t used_slots = 0;
+
+/**
+ * @brief Entries already in the index.
+ */
+static size_t num_indexed = 0;
+
+/**
+ * @brief Non-zero once building the index ran out of memory; searches then scan.
+ */
+static int index_failed = 0;
+
+/**
+ * @brief Appends an entry to the in-memory history.
+ *
+ * @return int 0 on success, -1 on error.
+ */
+static int append_entry(const history_entry* entry)
+{
+    if (num_entries == capacity)
+    {
+        size_t new_capacity = capacity == 0 ? INITIAL_CAPACITY : capacity * 2;
+        history_entry* grown = realloc(entries, new_capacity * sizeof(history_entry));
+        if (grown == NULL)
+        {
+            perror("realloc");
+            return -1;
+        }
+        entries = grown;
+        capacity = new_capacity;
+    }
+    entries[num_entries++] = *entry;
+    return 0;
+}
+
+/**
+ * @brief Returns the size of a record holding `len` bytes of command.
+ */
+static size_t record_size(size_t len)
+{
+    return (sizeof(history_record) + len + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+}
+
+/**
+ * @brief Adds the records of the mapping to the entries.
+ *
+ * @return size_t The offset where the valid records end.
+ */
+static size_t load_records(void)
+{
+    size_t offset = HEADER_LEN;
+    while (offset + sizeof(history_record) <= mapping_len)
+    {
+        history_record record;
+        memcpy(&record, mapping + offset, sizeof(record));
+        if (record.magic != HISTORY_RECORD_MAGIC || record.len > mapping_len - offset - sizeof(record))
+        {
+            break;
+        }
+        history_entry entry = {mapping + offset + sizeof(record), record.len, record.status, record.duration_ms,
+                               record.started};
+        if (append_entry(&entry) == -1)
+        {
+            break;
+        }
+        offset += record_size(record.len);
+    }
+    num_mapped = num_entries;
+    return offset < mapping_len ? offset : mapping_len;
+}
+
+const char* history_default_path(char* buffer, size_t size)
+{
+    const char* path = getenv(HISTORY_ENV);
+    if (path != NULL)
+    {
+        return path;
+    }
+    const char* home = getenv("HOME");
+    if (home == NULL)
+    {
+        return NULL;
+    }
+    snprintf(buffer, size, "%s/%s", home, HISTORY_DEFAULT_FILE);
+    return buffer;
+}
+
+int history_open(const char* path)
+{
+    history_close();
+    if (path == NULL)
+    {
+        return 0;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd == -1)
+    {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0)
+    {
+        if (write(fd, HISTORY_FILE_MAGIC, HEADER_LEN) != (ssize_t)HEADER_LEN)
+        {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+        history_fd = fd;
+        return 0;
+    }
+
+    mapping_len = (size_t)st.st_size;
+    mapping = mmap(NULL, mapping_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        perror("mmap");
+        mapping = NULL;
+        mapping_len = 0;
+        close(fd);
+        return -1;
+    }
+    if (mapping_len < HEADER_LEN || memcmp(mapping, HISTORY_FILE_MAGIC, HEADER_LEN) != 0)
+    {
+        fprintf(stderr, "%s: not a history file\n", path);
+        close(fd);
+        history_close();
+        return -1;
+    }
+
+    size_t end = load_records();
+    if (end < mapping_len && ftruncate(fd, (off_t)end) == -1)
+    {
+        // New records would follow the torn one and be lost on the next load
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    history_fd = fd;
+    return 0;
+}
+
+int history_add(const char* text, size_t len, int status, uint32_t duration_ms, int64_t started)
+{
+    if (len > UINT32_MAX)
+    {
+        return -1;
+    }
+    char* copy = malloc(len > 0 ? len : 1);
+    if (copy == NULL)
+    {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(copy, text, len);
+    history_entry entry = {copy, (uint32_t)len, status, duration_ms, started};
+    if (append_entry(&entry) == -1)
+    {
+        free(copy);
+        return -1;
+    }
+    if (history_fd == -1)
+    {
+        return 0;
+    }
+
+    // One write per record, so shells sharing the file never interleave records
+    size_t size = record_size(len);
+    char* buffer = calloc(1, size);
+    if (buffer == NULL)
+    {
+        perror("calloc");
+        return -1;
+    }
+    history_record record = {HISTORY_RECORD_MAGIC, (uint32_t)len, started, duration_ms, status};
+    memcpy(buffer, &record, sizeof(record));
+    memcpy(buffer + sizeof(record), text, len);
+    ssize_t written = write(history_fd, buffer, size);
+    free(buffer);
+    return written == (ssize_t)size ? 0 : -1;
+}
+
+size_t history_count(void)
+{
+    return num_entries;
+}
+
+const history_entry* history_get(size_t index)
+{
+    return index < num_entries ? &entries[index] : NULL;
+}
+
+/**
+ * @brief Returns the trigram starting at `text`.
+ */
+static uint32_t trigram_at(const char* text)
+{
+    return (uint32_t)(unsigned char)text[0] << 16 | (uint32_t)(unsigned char)text[1] << 8 |
+           (uint32_t)(unsigned char)text[2];
+}
+
+/**
+ * @brief Returns the first slot to probe for a key.
+ */
+static size_t slot_of(uint32_t key, size_t count)
+{
+    // Fibonacci hashing spreads neighbouring trigrams apart
+    return (size_t)(key * 2654435761u) & (count - 1);
+}
+
+/**
+ * @brief Releases the trigram index.
+ */
+static void index_free(void)
+{
+    for (size_t i = 0; i < num_slots; i++)
+    {
+        free(slots[i].ids);
+    }
+    free(slots);
+    slots = NULL;
+    num_slots = 0;
+    used_slots = 0;
+    num_indexed = 0;
+}
+
+/**
+ * @brief Doubles the slots of the index (or creates them).
+ *
+ * @return int 0 on success, -1 on error.
+ */
+static int index_grow(void)
+{
+    size_t count = num_slots == 0 ? INDEX_INITIAL_SLOTS : num_slots * 2;
+    posting_list* grown = calloc(count, sizeof(posting_list));
+    if (grown == NULL)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < num_slots; i++)
+    {
+        if (slots[i].key != 0)
+        {
+            size_t j = slot_of(slots[i].key, count);
+            while (grown[j].key != 0)
+            {
+                j = (j + 1) & (count - 1);
+            }
+            grown[j] = slots[i];
+        }
+    }
+    free(slots);
+    slots = grown;
+    num_slots = count;
+    return 0;
+}
+
+/**
+ * @brief Finds the posting list of a trigram, optionally creating it.
+ *
+ * @return posting_list* The list, or NULL if it does not exist (or could not be created).
+ */
+static posting_list* index_lookup(uint32_t trigram, int create)
+{
+    uint32_t key = trigram + 1;
+    if (create && (used_slots + 1) * 4 > num_slots * 3 && index_grow() == -1)
+    {
+        return NULL;
+    }
+    size_t i = slot_of(key, num_slots);
+    while (slots[i].key != 0)
+    {
+        if (slots[i].key == key)
+        {
+            return &slots[i];
+        }
+        i = (i + 1) & (num_slots - 1);
+    }
+    if (!create)
+    {
+        return NULL;
+    }
+    slots[i].key = key;
+    used_slots++;
+    return &slots[i];
+}
+
+/**
+ * @brief Adds every trigram of an entry to the index.
+ *
+ * @return int 0 on success, -1 on error.
+ */
+static int index_entry(uint32_t id)
+{
+    const history_entry* entry = &entries[id];
+    for (size_t i = 0; i + TRIGRAM_LEN <= entry->len; i++)
+    {
+        posting_list* list = index_lookup(trigram_at(entry->text + i), 1);
+        if (list == NULL)
+        {
+            return -1;
+        }
+        // Ids are added in order, so a repeated trigram is always the last id
+        if (list->count > 0 && list->ids[list->count - 1] == id)
+        {
+            continue;
+        }
+        if (list->count == list->capacity)
+        {
+            uint32_t new_capacity = list->capacity == 0 ? 4 : list->capacity * 2;
+            uint32_t* grown = realloc(list->ids, new_capacity * sizeof(uint32_t));
+            if (grown == NULL)
+            {
+                return -1;
+            }
+            list->ids = grown;
+            list->capacity = new_capacity;
+        }
+        list->ids[list->count++] = id;
+    }
+    return 0;
+}
+
+/**
+ * @brief Indexes the entries added since the last search.
+ *
+ * @return int Non-zero if the index can be used.
+ */
+static int index_catch_up(void)
+{
+    if (index_failed || num_entries > UINT32_MAX)
+    {
+        return 0;
+    }
+    if (slots == NULL && index_grow() == -1)
+    {
+        index_failed = 1;
+        return 0;
+    }
+    for (; num_indexed < num_entries; num_indexed++)
+    {
+        if (index_entry((uint32_t)num_indexed) == -1)
+        {
+            index_free();
+            index_failed = 1;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Returns whether an entry contains the query.
+ */
+static int entry_matches(size_t index, const char* query, size_t len)
+{
+    return memmem(entries[index].text, entries[index].len, query, len) != NULL;
+}
+
+long history_search(const char* query, size_t len, size_t before)
+{
+    if (before > num_entries)
+    {
+        before = num_entries;
+    }
+    if (len == 0)
+    {
+        return -1;
+    }
+    if (len < TRIGRAM_LEN || !index_catch_up())
+    {
+        for (size_t i = before; i-- > 0;)
+        {
+            if (entry_matches(i, query, len))
+            {
+                return (long)i;
+            }
+        }
+        return -1;
+    }
+
+    // Every match holds every trigram of the query; walk the rarest one's entries
+    const posting_list* rarest = NULL;
+    for (size_t i = 0; i + TRIGRAM_LEN <= len; i++)
+    {
+        const posting_list* list = index_lookup(trigram_at(query + i), 0);
+        if (list == NULL)
+        {
+            return -1;
+        }
+        if (rarest == NULL || list->count < rarest->count)
+        {
+            rarest = list;
+        }
+    }
+    size_t low = 0;
+    size_t high = rarest->count;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (rarest->ids[mid] < before)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    for (size_t i = low; i-- > 0;)
+    {
+        if (entry_matches(rarest->ids[i], query, len))
+        {
+            return (long)rarest->ids[i];
+        }
+    }
+    return -1;
+}
+
+void history_close(void)
+{
+    index_free();
+    index_failed = 0;
+    for (size_t i = num_mapped; i < num_entries; i++)
+    {
+        free((char*)entries[i].text);
+    }
+    free(entries);
+    entries = NULL;
+    num_entries = 0;
+    capacity = 0;
+    num_mapped = 0;
+    if (mapping != NULL)
+    {
+        munmap(mapping, mapping_len);
+        mapping = NULL;
+        mapping_len = 0;
+    }
+    if (history_fd != -1)
+    {
+        close(history_fd);
+        history_fd = -1;
+    }
+}
+
+/**
+ * @brief Parses a non-negative number argument of `history`.
+ *
+ * @return long The number, or -1 if it is not one.
+ */
+static long parse_count(const char* text)
+{
+    char* end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    return errno == 0 && end != text && *end == '\0' && value >= 0 ? value : -1;
+}
+
+/**
+ * @brief history [-n count] [-s ms]: lists the last entries, optionally only the slow ones.
+ */
+static int history_builtin(int argc, char** argv)
+{
+    long count = HISTORY_DEFAULT_LIST;
+    long slow_ms = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        long* target = strcmp(argv[i], "-n") == 0 ? &count : strcmp(argv[i], "-s") == 0 ? &slow_ms : NULL;
+        if (target == NULL || i + 1 == argc || (*target = parse_count(argv[i + 1])) == -1)
+        {
+            fprintf(stderr, "Usage: history [-n count] [-s ms]\n");
+            return 1;
+        }
+        i++;
+    }
+
+    // The last `count` entries that are slow enough, printed oldest first
+    size_t first = num_entries;
+    for (long shown = 0; first > 0 && shown < count;)
+    {
+        first--;
+        shown += entries[first].duration_ms >= (unsigned long)slow_ms;
+    }
+    for (size_t i = first; i < num_entries; i++)
+    {
+        const history_entry* entry = &entries[i];
+        if (entry->duration_ms >= (unsigned long)slow_ms)
+        {
+            printf("%6zu  %3d %9.3fs  %.*s\n", i + 1, (int)entry->status, entry->duration_ms / MSEC_PER_SEC,
+                   (int)entry->len, entry->text);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Builtins implemented in this module.
+ */
+static const builtin history_builtins[] = {
+    {"history", history_builtin, 0, 4, BUILTIN_PIPELINE_SAFE, "history [-n count] [-s ms]"},
+};
+
+void history_register_builtins(void)
+{
+    builtin_register(history_builtins, sizeof(history_builtins) / sizeof(history_builtins[0]));
+}
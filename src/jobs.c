@@ -0,0 +1,1477 @@
+#include "jobs.h"
+#include "builtins.h"
+#include "prompt.h"
+#include "stats.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#ifndef P_PIDFD
+/**
+ * @brief waitid() id type selecting a pidfd (Linux 5.4).
+ */
+#define P_PIDFD 3
+#endif
+
+/**
+ * @brief Initial number of slots of the PID table (a power of two).
+ */
+#define INITIAL_PID_CAPACITY 64
+
+/**
+ * @brief Initial number of job slots indexed by job number.
+ */
+#define INITIAL_ID_CAPACITY 16
+
+/**
+ * @brief Initial number of processes per job.
+ */
+#define INITIAL_PROCS 2
+
+/**
+ * @brief Multiplier used to scatter PIDs over the table (Knuth's multiplicative hash).
+ */
+#define PID_HASH_MULTIPLIER 2654435761u
+
+/**
+ * @brief Nanoseconds per second.
+ */
+#define NSEC_PER_SEC 1000000000L
+
+/**
+ * @brief epoll events handled per epoll_wait() call.
+ */
+#define MAX_WAIT_EVENTS 8
+
+/**
+ * @brief epoll user data marking the SIGCHLD signalfd (other entries hold a process index).
+ */
+#define SIGCHLD_EVENT UINT64_MAX
+
+/**
+ * @brief Kinds of state changes reported for a process.
+ */
+typedef enum
+{
+    EVENT_EXITED,    /**< Exited or was killed. */
+    EVENT_STOPPED,   /**< Stopped by a signal. */
+    EVENT_CONTINUED, /**< Resumed by SIGCONT. */
+} process_event;
+
+/**
+ * @brief An entry of the PID table.
+ */
+typedef struct
+{
+    pid_t pid; /**< Process ID, 0 for an empty slot. */
+    job* job;  /**< The job owning the process. */
+} pid_entry;
+
+/**
+ * @brief Open addressing table mapping every live process to its job.
+ */
+static pid_entry* pid_table = NULL;
+static size_t pid_capacity = 0;
+static size_t pid_count = 0;
+
+/**
+ * @brief Jobs indexed by job number; slot 0 is unused.
+ */
+static job** jobs_by_id = NULL;
+static int id_capacity = 0;
+
+/**
+ * @brief Highest job number in use, 0 when the table is empty.
+ */
+static int max_id = 0;
+
+/**
+ * @brief Number of jobs in the table.
+ */
+static size_t num_jobs = 0;
+
+/**
+ * @brief The current (`%+`) and previous (`%-`) jobs, 0 if none.
+ */
+static int current_id = 0;
+static int previous_id = 0;
+
+/**
+ * @brief Job the shell is waiting for.
+ */
+static job* volatile foreground_job = NULL;
+
+/**
+ * @brief Jobs whose state changed since they were last reported, most recent first.
+ */
+static job* changed_head = NULL;
+
+/**
+ * @brief Processes of the last foreground job that finished, for `PIPESTATUS`.
+ */
+static job_process* last_procs = NULL;
+static size_t last_num_procs = 0;
+
+/**
+ * @brief Number of times save_pipestatus() ran.
+ */
+static unsigned long finished_count = 0;
+
+/**
+ * @brief Terminal handed to foreground jobs, -1 when the shell does not own one.
+ */
+static int terminal_fd = -1;
+
+/**
+ * @brief Process group the terminal is given back to.
+ */
+static pid_t shell_pgid = 0;
+
+/**
+ * @brief Terminal modes restored once a foreground job returns.
+ */
+static struct termios shell_modes;
+
+/**
+ * @brief epoll set and SIGCHLD signalfd used by foreground waits, created on first use.
+ */
+static int wait_epoll_fd = -1;
+static int sigchld_fd = -1;
+
+/**
+ * @brief Set once pidfd_open() failed with ENOSYS; waits fall back to waitpid() per process.
+ */
+static int pidfd_unsupported = 0;
+
+void job_control_init(int interactive)
+{
+    if (!isatty(STDIN_FILENO))
+    {
+        return;
+    }
+    if (interactive)
+    {
+        // Stop until the parent shell puts us in the foreground
+        while (tcgetpgrp(STDIN_FILENO) != getpgrp())
+        {
+            kill(-getpgrp(), SIGTTIN);
+        }
+        if (getpid() != getpgrp() && setpgid(0, 0) == -1)
+        {
+            perror("setpgid");
+            return;
+        }
+        if (tcsetpgrp(STDIN_FILENO, getpgrp()) == -1)
+        {
+            perror("tcsetpgrp");
+            return;
+        }
+    }
+    if (tcgetpgrp(STDIN_FILENO) != getpgrp())
+    {
+        // Started in the background: leave the terminal alone
+        return;
+    }
+    terminal_fd = STDIN_FILENO;
+    shell_pgid = getpgrp();
+    tcgetattr(terminal_fd, &shell_modes);
+}
+
+/**
+ * @brief Makes `pgid` the foreground process group of the terminal.
+ */
+static void set_terminal_owner(pid_t pgid)
+{
+    // A background process changing the foreground group gets SIGTTOU unless it is blocked
+    sigset_t mask;
+    sigset_t old;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &mask, &old);
+    if (tcsetpgrp(terminal_fd, pgid) == -1)
+    {
+        perror("tcsetpgrp");
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+void jobs_block_sigchld(sigset_t* old)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, old);
+}
+
+void jobs_restore_sigmask(const sigset_t* old)
+{
+    sigprocmask(SIG_SETMASK, old, NULL);
+}
+
+static size_t pid_slot(pid_t pid)
+{
+    return ((uint32_t)pid * PID_HASH_MULTIPLIER) & (pid_capacity - 1);
+}
+
+static void pid_insert(pid_t pid, job* j)
+{
+    if ((pid_count + 1) * 2 > pid_capacity)
+    {
+        // Keep the load factor under one half so probes stay short
+        size_t old_capacity = pid_capacity;
+        pid_entry* old_table = pid_table;
+        size_t new_capacity = pid_capacity == 0 ? INITIAL_PID_CAPACITY : pid_capacity * 2;
+        pid_entry* grown = calloc(new_capacity, sizeof(pid_entry));
+        if (grown == NULL)
+        {
+            perror("calloc");
+            return;
+        }
+        pid_table = grown;
+        pid_capacity = new_capacity;
+        pid_count = 0;
+        for (size_t i = 0; i < old_capacity; i++)
+        {
+            if (old_table[i].pid != 0)
+            {
+                pid_insert(old_table[i].pid, old_table[i].job);
+            }
+        }
+        free(old_table);
+    }
+
+    size_t i = pid_slot(pid);
+    while (pid_table[i].pid != 0 && pid_table[i].pid != pid)
+    {
+        i = (i + 1) & (pid_capacity - 1);
+    }
+    if (pid_table[i].pid == 0)
+    {
+        pid_count++;
+    }
+    pid_table[i].pid = pid;
+    pid_table[i].job = j;
+}
+
+static void pid_delete(pid_t pid)
+{
+    if (pid_capacity == 0)
+    {
+        return;
+    }
+    size_t i = pid_slot(pid);
+    while (pid_table[i].pid != pid)
+    {
+        if (pid_table[i].pid == 0)
+        {
+            return;
+        }
+        i = (i + 1) & (pid_capacity - 1);
+    }
+
+    // Backward shift deletion: move later entries of the cluster into the hole
+    size_t hole = i;
+    size_t next = (hole + 1) & (pid_capacity - 1);
+    while (pid_table[next].pid != 0)
+    {
+        size_t home = pid_slot(pid_table[next].pid);
+        if (((next - home) & (pid_capacity - 1)) >= ((next - hole) & (pid_capacity - 1)))
+        {
+            pid_table[hole] = pid_table[next];
+            hole = next;
+        }
+        next = (next + 1) & (pid_capacity - 1);
+    }
+    pid_table[hole].pid = 0;
+    pid_table[hole].job = NULL;
+    pid_count--;
+}
+
+job* job_find_by_pid(pid_t pid)
+{
+    if (pid_capacity == 0 || pid <= 0)
+    {
+        return NULL;
+    }
+    size_t i = pid_slot(pid);
+    while (pid_table[i].pid != 0)
+    {
+        if (pid_table[i].pid == pid)
+        {
+            return pid_table[i].job;
+        }
+        i = (i + 1) & (pid_capacity - 1);
+    }
+    return NULL;
+}
+
+job* job_find_by_id(int id)
+{
+    return id > 0 && id <= max_id ? jobs_by_id[id] : NULL;
+}
+
+job* job_foreground(void)
+{
+    return foreground_job;
+}
+
+size_t jobs_count(void)
+{
+    return num_jobs;
+}
+
+/**
+ * @brief Makes `id` the current job, demoting the previous current job.
+ */
+static void make_current(int id)
+{
+    if (current_id != id)
+    {
+        previous_id = current_id;
+        current_id = id;
+    }
+}
+
+job* job_create(const char* command, size_t len, int foreground)
+{
+    job* j = calloc(1, sizeof(job));
+    if (j == NULL)
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    j->command = strndup(command, len);
+    j->procs = malloc(INITIAL_PROCS * sizeof(job_process));
+    if (j->command == NULL || j->procs == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    j->capacity = INITIAL_PROCS;
+    j->state = JOB_RUNNING;
+    j->foreground = foreground;
+    clock_gettime(CLOCK_MONOTONIC, &j->started);
+
+    // Numbers grow from the highest one in use, like other shells
+    j->id = max_id + 1;
+    if (j->id >= id_capacity)
+    {
+        int new_capacity = id_capacity == 0 ? INITIAL_ID_CAPACITY : id_capacity * 2;
+        job** grown = realloc(jobs_by_id, (size_t)new_capacity * sizeof(job*));
+        if (grown == NULL)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        memset(grown + id_capacity, 0, (size_t)(new_capacity - id_capacity) * sizeof(job*));
+        jobs_by_id = grown;
+        id_capacity = new_capacity;
+    }
+    jobs_by_id[j->id] = j;
+    max_id = j->id;
+    num_jobs++;
+    prompt_invalidate(PROMPT_EVENT_JOBS);
+    if (!foreground)
+    {
+        make_current(j->id);
+    }
+    return j;
+}
+
+/**
+ * @brief Adds an entry at the end of a job's processes.
+ *
+ * @return job_process* The new entry, or NULL if there is no memory for it.
+ */
+static job_process* append_process(job* j)
+{
+    if (j->num_procs == j->capacity)
+    {
+        job_process* grown = realloc(j->procs, j->capacity * 2 * sizeof(job_process));
+        if (grown == NULL)
+        {
+            perror("realloc");
+            return NULL;
+        }
+        j->procs = grown;
+        j->capacity *= 2;
+    }
+    return &j->procs[j->num_procs++];
+}
+
+void job_add_process(job* j, pid_t pid, pid_t pgid)
+{
+    job_process* proc = append_process(j);
+    if (proc == NULL)
+    {
+        return;
+    }
+    proc->pid = pid;
+    proc->state = JOB_RUNNING;
+    proc->status = 0;
+    if (j->pgid == 0)
+    {
+        j->pgid = pgid;
+    }
+    pid_insert(pid, j);
+}
+
+void job_add_finished(job* j, int status)
+{
+    job_process* proc = append_process(j);
+    if (proc == NULL)
+    {
+        return;
+    }
+    // Never waited for: the shell's own PID only labels the stage
+    proc->pid = getpid();
+    proc->state = JOB_DONE;
+    proc->status = status;
+    memset(&proc->usage, 0, sizeof(proc->usage));
+    clock_gettime(CLOCK_MONOTONIC, &proc->ended);
+    if (j->state == JOB_DONE)
+    {
+        // The status of a job is the one of its last stage
+        j->status = status;
+    }
+}
+
+void job_remove(job* j)
+{
+    for (size_t i = 0; i < j->num_procs; i++)
+    {
+        if (j->procs[i].state != JOB_DONE)
+        {
+            pid_delete(j->procs[i].pid);
+        }
+    }
+    if (j->queued)
+    {
+        job** link = &changed_head;
+        while (*link != j)
+        {
+            link = &(*link)->next_changed;
+        }
+        *link = j->next_changed;
+    }
+
+    jobs_by_id[j->id] = NULL;
+    while (max_id > 0 && jobs_by_id[max_id] == NULL)
+    {
+        max_id--;
+    }
+    if (current_id == j->id)
+    {
+        current_id = previous_id;
+        previous_id = 0;
+    }
+    if (previous_id == j->id)
+    {
+        previous_id = 0;
+    }
+    if (current_id == 0)
+    {
+        current_id = max_id;
+    }
+    num_jobs--;
+    prompt_invalidate(PROMPT_EVENT_JOBS);
+
+    free(j->command);
+    free(j->procs);
+    free(j);
+}
+
+void jobs_forget_all(void)
+{
+    for (int id = 1; id <= max_id; id++)
+    {
+        if (jobs_by_id[id] != NULL)
+        {
+            job_remove(jobs_by_id[id]);
+        }
+    }
+    foreground_job = NULL;
+
+    // A forked subshell is never in the foreground, and must not share the parent's epoll set
+    terminal_fd = -1;
+    if (wait_epoll_fd != -1)
+    {
+        close(wait_epoll_fd);
+        close(sigchld_fd);
+        wait_epoll_fd = -1;
+        sigchld_fd = -1;
+    }
+}
+
+job* job_from_spec(const char* spec)
+{
+    job* j = NULL;
+    if (spec == NULL || strcmp(spec, "%") == 0 || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0)
+    {
+        j = job_find_by_id(current_id);
+        if (j == NULL)
+        {
+            fprintf(stderr, "%s: no current job\n", spec != NULL ? spec : "%%");
+            return NULL;
+        }
+        return j;
+    }
+    if (strcmp(spec, "%-") == 0)
+    {
+        j = job_find_by_id(previous_id);
+    }
+    else
+    {
+        char* end;
+        long value = strtol(spec[0] == '%' ? spec + 1 : spec, &end, 10);
+        if (*end == '\0' && end != spec + (spec[0] == '%'))
+        {
+            j = spec[0] == '%' ? job_find_by_id((int)value) : job_find_by_pid((pid_t)value);
+        }
+    }
+    if (j == NULL)
+    {
+        fprintf(stderr, "%s: no such job\n", spec);
+    }
+    return j;
+}
+
+void job_announce(const job* j)
+{
+    printf("[%d] %d\n", j->id, j->procs[j->num_procs - 1].pid);
+}
+
+/**
+ * @brief Adds the resource usage of a reaped process to its job.
+ */
+static void add_usage(struct rusage* total, const struct rusage* usage)
+{
+    timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+    if (usage->ru_maxrss > total->ru_maxrss)
+    {
+        total->ru_maxrss = usage->ru_maxrss;
+    }
+    total->ru_minflt += usage->ru_minflt;
+    total->ru_majflt += usage->ru_majflt;
+    total->ru_inblock += usage->ru_inblock;
+    total->ru_oublock += usage->ru_oublock;
+    total->ru_nvcsw += usage->ru_nvcsw;
+    total->ru_nivcsw += usage->ru_nivcsw;
+}
+
+/**
+ * @brief Recomputes the state of a job from its processes and queues it if it changed.
+ */
+static void update_job_state(job* j)
+{
+    job_state state = JOB_DONE;
+    for (size_t i = 0; i < j->num_procs; i++)
+    {
+        if (j->procs[i].state == JOB_RUNNING)
+        {
+            state = JOB_RUNNING;
+            break;
+        }
+        if (j->procs[i].state == JOB_STOPPED)
+        {
+            state = JOB_STOPPED;
+        }
+    }
+    if (state == j->state)
+    {
+        return;
+    }
+
+    j->state = state;
+    j->notified = 0;
+    if (state == JOB_DONE)
+    {
+        j->status = j->procs[j->num_procs - 1].status;
+        clock_gettime(CLOCK_MONOTONIC, &j->ended);
+    }
+    if (!j->queued)
+    {
+        j->queued = 1;
+        j->next_changed = changed_head;
+        changed_head = j;
+    }
+}
+
+/**
+ * @brief Records a state change of one process of a job.
+ *
+ * @param j The job.
+ * @param proc The process.
+ * @param event What happened.
+ * @param status The exit status (or 128 + signal number) for EVENT_EXITED and EVENT_STOPPED.
+ * @param usage The process's resource usage for EVENT_EXITED.
+ */
+static void apply_event(job* j, job_process* proc, process_event event, int status, const struct rusage* usage)
+{
+    switch (event)
+    {
+    case EVENT_STOPPED:
+        proc->state = JOB_STOPPED;
+        proc->status = status;
+        break;
+    case EVENT_CONTINUED:
+        proc->state = JOB_RUNNING;
+        break;
+    case EVENT_EXITED:
+        proc->state = JOB_DONE;
+        proc->status = status;
+        proc->usage = *usage;
+        clock_gettime(CLOCK_MONOTONIC, &proc->ended);
+        add_usage(&j->usage, usage);
+        // The PID may be reused by the kernel from now on
+        pid_delete(proc->pid);
+        break;
+    }
+    update_job_state(j);
+}
+
+/**
+ * @brief Records a status returned by wait4() in the process's job.
+ */
+static void record_status(pid_t pid, int status, const struct rusage* usage)
+{
+    job* j = job_find_by_pid(pid);
+    if (j == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < j->num_procs; i++)
+    {
+        if (j->procs[i].pid != pid)
+        {
+            continue;
+        }
+        if (WIFSTOPPED(status))
+        {
+            apply_event(j, &j->procs[i], EVENT_STOPPED, SIGNAL_STATUS_BASE + WSTOPSIG(status), NULL);
+        }
+        else if (WIFCONTINUED(status))
+        {
+            apply_event(j, &j->procs[i], EVENT_CONTINUED, 0, NULL);
+        }
+        else
+        {
+            int code = WIFEXITED(status) ? WEXITSTATUS(status) : SIGNAL_STATUS_BASE + WTERMSIG(status);
+            apply_event(j, &j->procs[i], EVENT_EXITED, code, usage);
+        }
+        return;
+    }
+}
+
+int jobs_reap(int block)
+{
+    int saved_errno = errno;
+    int options = WUNTRACED | WCONTINUED | (block ? 0 : WNOHANG);
+    int changes = 0;
+
+    while (1)
+    {
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, options, &usage);
+        if (pid == -1)
+        {
+            if (errno == EINTR && changes == 0)
+            {
+                continue;
+            }
+            if (errno == ECHILD && changes == 0)
+            {
+                changes = -1;
+            }
+            break;
+        }
+        if (pid == 0)
+        {
+            break;
+        }
+        record_status(pid, status, &usage);
+        changes++;
+        // Collect whatever else is ready without blocking again
+        options |= WNOHANG;
+    }
+
+    errno = saved_errno;
+    return changes;
+}
+
+/**
+ * @brief Returns the word describing a job's state in `jobs` and notices.
+ */
+static const char* state_text(const job* j, char* buffer, size_t size)
+{
+    switch (j->state)
+    {
+    case JOB_RUNNING:
+        return "Running";
+    case JOB_STOPPED:
+        return "Stopped";
+    case JOB_DONE:
+    default:
+        if (j->status == 0)
+        {
+            return "Done";
+        }
+        snprintf(buffer, size, "Exit %d", j->status);
+        return buffer;
+    }
+}
+
+/**
+ * @brief Prints a job as `[id]+  State  command`.
+ */
+static void print_job(const job* j, int long_format)
+{
+    char buffer[32];
+    char marker = j->id == current_id ? '+' : (j->id == previous_id ? '-' : ' ');
+    printf("[%d]%c  ", j->id, marker);
+    if (long_format)
+    {
+        printf("%d ", j->procs[0].pid);
+    }
+    printf("%-24s%s%s\n", state_text(j, buffer, sizeof(buffer)), j->command, j->state == JOB_RUNNING ? " &" : "");
+
+    if (long_format)
+    {
+        struct timespec now;
+        const struct timespec* end = &j->ended;
+        if (j->state != JOB_DONE)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            end = &now;
+        }
+        long elapsed_ms = (end->tv_sec - j->started.tv_sec) * 1000L + (end->tv_nsec - j->started.tv_nsec) / 1000000L;
+        printf("      elapsed %ld.%03lds  user %ld.%03lds  sys %ld.%03lds  maxrss %ldKB\n", elapsed_ms / 1000,
+               elapsed_ms % 1000, (long)j->usage.ru_utime.tv_sec, (long)j->usage.ru_utime.tv_usec / 1000,
+               (long)j->usage.ru_stime.tv_sec, (long)j->usage.ru_stime.tv_usec / 1000, j->usage.ru_maxrss);
+    }
+}
+
+/**
+ * @brief Takes the changed list, so it can be walked while jobs are removed.
+ */
+static job* take_changed(void)
+{
+    job* head = changed_head;
+    changed_head = NULL;
+    for (job* j = head; j != NULL; j = j->next_changed)
+    {
+        j->queued = 0;
+    }
+    return head;
+}
+
+void jobs_notify(int verbose)
+{
+    sigset_t old;
+    jobs_block_sigchld(&old);
+
+    job* next;
+    for (job* j = take_changed(); j != NULL; j = next)
+    {
+        next = j->next_changed;
+        if (j->foreground)
+        {
+            continue;
+        }
+        if (verbose && !j->notified)
+        {
+            print_job(j, 0);
+        }
+        j->notified = 1;
+        if (j->state == JOB_DONE)
+        {
+            job_remove(j);
+        }
+    }
+    fflush(stdout);
+
+    jobs_restore_sigmask(&old);
+}
+
+int job_signal(const job* j, int sig)
+{
+    if (j->pgid > 0)
+    {
+        return kill(-j->pgid, sig);
+    }
+    int result = 0;
+    for (size_t i = 0; i < j->num_procs; i++)
+    {
+        if (j->procs[i].state != JOB_DONE && kill(j->procs[i].pid, sig) == -1)
+        {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Collects pending state changes of one process through its pidfd.
+ *
+ * waitid() is called through syscall(2) for its rusage argument, which the
+ * libc wrapper does not expose.
+ */
+static void collect_pidfd(job* j, size_t index, int pidfd)
+{
+    while (j->procs[index].state != JOB_DONE)
+    {
+        siginfo_t info;
+        struct rusage usage;
+        memset(&info, 0, sizeof(info));
+        if (syscall(SYS_waitid, P_PIDFD, pidfd, &info, WEXITED | WSTOPPED | WCONTINUED | WNOHANG, &usage) == -1 ||
+            info.si_pid == 0)
+        {
+            return;
+        }
+        job_process* proc = &j->procs[index];
+        switch (info.si_code)
+        {
+        case CLD_EXITED:
+            apply_event(j, proc, EVENT_EXITED, info.si_status, &usage);
+            break;
+        case CLD_KILLED:
+        case CLD_DUMPED:
+            apply_event(j, proc, EVENT_EXITED, SIGNAL_STATUS_BASE + info.si_status, &usage);
+            break;
+        case CLD_STOPPED:
+        case CLD_TRAPPED:
+            apply_event(j, proc, EVENT_STOPPED, SIGNAL_STATUS_BASE + info.si_status, NULL);
+            return;
+        case CLD_CONTINUED:
+            apply_event(j, proc, EVENT_CONTINUED, 0, NULL);
+            break;
+        default:
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Creates the epoll set and the SIGCHLD signalfd used by foreground waits.
+ *
+ * @return int 0 on success, -1 on error.
+ */
+static int open_wait_set(void)
+{
+    if (wait_epoll_fd != -1)
+    {
+        return 0;
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    wait_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = SIGCHLD_EVENT;
+    if (wait_epoll_fd == -1 || sigchld_fd == -1 || epoll_ctl(wait_epoll_fd, EPOLL_CTL_ADD, sigchld_fd, &event) == -1)
+    {
+        perror("epoll");
+        if (wait_epoll_fd != -1)
+        {
+            close(wait_epoll_fd);
+        }
+        if (sigchld_fd != -1)
+        {
+            close(sigchld_fd);
+        }
+        wait_epoll_fd = -1;
+        sigchld_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Waits for a job through one pidfd per process on the epoll set.
+ *
+ * A pidfd only becomes readable when its process exits, so stops are noticed
+ * through the SIGCHLD signalfd, after which every live process is polled.
+ *
+ * @return int 0 once the job finished or stopped, -1 if pidfds are not available.
+ */
+static int wait_with_pidfds(job* j)
+{
+    if (pidfd_unsupported || open_wait_set() == -1)
+    {
+        return -1;
+    }
+    int* pidfds = malloc(j->num_procs * sizeof(int));
+    if (pidfds == NULL)
+    {
+        perror("malloc");
+        return -1;
+    }
+
+    for (size_t i = 0; i < j->num_procs; i++)
+    {
+        pidfds[i] = -1;
+        if (j->procs[i].state == JOB_DONE)
+        {
+            continue;
+        }
+        pidfds[i] = (int)syscall(SYS_pidfd_open, j->procs[i].pid, 0);
+        if (pidfds[i] == -1 && errno == ENOSYS)
+        {
+            pidfd_unsupported = 1;
+            for (size_t k = 0; k < i; k++)
+            {
+                if (pidfds[k] != -1)
+                {
+                    close(pidfds[k]);
+                }
+            }
+            free(pidfds);
+            return -1;
+        }
+        if (pidfds[i] == -1)
+        {
+            continue;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = i;
+        epoll_ctl(wait_epoll_fd, EPOLL_CTL_ADD, pidfds[i], &event);
+        // It may have changed state before the pidfd existed
+        collect_pidfd(j, i, pidfds[i]);
+    }
+
+    while (j->state == JOB_RUNNING)
+    {
+        struct epoll_event events[MAX_WAIT_EVENTS];
+        int ready = epoll_wait(wait_epoll_fd, events, MAX_WAIT_EVENTS, -1);
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+        for (int e = 0; e < ready; e++)
+        {
+            if (events[e].data.u64 != SIGCHLD_EVENT)
+            {
+                size_t i = (size_t)events[e].data.u64;
+                collect_pidfd(j, i, pidfds[i]);
+                continue;
+            }
+            struct signalfd_siginfo info;
+            while (read(sigchld_fd, &info, sizeof(info)) == sizeof(info))
+            {
+            }
+            for (size_t i = 0; i < j->num_procs; i++)
+            {
+                if (pidfds[i] != -1)
+                {
+                    collect_pidfd(j, i, pidfds[i]);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < j->num_procs; i++)
+    {
+        if (pidfds[i] != -1)
+        {
+            epoll_ctl(wait_epoll_fd, EPOLL_CTL_DEL, pidfds[i], NULL);
+            close(pidfds[i]);
+        }
+    }
+    free(pidfds);
+    return 0;
+}
+
+/**
+ * @brief Waits for a job with waitpid() on each of its processes in turn.
+ */
+static void wait_per_process(job* j)
+{
+    for (size_t i = 0; i < j->num_procs; i++)
+    {
+        while (j->procs[i].state == JOB_RUNNING)
+        {
+            int status;
+            struct rusage usage;
+            pid_t pid = wait4(j->procs[i].pid, &status, WUNTRACED, &usage);
+            if (pid == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (pid == -1)
+            {
+                // Reaped elsewhere; its status is lost
+                struct rusage none;
+                memset(&none, 0, sizeof(none));
+                apply_event(j, &j->procs[i], EVENT_EXITED, 0, &none);
+                break;
+            }
+            record_status(pid, status, &usage);
+        }
+    }
+}
+
+/**
+ * @brief Saves the per-process statuses of a finished foreground job and exports `PIPESTATUS`.
+ */
+static void save_pipestatus(job* j)
+{
+    // The job is about to be freed, so take its process array instead of copying it
+    free(last_procs);
+    finished_count++;
+    last_procs = j->procs;
+    last_num_procs = j->num_procs;
+    j->procs = NULL;
+    j->num_procs = 0;
+
+    char* text = malloc(last_num_procs * 5 + 1);
+    if (text == NULL)
+    {
+        return;
+    }
+    char* end = text;
+    for (size_t i = 0; i < last_num_procs; i++)
+    {
+        end += sprintf(end, i == 0 ? "%d" : " %d", last_procs[i].status);
+    }
+    setenv("PIPESTATUS", text, 1);
+    free(text);
+}
+
+const job_process* jobs_last_pipestatus(size_t* count)
+{
+    *count = last_num_procs;
+    return last_procs;
+}
+
+unsigned long jobs_finished_count(void)
+{
+    return finished_count;
+}
+
+int job_wait(job* j)
+{
+    j->foreground = 1;
+    foreground_job = j;
+    int owns_terminal = terminal_fd != -1 && j->pgid > 0;
+    if (owns_terminal)
+    {
+        set_terminal_owner(j->pgid);
+    }
+
+    if (wait_with_pidfds(j) == -1)
+    {
+        wait_per_process(j);
+    }
+    // SIGCHLDs consumed above may have been for background jobs
+    jobs_reap(0);
+
+    if (owns_terminal)
+    {
+        set_terminal_owner(shell_pgid);
+        tcsetattr(terminal_fd, TCSADRAIN, &shell_modes);
+    }
+    foreground_job = NULL;
+    j->foreground = 0;
+
+    if (j->state == JOB_STOPPED)
+    {
+        int status = SIGNAL_STATUS_BASE + SIGTSTP;
+        for (size_t i = 0; i < j->num_procs; i++)
+        {
+            if (j->procs[i].state == JOB_STOPPED)
+            {
+                status = j->procs[i].status;
+            }
+        }
+        make_current(j->id);
+        j->notified = 1;
+        printf("\n");
+        print_job(j, 0);
+        fflush(stdout);
+        return status;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    stats_record(STAT_RUN, (uint64_t)(now.tv_sec - j->started.tv_sec) * 1000000000ull + (uint64_t)now.tv_nsec -
+                               (uint64_t)j->started.tv_nsec);
+
+    int status = j->status;
+    save_pipestatus(j);
+    job_remove(j);
+    return status;
+}
+
+/**
+ * @brief Marks every stopped process of a job as running after SIGCONT was sent.
+ */
+static void mark_continued(job* j)
+{
+    for (size_t i = 0; i < j->num_procs; i++)
+    {
+        if (j->procs[i].state == JOB_STOPPED)
+        {
+            j->procs[i].state = JOB_RUNNING;
+        }
+    }
+    j->state = JOB_RUNNING;
+    j->notified = 0;
+}
+
+/**
+ * @brief jobs [-l|-p]: lists the jobs.
+ */
+static int jobs_builtin(int argc, char** argv)
+{
+    int long_format = argc > 1 && strcmp(argv[1], "-l") == 0;
+    int pids_only = argc > 1 && strcmp(argv[1], "-p") == 0;
+    if (argc > 1 && !long_format && !pids_only)
+    {
+        fprintf(stderr, "jobs: %s: invalid option\n", argv[1]);
+        return 2;
+    }
+
+    sigset_t old;
+    jobs_block_sigchld(&old);
+    for (int id = 1; id <= max_id; id++)
+    {
+        job* j = jobs_by_id[id];
+        if (j == NULL || j->foreground)
+        {
+            continue;
+        }
+        if (pids_only)
+        {
+            printf("%d\n", j->procs[0].pid);
+            continue;
+        }
+        print_job(j, long_format);
+        if (j->state == JOB_DONE)
+        {
+            // Reported now, so there is no notice at the next prompt
+            j->notified = 1;
+        }
+    }
+    // Finished jobs have been reported
+    jobs_notify(0);
+    jobs_restore_sigmask(&old);
+    return 0;
+}
+
+/**
+ * @brief fg [job]: continues a job in the foreground and waits for it.
+ */
+static int fg_builtin(int argc, char** argv)
+{
+    sigset_t old;
+    jobs_block_sigchld(&old);
+    job* j = job_from_spec(argc > 1 ? argv[1] : NULL);
+    int status = 1;
+    if (j != NULL)
+    {
+        printf("%s\n", j->command);
+        fflush(stdout);
+        if (j->state == JOB_STOPPED)
+        {
+            job_signal(j, SIGCONT);
+            mark_continued(j);
+        }
+        status = job_wait(j);
+    }
+    jobs_restore_sigmask(&old);
+    return status;
+}
+
+/**
+ * @brief bg [job]: continues a stopped job in the background.
+ */
+static int bg_builtin(int argc, char** argv)
+{
+    sigset_t old;
+    jobs_block_sigchld(&old);
+    job* j = job_from_spec(argc > 1 ? argv[1] : NULL);
+    int status = 1;
+    if (j != NULL && j->state == JOB_DONE)
+    {
+        fprintf(stderr, "bg: job %d has already completed\n", j->id);
+    }
+    else if (j != NULL)
+    {
+        if (j->state == JOB_STOPPED)
+        {
+            job_signal(j, SIGCONT);
+            mark_continued(j);
+        }
+        make_current(j->id);
+        printf("[%d]+ %s &\n", j->id, j->command);
+        status = 0;
+    }
+    jobs_restore_sigmask(&old);
+    return status;
+}
+
+/**
+ * @brief Waits until `j` is no longer running, then removes it if it finished.
+ */
+static int wait_for_job(job* j)
+{
+    while (j->state == JOB_RUNNING && jobs_reap(1) != -1)
+    {
+    }
+    if (j->state != JOB_DONE)
+    {
+        // Stopped: report the stop signal like a foreground wait would
+        return SIGNAL_STATUS_BASE + SIGTSTP;
+    }
+    int status = j->status;
+    job_remove(j);
+    return status;
+}
+
+/**
+ * @brief Waits for the next background job to finish and returns its status.
+ */
+static int wait_next(void)
+{
+    while (num_jobs > 0)
+    {
+        for (job* j = changed_head; j != NULL; j = j->next_changed)
+        {
+            if (j->state == JOB_DONE && !j->foreground && !j->notified)
+            {
+                int status = j->status;
+                job_remove(j);
+                return status;
+            }
+        }
+        if (jobs_reap(1) == -1)
+        {
+            break;
+        }
+    }
+    return SIGNAL_STATUS_BASE - 1;
+}
+
+/**
+ * @brief wait [-n] [job...]: waits for background jobs.
+ */
+static int wait_builtin(int argc, char** argv)
+{
+    sigset_t old;
+    jobs_block_sigchld(&old);
+    int status = 0;
+
+    if (argc > 1 && strcmp(argv[1], "-n") == 0)
+    {
+        status = wait_next();
+    }
+    else if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            job* j = job_from_spec(argv[i]);
+            status = j != NULL ? wait_for_job(j) : SIGNAL_STATUS_BASE - 1;
+        }
+    }
+    else
+    {
+        // Every job that is still running; finished ones stay for their notice
+        for (int id = 1; id <= max_id; id++)
+        {
+            job* j = jobs_by_id[id];
+            while (j != NULL && j->state == JOB_RUNNING && jobs_reap(1) != -1)
+            {
+            }
+        }
+    }
+
+    jobs_restore_sigmask(&old);
+    return status;
+}
+
+/**
+ * @brief A signal accepted by `kill` by name.
+ */
+typedef struct
+{
+    const char* name; /**< Name without the `SIG` prefix. */
+    int number;       /**< Signal number. */
+} signal_name;
+
+/**
+ * @brief Signals `kill` knows by name.
+ */
+static const signal_name signal_names[] = {
+    {"HUP", SIGHUP},   {"INT", SIGINT},   {"QUIT", SIGQUIT}, {"KILL", SIGKILL}, {"USR1", SIGUSR1},
+    {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM}, {"TERM", SIGTERM}, {"CHLD", SIGCHLD},
+    {"CONT", SIGCONT}, {"STOP", SIGSTOP}, {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU},
+    {"WINCH", SIGWINCH},
+};
+
+/**
+ * @brief Parses a signal given as a number, a name or a `SIG` name.
+ *
+ * @return int The signal number, or -1 if it is not valid.
+ */
+static int parse_signal(const char* text)
+{
+    char* end;
+    long number = strtol(text, &end, 10);
+    if (*end == '\0' && end != text)
+    {
+        return number >= 0 && number < NSIG ? (int)number : -1;
+    }
+    if (strncmp(text, "SIG", 3) == 0)
+    {
+        text += 3;
+    }
+    for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++)
+    {
+        if (strcmp(text, signal_names[i].name) == 0)
+        {
+            return signal_names[i].number;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief kill [-s sig | -sig] pid|job...: sends a signal to processes or jobs.
+ */
+static int kill_builtin(int argc, char** argv)
+{
+    int sig = SIGTERM;
+    int first = 1;
+
+    if (strcmp(argv[1], "-l") == 0)
+    {
+        for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++)
+        {
+            printf("%2d) SIG%s\n", signal_names[i].number, signal_names[i].name);
+        }
+        return 0;
+    }
+    if (strcmp(argv[1], "-s") == 0 && argc > 2)
+    {
+        sig = parse_signal(argv[2]);
+        first = 3;
+    }
+    else if (argv[1][0] == '-' && argv[1][1] != '\0')
+    {
+        sig = parse_signal(argv[1] + 1);
+        first = 2;
+    }
+    if (sig == -1)
+    {
+        fprintf(stderr, "kill: %s: invalid signal specification\n", argv[first - 1]);
+        return 1;
+    }
+    if (first >= argc)
+    {
+        fprintf(stderr, "kill: usage: kill [-s sig | -sig] pid | %%job ...\n");
+        return 2;
+    }
+
+    sigset_t old;
+    jobs_block_sigchld(&old);
+    int status = 0;
+    for (int i = first; i < argc; i++)
+    {
+        if (argv[i][0] == '%')
+        {
+            job* j = job_from_spec(argv[i]);
+            if (j == NULL || job_signal(j, sig) == -1)
+            {
+                status = 1;
+            }
+            else if (j->state == JOB_STOPPED && sig != SIGCONT && sig != SIGKILL && sig != SIGSTOP)
+            {
+                // A stopped job only sees the signal once it runs again
+                job_signal(j, SIGCONT);
+            }
+            continue;
+        }
+        char* end;
+        long pid = strtol(argv[i], &end, 10);
+        if (*end != '\0' || end == argv[i])
+        {
+            fprintf(stderr, "kill: %s: arguments must be process or job IDs\n", argv[i]);
+            status = 1;
+        }
+        else if (kill((pid_t)pid, sig) == -1)
+        {
+            fprintf(stderr, "kill: (%ld): %s\n", pid, strerror(errno));
+            status = 1;
+        }
+    }
+    jobs_restore_sigmask(&old);
+    return status;
+}
+
+/**
+ * @brief pipestatus [-v]: prints the exit status of every stage of the last foreground pipeline.
+ */
+static int pipestatus_builtin(int argc, char** argv)
+{
+    int verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+    if (argc > 1 && !verbose)
+    {
+        fprintf(stderr, "pipestatus: %s: invalid option\n", argv[1]);
+        return 2;
+    }
+    for (size_t i = 0; i < last_num_procs; i++)
+    {
+        const job_process* proc = &last_procs[i];
+        if (!verbose)
+        {
+            printf(i == 0 ? "%d" : " %d", proc->status);
+            continue;
+        }
+        printf("%zu: pid %d status %d user %ld.%03lds sys %ld.%03lds maxrss %ldKB\n", i, proc->pid, proc->status,
+               (long)proc->usage.ru_utime.tv_sec, (long)proc->usage.ru_utime.tv_usec / 1000,
+               (long)proc->usage.ru_stime.tv_sec, (long)proc->usage.ru_stime.tv_usec / 1000, proc->usage.ru_maxrss);
+    }
+    if (!verbose && last_num_procs > 0)
+    {
+        printf("\n");
+    }
+    return 0;
+}
+
+/**
+ * @brief Builtins implemented in this module.
+ */
+static const builtin job_builtins[] = {
+    {"jobs", jobs_builtin, 0, 1, BUILTIN_SHELL_STATE, "jobs [-l|-p]"},
+    {"fg", fg_builtin, 0, 1, BUILTIN_SHELL_STATE, "fg [%job]"},
+    {"bg", bg_builtin, 0, 1, BUILTIN_SHELL_STATE, "bg [%job]"},
+    {"wait", wait_builtin, 0, BUILTIN_ANY_ARGS, BUILTIN_SHELL_STATE, "wait [-n] [%job|pid...]"},
+    {"kill", kill_builtin, 1, BUILTIN_ANY_ARGS, BUILTIN_SHELL_STATE, "kill [-s sig | -sig] pid | %job..."},
+    {"pipestatus", pipestatus_builtin, 0, 1, BUILTIN_SHELL_STATE, "pipestatus [-v]"},
+};
+
+void jobs_register_builtins(void)
+{
+    builtin_register(job_builtins, sizeof(job_builtins) / sizeof(job_builtins[0]));
+}
@@ -0,0 +1,396 @@
+#define _GNU_SOURCE
+#include "launcher.h"
+#include "forkserver.h"
+#include "path_cache.h"
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @brief Exit status of a child whose exec failed.
+ */
+#define EXEC_FAILURE_STATUS 127
+
+extern char** environ;
+
+/**
+ * @brief Backend used by launch_command().
+ */
+static launch_backend current_backend = LAUNCH_BACKEND_POSIX_SPAWN;
+
+/**
+ * @brief Signals the shell catches; children must see them with their default action.
+ */
+static const int reset_signals[] = {SIGINT, SIGQUIT, SIGTSTP, SIGCHLD, SIGTTIN, SIGTTOU, SIGPIPE};
+
+/**
+ * @brief Number of entries in reset_signals.
+ */
+#define NUM_RESET_SIGNALS (sizeof(reset_signals) / sizeof(reset_signals[0]))
+
+void launch_spec_init(launch_spec* spec, char* const* argv)
+{
+    spec->argv = argv;
+    spec->envp = NULL;
+    spec->num_actions = 0;
+    spec->pgid = LAUNCH_PGID_INHERIT;
+    spec->policy = NULL;
+}
+
+int launch_spec_add_dup2(launch_spec* spec, int fd, int target_fd)
+{
+    if (spec->num_actions >= LAUNCH_MAX_ACTIONS)
+    {
+        fprintf(stderr, "launch: too many file actions\n");
+        return -1;
+    }
+    spec->actions[spec->num_actions].type = LAUNCH_ACTION_DUP2;
+    spec->actions[spec->num_actions].fd = fd;
+    spec->actions[spec->num_actions].target_fd = target_fd;
+    spec->num_actions++;
+    return 0;
+}
+
+int launch_spec_add_close(launch_spec* spec, int fd)
+{
+    if (spec->num_actions >= LAUNCH_MAX_ACTIONS)
+    {
+        fprintf(stderr, "launch: too many file actions\n");
+        return -1;
+    }
+    spec->actions[spec->num_actions].type = LAUNCH_ACTION_CLOSE;
+    spec->actions[spec->num_actions].fd = fd;
+    spec->actions[spec->num_actions].target_fd = -1;
+    spec->num_actions++;
+    return 0;
+}
+
+void launch_set_backend(launch_backend backend)
+{
+    current_backend = backend;
+}
+
+launch_backend launch_get_backend(void)
+{
+    return current_backend;
+}
+
+int launch_backend_from_name(const char* name, launch_backend* backend)
+{
+    if (strcmp(name, "posix_spawn") == 0)
+    {
+        *backend = LAUNCH_BACKEND_POSIX_SPAWN;
+    }
+    else if (strcmp(name, "vfork") == 0)
+    {
+        *backend = LAUNCH_BACKEND_VFORK;
+    }
+    else if (strcmp(name, "fork") == 0)
+    {
+        *backend = LAUNCH_BACKEND_FORK;
+    }
+    else if (strcmp(name, "forkserver") == 0)
+    {
+        *backend = LAUNCH_BACKEND_FORKSERVER;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Who ioprio_set(2) applies to: a single process.
+ */
+#define IOPRIO_WHO_PROCESS_ID 1
+
+int launch_policy_apply(const launch_policy* policy)
+{
+    if (policy->flags & LAUNCH_POLICY_CPUS)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu = 0; cpu < LAUNCH_MAX_CPUS && cpu < CPU_SETSIZE; cpu++)
+        {
+            if (policy->cpus[cpu / LAUNCH_CPU_WORD_BITS] & (1UL << (cpu % LAUNCH_CPU_WORD_BITS)))
+            {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) == -1)
+        {
+            return -1;
+        }
+    }
+    if (policy->flags & LAUNCH_POLICY_NICE)
+    {
+        // nice() may legitimately return -1: only errno tells a failure
+        errno = 0;
+        if (nice(policy->nice) == -1 && errno != 0)
+        {
+            return -1;
+        }
+    }
+    if ((policy->flags & LAUNCH_POLICY_IOPRIO) &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS_ID, 0, policy->ioprio) == -1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Launches `spec` through posix_spawn(3).
+ *
+ * @param spec The process to launch.
+ * @param path The resolved executable.
+ * @param error Where to store the error number on failure.
+ */
+static pid_t launch_posix_spawn(const launch_spec* spec, const char* path, int* error)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    pid_t pid = -1;
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    int rc;
+
+    if ((rc = posix_spawn_file_actions_init(&actions)) != 0)
+    {
+        *error = rc;
+        return -1;
+    }
+    if ((rc = posix_spawnattr_init(&attr)) != 0)
+    {
+        *error = rc;
+        posix_spawn_file_actions_destroy(&actions);
+        return -1;
+    }
+
+    for (int i = 0; i < spec->num_actions && rc == 0; i++)
+    {
+        const launch_action* action = &spec->actions[i];
+        if (action->type == LAUNCH_ACTION_DUP2)
+        {
+            rc = posix_spawn_file_actions_adddup2(&actions, action->fd, action->target_fd);
+        }
+        else
+        {
+            rc = posix_spawn_file_actions_addclose(&actions, action->fd);
+        }
+    }
+
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    for (size_t i = 0; i < NUM_RESET_SIGNALS; i++)
+    {
+        sigaddset(&mask, reset_signals[i]);
+    }
+    posix_spawnattr_setsigdefault(&attr, &mask);
+
+    if (spec->pgid != LAUNCH_PGID_INHERIT)
+    {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, spec->pgid);
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    if (rc == 0)
+    {
+        rc = posix_spawn(&pid, path, &actions, &attr, spec->argv, spec->envp != NULL ? spec->envp : environ);
+    }
+    if (rc != 0)
+    {
+        *error = rc;
+        pid = -1;
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return pid;
+}
+
+/**
+ * @brief Child side of the vfork and fork backends.
+ *
+ * Only async-signal-safe calls are made here since, under vfork, the child
+ * borrows the parent's memory until it execs or exits.
+ *
+ * @param spec The process to launch.
+ * @param path The resolved executable.
+ * @param exec_errno Where to store errno if exec fails (shared with the parent under vfork).
+ * @param mask The signal mask to install before exec.
+ * @param shared_memory Non-zero under vfork; a forked child reports errors itself.
+ */
+static void launch_child(const launch_spec* spec, const char* path, volatile int* exec_errno, const sigset_t* mask,
+                         int shared_memory)
+{
+    for (size_t i = 0; i < NUM_RESET_SIGNALS; i++)
+    {
+        signal(reset_signals[i], SIG_DFL);
+    }
+    for (int i = 0; i < spec->num_actions; i++)
+    {
+        const launch_action* action = &spec->actions[i];
+        int rc = action->type == LAUNCH_ACTION_DUP2 ? dup2(action->fd, action->target_fd) : close(action->fd);
+        if (rc == -1)
+        {
+            *exec_errno = errno;
+            _exit(EXEC_FAILURE_STATUS);
+        }
+    }
+    if (spec->pgid != LAUNCH_PGID_INHERIT && setpgid(0, spec->pgid) == -1)
+    {
+        *exec_errno = errno;
+        _exit(EXEC_FAILURE_STATUS);
+    }
+    if (spec->policy != NULL && launch_policy_apply(spec->policy) == -1)
+    {
+        *exec_errno = errno;
+        _exit(EXEC_FAILURE_STATUS);
+    }
+    char* const* envp = spec->envp != NULL ? spec->envp : environ;
+    sigprocmask(SIG_SETMASK, mask, NULL);
+    execve(path, spec->argv, envp);
+    *exec_errno = errno;
+    if (!shared_memory)
+    {
+        // Nobody can evict a stale cache entry for us, so search PATH directly
+        if (path != spec->argv[0] && (errno == ENOENT || errno == ENOTDIR))
+        {
+            execvpe(spec->argv[0], spec->argv, envp);
+        }
+        perror(spec->argv[0]);
+    }
+    _exit(EXEC_FAILURE_STATUS);
+}
+
+/**
+ * @brief Launches `spec` with vfork(2) or fork(2).
+ *
+ * All signals are blocked around the fork so no shell handler can run in the
+ * child before its dispositions are reset.
+ *
+ * @param spec The process to launch.
+ * @param path The resolved executable.
+ * @param use_vfork Non-zero to use vfork(2).
+ * @param error Where to store the error number on failure.
+ */
+static pid_t launch_forked(const launch_spec* spec, const char* path, int use_vfork, int* error)
+{
+    static volatile int exec_errno;
+    sigset_t all;
+    sigset_t old;
+    sigset_t none;
+    pid_t pid;
+
+    sigfillset(&all);
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &all, &old);
+    exec_errno = 0;
+
+    pid = use_vfork ? vfork() : fork();
+    if (pid == 0)
+    {
+        // Like posix_spawn, start with nothing blocked even if the shell blocks SIGCHLD
+        launch_child(spec, path, &exec_errno, &none, use_vfork);
+    }
+
+    *error = errno;
+    if (pid > 0 && !use_vfork && spec->pgid != LAUNCH_PGID_INHERIT)
+    {
+        // The forked child may not have run yet; set its group from here too
+        setpgid(pid, spec->pgid);
+    }
+    // Under vfork the child has either exec'd or exited by now, so a failed
+    // exec is reaped and reported here, like posix_spawn does. A forked child
+    // reports through its own stderr and exit status instead.
+    if (pid > 0 && use_vfork && exec_errno != 0)
+    {
+        *error = exec_errno;
+        waitpid(pid, NULL, 0);
+        pid = -1;
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return pid;
+}
+
+/**
+ * @brief Launches `spec` running the executable at `path` with the active backend.
+ */
+static pid_t launch_path(const launch_spec* spec, const char* path, int* error)
+{
+    if (spec->policy != NULL && current_backend != LAUNCH_BACKEND_FORK)
+    {
+        // Neither posix_spawn nor the fork server can run the policy in the child
+        return launch_forked(spec, path, 1, error);
+    }
+    switch (current_backend)
+    {
+    case LAUNCH_BACKEND_VFORK:
+        return launch_forked(spec, path, 1, error);
+    case LAUNCH_BACKEND_FORK:
+        return launch_forked(spec, path, 0, error);
+    case LAUNCH_BACKEND_FORKSERVER:
+        if (forkserver_running() || forkserver_start() == 0)
+        {
+            pid_t pid = forkserver_launch(spec, path, error);
+            if (pid != -1 || (*error != EMSGSIZE && *error != ENOTCONN))
+            {
+                return pid;
+            }
+        }
+        // Too large for a request, or no server: launch it directly
+        return launch_posix_spawn(spec, path, error);
+    case LAUNCH_BACKEND_POSIX_SPAWN:
+    default:
+        return launch_posix_spawn(spec, path, error);
+    }
+}
+
+pid_t launch_command(const launch_spec* spec)
+{
+    if (spec->argv == NULL || spec->argv[0] == NULL)
+    {
+        fprintf(stderr, "launch: empty command\n");
+        return -1;
+    }
+
+    const char* name = spec->argv[0];
+    const char* path = path_cache_resolve(name);
+    if (path == NULL)
+    {
+        fprintf(stderr, "%s: command not found\n", name);
+        return -1;
+    }
+
+    int error = 0;
+    pid_t pid = launch_path(spec, path, &error);
+    if (pid == -1 && path != name && (error == ENOENT || error == ENOTDIR))
+    {
+        // The cached binary disappeared; search PATH again
+        path_cache_forget(name);
+        path = path_cache_resolve(name);
+        if (path == NULL)
+        {
+            fprintf(stderr, "%s: command not found\n", name);
+            return -1;
+        }
+        pid = launch_path(spec, path, &error);
+    }
+    if (pid == -1)
+    {
+        errno = error;
+        perror(name);
+    }
+    return pid;
+}
@@ -0,0 +1,405 @@
+#include "lexer.h"
+#include <ctype.h>
+#include <string.h>
+
+/**
+ * @brief Upper bound for the descriptor number written before a redirection.
+ */
+#define MAX_IO_NUMBER 1000
+
+void lexer_init(lexer* lex, const char* text, size_t len)
+{
+    lex->pos = text;
+    lex->end = text + len;
+}
+
+/**
+ * @brief Checks whether `c` ends an unquoted word.
+ */
+static int is_metachar(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '|' || c == '&' || c == ';' || c == '<' || c == '>' ||
+           c == '(' || c == ')';
+}
+
+const char* lexer_parameter_end(const char* p, const char* end)
+{
+    int depth = 1;
+    while (p < end)
+    {
+        if (*p == '\\')
+        {
+            p += 2;
+        }
+        else if (*p == '\'')
+        {
+            const char* close = memchr(p + 1, '\'', (size_t)(end - p - 1));
+            if (close == NULL)
+            {
+                return NULL;
+            }
+            p = close + 1;
+        }
+        else if (*p == '"')
+        {
+            p++;
+            while (p < end && *p != '"')
+            {
+                p += (*p == '\\' && p + 1 < end) ? 2 : 1;
+            }
+            p++;
+        }
+        else if (*p == '$' && p + 1 < end && p[1] == '{')
+        {
+            depth++;
+            p += 2;
+        }
+        else if (*p == '}' && --depth == 0)
+        {
+            return p;
+        }
+        else
+        {
+            p++;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Skips a double-quoted string whose opening quote is just before `p`.
+ *
+ * @return const char* The first character after the closing quote, or NULL if the input ends first.
+ */
+static const char* skip_double_quoted(const char* p, const char* end)
+{
+    while (p < end && *p != '"')
+    {
+        if (*p == '\\')
+        {
+            p += 2;
+        }
+        else if (*p == '$' && p + 1 < end && p[1] == '(')
+        {
+            // Quotes inside `$(( ))` belong to it, not to the string
+            const char* close = lexer_substitution_end(p + 2, end);
+            if (close == NULL)
+            {
+                return NULL;
+            }
+            p = close + 1;
+        }
+        else
+        {
+            p++;
+        }
+    }
+    return p < end ? p + 1 : NULL;
+}
+
+const char* lexer_substitution_end(const char* p, const char* end)
+{
+    int depth = 1;
+    while (p < end)
+    {
+        if (*p == '\\')
+        {
+            p += 2;
+        }
+        else if (*p == '\'')
+        {
+            const char* close = memchr(p + 1, '\'', (size_t)(end - p - 1));
+            if (close == NULL)
+            {
+                return NULL;
+            }
+            p = close + 1;
+        }
+        else if (*p == '"')
+        {
+            p = skip_double_quoted(p + 1, end);
+            if (p == NULL)
+            {
+                return NULL;
+            }
+        }
+        else if (*p == '(')
+        {
+            depth++;
+            p++;
+        }
+        else if (*p == ')' && --depth == 0)
+        {
+            return p;
+        }
+        else
+        {
+            p++;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Advances past a word, honoring quotes, escapes, `${...}` and `$((...))`.
+ *
+ * @return int 0 on success, -1 if the input ends inside a quote or escape.
+ */
+static int scan_word(lexer* lex)
+{
+    const char* p = lex->pos;
+    while (p < lex->end && !is_metachar(*p))
+    {
+        if (*p == '\\')
+        {
+            if (p + 1 >= lex->end)
+            {
+                return -1;
+            }
+            p += 2;
+        }
+        else if (*p == '\'')
+        {
+            const char* close = memchr(p + 1, '\'', lex->end - p - 1);
+            if (close == NULL)
+            {
+                return -1;
+            }
+            p = close + 1;
+        }
+        else if (*p == '"')
+        {
+            p = skip_double_quoted(p + 1, lex->end);
+            if (p == NULL)
+            {
+                return -1;
+            }
+        }
+        else if (*p == '$' && p + 1 < lex->end && p[1] == '(')
+        {
+            // `$(( a + b ))` is a single word
+            const char* close = lexer_substitution_end(p + 2, lex->end);
+            if (close == NULL)
+            {
+                return -1;
+            }
+            p = close + 1;
+        }
+        else if (*p == '$' && p + 1 < lex->end && p[1] == '{')
+        {
+            // `${NAME:-two words}` is a single word
+            const char* close = lexer_parameter_end(p + 2, lex->end);
+            if (close == NULL)
+            {
+                return -1;
+            }
+            p = close + 1;
+        }
+        else
+        {
+            p++;
+        }
+    }
+    lex->pos = p;
+    return 0;
+}
+
+/**
+ * @brief Builds a token of `type` spanning from `start` to the lexer position.
+ */
+static token make_token(const lexer* lex, token_type type, const char* start)
+{
+    token tok;
+    tok.type = type;
+    tok.start = start;
+    tok.len = (size_t)(lex->pos - start);
+    tok.io_number = TOKEN_NO_IO_NUMBER;
+    return tok;
+}
+
+/**
+ * @brief Lexes an operator starting at the lexer position.
+ */
+static token scan_operator(lexer* lex)
+{
+    const char* start = lex->pos;
+    char c = *lex->pos++;
+    int doubled = lex->pos < lex->end && *lex->pos == c;
+
+    switch (c)
+    {
+    case '|':
+        lex->pos += doubled;
+        return make_token(lex, doubled ? TOKEN_OR_IF : TOKEN_PIPE, start);
+    case '&':
+        lex->pos += doubled;
+        return make_token(lex, doubled ? TOKEN_AND_IF : TOKEN_AMP, start);
+    case '>':
+        lex->pos += doubled;
+        return make_token(lex, doubled ? TOKEN_DGREAT : TOKEN_GREAT, start);
+    case '<':
+        if (!doubled)
+        {
+            return make_token(lex, TOKEN_LESS, start);
+        }
+        lex->pos++;
+        if (lex->pos < lex->end && (*lex->pos == '<' || *lex->pos == '-'))
+        {
+            return make_token(lex, *lex->pos++ == '<' ? TOKEN_TLESS : TOKEN_DLESSDASH, start);
+        }
+        return make_token(lex, TOKEN_DLESS, start);
+    case ';':
+        lex->pos += doubled;
+        return make_token(lex, doubled ? TOKEN_DSEMI : TOKEN_SEMI, start);
+    case '(':
+        return make_token(lex, TOKEN_LPAREN, start);
+    case ')':
+        return make_token(lex, TOKEN_RPAREN, start);
+    case '\n':
+    default:
+        return make_token(lex, TOKEN_NEWLINE, start);
+    }
+}
+
+token lexer_next(lexer* lex)
+{
+    // Skip blanks and escaped newlines
+    while (lex->pos < lex->end)
+    {
+        if (*lex->pos == ' ' || *lex->pos == '\t' || *lex->pos == '\r')
+        {
+            lex->pos++;
+        }
+        else if (*lex->pos == '\\' && lex->pos + 1 < lex->end && lex->pos[1] == '\n')
+        {
+            lex->pos += 2;
+        }
+        else if (*lex->pos == '#')
+        {
+            const char* newline = memchr(lex->pos, '\n', lex->end - lex->pos);
+            lex->pos = newline != NULL ? newline : lex->end;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    const char* start = lex->pos;
+    if (lex->pos >= lex->end)
+    {
+        return make_token(lex, TOKEN_EOF, start);
+    }
+    if (is_metachar(*lex->pos))
+    {
+        return scan_operator(lex);
+    }
+
+    if (scan_word(lex) == -1)
+    {
+        lex->pos = lex->end;
+        return make_token(lex, TOKEN_ERROR, start);
+    }
+
+    // A number directly followed by a redirection operator names the descriptor
+    if (lex->pos < lex->end && (*lex->pos == '<' || *lex->pos == '>'))
+    {
+        int io_number = 0;
+        const char* p = start;
+        while (p < lex->pos && isdigit((unsigned char)*p) && io_number < MAX_IO_NUMBER)
+        {
+            io_number = io_number * 10 + (*p++ - '0');
+        }
+        if (p == lex->pos)
+        {
+            token tok = scan_operator(lex);
+            tok.io_number = io_number;
+            return tok;
+        }
+    }
+    return make_token(lex, TOKEN_WORD, start);
+}
+
+int lexer_heredoc(lexer* lex, const char* delimiter, size_t delimiter_len, int strip_tabs, const char** body,
+                  size_t* body_len)
+{
+    const char* line = lex->pos;
+    while (line < lex->end)
+    {
+        const char* newline = memchr(line, '\n', (size_t)(lex->end - line));
+        const char* line_end = newline != NULL ? newline : lex->end;
+        const char* text = line;
+        while (strip_tabs && text < line_end && *text == '\t')
+        {
+            text++;
+        }
+        if ((size_t)(line_end - text) == delimiter_len && memcmp(text, delimiter, delimiter_len) == 0)
+        {
+            *body = lex->pos;
+            *body_len = (size_t)(line - lex->pos);
+            lex->pos = newline != NULL ? newline + 1 : lex->end;
+            return 0;
+        }
+        if (newline == NULL)
+        {
+            break;
+        }
+        line = newline + 1;
+    }
+    return -1;
+}
+
+char* lexer_unquote(arena* a, const char* start, size_t len)
+{
+    char* out = arena_alloc(a, len + 1);
+    const char* p = start;
+    const char* end = start + len;
+    size_t n = 0;
+
+    while (p < end)
+    {
+        if (*p == '\\' && p + 1 < end)
+        {
+            if (p[1] != '\n')
+            {
+                out[n++] = p[1];
+            }
+            p += 2;
+        }
+        else if (*p == '\'')
+        {
+            p++;
+            while (p < end && *p != '\'')
+            {
+                out[n++] = *p++;
+            }
+            p++;
+        }
+        else if (*p == '"')
+        {
+            p++;
+            while (p < end && *p != '"')
+            {
+                if (*p == '\\' && p + 1 < end && strchr("$`\"\\\n", p[1]) != NULL)
+                {
+                    if (p[1] != '\n')
+                    {
+                        out[n++] = p[1];
+                    }
+                    p += 2;
+                }
+                else
+                {
+                    out[n++] = *p++;
+                }
+            }
+            p++;
+        }
+        else
+        {
+            out[n++] = *p++;
+        }
+    }
+    out[n] = '\0';
+    return out;
+}
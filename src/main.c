@@ -1,15 +1,24 @@
 #include <errno.h>
 #include <limits.h>
-#include <linux/limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "commands.h"
-#include "utils.h"
+#include "complete.h"
+#include "editor.h"
+#include "expand.h"
+#include "forkserver.h"
+#include "history.h"
+#include "jobs.h"
+#include "launcher.h"
+#include "prompt.h"
+#include "script.h"
+#include "stats.h"
 
 #ifndef HOST_NAME_MAX
 /**
@@ -19,19 +28,44 @@
 #endif
 
 /**
- * @brief Size of the input buffer.
+ * @brief Maximum length of a username.
  */
-#define INPUT_SIZE 1024
+#define USERNAME_MAX 256
 
 /**
- * @brief Maximum number of lines to read in batch mode.
+ * @brief Prompt of the lines that continue an incomplete command.
  */
-#define MAX_LINES 100
+#define CONTINUATION_PROMPT "> "
 
 /**
- * @brief Maximum length of a username.
+ * @brief Reads a continuation line and appends it to `*line` after a newline.
+ *
+ * @param line The command so far, reallocated to hold the new line.
+ * @param len Its length, updated.
+ * @return int 0 on success, -1 at end of input or on error.
  */
-#define USERNAME_MAX 256
+static int append_continuation(char** line, size_t* len)
+{
+    char* more = editor_read_line(CONTINUATION_PROMPT, strlen(CONTINUATION_PROMPT));
+    if (more == NULL)
+    {
+        return -1;
+    }
+    size_t more_len = strlen(more);
+    char* joined = realloc(*line, *len + more_len + 2);
+    if (joined == NULL)
+    {
+        perror("realloc");
+        free(more);
+        return -1;
+    }
+    joined[(*len)++] = '\n';
+    memcpy(joined + *len, more, more_len + 1);
+    *len += more_len;
+    *line = joined;
+    free(more);
+    return 0;
+}
 
 /**
  * @brief Main function of the program.
@@ -46,8 +80,6 @@
 int main(int argc, char* argv[])
 {
     char hostname[HOST_NAME_MAX];
-    char cwd[PATH_MAX];
-    char* input[MAX_LINES];
     char* username = getenv("USER");
 
     if (username == NULL)
@@ -56,6 +88,46 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    // `$$` names this process, even in the subshells forked later
+    expand_init();
+
+    // Select how external commands are launched
+    const char* spawn_backend = getenv("MYSHELL_SPAWN");
+    if (spawn_backend != NULL)
+    {
+        launch_backend backend;
+        if (launch_backend_from_name(spawn_backend, &backend) == 0)
+        {
+            launch_set_backend(backend);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown MYSHELL_SPAWN backend: %s\n", spawn_backend);
+        }
+    }
+
+    // The fork server is forked now, while the shell is still small
+    if (launch_get_backend() == LAUNCH_BACKEND_FORKSERVER && forkserver_start() == -1)
+    {
+        launch_set_backend(LAUNCH_BACKEND_POSIX_SPAWN);
+    }
+
+    // myshell [-j N] [script]
+    long max_running = 1;
+    int script_index = 1;
+    if (argc > 2 && strcmp(argv[1], "-j") == 0)
+    {
+        char* end;
+        max_running = strtol(argv[2], &end, 10);
+        if (*end != '\0' || max_running < 0)
+        {
+            fprintf(stderr, "Usage: %s [-j N] [script]\n", argv[0]);
+            return 1;
+        }
+        script_index = 3;
+    }
+    const char* script = script_index < argc ? argv[script_index] : NULL;
+
     if (gethostname(hostname, sizeof(hostname)) != 0)
     {
         perror("gethostname");
@@ -65,53 +137,144 @@ int main(int argc, char* argv[])
     // Setup signal handlers
     setup_signal_handlers();
 
-    if (argc == 2)
+    // Every job runs in its own process group; the interactive shell also owns the terminal
+    job_control_init(script == NULL);
+
+    if (script != NULL && max_running != 1)
     {
-        // Mode batch: read commands from a file
-        FILE* file = fopen(argv[1], "r");
-        if (file == NULL)
-        {
-            perror("fopen");
-            return 1;
-        }
+        // Mode batch with -j: independent commands run concurrently, 0 meaning one per CPU
+        return run_script_concurrently(script, max_running);
+    }
+    else if (script != NULL)
+    {
+        // Mode batch: run the commands of a file as they are read
+        return run_script(script);
+    }
+    else
+    {
+        // Segments are cached between prompts; the expensive ones are computed on a thread
+        prompt_init(getenv(PROMPT_ENV), username, hostname);
 
-        int line_count = 0;
-        while (line_count < MAX_LINES && (input[line_count] = malloc(INPUT_SIZE)) != NULL &&
-               fgets(input[line_count], INPUT_SIZE, file) != NULL)
+        if (editor_usable())
         {
-            input[line_count][strcspn(input[line_count], "\n")] = 0;
-            line_count++;
-        }
-        fclose(file);
+            // Lines are edited in raw mode and kept with their status and duration
+            char history_path[PATH_MAX];
+            history_open(history_default_path(history_path, sizeof(history_path)));
+            static char prompt[PROMPT_MAX];
+            while (1)
+            {
+                jobs_notify(1);
 
-        for (int i = 0; i < line_count; i++)
-        {
-            execute_command(input[i]);
-            free(input[i]);
+                uint64_t prompt_start = stats_now();
+                size_t prompt_len = prompt_format(prompt, sizeof(prompt));
+                stats_record_since(STAT_PROMPT, prompt_start);
+
+                char* line = editor_read_line(prompt, prompt_len);
+                if (line == NULL)
+                {
+                    break;
+                }
+                size_t len = strlen(line);
+                int64_t started;
+                uint64_t run_start;
+                while (1)
+                {
+                    started = time(NULL);
+                    run_start = stats_now();
+                    if (execute_command_text(line, len) != PARSE_INCOMPLETE)
+                    {
+                        break;
+                    }
+                    // An open quote or a here-document continues on the next line
+                    if (append_continuation(&line, &len) == -1)
+                    {
+                        fprintf(stderr, "syntax error: unexpected end of input\n");
+                        break;
+                    }
+                }
+                uint64_t duration_ms = (stats_now() - run_start) / 1000000;
+                if (line[strspn(line, " \t")] != '\0')
+                {
+                    history_add(line, len, command_last_status(),
+                                duration_ms > UINT32_MAX ? UINT32_MAX : (uint32_t)duration_ms, started);
+                }
+                free(line);
+            }
+            history_close();
+            complete_shutdown();
+            prompt_shutdown();
+            return 0;
         }
-    }
-    else
-    {
-        char single_input[INPUT_SIZE];
+
+        char* single_input = NULL;
+        size_t capacity = 0;
+        // Lines of a command left incomplete, waiting for the rest
+        char* pending = NULL;
+        size_t pending_len = 0;
+        // Waiting for someone to type is not the shell's latency
+        int time_reads = !isatty(STDIN_FILENO);
         while (1)
         {
-            // Get the current working directory
-            if (getcwd(cwd, sizeof(cwd)) == NULL)
+            if (pending_len == 0)
             {
-                perror("getcwd");
-                continue;
+                // Report background jobs that finished or stopped since the last prompt
+                jobs_notify(1);
+
+                uint64_t prompt_start = stats_now();
+                prompt_render();
+                stats_record_since(STAT_PROMPT, prompt_start);
+            }
+            else
+            {
+                fputs(CONTINUATION_PROMPT, stdout);
+                fflush(stdout);
             }
 
-            print_colored_prompt(username, hostname, cwd);
+            // Read user input, whatever its length
+            uint64_t read_start = stats_now();
+            ssize_t read = getline(&single_input, &capacity, stdin);
+            if (time_reads && read != -1)
+            {
+                stats_record_since(STAT_READ, read_start);
+            }
+            if (read == -1)
+            {
+                if (feof(stdin))
+                {
+                    break;
+                }
+                perror("getline");
+                clearerr(stdin);
+                continue;
+            }
+            if (pending_len == 0 && execute_command_text(single_input, (size_t)read) != PARSE_INCOMPLETE)
+            {
+                continue;
+            }
 
-            // Read user input
-            if (fgets(single_input, sizeof(single_input), stdin) == NULL)
+            // An open quote or a here-document continues on the next line
+            char* joined = realloc(pending, pending_len + (size_t)read);
+            if (joined == NULL)
             {
-                perror("fgets");
+                perror("realloc");
+                pending_len = 0;
                 continue;
             }
-            execute_command(single_input);
+            pending = joined;
+            memcpy(pending + pending_len, single_input, (size_t)read);
+            pending_len += (size_t)read;
+            if (pending_len > (size_t)read && execute_command_text(pending, pending_len) != PARSE_INCOMPLETE)
+            {
+                pending_len = 0;
+            }
+        }
+        if (pending_len > 0)
+        {
+            fprintf(stderr, "syntax error: unexpected end of input\n");
         }
+        free(pending);
+        free(single_input);
+        prompt_shutdown();
     }
     return 0;
 }
@@ -1,4 +1,5 @@
 #include "monitor.h"
+#include "builtins.h"
 #include <cjson/cJSON.h>
 #include <errno.h>
 #include <linux/limits.h>
@@ -198,6 +199,22 @@ void status_monitor()
     }
 }
 
+pid_t monitor_running_pid(const char* project_root)
+{
+    char pid_file_path[PATH_MAX];
+    snprintf(pid_file_path, sizeof(pid_file_path), "%s/monitor.pid", project_root);
+
+    FILE* pid_file = fopen(pid_file_path, "re");
+    if (pid_file == NULL)
+    {
+        return 0;
+    }
+    pid_t pid;
+    int found = fscanf(pid_file, "%d", &pid) == 1;
+    fclose(pid_file);
+    return found && pid > 0 && kill(pid, 0) == 0 ? pid : 0;
+}
+
 void config_monitor()
 {
     const char* project_root = getenv("PROJECT_ROOT");
@@ -301,3 +318,59 @@ void config_monitor()
     printf(ANSI_COLOR_GREEN "Configuration updated successfully.\n" ANSI_COLOR_RESET);
     printf("Please update the monitor process to apply the changes with the update_monitor command.\n");
 }
+
+static int start_monitor_builtin(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    start_monitor();
+    return 0;
+}
+
+static int stop_monitor_builtin(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    stop_monitor();
+    return 0;
+}
+
+static int update_monitor_builtin(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    update_monitor();
+    return 0;
+}
+
+static int status_monitor_builtin(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    status_monitor();
+    return 0;
+}
+
+static int config_monitor_builtin(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+    config_monitor();
+    return 0;
+}
+
+/**
+ * @brief Builtins controlling the monitor process.
+ */
+static const builtin monitor_builtins[] = {
+    {"start_monitor", start_monitor_builtin, 0, 0, BUILTIN_SHELL_STATE, "start_monitor"},
+    {"stop_monitor", stop_monitor_builtin, 0, 0, BUILTIN_SHELL_STATE, "stop_monitor"},
+    {"update_monitor", update_monitor_builtin, 0, 0, BUILTIN_SHELL_STATE, "update_monitor"},
+    {"status_monitor", status_monitor_builtin, 0, 0, BUILTIN_PIPELINE_SAFE, "status_monitor"},
+    {"config_monitor", config_monitor_builtin, 0, 0, BUILTIN_SHELL_STATE, "config_monitor"},
+};
+
+void monitor_register_builtins(void)
+{
+    builtin_register(monitor_builtins, sizeof(monitor_builtins) / sizeof(monitor_builtins[0]));
+}
@@ -0,0 +1,657 @@
+#define _GNU_SOURCE
+#include "parallel.h"
+#include "arena.h"
+#include "builtins.h"
+#include "control.h"
+#include "executor.h"
+#include "jobs.h"
+#include "launcher.h"
+#include "parser.h"
+#include "script.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Nanoseconds per second.
+ */
+#define NSEC_PER_SEC 1000000000L
+
+/**
+ * @brief Nanoseconds per millisecond.
+ */
+#define NSEC_PER_MSEC 1000000L
+
+/**
+ * @brief Milliseconds per second.
+ */
+#define MSEC_PER_SEC 1000.0
+
+/**
+ * @brief Initial number of entries of the task window.
+ */
+#define INITIAL_TASKS 16
+
+/**
+ * @brief Marker replaced by the item in the command template.
+ */
+#define ITEM_MARKER "{}"
+
+/**
+ * @brief Separator between the command template and inline items.
+ */
+#define ITEMS_SEPARATOR ":::"
+
+/**
+ * @brief Where the items come from: the arguments after `:::` or lines of standard input.
+ */
+typedef struct
+{
+    char** args;          /**< Remaining inline items, or NULL to read standard input. */
+    script_reader reader; /**< Line reader over standard input. */
+} item_source;
+
+/**
+ * @brief Returns the number of CPUs the shell may run on.
+ */
+static long available_cpus(void)
+{
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        return CPU_COUNT(&set);
+    }
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 0 ? online : 1;
+}
+
+/**
+ * @brief Returns the next item, without its newline.
+ *
+ * @return int 1 if an item was returned, 0 when there are no more.
+ */
+static int next_item(item_source* source, const char** item, size_t* len)
+{
+    if (source->args != NULL)
+    {
+        if (*source->args == NULL)
+        {
+            return 0;
+        }
+        *item = *source->args++;
+        *len = strlen(*item);
+        return 1;
+    }
+
+    const char* text;
+    size_t text_len;
+    while (script_reader_next(&source->reader, 0, &text, &text_len) == 1)
+    {
+        while (text_len > 0 && (text[text_len - 1] == '\n' || text[text_len - 1] == '\r'))
+        {
+            text_len--;
+        }
+        if (text_len > 0)
+        {
+            *item = text;
+            *len = text_len;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Appends `item` to `out` in single quotes, so the parser sees it as one literal word.
+ *
+ * @return char* One past the last byte written.
+ */
+static char* quote_item(char* out, const char* item, size_t len)
+{
+    *out++ = '\'';
+    for (size_t i = 0; i < len; i++)
+    {
+        if (item[i] == '\'')
+        {
+            memcpy(out, "'\\''", 4);
+            out += 4;
+        }
+        else
+        {
+            *out++ = item[i];
+        }
+    }
+    *out++ = '\'';
+    return out;
+}
+
+/**
+ * @brief Builds the command line of one task from the template.
+ */
+static char* build_command(arena* a, const char* template, const char* item, size_t item_len, size_t* len)
+{
+    size_t markers = 0;
+    for (const char* p = strstr(template, ITEM_MARKER); p != NULL; p = strstr(p + 2, ITEM_MARKER))
+    {
+        markers++;
+    }
+    // Every quote of the item may grow to four bytes, plus the surrounding quotes and a space
+    size_t quoted = 4 * item_len + 3;
+    char* command = arena_alloc(a, strlen(template) + (markers > 0 ? markers : 1) * quoted + 1);
+
+    char* out = command;
+    const char* p = template;
+    const char* marker;
+    while ((marker = strstr(p, ITEM_MARKER)) != NULL)
+    {
+        memcpy(out, p, (size_t)(marker - p));
+        out = quote_item(out + (marker - p), item, item_len);
+        p = marker + 2;
+    }
+    size_t rest = strlen(p);
+    memcpy(out, p, rest);
+    out += rest;
+    if (markers == 0)
+    {
+        *out++ = ' ';
+        out = quote_item(out, item, item_len);
+    }
+    *out = '\0';
+    *len = (size_t)(out - command);
+    return command;
+}
+
+/**
+ * @brief Makes room for one more task at the end of the window.
+ *
+ * @return parallel_task* The new entry, or NULL on error.
+ */
+static parallel_task* append_task(parallel_run* run)
+{
+    if (run->first > 0 && run->count == run->capacity)
+    {
+        // Written tasks leave a gap at the front; reuse it before growing
+        memmove(run->tasks, run->tasks + run->first, (run->count - run->first) * sizeof(parallel_task));
+        run->count -= run->first;
+        run->first = 0;
+    }
+    if (run->count == run->capacity)
+    {
+        size_t capacity = run->capacity == 0 ? INITIAL_TASKS : run->capacity * 2;
+        parallel_task* tasks = realloc(run->tasks, capacity * sizeof(parallel_task));
+        if (tasks == NULL)
+        {
+            perror("realloc");
+            return NULL;
+        }
+        run->tasks = tasks;
+        run->capacity = capacity;
+    }
+    parallel_task* task = &run->tasks[run->count++];
+    memset(task, 0, sizeof(*task));
+    task->out_fd = -1;
+    task->err_fd = -1;
+    return task;
+}
+
+/**
+ * @brief Sets `deadline` to `ms` milliseconds from now.
+ */
+static void set_deadline(struct timespec* deadline, long ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += ms / (long)MSEC_PER_SEC;
+    deadline->tv_nsec += (ms % (long)MSEC_PER_SEC) * NSEC_PER_MSEC;
+    if (deadline->tv_nsec >= NSEC_PER_SEC)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= NSEC_PER_SEC;
+    }
+}
+
+/**
+ * @brief Launches one task with its output going to fresh memfds. SIGCHLD must be blocked.
+ *
+ * Plain external commands go through the launcher; builtins, pipelines and
+ * lists run in a forked copy of the shell.
+ *
+ * @return int 0 if a task was recorded (possibly one that failed to start), -1 on error.
+ */
+static int start_task(parallel_run* run, arena* a, const node* n, const char* command, size_t len)
+{
+    parallel_task* task = append_task(run);
+    if (task == NULL)
+    {
+        return -1;
+    }
+    // Until a process is running, the task is one that failed to start
+    task->status = 1;
+    task->out_fd = memfd_create("parallel-stdout", MFD_CLOEXEC);
+    task->err_fd = memfd_create("parallel-stderr", MFD_CLOEXEC);
+    if (task->out_fd == -1 || task->err_fd == -1)
+    {
+        perror("memfd_create");
+        return 0;
+    }
+
+    launch_spec spec;
+    launch_spec_init(&spec, NULL);
+    spec.pgid = 0;
+    launch_spec_add_dup2(&spec, run->devnull, STDIN_FILENO);
+    launch_spec_add_dup2(&spec, task->out_fd, STDOUT_FILENO);
+    launch_spec_add_dup2(&spec, task->err_fd, STDERR_FILENO);
+
+    pid_t pid;
+    char** argv = NULL;
+    if (n->type == NODE_SIMPLE && n->simple.num_words > 0 && (argv = build_argv(a, n)) == NULL)
+    {
+        return 0;
+    }
+    if (argv != NULL && argv[0] != NULL && control_find_function(argv[0]) == NULL)
+    {
+        spec.argv = argv;
+        spec.envp = build_envp(a, n);
+        int* opened = arena_alloc(a, (n->simple.num_redirections + 1) * sizeof(int));
+        int count = open_redirections(a, n, &spec, opened);
+        if (count == -1)
+        {
+            return 0;
+        }
+        const builtin* cmd = builtin_find(argv[0], strlen(argv[0]));
+        uint64_t spawn_start = stats_now();
+        pid = cmd != NULL ? fork_builtin(cmd, argv, &spec, NULL, 0) : launch_command(&spec);
+        stats_record_since(STAT_SPAWN, spawn_start);
+        close_redirections(opened, count);
+    }
+    else
+    {
+        uint64_t spawn_start = stats_now();
+        pid = fork_subshell(a, n, &spec, NULL, 0);
+        stats_record_since(STAT_SPAWN, spawn_start);
+    }
+    if (pid == -1)
+    {
+        return 0;
+    }
+
+    // Tasks are the shell's own business: registered as foreground jobs, they are never announced
+    task->j = job_create(command, len, 1);
+    job_add_process(task->j, pid, pid);
+    if (run->timeout_ms > 0)
+    {
+        set_deadline(&task->deadline, run->timeout_ms);
+    }
+    run->running++;
+    return 0;
+}
+
+/**
+ * @brief Copies a memfd to `fd` from the start.
+ */
+static void copy_capture(int capture, int fd)
+{
+    char buffer[BUFSIZ];
+    off_t offset = 0;
+    ssize_t n;
+    while ((n = pread(capture, buffer, sizeof(buffer), offset)) > 0)
+    {
+        offset += n;
+        for (ssize_t done = 0; done < n;)
+        {
+            ssize_t written = write(fd, buffer + done, (size_t)(n - done));
+            if (written == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return;
+            }
+            done += written;
+        }
+    }
+}
+
+/**
+ * @brief Writes out and releases a collected task's output.
+ */
+static void write_task(parallel_task* task)
+{
+    if (task->out_fd != -1)
+    {
+        copy_capture(task->out_fd, STDOUT_FILENO);
+        close(task->out_fd);
+        task->out_fd = -1;
+    }
+    if (task->err_fd != -1)
+    {
+        copy_capture(task->err_fd, STDERR_FILENO);
+        close(task->err_fd);
+        task->err_fd = -1;
+    }
+}
+
+/**
+ * @brief Collects finished tasks, enforces timeouts and writes whatever output may be written.
+ */
+static void collect_tasks(parallel_run* run)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (size_t i = run->first; i < run->count; i++)
+    {
+        parallel_task* task = &run->tasks[i];
+        if (task->j == NULL)
+        {
+            continue;
+        }
+        if (task->j->state == JOB_DONE)
+        {
+            task->status = task->signals_sent > 0 ? PARALLEL_TIMEOUT_STATUS : task->j->status;
+            job_remove(task->j);
+            task->j = NULL;
+            run->running--;
+        }
+        else if (run->timeout_ms > 0 && task->signals_sent < 2 &&
+                 (now.tv_sec > task->deadline.tv_sec ||
+                  (now.tv_sec == task->deadline.tv_sec && now.tv_nsec >= task->deadline.tv_nsec)))
+        {
+            // Ask politely first, then make sure
+            job_signal(task->j, task->signals_sent == 0 ? SIGTERM : SIGKILL);
+            task->signals_sent++;
+            set_deadline(&task->deadline, PARALLEL_KILL_GRACE_MS);
+        }
+    }
+
+    fflush(stdout);
+    for (size_t i = run->first; i < run->count; i++)
+    {
+        parallel_task* task = &run->tasks[i];
+        if (task->j != NULL)
+        {
+            // With -k, nothing after a running task may be written yet
+            if (run->keep_order)
+            {
+                break;
+            }
+            continue;
+        }
+        if (!task->written)
+        {
+            write_task(task);
+            run->failures += task->status != 0;
+            task->written = 1;
+        }
+    }
+    while (run->first < run->count && run->tasks[run->first].written)
+    {
+        run->first++;
+    }
+    if (run->first == run->count)
+    {
+        run->first = 0;
+        run->count = 0;
+    }
+}
+
+/**
+ * @brief Blocks SIGCHLD and SIGINT while the tasks are looked at.
+ *
+ * Neither can then be lost between checking the tasks and going to sleep.
+ */
+static void block_wait_signals(sigset_t* wait_set, sigset_t* old)
+{
+    sigemptyset(wait_set);
+    sigaddset(wait_set, SIGCHLD);
+    sigaddset(wait_set, SIGINT);
+    sigprocmask(SIG_BLOCK, wait_set, old);
+}
+
+/**
+ * @brief Waits until a task changes state or its deadline passes; ^C interrupts every task.
+ */
+static void wait_for_tasks(parallel_run* run, const sigset_t* wait_set)
+{
+    struct timespec timeout;
+    struct timespec* limit = NULL;
+    if (run->timeout_ms > 0)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long nearest = -1;
+        for (size_t i = run->first; i < run->count; i++)
+        {
+            const parallel_task* task = &run->tasks[i];
+            if (task->j == NULL)
+            {
+                continue;
+            }
+            long ns = (task->deadline.tv_sec - now.tv_sec) * NSEC_PER_SEC + (task->deadline.tv_nsec - now.tv_nsec);
+            if (nearest == -1 || ns < nearest)
+            {
+                nearest = ns > 0 ? ns : 0;
+            }
+        }
+        if (nearest >= 0)
+        {
+            timeout.tv_sec = nearest / NSEC_PER_SEC;
+            timeout.tv_nsec = nearest % NSEC_PER_SEC;
+            limit = &timeout;
+        }
+    }
+
+    int sig = sigtimedwait(wait_set, NULL, limit);
+    jobs_reap(0);
+    if (sig == SIGINT && !run->interrupted)
+    {
+        run->interrupted = 1;
+        for (size_t i = run->first; i < run->count; i++)
+        {
+            if (run->tasks[i].j != NULL)
+            {
+                job_signal(run->tasks[i].j, SIGINT);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Collects tasks until at most `max_running` are still running. The wait signals must be blocked.
+ */
+static void drain_tasks(parallel_run* run, long max_running, const sigset_t* wait_set)
+{
+    collect_tasks(run);
+    while (run->running > max_running)
+    {
+        wait_for_tasks(run, wait_set);
+        collect_tasks(run);
+    }
+}
+
+int parallel_init(parallel_run* run, long max_running, int keep_order, long timeout_ms)
+{
+    memset(run, 0, sizeof(*run));
+    run->max_running = max_running > 0 ? max_running : available_cpus();
+    run->keep_order = keep_order;
+    run->timeout_ms = timeout_ms;
+    run->devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (run->devnull == -1)
+    {
+        perror("open /dev/null");
+        return -1;
+    }
+    return 0;
+}
+
+int parallel_start(parallel_run* run, arena* a, const node* n, const char* command, size_t len)
+{
+    sigset_t wait_set;
+    sigset_t old;
+    block_wait_signals(&wait_set, &old);
+    drain_tasks(run, run->max_running - 1, &wait_set);
+    int result = -1;
+    if (!run->interrupted)
+    {
+        result = start_task(run, a, n, command, len);
+        if (result == -1)
+        {
+            run->failures++;
+        }
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return run->interrupted ? -1 : result;
+}
+
+int parallel_wait(parallel_run* run)
+{
+    sigset_t wait_set;
+    sigset_t old;
+    block_wait_signals(&wait_set, &old);
+    drain_tasks(run, 0, &wait_set);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return run->interrupted ? -1 : 0;
+}
+
+int parallel_finish(parallel_run* run)
+{
+    parallel_wait(run);
+    free(run->tasks);
+    run->tasks = NULL;
+    close(run->devnull);
+    if (run->interrupted)
+    {
+        return SIGNAL_STATUS_BASE + SIGINT;
+    }
+    return run->failures < PARALLEL_MAX_FAILURES ? run->failures : PARALLEL_MAX_FAILURES;
+}
+
+/**
+ * @brief Parses the options of `parallel`.
+ *
+ * @return int The index of the command template, or -1 on error.
+ */
+static int parse_options(long* max_running, int* keep_order, long* timeout_ms, int argc, char** argv)
+{
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+    {
+        if (strcmp(argv[i], "-k") == 0)
+        {
+            *keep_order = 1;
+        }
+        else if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "-t") == 0) && i + 1 < argc)
+        {
+            char* end;
+            double value = strtod(argv[i + 1], &end);
+            if (*end != '\0' || value <= 0 || (argv[i][1] == 'j' && value < 1))
+            {
+                fprintf(stderr, "parallel: invalid %s value: %s\n", argv[i], argv[i + 1]);
+                return -1;
+            }
+            if (argv[i][1] == 'j')
+            {
+                *max_running = (long)value;
+            }
+            else
+            {
+                *timeout_ms = (long)(value * MSEC_PER_SEC);
+            }
+            i++;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    if (i >= argc || (i + 1 < argc && strcmp(argv[i + 1], ITEMS_SEPARATOR) != 0))
+    {
+        return -1;
+    }
+    return i;
+}
+
+/**
+ * @brief parallel [-j N] [-k] [-t seconds] command [::: item...]: runs a command per item.
+ */
+static int parallel_builtin(int argc, char** argv)
+{
+    long max_running = 0;
+    int keep_order = 0;
+    long timeout_ms = 0;
+    int template_index = parse_options(&max_running, &keep_order, &timeout_ms, argc, argv);
+    if (template_index == -1)
+    {
+        fprintf(stderr, "Usage: parallel [-j N] [-k] [-t seconds] 'command {}' [::: item...]\n");
+        return 1;
+    }
+    const char* template = argv[template_index];
+
+    item_source source = {0};
+    if (template_index + 1 < argc)
+    {
+        source.args = argv + template_index + 2;
+    }
+    else if (script_reader_init(&source.reader, STDIN_FILENO) == -1)
+    {
+        return 1;
+    }
+    parallel_run run;
+    if (parallel_init(&run, max_running, keep_order, timeout_ms) == -1)
+    {
+        if (source.args == NULL)
+        {
+            script_reader_free(&source.reader);
+        }
+        return 1;
+    }
+
+    arena a;
+    arena_init(&a);
+    const char* item;
+    size_t item_len;
+    while (next_item(&source, &item, &item_len))
+    {
+        size_t len;
+        char* command = build_command(&a, template, item, item_len, &len);
+        node* n;
+        if (parse_line(&a, command, len, &n) != PARSE_OK)
+        {
+            fprintf(stderr, "parallel: cannot run: %s\n", command);
+            run.failures++;
+        }
+        else if (parallel_start(&run, &a, n, command, len) == -1 && run.interrupted)
+        {
+            break;
+        }
+        arena_reset(&a);
+    }
+
+    arena_free(&a);
+    if (source.args == NULL)
+    {
+        script_reader_free(&source.reader);
+    }
+    return parallel_finish(&run);
+}
+
+/**
+ * @brief Builtins implemented in this module.
+ */
+static const builtin parallel_builtins[] = {
+    {"parallel", parallel_builtin, 1, BUILTIN_ANY_ARGS, BUILTIN_PIPELINE_SAFE,
+     "parallel [-j N] [-k] [-t seconds] 'command {}' [::: item...]"},
+};
+
+void parallel_register_builtins(void)
+{
+    builtin_register(parallel_builtins, sizeof(parallel_builtins) / sizeof(parallel_builtins[0]));
+}
@@ -0,0 +1,909 @@
+#include "parser.h"
+#include "lexer.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Initial capacity of the arrays built while parsing.
+ */
+#define INITIAL_ARRAY_CAPACITY 4
+
+/**
+ * @brief Most here-documents a single line may start.
+ */
+#define MAX_PENDING_HEREDOCS 16
+
+/**
+ * @brief Recursive descent parser state, with one token of lookahead.
+ */
+typedef struct
+{
+    lexer lex;                /**< Token source. */
+    token current;            /**< Lookahead token. */
+    const char* consumed_end; /**< End of the last token consumed. */
+    arena* arena;             /**< Where nodes are allocated. */
+    int status;               /**< PARSE_OK until an error or premature end is found. */
+    int quiet;                /**< Non-zero to leave syntax errors unreported. */
+    struct
+    {
+        redirection** list; /**< The redirections array of the command holding the here-document. */
+        size_t index;       /**< Its index in that array. */
+    } pending[MAX_PENDING_HEREDOCS]; /**< Here-documents whose body starts after the next newline. */
+    size_t num_pending;              /**< Number of entries in `pending`. */
+} parser;
+
+/**
+ * @brief Reads the bodies of the pending here-documents, which follow the newline just lexed.
+ */
+static void read_heredocs(parser* p)
+{
+    for (size_t i = 0; i < p->num_pending; i++)
+    {
+        redirection* r = &(*p->pending[i].list)[p->pending[i].index];
+        char* delimiter = lexer_unquote(p->arena, r->target.start, r->target.len);
+        if (lexer_heredoc(&p->lex, delimiter, strlen(delimiter), r->strip_tabs, &r->body.start, &r->body.len) == -1)
+        {
+            // The delimiter line may still come
+            p->status = PARSE_INCOMPLETE;
+            p->current.type = TOKEN_EOF;
+            return;
+        }
+    }
+    p->num_pending = 0;
+}
+
+static void advance(parser* p)
+{
+    p->consumed_end = p->current.start + p->current.len;
+    p->current = lexer_next(&p->lex);
+    if (p->current.type == TOKEN_NEWLINE && p->num_pending > 0)
+    {
+        read_heredocs(p);
+    }
+}
+
+/**
+ * @brief Records a syntax error at the current token.
+ */
+static void syntax_error(parser* p)
+{
+    if (p->status != PARSE_OK)
+    {
+        return;
+    }
+    if (p->current.type == TOKEN_EOF || p->current.type == TOKEN_ERROR)
+    {
+        // More input could still make this valid
+        p->status = PARSE_INCOMPLETE;
+        return;
+    }
+    p->status = PARSE_ERROR;
+    if (p->quiet)
+    {
+        return;
+    }
+    if (p->current.type == TOKEN_NEWLINE)
+    {
+        fprintf(stderr, "syntax error near unexpected token `newline'\n");
+    }
+    else
+    {
+        fprintf(stderr, "syntax error near unexpected token `%.*s'\n", (int)p->current.len, p->current.start);
+    }
+}
+
+/**
+ * @brief Makes room for one more element in an arena array, doubling it when full.
+ */
+static void* reserve(parser* p, void* items, size_t count, size_t* capacity, size_t size)
+{
+    if (count < *capacity)
+    {
+        return items;
+    }
+    size_t new_capacity = *capacity == 0 ? INITIAL_ARRAY_CAPACITY : *capacity * 2;
+    void* grown = arena_alloc(p->arena, new_capacity * size);
+    if (count > 0)
+    {
+        memcpy(grown, items, count * size);
+    }
+    *capacity = new_capacity;
+    return grown;
+}
+
+static node* new_node(parser* p, node_type type)
+{
+    node* n = arena_alloc(p->arena, sizeof(node));
+    memset(n, 0, sizeof(node));
+    n->type = type;
+    return n;
+}
+
+/**
+ * @brief Checks whether a word has the form `NAME=value` with an unquoted name.
+ */
+static int is_assignment(const token* tok)
+{
+    if (tok->len == 0 || !(isalpha((unsigned char)tok->start[0]) || tok->start[0] == '_'))
+    {
+        return 0;
+    }
+    for (size_t i = 1; i < tok->len; i++)
+    {
+        if (tok->start[i] == '=')
+        {
+            return 1;
+        }
+        if (!isalnum((unsigned char)tok->start[i]) && tok->start[i] != '_')
+        {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static int is_redirection(token_type type)
+{
+    return type == TOKEN_LESS || type == TOKEN_GREAT || type == TOKEN_DGREAT || type == TOKEN_DLESS ||
+           type == TOKEN_DLESSDASH || type == TOKEN_TLESS;
+}
+
+/**
+ * @brief Returns the kind of redirection an operator makes.
+ */
+static redirection_type redirection_kind(token_type type)
+{
+    switch (type)
+    {
+    case TOKEN_GREAT:
+        return REDIR_OUTPUT;
+    case TOKEN_DGREAT:
+        return REDIR_APPEND;
+    case TOKEN_DLESS:
+    case TOKEN_DLESSDASH:
+        return REDIR_HEREDOC;
+    case TOKEN_TLESS:
+        return REDIR_HERESTRING;
+    default:
+        return REDIR_INPUT;
+    }
+}
+
+/**
+ * @brief Checks whether any part of a word is quoted or escaped.
+ */
+static int is_quoted(const word* w)
+{
+    for (size_t i = 0; i < w->len; i++)
+    {
+        if (w->start[i] == '\'' || w->start[i] == '"' || w->start[i] == '\\')
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Skips newlines allowed after `|`, `&&` and `||`.
+ */
+static void skip_newlines(parser* p)
+{
+    while (p->current.type == TOKEN_NEWLINE)
+    {
+        advance(p);
+    }
+}
+
+/**
+ * @brief redirection := [io_number] operator word
+ *
+ * Appends the redirection at the current token to `*list`; a here-document is
+ * queued so that its body is read after the next newline.
+ *
+ * @return int 0 on success, -1 on a syntax error.
+ */
+static int parse_redirection(parser* p, redirection** list, size_t* count, size_t* capacity)
+{
+    token tok = p->current;
+    advance(p);
+    if (p->current.type != TOKEN_WORD)
+    {
+        syntax_error(p);
+        return -1;
+    }
+    redirection r = {0};
+    r.type = redirection_kind(tok.type);
+    int reads = r.type != REDIR_OUTPUT && r.type != REDIR_APPEND;
+    r.fd = tok.io_number != TOKEN_NO_IO_NUMBER ? tok.io_number : (reads ? 0 : 1);
+    r.target.start = p->current.start;
+    r.target.len = p->current.len;
+    // Quoting any part of the delimiter keeps the body literal
+    r.expand = !is_quoted(&r.target);
+    r.strip_tabs = tok.type == TOKEN_DLESSDASH;
+    *list = reserve(p, *list, *count, capacity, sizeof(redirection));
+    (*list)[(*count)++] = r;
+    if (r.type == REDIR_HEREDOC)
+    {
+        if (p->num_pending == MAX_PENDING_HEREDOCS)
+        {
+            if (!p->quiet)
+            {
+                fprintf(stderr, "syntax error: too many here-documents\n");
+            }
+            p->status = PARSE_ERROR;
+            return -1;
+        }
+        p->pending[p->num_pending].list = list;
+        p->pending[p->num_pending].index = *count - 1;
+        p->num_pending++;
+    }
+    advance(p);
+    return 0;
+}
+
+/**
+ * @brief Checks whether a token is an operator `[[` takes as a plain word (`&& || < > ( )`).
+ */
+static int is_conditional_operator(token_type type)
+{
+    return type == TOKEN_AND_IF || type == TOKEN_OR_IF || type == TOKEN_LESS || type == TOKEN_GREAT ||
+           type == TOKEN_LPAREN || type == TOKEN_RPAREN;
+}
+
+/**
+ * @brief simple_command := (assignment | redirection)* word (word | redirection)*
+ *
+ * Between `[[` and `]]`, `&& || < > ( )` are words of the expression.
+ */
+static node* parse_simple_command(parser* p)
+{
+    node* n = new_node(p, NODE_SIMPLE);
+    size_t words_capacity = 0;
+    size_t assignments_capacity = 0;
+    size_t redirections_capacity = 0;
+    int conditional = 0;
+
+    while (p->status == PARSE_OK)
+    {
+        token tok = p->current;
+        if (tok.type == TOKEN_WORD || (conditional && is_conditional_operator(tok.type)))
+        {
+            // A `[[` command runs up to its `]]`
+            if (tok.type == TOKEN_WORD && tok.len == 2 && n->simple.num_words == 0 && memcmp(tok.start, "[[", 2) == 0)
+            {
+                conditional = 1;
+            }
+            else if (tok.type == TOKEN_WORD && tok.len == 2 && conditional && memcmp(tok.start, "]]", 2) == 0)
+            {
+                conditional = 0;
+            }
+            word w = {tok.start, tok.len};
+            if (n->simple.num_words == 0 && is_assignment(&tok))
+            {
+                n->simple.assignments = reserve(p, n->simple.assignments, n->simple.num_assignments,
+                                                &assignments_capacity, sizeof(word));
+                n->simple.assignments[n->simple.num_assignments++] = w;
+            }
+            else
+            {
+                n->simple.words = reserve(p, n->simple.words, n->simple.num_words, &words_capacity, sizeof(word));
+                n->simple.words[n->simple.num_words++] = w;
+            }
+            advance(p);
+        }
+        else if (is_redirection(tok.type))
+        {
+            if (parse_redirection(p, &n->simple.redirections, &n->simple.num_redirections, &redirections_capacity) ==
+                -1)
+            {
+                return NULL;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (n->simple.num_words == 0 && n->simple.num_assignments == 0 && n->simple.num_redirections == 0)
+    {
+        syntax_error(p);
+        return NULL;
+    }
+    return n;
+}
+
+/**
+ * @brief Checks whether the current token is the unquoted word `text`.
+ */
+static int current_is(const parser* p, const char* text)
+{
+    size_t len = strlen(text);
+    return p->current.type == TOKEN_WORD && p->current.len == len && memcmp(p->current.start, text, len) == 0;
+}
+
+/**
+ * @brief Consumes a leading `time [-j]` keyword if a command follows it.
+ *
+ * A `time` with nothing after it is left alone, to run as an ordinary command.
+ */
+static time_format parse_time_keyword(parser* p)
+{
+    if (!current_is(p, "time"))
+    {
+        return TIME_NONE;
+    }
+    lexer ahead = p->lex;
+    token next = lexer_next(&ahead);
+    time_format format = TIME_TEXT;
+    if (next.type == TOKEN_WORD && next.len == 2 && memcmp(next.start, "-j", 2) == 0)
+    {
+        format = TIME_JSON;
+        next = lexer_next(&ahead);
+    }
+    if (next.type != TOKEN_WORD && !is_redirection(next.type))
+    {
+        return TIME_NONE;
+    }
+    advance(p);
+    if (format == TIME_JSON)
+    {
+        advance(p);
+    }
+    return format;
+}
+
+static node* parse_list(parser* p);
+
+/**
+ * @brief Reserved words that end a compound list.
+ */
+static const char* const closing_words[] = {"then", "else", "elif", "fi", "do", "done", "esac", "}"};
+
+/**
+ * @brief Checks whether the current token ends a compound list: a closing reserved word, `;;` or `)`.
+ */
+static int at_closer(const parser* p)
+{
+    if (p->current.type == TOKEN_DSEMI || p->current.type == TOKEN_RPAREN)
+    {
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(closing_words) / sizeof(closing_words[0]); i++)
+    {
+        if (current_is(p, closing_words[i]))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks whether the current token is an unquoted name (letters, digits and `_`, not starting with a digit).
+ */
+static int current_is_name(const parser* p)
+{
+    if (p->current.type != TOKEN_WORD || !(isalpha((unsigned char)p->current.start[0]) || p->current.start[0] == '_'))
+    {
+        return 0;
+    }
+    for (size_t i = 1; i < p->current.len; i++)
+    {
+        if (!isalnum((unsigned char)p->current.start[i]) && p->current.start[i] != '_')
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Consumes the reserved word `text`, or records a syntax error.
+ *
+ * @return int 1 if it was there, 0 otherwise.
+ */
+static int expect(parser* p, const char* text)
+{
+    if (!current_is(p, text))
+    {
+        syntax_error(p);
+        return 0;
+    }
+    advance(p);
+    return 1;
+}
+
+/**
+ * @brief Parses a compound list that must have at least one command.
+ */
+static node* parse_body(parser* p)
+{
+    node* list = parse_list(p);
+    if (list != NULL && list->list.num_items == 0)
+    {
+        syntax_error(p);
+        return NULL;
+    }
+    return list;
+}
+
+/**
+ * @brief if_clause := ('if' | 'elif') body 'then' body ('elif' ... | ['else' body] 'fi')
+ *
+ * An `elif` becomes a NODE_IF in the else part, which consumes the final `fi`.
+ */
+static node* parse_if(parser* p)
+{
+    node* n = new_node(p, NODE_IF);
+    advance(p);
+    n->compound.condition = parse_body(p);
+    if (n->compound.condition == NULL || !expect(p, "then"))
+    {
+        return NULL;
+    }
+    n->compound.body = parse_body(p);
+    if (n->compound.body == NULL)
+    {
+        return NULL;
+    }
+    if (current_is(p, "elif"))
+    {
+        n->compound.else_part = parse_if(p);
+        return n->compound.else_part != NULL ? n : NULL;
+    }
+    if (current_is(p, "else"))
+    {
+        advance(p);
+        n->compound.else_part = parse_body(p);
+        if (n->compound.else_part == NULL)
+        {
+            return NULL;
+        }
+    }
+    return expect(p, "fi") ? n : NULL;
+}
+
+/**
+ * @brief do_group := 'do' body 'done'
+ */
+static node* parse_do_group(parser* p)
+{
+    if (!expect(p, "do"))
+    {
+        return NULL;
+    }
+    node* body = parse_body(p);
+    if (body == NULL || !expect(p, "done"))
+    {
+        return NULL;
+    }
+    return body;
+}
+
+/**
+ * @brief while_clause := ('while' | 'until') body do_group
+ */
+static node* parse_while(parser* p)
+{
+    node* n = new_node(p, current_is(p, "while") ? NODE_WHILE : NODE_UNTIL);
+    advance(p);
+    n->compound.condition = parse_body(p);
+    if (n->compound.condition == NULL)
+    {
+        return NULL;
+    }
+    n->compound.body = parse_do_group(p);
+    return n->compound.body != NULL ? n : NULL;
+}
+
+/**
+ * @brief for_clause := 'for' name [linebreak 'in' word* (';' | newline)] [';'] linebreak do_group
+ */
+static node* parse_for(parser* p)
+{
+    node* n = new_node(p, NODE_FOR);
+    size_t capacity = 0;
+    advance(p);
+    if (!current_is_name(p))
+    {
+        syntax_error(p);
+        return NULL;
+    }
+    n->compound.name.start = p->current.start;
+    n->compound.name.len = p->current.len;
+    advance(p);
+    skip_newlines(p);
+
+    if (current_is(p, "in"))
+    {
+        advance(p);
+        n->compound.has_words = 1;
+        while (p->current.type == TOKEN_WORD)
+        {
+            n->compound.words = reserve(p, n->compound.words, n->compound.num_words, &capacity, sizeof(word));
+            n->compound.words[n->compound.num_words].start = p->current.start;
+            n->compound.words[n->compound.num_words].len = p->current.len;
+            n->compound.num_words++;
+            advance(p);
+        }
+        if (p->current.type != TOKEN_SEMI && p->current.type != TOKEN_NEWLINE)
+        {
+            syntax_error(p);
+            return NULL;
+        }
+        advance(p);
+    }
+    else if (p->current.type == TOKEN_SEMI)
+    {
+        advance(p);
+    }
+    skip_newlines(p);
+    n->compound.body = parse_do_group(p);
+    return n->compound.body != NULL ? n : NULL;
+}
+
+/**
+ * @brief case_clause := 'case' word linebreak 'in' linebreak (['('] word ('|' word)* ')' list [';;' linebreak])* 'esac'
+ */
+static node* parse_case(parser* p)
+{
+    node* n = new_node(p, NODE_CASE);
+    size_t capacity = 0;
+    advance(p);
+    if (p->current.type != TOKEN_WORD)
+    {
+        syntax_error(p);
+        return NULL;
+    }
+    n->compound.name.start = p->current.start;
+    n->compound.name.len = p->current.len;
+    advance(p);
+    skip_newlines(p);
+    if (!expect(p, "in"))
+    {
+        return NULL;
+    }
+    skip_newlines(p);
+
+    while (!current_is(p, "esac"))
+    {
+        if (p->current.type == TOKEN_LPAREN)
+        {
+            advance(p);
+        }
+        case_item item = {0};
+        size_t patterns_capacity = 0;
+        do
+        {
+            if (item.num_patterns > 0)
+            {
+                advance(p);
+            }
+            if (p->current.type != TOKEN_WORD)
+            {
+                syntax_error(p);
+                return NULL;
+            }
+            item.patterns = reserve(p, item.patterns, item.num_patterns, &patterns_capacity, sizeof(word));
+            item.patterns[item.num_patterns].start = p->current.start;
+            item.patterns[item.num_patterns].len = p->current.len;
+            item.num_patterns++;
+            advance(p);
+        } while (p->current.type == TOKEN_PIPE);
+        if (p->current.type != TOKEN_RPAREN)
+        {
+            syntax_error(p);
+            return NULL;
+        }
+        advance(p);
+
+        item.body = parse_list(p);
+        if (item.body == NULL)
+        {
+            return NULL;
+        }
+        n->compound.items = reserve(p, n->compound.items, n->compound.num_items, &capacity, sizeof(case_item));
+        n->compound.items[n->compound.num_items++] = item;
+
+        if (p->current.type == TOKEN_DSEMI)
+        {
+            advance(p);
+            skip_newlines(p);
+        }
+        else if (!current_is(p, "esac"))
+        {
+            syntax_error(p);
+            return NULL;
+        }
+    }
+    advance(p);
+    return n;
+}
+
+/**
+ * @brief brace_group := '{' body '}'
+ */
+static node* parse_group(parser* p)
+{
+    node* n = new_node(p, NODE_GROUP);
+    advance(p);
+    n->compound.body = parse_body(p);
+    if (n->compound.body == NULL || !expect(p, "}"))
+    {
+        return NULL;
+    }
+    return n;
+}
+
+/**
+ * @brief Checks whether the current token starts a compound command.
+ */
+static int at_compound(const parser* p)
+{
+    return current_is(p, "if") || current_is(p, "while") || current_is(p, "until") || current_is(p, "for") ||
+           current_is(p, "case") || current_is(p, "{");
+}
+
+/**
+ * @brief compound_command := (if_clause | while_clause | for_clause | case_clause | brace_group) redirection*
+ */
+static node* parse_compound(parser* p)
+{
+    const char* start = p->current.start;
+    node* n;
+    if (current_is(p, "if"))
+    {
+        n = parse_if(p);
+    }
+    else if (current_is(p, "while") || current_is(p, "until"))
+    {
+        n = parse_while(p);
+    }
+    else if (current_is(p, "for"))
+    {
+        n = parse_for(p);
+    }
+    else if (current_is(p, "case"))
+    {
+        n = parse_case(p);
+    }
+    else
+    {
+        n = parse_group(p);
+    }
+    if (n != NULL)
+    {
+        n->compound.source.start = start;
+        n->compound.source.len = (size_t)(p->consumed_end - start);
+    }
+
+    size_t capacity = 0;
+    while (n != NULL && is_redirection(p->current.type))
+    {
+        if (parse_redirection(p, &n->compound.redirections, &n->compound.num_redirections, &capacity) == -1)
+        {
+            return NULL;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Checks whether the current token starts a function definition: `function name` or `name (`.
+ */
+static int at_function(const parser* p)
+{
+    if (current_is(p, "function"))
+    {
+        return 1;
+    }
+    if (!current_is_name(p))
+    {
+        return 0;
+    }
+    lexer ahead = p->lex;
+    return lexer_next(&ahead).type == TOKEN_LPAREN;
+}
+
+/**
+ * @brief function_definition := ('function' name ['(' ')'] | name '(' ')') linebreak compound_command
+ */
+static node* parse_function(parser* p)
+{
+    node* n = new_node(p, NODE_FUNCTION);
+    n->compound.source.start = p->current.start;
+    int keyword = current_is(p, "function");
+    if (keyword)
+    {
+        advance(p);
+        if (!current_is_name(p))
+        {
+            syntax_error(p);
+            return NULL;
+        }
+    }
+    n->compound.name.start = p->current.start;
+    n->compound.name.len = p->current.len;
+    advance(p);
+    if (!keyword || p->current.type == TOKEN_LPAREN)
+    {
+        advance(p);
+        if (p->current.type != TOKEN_RPAREN)
+        {
+            syntax_error(p);
+            return NULL;
+        }
+        advance(p);
+    }
+    skip_newlines(p);
+    if (!at_compound(p))
+    {
+        syntax_error(p);
+        return NULL;
+    }
+    n->compound.body = parse_compound(p);
+    n->compound.source.len = (size_t)(p->consumed_end - n->compound.source.start);
+    return n->compound.body != NULL ? n : NULL;
+}
+
+/**
+ * @brief command := function_definition | compound_command | simple_command
+ *
+ * Reserved words are only recognized unquoted, in command position.
+ */
+static node* parse_command(parser* p)
+{
+    if (at_function(p))
+    {
+        return parse_function(p);
+    }
+    if (at_compound(p))
+    {
+        return parse_compound(p);
+    }
+    return parse_simple_command(p);
+}
+
+/**
+ * @brief pipeline := ['time' ['-j']] command ('|' linebreak command)*
+ */
+static node* parse_pipeline(parser* p)
+{
+    node* n = new_node(p, NODE_PIPELINE);
+    size_t capacity = 0;
+    n->pipeline.timed = parse_time_keyword(p);
+
+    do
+    {
+        if (n->pipeline.num_stages > 0)
+        {
+            advance(p);
+            skip_newlines(p);
+        }
+        node* stage = parse_command(p);
+        if (stage == NULL)
+        {
+            return NULL;
+        }
+        n->pipeline.stages = reserve(p, n->pipeline.stages, n->pipeline.num_stages, &capacity, sizeof(node*));
+        n->pipeline.stages[n->pipeline.num_stages++] = stage;
+    } while (p->current.type == TOKEN_PIPE);
+
+    return n;
+}
+
+/**
+ * @brief and_or := pipeline (('&&' | '||') linebreak pipeline)*
+ */
+static node* parse_and_or(parser* p)
+{
+    node* left = parse_pipeline(p);
+    while (left != NULL && (p->current.type == TOKEN_AND_IF || p->current.type == TOKEN_OR_IF))
+    {
+        node* n = new_node(p, p->current.type == TOKEN_AND_IF ? NODE_AND : NODE_OR);
+        advance(p);
+        skip_newlines(p);
+        n->binary.left = left;
+        n->binary.right = parse_pipeline(p);
+        if (n->binary.right == NULL)
+        {
+            return NULL;
+        }
+        left = n;
+    }
+    return left;
+}
+
+/**
+ * @brief list := and_or ((';' | '&' | newline) and_or?)*
+ *
+ * The list ends at the end of the input or, inside a compound command, before
+ * the reserved word, `;;` or `)` closing it.
+ */
+static node* parse_list(parser* p)
+{
+    node* n = new_node(p, NODE_LIST);
+    size_t capacity = 0;
+
+    skip_newlines(p);
+    while (p->status == PARSE_OK && p->current.type != TOKEN_EOF && !at_closer(p))
+    {
+        node* command = parse_and_or(p);
+        if (command == NULL)
+        {
+            return NULL;
+        }
+        n->list.items = reserve(p, n->list.items, n->list.num_items, &capacity, sizeof(list_item));
+        n->list.items[n->list.num_items].command = command;
+        n->list.items[n->list.num_items].background = p->current.type == TOKEN_AMP;
+        n->list.num_items++;
+
+        if (p->current.type == TOKEN_SEMI || p->current.type == TOKEN_AMP || p->current.type == TOKEN_NEWLINE)
+        {
+            advance(p);
+            skip_newlines(p);
+        }
+        else if (p->current.type != TOKEN_EOF && !at_closer(p))
+        {
+            syntax_error(p);
+            return NULL;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Parses a line, reporting syntax errors on stderr unless `quiet` is set.
+ */
+static parse_status parse(arena* a, const char* text, size_t len, node** result, int quiet)
+{
+    parser p;
+    lexer_init(&p.lex, text, len);
+    p.arena = a;
+    p.status = PARSE_OK;
+    p.quiet = quiet;
+    p.num_pending = 0;
+    p.current.start = text;
+    p.current.len = 0;
+    advance(&p);
+
+    if (p.current.type == TOKEN_EOF)
+    {
+        return PARSE_EMPTY;
+    }
+
+    node* root = parse_list(&p);
+    if (root != NULL && p.current.type != TOKEN_EOF)
+    {
+        // A closing reserved word, `;;` or `)` with nothing to close
+        syntax_error(&p);
+    }
+    if (p.status == PARSE_OK && p.num_pending > 0)
+    {
+        // The line ended before the bodies of its here-documents
+        p.status = PARSE_INCOMPLETE;
+    }
+    if (p.status != PARSE_OK)
+    {
+        return p.status;
+    }
+    if (root == NULL || root->list.num_items == 0)
+    {
+        return PARSE_EMPTY;
+    }
+    *result = root;
+    return PARSE_OK;
+}
+
+parse_status parse_line(arena* a, const char* text, size_t len, node** result)
+{
+    return parse(a, text, len, result, 0);
+}
+
+parse_status parse_line_quiet(arena* a, const char* text, size_t len, node** result)
+{
+    return parse(a, text, len, result, 1);
+}
@@ -0,0 +1,363 @@
+#include "path_cache.h"
+#include <linux/limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Initial number of slots in the table (a power of two).
+ */
+#define INITIAL_CAPACITY 64
+
+/**
+ * @brief The table grows once more than LOAD_NUMERATOR / LOAD_DENOMINATOR of its slots are used.
+ */
+#define LOAD_NUMERATOR 7
+
+/**
+ * @brief Denominator of the maximum load factor.
+ */
+#define LOAD_DENOMINATOR 10
+
+/**
+ * @brief Search path used when `PATH` is not set, as in execvp(3).
+ */
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+/**
+ * @brief FNV-1a 64 bit offset basis.
+ */
+#define FNV_OFFSET 14695981039346656037ULL
+
+/**
+ * @brief FNV-1a 64 bit prime.
+ */
+#define FNV_PRIME 1099511628211ULL
+
+/**
+ * @brief A cached command.
+ */
+typedef struct
+{
+    char* name;         /**< Command name, NULL for an empty slot. */
+    char* path;         /**< Absolute path of the executable. */
+    unsigned long hits; /**< Number of lookups answered by this entry. */
+} path_entry;
+
+/**
+ * @brief Open addressing table with linear probing.
+ */
+static path_entry* table = NULL;
+
+/**
+ * @brief Number of slots in `table`.
+ */
+static size_t capacity = 0;
+
+/**
+ * @brief Number of used slots in `table`.
+ */
+static size_t count = 0;
+
+/**
+ * @brief Copy of `PATH` the cached entries were resolved against.
+ */
+static char* cached_path_env = NULL;
+
+/**
+ * @brief Lookup counters.
+ */
+static unsigned long hits = 0;
+static unsigned long misses = 0;
+
+/**
+ * @brief Holds the result of a lookup that is not cached (relative `PATH` entries).
+ */
+static char uncached_result[PATH_MAX];
+
+static uint64_t hash_name(const char* name)
+{
+    uint64_t hash = FNV_OFFSET;
+    while (*name != '\0')
+    {
+        hash ^= (unsigned char)*name++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief Returns the slot holding `name`, or the empty slot where it would go.
+ */
+static size_t find_slot(const char* name)
+{
+    size_t mask = capacity - 1;
+    size_t i = hash_name(name) & mask;
+    while (table[i].name != NULL && strcmp(table[i].name, name) != 0)
+    {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int grow_table(void)
+{
+    size_t new_capacity = capacity == 0 ? INITIAL_CAPACITY : capacity * 2;
+    path_entry* new_table = calloc(new_capacity, sizeof(path_entry));
+    if (new_table == NULL)
+    {
+        perror("calloc");
+        return -1;
+    }
+
+    path_entry* old_table = table;
+    size_t old_capacity = capacity;
+    table = new_table;
+    capacity = new_capacity;
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_table[i].name != NULL)
+        {
+            table[find_slot(old_table[i].name)] = old_table[i];
+        }
+    }
+    free(old_table);
+    return 0;
+}
+
+void path_cache_clear(void)
+{
+    for (size_t i = 0; i < capacity; i++)
+    {
+        free(table[i].name);
+        free(table[i].path);
+        table[i].name = NULL;
+        table[i].path = NULL;
+    }
+    count = 0;
+}
+
+void path_cache_forget(const char* name)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    size_t mask = capacity - 1;
+    size_t i = find_slot(name);
+    if (table[i].name == NULL)
+    {
+        return;
+    }
+    free(table[i].name);
+    free(table[i].path);
+    table[i].name = NULL;
+    count--;
+
+    // Backward shift deletion keeps probe sequences intact without tombstones
+    size_t j = i;
+    while (1)
+    {
+        j = (j + 1) & mask;
+        if (table[j].name == NULL)
+        {
+            break;
+        }
+        size_t home = hash_name(table[j].name) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            table[i] = table[j];
+            table[j].name = NULL;
+            table[j].path = NULL;
+            i = j;
+        }
+    }
+}
+
+/**
+ * @brief Drops the cache if `PATH` changed since the entries were resolved.
+ */
+static void check_path_env(const char* path_env)
+{
+    if (cached_path_env != NULL && strcmp(cached_path_env, path_env) == 0)
+    {
+        return;
+    }
+    path_cache_clear();
+    free(cached_path_env);
+    cached_path_env = strdup(path_env);
+}
+
+/**
+ * @brief Checks whether `path` names an executable regular file.
+ */
+static int is_executable(const char* path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+/**
+ * @brief Searches `path_env` for `name` the way execvp(3) does.
+ *
+ * @param absolute Set to non-zero if the match came from an absolute `PATH` entry.
+ */
+static int search_path(const char* path_env, const char* name, char* result, size_t size, int* absolute)
+{
+    const char* dir = path_env;
+    while (1)
+    {
+        const char* end = strchr(dir, ':');
+        size_t dir_len = end != NULL ? (size_t)(end - dir) : strlen(dir);
+        int written;
+
+        // An empty entry stands for the current directory
+        if (dir_len == 0)
+        {
+            written = snprintf(result, size, "%s", name);
+        }
+        else
+        {
+            written = snprintf(result, size, "%.*s/%s", (int)dir_len, dir, name);
+        }
+        if (written > 0 && (size_t)written < size && is_executable(result))
+        {
+            *absolute = dir_len > 0 && dir[0] == '/';
+            return 0;
+        }
+        if (end == NULL)
+        {
+            return -1;
+        }
+        dir = end + 1;
+    }
+}
+
+const char* path_cache_peek(const char* name)
+{
+    const char* path_env = getenv("PATH");
+    check_path_env(path_env != NULL ? path_env : DEFAULT_PATH);
+    if (count == 0)
+    {
+        return NULL;
+    }
+    path_entry* entry = &table[find_slot(name)];
+    return entry->name != NULL ? entry->path : NULL;
+}
+
+const char* path_cache_resolve(const char* name)
+{
+    if (strchr(name, '/') != NULL)
+    {
+        return name;
+    }
+
+    const char* path_env = getenv("PATH");
+    if (path_env == NULL)
+    {
+        path_env = DEFAULT_PATH;
+    }
+    check_path_env(path_env);
+
+    if (count > 0)
+    {
+        path_entry* entry = &table[find_slot(name)];
+        if (entry->name != NULL)
+        {
+            hits++;
+            entry->hits++;
+            return entry->path;
+        }
+    }
+
+    misses++;
+    int absolute = 0;
+    if (search_path(path_env, name, uncached_result, sizeof(uncached_result), &absolute) == -1)
+    {
+        return NULL;
+    }
+
+    // Matches in relative PATH entries depend on the working directory
+    if (!absolute)
+    {
+        return uncached_result;
+    }
+
+    if ((count + 1) * LOAD_DENOMINATOR > capacity * LOAD_NUMERATOR && grow_table() == -1)
+    {
+        return uncached_result;
+    }
+    path_entry* entry = &table[find_slot(name)];
+    entry->name = strdup(name);
+    entry->path = strdup(uncached_result);
+    if (entry->name == NULL || entry->path == NULL)
+    {
+        perror("strdup");
+        free(entry->name);
+        free(entry->path);
+        entry->name = NULL;
+        entry->path = NULL;
+        return uncached_result;
+    }
+    entry->hits = 0;
+    count++;
+    return entry->path;
+}
+
+unsigned long path_cache_hits(void)
+{
+    return hits;
+}
+
+unsigned long path_cache_misses(void)
+{
+    return misses;
+}
+
+int hash_command(char** args)
+{
+    int status = 0;
+
+    if (args[1] != NULL && strcmp(args[1], "-r") == 0)
+    {
+        path_cache_clear();
+        return 0;
+    }
+
+    if (args[1] != NULL)
+    {
+        for (int i = 1; args[i] != NULL; i++)
+        {
+            if (path_cache_resolve(args[i]) == NULL)
+            {
+                fprintf(stderr, "hash: %s: not found\n", args[i]);
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    // Refresh against the current PATH before listing
+    path_cache_peek("");
+    if (count == 0)
+    {
+        printf("hash: hash table empty\n");
+    }
+    else
+    {
+        printf("hits\tcommand\n");
+        for (size_t i = 0; i < capacity; i++)
+        {
+            if (table[i].name != NULL)
+            {
+                printf("%4lu\t%s\n", table[i].hits, table[i].path);
+            }
+        }
+    }
+    printf("lookups: %lu hits, %lu misses\n", hits, misses);
+    return status;
+}
@@ -1,139 +1,335 @@
+#define _GNU_SOURCE
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
+#include "builtins.h"
+#include "commands.h"
+#include "control.h"
+#include "executor.h"
+#include "jobs.h"
+#include "launcher.h"
 #include "pipe.h"
+#include "policy.h"
+#include "stats.h"
 
 /**
- * @brief Size of the input buffer.
+ * @brief Maximum number of commands in a pipeline.
  */
-#define INPUT_SIZE 1024
+#define MAX_COMMANDS 100
 
 /**
- * @brief Maximum number of commands in a pipeline.
+ * @brief Number of file descriptors per pipe.
  */
-#define MAX_COMMANDS 100
+#define PIPE_FDS_PER_PIPE 2
 
 /**
- * @brief Maximum number of arguments for a command.
+ * @brief Bytes per unit of the `K` suffix of a pipe size.
  */
-#define MAX_ARGS (INPUT_SIZE / 2 + 1)
+#define PIPE_SIZE_KIB 1024L
+
+long pipe_size_parse(const char* text)
+{
+    char* end;
+    errno = 0;
+    long size = strtol(text, &end, 10);
+    if (errno != 0 || end == text || size <= 0)
+    {
+        return -1;
+    }
+    if (*end == 'k' || *end == 'K')
+    {
+        size *= PIPE_SIZE_KIB;
+        end++;
+    }
+    else if (*end == 'm' || *end == 'M')
+    {
+        size *= PIPE_SIZE_KIB * PIPE_SIZE_KIB;
+        end++;
+    }
+    return *end == '\0' && size <= INT_MAX ? size : -1;
+}
+
+long pipe_max_size(void)
+{
+    static long max_size = 0;
+    if (max_size == 0)
+    {
+        max_size = -1;
+        FILE* fp = fopen(PIPE_MAX_SIZE_PATH, "re");
+        if (fp != NULL)
+        {
+            if (fscanf(fp, "%ld", &max_size) != 1)
+            {
+                max_size = -1;
+            }
+            fclose(fp);
+        }
+    }
+    return max_size;
+}
+
+long pipe_set_size(int fd, long size)
+{
+    long max_size = pipe_max_size();
+    if (max_size > 0 && size > max_size)
+    {
+        size = max_size;
+    }
+    while (fcntl(fd, F_SETPIPE_SZ, (int)size) == -1)
+    {
+        // EPERM: over the per-user quota of pipe pages; EBUSY: shrinking below the data in the pipe
+        if ((errno != EPERM && errno != EBUSY) || size <= PIPE_DEFAULT_SIZE)
+        {
+            return fcntl(fd, F_GETPIPE_SZ);
+        }
+        size /= 2;
+    }
+    return fcntl(fd, F_GETPIPE_SZ);
+}
 
 /**
- * @brief Number of file descriptors per pipe.
+ * @brief Returns the capacity requested through PIPE_SIZE_ENV, or 0 to keep the default.
  */
-#define PIPE_FDS_PER_PIPE 2
+static long requested_pipe_size(void)
+{
+    const char* text = getenv(PIPE_SIZE_ENV);
+    if (text == NULL || *text == '\0')
+    {
+        return 0;
+    }
+    long size = pipe_size_parse(text);
+    if (size == -1)
+    {
+        fprintf(stderr, "Invalid %s: %s\n", PIPE_SIZE_ENV, text);
+        return 0;
+    }
+    return size;
+}
 
-void execute_piped_commands(char* input)
+/**
+ * @brief Runs the last stage of a pipeline, a builtin, in the shell process reading from `input_fd`.
+ *
+ * @return int The builtin's exit status.
+ */
+static int run_last_stage_in_shell(arena* a, const builtin* cmd, const node* stage, char** argv, int input_fd)
 {
-    char* commands[MAX_ARGS];
-    int num_commands = 0;
-    char* token = strtok(input, "|");
-    while (token != NULL)
+    fflush(stdout);
+    int saved_stdin = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (saved_stdin == -1 || dup2(input_fd, STDIN_FILENO) == -1)
+    {
+        perror("dup2");
+        if (saved_stdin != -1)
+        {
+            close(saved_stdin);
+        }
+        return 1;
+    }
+    close(input_fd);
+
+    // The stage's own redirections apply on top of the pipe, as in a child
+    saved_fd* saved = arena_alloc(a, (stage->simple.num_redirections + 1) * sizeof(saved_fd));
+    int count = redirect_shell_fds(a, stage->simple.redirections, stage->simple.num_redirections, saved);
+    int status = 1;
+    if (count != -1)
     {
-        commands[num_commands++] = token;
-        token = strtok(NULL, "|");
+        status = run_builtin(a, cmd, stage, argv);
+        restore_shell_fds(saved, count);
     }
-    commands[num_commands] = NULL;
 
+    fflush(stdout);
+    dup2(saved_stdin, STDIN_FILENO);
+    close(saved_stdin);
+    clearerr(stdin);
+    return status;
+}
+
+int execute_piped_commands(arena* a, const node* pipeline, int background)
+{
+    size_t num_commands = pipeline->pipeline.num_stages;
     if (num_commands > MAX_COMMANDS)
     {
         fprintf(stderr, "Error: Too many commands\n");
-        return;
+        return 1;
     }
 
-    size_t pipe_fds_size = PIPE_FDS_PER_PIPE * (num_commands - 1) * sizeof(int);
-    if (pipe_fds_size / sizeof(int) != PIPE_FDS_PER_PIPE * (num_commands - 1))
+    // Builtins that change the shell's state make no sense in a pipeline stage
+    char*** stage_argv = arena_alloc(a, num_commands * sizeof(char**));
+    const builtin** stage_builtin = arena_alloc(a, num_commands * sizeof(builtin*));
+    // Each stage can have its own scheduling prefixes, on top of the background default
+    launch_policy* stage_policy = arena_alloc(a, num_commands * sizeof(launch_policy));
+    const launch_policy* defaults = background ? policy_background() : NULL;
+    for (size_t i = 0; i < num_commands; i++)
     {
-        fprintf(stderr, "Error: Size calculation overflow\n");
-        return;
+        const node* stage = pipeline->pipeline.stages[i];
+        stage_builtin[i] = NULL;
+        memset(&stage_policy[i], 0, sizeof(launch_policy));
+        policy_merge(&stage_policy[i], defaults);
+        if (stage->type != NODE_SIMPLE)
+        {
+            // Compound commands run in a forked copy of the shell
+            stage_argv[i] = NULL;
+            continue;
+        }
+        stage_argv[i] = build_argv(a, stage);
+        if (stage_argv[i] == NULL)
+        {
+            return 1;
+        }
+        if (stage_argv[i][0] == NULL)
+        {
+            fprintf(stderr, "Error: Empty command in pipeline\n");
+            return 1;
+        }
+        launch_policy prefixes;
+        char** argv = policy_strip_prefixes(stage_argv[i], &prefixes);
+        if (argv == NULL)
+        {
+            return 2;
+        }
+        if (control_find_function(argv[0]) != NULL)
+        {
+            // So do function calls, which read their prefixes again in there
+            stage_argv[i] = NULL;
+            continue;
+        }
+        policy_merge(&prefixes, defaults);
+        stage_policy[i] = prefixes;
+        stage_argv[i] = argv;
+        stage_builtin[i] = builtin_find(argv[0], strlen(argv[0]));
+        if (stage_builtin[i] != NULL && !(stage_builtin[i]->flags & BUILTIN_PIPELINE_SAFE))
+        {
+            fprintf(stderr, "%s: cannot be used in a pipeline\n", stage_builtin[i]->name);
+            return 1;
+        }
     }
 
-    int* pipe_fds = malloc(pipe_fds_size);
-    if (pipe_fds == NULL)
-    {
-        perror("malloc");
-        return;
-    }
+    // A builtin at the end of a foreground pipeline runs in the shell itself, like `cmd | read`
+    // in other shells
+    const node* last = pipeline->pipeline.stages[num_commands - 1];
+    int last_in_shell = !background && stage_builtin[num_commands - 1] != NULL &&
+                        stage_policy[num_commands - 1].flags == 0;
+    size_t num_forked = last_in_shell ? num_commands - 1 : num_commands;
 
-    for (int i = 0; i < num_commands - 1; i++)
+    long pipe_size = requested_pipe_size();
+    int num_pipe_fds = (int)(PIPE_FDS_PER_PIPE * (num_commands - 1));
+    int* pipe_fds = arena_alloc(a, (size_t)num_pipe_fds * sizeof(int));
+    for (size_t i = 0; i < num_commands - 1; i++)
     {
-        if (pipe(pipe_fds + i * PIPE_FDS_PER_PIPE) == -1)
+        // Close-on-exec keeps every child from inheriting the other stages' pipe ends,
+        // so each stage only needs its own dup2 file actions.
+        if (pipe2(pipe_fds + i * PIPE_FDS_PER_PIPE, O_CLOEXEC) == -1)
         {
             perror("pipe");
-            free(pipe_fds);
-            return;
+            close_redirections(pipe_fds, (int)(i * PIPE_FDS_PER_PIPE));
+            return 1;
+        }
+        if (pipe_size > 0)
+        {
+            // Larger pipes let bulk stages move more per read/write and switch context less
+            pipe_set_size(pipe_fds[i * PIPE_FDS_PER_PIPE], pipe_size);
         }
     }
 
-    for (int i = 0; i < num_commands; i++)
+    // Children must not be reaped before they are recorded in the job
+    sigset_t old;
+    jobs_block_sigchld(&old);
+
+    pid_t* pids = arena_alloc(a, num_commands * sizeof(pid_t));
+    size_t launched = 0;
+    // Every stage joins the process group led by the first one
+    pid_t pgid = 0;
+    pid_t last_pid = -1;
+    for (size_t i = 0; i < num_forked; i++)
     {
-        pid_t pid = fork();
-        if (pid == -1)
+        const node* stage = pipeline->pipeline.stages[i];
+        launch_spec spec;
+        launch_spec_init(&spec, stage_argv[i]);
+        spec.envp = stage_argv[i] != NULL ? build_envp(a, stage) : NULL;
+        spec.pgid = pgid;
+        spec.policy = stage_policy[i].flags != 0 ? &stage_policy[i] : NULL;
+        if (i > 0)
         {
-            perror("fork");
-            free(pipe_fds);
-            return;
+            // Redirect the input to the pipe from the previous command
+            launch_spec_add_dup2(&spec, pipe_fds[(i - 1) * PIPE_FDS_PER_PIPE], STDIN_FILENO);
         }
-        else if (pid == 0)
+        if (i < num_commands - 1)
         {
-            if (i > 0)
-            {
-                // Redirect the input to the pipe from the previous command
-                if (dup2(pipe_fds[(i - 1) * PIPE_FDS_PER_PIPE], STDIN_FILENO) == -1)
-                {
-                    perror("dup2");
-                    exit(EXIT_FAILURE);
-                }
-            }
-            if (i < num_commands - 1)
-            {
-                // Redirect the output to the pipe to the next command
-                if (dup2(pipe_fds[i * PIPE_FDS_PER_PIPE + 1], STDOUT_FILENO) == -1)
-                {
-                    perror("dup2");
-                    exit(EXIT_FAILURE);
-                }
-            }
-            // Close all the pipes in the child process
-            for (int j = 0; j < PIPE_FDS_PER_PIPE * (num_commands - 1); j++)
-            {
-                close(pipe_fds[j]);
-            }
-            // Split the command into arguments
-            char* args[MAX_ARGS];
-            int k = 0;
-            char* arg_token = strtok(commands[i], " ");
-            while (arg_token != NULL)
-            {
-                args[k++] = arg_token;
-                arg_token = strtok(NULL, " ");
-            }
-            args[k] = NULL;
-            if (execvp(args[0], args) == -1)
+            // Redirect the output to the pipe to the next command
+            launch_spec_add_dup2(&spec, pipe_fds[i * PIPE_FDS_PER_PIPE + 1], STDOUT_FILENO);
+        }
+
+        uint64_t spawn_start = stats_now();
+        pid_t pid;
+        if (stage_argv[i] == NULL)
+        {
+            // The subshell applies the stage's redirections itself, on top of the pipes
+            pid = fork_subshell(a, stage, &spec, pipe_fds, num_pipe_fds);
+        }
+        else
+        {
+            // Explicit redirections come after the pipe ones so they take precedence
+            int* opened = arena_alloc(a, (stage->simple.num_redirections + 1) * sizeof(int));
+            int count = open_redirections(a, stage, &spec, opened);
+            if (count == -1)
             {
-                perror("execvp");
-                exit(EXIT_FAILURE);
+                continue;
             }
+            // Builtins run in a forked child without exec, writing straight into the pipe
+            const builtin* cmd = stage_builtin[i];
+            pid = cmd != NULL ? fork_builtin(cmd, stage_argv[i], &spec, pipe_fds, num_pipe_fds)
+                              : launch_command(&spec);
+            close_redirections(opened, count);
+        }
+        stats_record_since(STAT_SPAWN, spawn_start);
+        if (pid != -1)
+        {
+            pids[launched++] = pid;
+            pgid = pids[0];
+        }
+        if (i == num_commands - 1)
+        {
+            last_pid = pid;
         }
     }
-    // Close all the pipes in the parent process
-    for (int i = 0; i < PIPE_FDS_PER_PIPE * (num_commands - 1); i++)
+
+    int status = STATUS_NOT_FOUND;
+    if (last_in_shell)
     {
-        close(pipe_fds[i]);
+        // Close every pipe end except the one the last stage reads from
+        int input_fd = pipe_fds[(num_commands - 2) * PIPE_FDS_PER_PIPE];
+        close_redirections(pipe_fds, num_pipe_fds - PIPE_FDS_PER_PIPE);
+        close(pipe_fds[num_pipe_fds - 1]);
+        // Record the other stages first: the builtin may reap children itself (`wait`, `parallel`)
+        job* j = launched > 0 ? register_job(pipeline, pids, launched, 0) : NULL;
+        status = run_last_stage_in_shell(a, stage_builtin[num_commands - 1], last, stage_argv[num_commands - 1],
+                                         input_fd);
+        if (j != NULL)
+        {
+            job_add_finished(j, status);
+            job_wait(j);
+        }
     }
-    // Wait for all the child processes to finish
-    for (int i = 0; i < num_commands; i++)
+    else
     {
-        int status;
-        if (waitpid(-1, &status, 0) == -1)
+        // Close all the pipes in the parent process
+        close_redirections(pipe_fds, num_pipe_fds);
+        if (launched > 0)
+        {
+            status = track_job(pipeline, pids, launched, background);
+        }
+        // The status of a pipeline is the one of its last command
+        if (last_pid == -1 && !background)
         {
-            perror("waitpid");
+            status = STATUS_NOT_FOUND;
         }
     }
-    free(pipe_fds);
+    jobs_restore_sigmask(&old);
+    return status;
 }
@@ -0,0 +1,285 @@
+#include "policy.h"
+#include "control.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Bits the I/O class is shifted by in an ioprio_set(2) value.
+ */
+#define IOPRIO_CLASS_SHIFT 13
+
+/**
+ * @brief Highest level within an I/O class.
+ */
+#define IOPRIO_MAX_LEVEL 7
+
+/**
+ * @brief Level of the realtime and best-effort classes when none is given, the kernel's default.
+ */
+#define IOPRIO_DEFAULT_LEVEL 4
+
+/**
+ * @brief Largest niceness change that can matter: niceness runs from -20 to 19.
+ */
+#define NICE_RANGE 39
+
+/**
+ * @brief Most words in POLICY_BACKGROUND_ENV.
+ */
+#define MAX_POLICY_WORDS 16
+
+/**
+ * @brief An I/O scheduling class accepted by `ionice`.
+ */
+typedef struct
+{
+    const char* name; /**< Its name. */
+    const char* code; /**< Its number, as ionice(1) takes it. */
+    int value;        /**< Its IOPRIO_CLASS_* value. */
+} io_class;
+
+/**
+ * @brief The I/O classes.
+ */
+static const io_class io_classes[] = {
+    {"realtime", "1", 1},
+    {"best-effort", "2", 2},
+    {"idle", "3", 3},
+};
+
+/**
+ * @brief POLICY_BACKGROUND_ENV as last parsed, or NULL.
+ */
+static char* background_text = NULL;
+
+/**
+ * @brief The policy parsed from background_text.
+ */
+static launch_policy background;
+
+/**
+ * @brief Non-zero if background_text was a valid policy.
+ */
+static int background_valid = 0;
+
+/**
+ * @brief Reads a whole decimal integer within [min, max].
+ *
+ * @return int 0 on success, -1 if `text` is not such a number, leaving `value` alone.
+ */
+static int parse_integer(const char* text, long min, long max, long* value)
+{
+    char* end;
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < min || parsed > max)
+    {
+        return -1;
+    }
+    *value = parsed;
+    return 0;
+}
+
+/**
+ * @brief Parses a CPU list such as `0-3,6` into the policy.
+ *
+ * @return int 0 on success, -1 if the list is invalid.
+ */
+static int parse_cpus(const char* text, launch_policy* policy)
+{
+    memset(policy->cpus, 0, sizeof(policy->cpus));
+    const char* p = text;
+    do
+    {
+        char* end;
+        errno = 0;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || *p == '-' || errno == ERANGE)
+        {
+            return -1;
+        }
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(++p, &end, 10);
+            if (end == p || *p == '-' || errno == ERANGE)
+            {
+                return -1;
+            }
+            p = end;
+        }
+        if (first > last || last >= LAUNCH_MAX_CPUS)
+        {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            policy->cpus[cpu / LAUNCH_CPU_WORD_BITS] |= 1UL << (cpu % LAUNCH_CPU_WORD_BITS);
+        }
+    } while (*p++ == ',');
+    return p[-1] == '\0' ? 0 : -1;
+}
+
+/**
+ * @brief Parses `CLASS[:LEVEL]` into the policy.
+ *
+ * @return int 0 on success, -1 if the class or level is invalid.
+ */
+static int parse_ioprio(const char* text, launch_policy* policy)
+{
+    const char* colon = strchr(text, ':');
+    size_t len = colon != NULL ? (size_t)(colon - text) : strlen(text);
+    for (size_t i = 0; i < sizeof(io_classes) / sizeof(io_classes[0]); i++)
+    {
+        const io_class* c = &io_classes[i];
+        if ((strlen(c->name) == len && strncmp(text, c->name, len) == 0) ||
+            (strlen(c->code) == len && strncmp(text, c->code, len) == 0))
+        {
+            long level = IOPRIO_DEFAULT_LEVEL;
+            if (colon != NULL && parse_integer(colon + 1, 0, IOPRIO_MAX_LEVEL, &level) == -1)
+            {
+                return -1;
+            }
+            // The idle class has no levels
+            policy->ioprio = c->value << IOPRIO_CLASS_SHIFT | (strcmp(c->name, "idle") == 0 ? 0 : (int)level);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+char** policy_strip_prefixes(char** argv, launch_policy* policy)
+{
+    memset(policy, 0, sizeof(*policy));
+    while (argv[0] != NULL && control_find_function(argv[0]) == NULL)
+    {
+        const char* name = argv[0];
+        int used;
+        if (strcmp(name, "nice") == 0)
+        {
+            // `nice cmd` adds the default, `nice [-n] N cmd` adds N
+            int has_flag = argv[1] != NULL && strcmp(argv[1], "-n") == 0;
+            long increment = POLICY_DEFAULT_NICE;
+            used = 1 + has_flag;
+            if (argv[used] != NULL && parse_integer(argv[used], -NICE_RANGE, NICE_RANGE, &increment) == 0)
+            {
+                used++;
+            }
+            else if (has_flag && argv[used] != NULL)
+            {
+                fprintf(stderr, "%s: invalid adjustment: %s\n", name, argv[used]);
+                return NULL;
+            }
+            if (argv[used] == NULL)
+            {
+                break;
+            }
+            policy->nice += (int)increment;
+            policy->flags |= LAUNCH_POLICY_NICE;
+        }
+        else if (strcmp(name, "pin") == 0 || strcmp(name, "ionice") == 0)
+        {
+            used = 2;
+            if (argv[1] == NULL || argv[2] == NULL)
+            {
+                break;
+            }
+            if (name[0] == 'p' && parse_cpus(argv[1], policy) == -1)
+            {
+                fprintf(stderr, "%s: invalid CPU list: %s\n", name, argv[1]);
+                return NULL;
+            }
+            if (name[0] == 'i' && parse_ioprio(argv[1], policy) == -1)
+            {
+                fprintf(stderr, "%s: invalid class: %s\n", name, argv[1]);
+                return NULL;
+            }
+            policy->flags |= name[0] == 'p' ? LAUNCH_POLICY_CPUS : LAUNCH_POLICY_IOPRIO;
+        }
+        else
+        {
+            break;
+        }
+        argv += used;
+    }
+    return argv;
+}
+
+/**
+ * @brief Parses a policy written as prefixes, such as `nice 5 pin 0-1`.
+ *
+ * @return int 0 on success, -1 if some word is not part of a prefix.
+ */
+static int parse_policy(const char* text, launch_policy* policy)
+{
+    char* copy = strdup(text);
+    if (copy == NULL)
+    {
+        perror("strdup");
+        return -1;
+    }
+    // Followed by a stand-in command, so that the last prefix counts
+    char* words[MAX_POLICY_WORDS + 2];
+    int count = 0;
+    char* saveptr;
+    for (char* w = strtok_r(copy, " \t", &saveptr); w != NULL; w = strtok_r(NULL, " \t", &saveptr))
+    {
+        if (count == MAX_POLICY_WORDS)
+        {
+            free(copy);
+            return -1;
+        }
+        words[count++] = w;
+    }
+    char command[] = "command";
+    words[count] = command;
+    words[count + 1] = NULL;
+    char** rest = policy_strip_prefixes(words, policy);
+    free(copy);
+    return rest == words + count ? 0 : -1;
+}
+
+const launch_policy* policy_background(void)
+{
+    const char* text = getenv(POLICY_BACKGROUND_ENV);
+    if (text == NULL || *text == '\0')
+    {
+        return NULL;
+    }
+    if (background_text == NULL || strcmp(text, background_text) != 0)
+    {
+        // Parsed again only when the variable changes
+        free(background_text);
+        background_text = strdup(text);
+        background_valid = background_text != NULL && parse_policy(text, &background) == 0;
+        if (!background_valid)
+        {
+            fprintf(stderr, "%s: invalid policy: %s\n", POLICY_BACKGROUND_ENV, text);
+        }
+    }
+    return background_valid && background.flags != 0 ? &background : NULL;
+}
+
+void policy_merge(launch_policy* policy, const launch_policy* defaults)
+{
+    if (defaults == NULL)
+    {
+        return;
+    }
+    if (!(policy->flags & LAUNCH_POLICY_CPUS) && (defaults->flags & LAUNCH_POLICY_CPUS))
+    {
+        memcpy(policy->cpus, defaults->cpus, sizeof(policy->cpus));
+    }
+    if (!(policy->flags & LAUNCH_POLICY_NICE))
+    {
+        policy->nice = defaults->nice;
+    }
+    if (!(policy->flags & LAUNCH_POLICY_IOPRIO))
+    {
+        policy->ioprio = defaults->ioprio;
+    }
+    policy->flags |= defaults->flags;
+}
@@ -0,0 +1,464 @@
+#include "prompt.h"
+#include "commands.h"
+#include "jobs.h"
+#include "monitor.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Largest user or host name kept.
+ */
+#define NAME_MAX_LEN 256
+
+/**
+ * @brief Nanoseconds per millisecond.
+ */
+#define NSEC_PER_MSEC 1000000L
+
+/**
+ * @brief Nanoseconds per second.
+ */
+#define NSEC_PER_SEC 1000000000L
+
+/**
+ * @brief How a segment is kept up to date.
+ */
+typedef enum
+{
+    SEGMENT_STATIC, /**< Computed once. */
+    SEGMENT_CACHED, /**< Recomputed by the prompt after one of its events. */
+    SEGMENT_ASYNC,  /**< Recomputed on the background thread before every prompt. */
+} segment_kind;
+
+/**
+ * @brief A kind of segment.
+ */
+typedef struct
+{
+    const char* name;                          /**< Name used in PROMPT_ENV. */
+    const char* prefix;                        /**< Written before the text, unless the text is empty. */
+    segment_kind kind;                         /**< How it is kept up to date. */
+    unsigned int events;                       /**< PROMPT_EVENT_* flags invalidating a cached segment. */
+    void (*compute)(char* text, size_t size); /**< Stores the text, empty to hide the segment. */
+} segment_type;
+
+/**
+ * @brief A segment of the configured prompt.
+ */
+typedef struct
+{
+    const segment_type* type; /**< Its kind. */
+    int valid;                /**< Non-zero once `text` was computed and not invalidated. */
+    char text[PROMPT_SEGMENT_MAX];   /**< The last computed text. */
+} segment;
+
+/**
+ * @brief State shared with the background thread, guarded by `lock`.
+ */
+typedef struct
+{
+    pthread_t thread;        /**< The thread computing the SEGMENT_ASYNC segments. */
+    pthread_mutex_t lock;    /**< Guards this structure and the texts of the async segments. */
+    pthread_cond_t wake;     /**< Signaled when a refresh is requested or the thread must stop. */
+    pthread_cond_t done;     /**< Signaled when a refresh is complete. */
+    unsigned long requested; /**< Refreshes requested. */
+    unsigned long completed; /**< The last refresh completed. */
+    int started;             /**< Non-zero while the thread runs. */
+    int stop;                /**< Non-zero to make the thread exit. */
+} async_state;
+
+/**
+ * @brief The configured segments, in order.
+ */
+static segment segments[PROMPT_MAX_SEGMENTS];
+
+/**
+ * @brief Number of entries of `segments`.
+ */
+static size_t num_segments = 0;
+
+/**
+ * @brief PROMPT_EVENT_* flags raised since the last prompt.
+ */
+static _Atomic unsigned int stale_events = 0;
+
+/**
+ * @brief The background thread.
+ */
+static async_state async = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * @brief The user shown by the `user` segment.
+ */
+static char prompt_user[NAME_MAX_LEN];
+
+/**
+ * @brief The host shown by the `host` segment.
+ */
+static char prompt_host[NAME_MAX_LEN];
+
+/**
+ * @brief PROJECT_ROOT at startup, so the background thread never reads the environment.
+ */
+static char project_root[PATH_MAX];
+
+static void compute_user(char* text, size_t size)
+{
+    snprintf(text, size, COLOR_USER "%s" COLOR_RESET, prompt_user);
+}
+
+static void compute_host(char* text, size_t size)
+{
+    snprintf(text, size, COLOR_HOST "%s" COLOR_RESET, prompt_host);
+}
+
+static void compute_cwd(char* text, size_t size)
+{
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+    {
+        snprintf(cwd, sizeof(cwd), "?");
+    }
+    const char* display_dir = cwd;
+    if (!show_full_path)
+    {
+        const char* last_slash = strrchr(cwd, '/');
+        if (last_slash != NULL && last_slash[1] != '\0')
+        {
+            display_dir = last_slash + 1;
+        }
+    }
+    snprintf(text, size, COLOR_DIR "%s" COLOR_RESET, display_dir);
+}
+
+static void compute_status(char* text, size_t size)
+{
+    int status = command_last_status();
+    if (status == 0)
+    {
+        text[0] = '\0';
+        return;
+    }
+    snprintf(text, size, COLOR_STATUS "[%d]" COLOR_RESET, status);
+}
+
+static void compute_jobs(char* text, size_t size)
+{
+    size_t count = jobs_count();
+    if (count == 0)
+    {
+        text[0] = '\0';
+        return;
+    }
+    snprintf(text, size, COLOR_JOBS "%zu job%s" COLOR_RESET, count, count == 1 ? "" : "s");
+}
+
+static void compute_load(char* text, size_t size)
+{
+    text[0] = '\0';
+    int fd = open("/proc/loadavg", O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return;
+    }
+    char buffer[64];
+    ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (n <= 0)
+    {
+        return;
+    }
+    buffer[n] = '\0';
+    // The one minute average is the first field
+    buffer[strcspn(buffer, " ")] = '\0';
+    snprintf(text, size, "%s", buffer);
+}
+
+static void compute_monitor(char* text, size_t size)
+{
+    pid_t pid = monitor_running_pid(project_root);
+    if (pid <= 0)
+    {
+        text[0] = '\0';
+        return;
+    }
+    snprintf(text, size, COLOR_MONITOR "monitor:%d" COLOR_RESET, (int)pid);
+}
+
+/**
+ * @brief Every kind of segment.
+ */
+static const segment_type segment_types[] = {
+    {"user", "", SEGMENT_STATIC, 0, compute_user},
+    {"host", "@", SEGMENT_STATIC, 0, compute_host},
+    {"cwd", ":", SEGMENT_CACHED, PROMPT_EVENT_CWD, compute_cwd},
+    {"status", " ", SEGMENT_CACHED, PROMPT_EVENT_STATUS, compute_status},
+    {"jobs", " ", SEGMENT_CACHED, PROMPT_EVENT_JOBS, compute_jobs},
+    {"load", " ", SEGMENT_ASYNC, 0, compute_load},
+    {"monitor", " ", SEGMENT_ASYNC, 0, compute_monitor},
+};
+
+/**
+ * @brief Returns the kind of segment called `len` bytes of `name`, or NULL.
+ */
+static const segment_type* find_segment_type(const char* name, size_t len)
+{
+    for (size_t i = 0; i < sizeof(segment_types) / sizeof(segment_types[0]); i++)
+    {
+        if (strlen(segment_types[i].name) == len && strncmp(segment_types[i].name, name, len) == 0)
+        {
+            return &segment_types[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Loop of the background thread: computes the async segments on request.
+ */
+static void* async_main(void* arg)
+{
+    (void)arg;
+    static char texts[PROMPT_MAX_SEGMENTS][PROMPT_SEGMENT_MAX];
+    pthread_mutex_lock(&async.lock);
+    while (1)
+    {
+        while (!async.stop && async.completed == async.requested)
+        {
+            pthread_cond_wait(&async.wake, &async.lock);
+        }
+        if (async.stop)
+        {
+            break;
+        }
+        unsigned long generation = async.requested;
+        pthread_mutex_unlock(&async.lock);
+
+        // Computed without the lock, so a slow segment does not hold up the prompt
+        for (size_t i = 0; i < num_segments; i++)
+        {
+            if (segments[i].type->kind == SEGMENT_ASYNC)
+            {
+                segments[i].type->compute(texts[i], PROMPT_SEGMENT_MAX);
+            }
+        }
+
+        pthread_mutex_lock(&async.lock);
+        for (size_t i = 0; i < num_segments; i++)
+        {
+            if (segments[i].type->kind == SEGMENT_ASYNC)
+            {
+                memcpy(segments[i].text, texts[i], PROMPT_SEGMENT_MAX);
+                segments[i].valid = 1;
+            }
+        }
+        async.completed = generation;
+        pthread_cond_broadcast(&async.done);
+    }
+    pthread_mutex_unlock(&async.lock);
+    return NULL;
+}
+
+/**
+ * @brief Starts the background thread, with every signal blocked so they are all handled by the shell's thread.
+ *
+ * @return int 0 on success, -1 on error.
+ */
+static int async_start(void)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&async.wake, NULL);
+    pthread_cond_init(&async.done, &attr);
+    pthread_condattr_destroy(&attr);
+    async.requested = 0;
+    async.completed = 0;
+    async.stop = 0;
+
+    sigset_t all;
+    sigset_t old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int rc = pthread_create(&async.thread, NULL, async_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0)
+    {
+        errno = rc;
+        perror("pthread_create");
+        return -1;
+    }
+    async.started = 1;
+    return 0;
+}
+
+void prompt_shutdown(void)
+{
+    if (async.started)
+    {
+        pthread_mutex_lock(&async.lock);
+        async.stop = 1;
+        pthread_cond_signal(&async.wake);
+        pthread_mutex_unlock(&async.lock);
+        pthread_join(async.thread, NULL);
+        pthread_cond_destroy(&async.wake);
+        pthread_cond_destroy(&async.done);
+        async.started = 0;
+    }
+    num_segments = 0;
+}
+
+int prompt_init(const char* spec, const char* username, const char* hostname)
+{
+    prompt_shutdown();
+    snprintf(prompt_user, sizeof(prompt_user), "%s", username);
+    snprintf(prompt_host, sizeof(prompt_host), "%s", hostname);
+    const char* root = getenv("PROJECT_ROOT");
+    snprintf(project_root, sizeof(project_root), "%s", root != NULL ? root : "");
+
+    int status = 0;
+    const char* cursor = spec != NULL ? spec : PROMPT_DEFAULT;
+    while (*cursor != '\0')
+    {
+        size_t len = strcspn(cursor, ",");
+        const segment_type* type = find_segment_type(cursor, len);
+        if (type == NULL || num_segments == PROMPT_MAX_SEGMENTS)
+        {
+            fprintf(stderr, "prompt: unknown segment '%.*s'\n", (int)len, cursor);
+            status = -1;
+            break;
+        }
+        segments[num_segments].type = type;
+        segments[num_segments].valid = 0;
+        segments[num_segments].text[0] = '\0';
+        num_segments++;
+        cursor += len;
+        cursor += *cursor == ',';
+    }
+    if (status == -1)
+    {
+        num_segments = 0;
+        prompt_init(PROMPT_DEFAULT, username, hostname);
+        return -1;
+    }
+
+    int needs_thread = 0;
+    for (size_t i = 0; i < num_segments; i++)
+    {
+        needs_thread |= segments[i].type->kind == SEGMENT_ASYNC;
+    }
+    if (needs_thread && async_start() == -1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+void prompt_invalidate(unsigned int events)
+{
+    atomic_fetch_or_explicit(&stale_events, events, memory_order_relaxed);
+}
+
+/**
+ * @brief Asks the background thread for fresh values and waits for them until the deadline.
+ *
+ * Called, and returns, with `async.lock` held.
+ */
+static void async_refresh(void)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += PROMPT_ASYNC_DEADLINE_MS * NSEC_PER_MSEC;
+    if (deadline.tv_nsec >= NSEC_PER_SEC)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= NSEC_PER_SEC;
+    }
+
+    unsigned long generation = ++async.requested;
+    pthread_cond_signal(&async.wake);
+    while (async.completed < generation)
+    {
+        if (pthread_cond_timedwait(&async.done, &async.lock, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+}
+
+size_t prompt_format(char* buffer, size_t size)
+{
+    unsigned int events = atomic_exchange_explicit(&stale_events, 0, memory_order_relaxed);
+    for (size_t i = 0; i < num_segments; i++)
+    {
+        segment* s = &segments[i];
+        if (s->type->kind == SEGMENT_ASYNC)
+        {
+            continue;
+        }
+        if (!s->valid || (s->type->events & events) != 0)
+        {
+            s->type->compute(s->text, sizeof(s->text));
+            s->valid = 1;
+        }
+    }
+
+    if (async.started)
+    {
+        pthread_mutex_lock(&async.lock);
+        async_refresh();
+    }
+    size_t len = 0;
+    buffer[0] = '\0';
+    for (size_t i = 0; i < num_segments && len < size; i++)
+    {
+        const segment* s = &segments[i];
+        if (s->text[0] != '\0')
+        {
+            int n = snprintf(buffer + len, size - len, "%s%s", len > 0 ? s->type->prefix : "", s->text);
+            len += n > 0 ? (size_t)n : 0;
+        }
+    }
+    if (async.started)
+    {
+        pthread_mutex_unlock(&async.lock);
+    }
+    if (len < size)
+    {
+        int n = snprintf(buffer + len, size - len, "$ ");
+        len += n > 0 ? (size_t)n : 0;
+    }
+    return len < size ? len : size - 1;
+}
+
+void prompt_render(void)
+{
+    static char buffer[PROMPT_MAX];
+    size_t len = prompt_format(buffer, sizeof(buffer));
+    // Whatever was printed before (job notices) must come first
+    fflush(stdout);
+    size_t written = 0;
+    while (written < len)
+    {
+        ssize_t n = write(STDOUT_FILENO, buffer + written, len - written);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        written += (size_t)n;
+    }
+}
@@ -0,0 +1,332 @@
+#include "script.h"
+#include "builtins.h"
+#include "commands.h"
+#include "control.h"
+#include "executor.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "script_cache.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int script_reader_init(script_reader* reader, int fd)
+{
+    reader->buffer = malloc(SCRIPT_BUFFER_SIZE);
+    if (reader->buffer == NULL)
+    {
+        perror("malloc");
+        return -1;
+    }
+    reader->fd = fd;
+    reader->capacity = SCRIPT_BUFFER_SIZE;
+    reader->start = 0;
+    reader->scan = 0;
+    reader->end = 0;
+    reader->eof = 0;
+    return 0;
+}
+
+/**
+ * @brief Reads more input, first moving the command being assembled to the front of the buffer.
+ *
+ * @return int 0 on success (or end of file), -1 on error.
+ */
+static int fill(script_reader* reader)
+{
+    if (reader->start > 0)
+    {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->scan -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->end == reader->capacity)
+    {
+        // A single command fills the whole buffer
+        char* grown = realloc(reader->buffer, reader->capacity * 2);
+        if (grown == NULL)
+        {
+            perror("realloc");
+            return -1;
+        }
+        reader->buffer = grown;
+        reader->capacity *= 2;
+    }
+
+    ssize_t n;
+    do
+    {
+        n = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+    } while (n == -1 && errno == EINTR);
+
+    if (n == -1)
+    {
+        perror("read");
+        return -1;
+    }
+    if (n == 0)
+    {
+        reader->eof = 1;
+    }
+    reader->end += (size_t)n;
+    return 0;
+}
+
+int script_reader_next(script_reader* reader, int keep, const char** text, size_t* len)
+{
+    if (!keep)
+    {
+        reader->start = reader->scan;
+    }
+
+    while (1)
+    {
+        char* newline = memchr(reader->buffer + reader->scan, '\n', reader->end - reader->scan);
+        if (newline != NULL || (reader->eof && reader->scan < reader->end))
+        {
+            // A final line without a newline is still a line
+            reader->scan = newline != NULL ? (size_t)(newline - reader->buffer) + 1 : reader->end;
+            *text = reader->buffer + reader->start;
+            *len = reader->scan - reader->start;
+            return 1;
+        }
+        if (reader->eof)
+        {
+            return 0;
+        }
+        if (fill(reader) == -1)
+        {
+            return -1;
+        }
+    }
+}
+
+void script_reader_free(script_reader* reader)
+{
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+/**
+ * @brief Opens a script for sequential reading.
+ *
+ * @return int The descriptor, or -1 on error.
+ */
+static int open_script(const char* path, script_reader* reader)
+{
+    // Close-on-exec, so commands run by the script do not inherit it
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        perror("open");
+        return -1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (script_reader_init(reader, fd) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int run_script(const char* path)
+{
+    const char* cache_dir = getenv(SCRIPT_CACHE_ENV);
+    if (cache_dir != NULL && cache_dir[0] != '\0')
+    {
+        int status = script_cache_run(path, cache_dir);
+        if (status != -1)
+        {
+            return status;
+        }
+    }
+
+    script_reader reader;
+    int fd = open_script(path, &reader);
+    if (fd == -1)
+    {
+        return 1;
+    }
+
+    const char* text;
+    size_t len;
+    int keep = 0;
+    int result;
+    for (uint64_t read_start = stats_now(); (result = script_reader_next(&reader, keep, &text, &len)) == 1;
+         read_start = stats_now())
+    {
+        stats_record_since(STAT_READ, read_start);
+        // An incomplete command is retried with the next line appended
+        keep = execute_command_text(text, len) == PARSE_INCOMPLETE;
+        // Scripts get no notices, but finished jobs must not pile up
+        jobs_notify(0);
+    }
+    if (keep)
+    {
+        fprintf(stderr, "syntax error: unexpected end of file\n");
+    }
+
+    script_reader_free(&reader);
+    close(fd);
+    return result == -1 ? 1 : 0;
+}
+
+/**
+ * @brief Tells whether one of `count` words holds a `$(...)` or `$((...))` expansion.
+ */
+static int has_substitution(const word* words, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        for (size_t j = 0; j + 1 < words[i].len; j++)
+        {
+            if (words[i].start[j] == '$' && words[i].start[j + 1] == '(')
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Tells whether a command must run in the shell itself, after every command before it.
+ *
+ * That is the case for assignments, builtins flagged BUILTIN_SHELL_STATE,
+ * background jobs, function definitions and calls, and compound commands
+ * (which may assign loop variables), whose effects would be lost in a forked
+ * task. So is a command with a `$(...)` or `$((...))` expansion, which must
+ * not be expanded both here and in the task.
+ */
+static int runs_alone(arena* a, const node* n)
+{
+    switch (n->type)
+    {
+    case NODE_SIMPLE:
+    {
+        if (n->simple.num_words == 0)
+        {
+            return n->simple.num_assignments > 0;
+        }
+        if (has_substitution(n->simple.words, n->simple.num_words))
+        {
+            // Its expansions run commands: they are left to execute_command_text()
+            return 1;
+        }
+        char** argv = build_argv(a, n);
+        if (argv == NULL || argv[0] == NULL)
+        {
+            return n->simple.num_assignments > 0;
+        }
+        if (control_find_function(argv[0]) != NULL)
+        {
+            return 1;
+        }
+        const builtin* cmd = builtin_find(argv[0], strlen(argv[0]));
+        return cmd != NULL && (cmd->flags & BUILTIN_SHELL_STATE);
+    }
+    case NODE_PIPELINE:
+        for (size_t i = 0; i < n->pipeline.num_stages; i++)
+        {
+            if (runs_alone(a, n->pipeline.stages[i]))
+            {
+                return 1;
+            }
+        }
+        return 0;
+    case NODE_AND:
+    case NODE_OR:
+        return runs_alone(a, n->binary.left) || runs_alone(a, n->binary.right);
+    case NODE_LIST:
+        for (size_t i = 0; i < n->list.num_items; i++)
+        {
+            if (n->list.items[i].background || runs_alone(a, n->list.items[i].command))
+            {
+                return 1;
+            }
+        }
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+int run_script_concurrently(const char* path, long max_running)
+{
+    script_reader reader;
+    int fd = open_script(path, &reader);
+    if (fd == -1)
+    {
+        return 1;
+    }
+    // Outputs come out in script order whatever order the commands finish in
+    parallel_run run;
+    if (parallel_init(&run, max_running, 1, 0) == -1)
+    {
+        script_reader_free(&reader);
+        close(fd);
+        return 1;
+    }
+
+    arena a;
+    arena_init(&a);
+    const char* text;
+    size_t len;
+    int keep = 0;
+    int result;
+    for (uint64_t read_start = stats_now(); (result = script_reader_next(&reader, keep, &text, &len)) == 1;
+         read_start = stats_now())
+    {
+        stats_record_since(STAT_READ, read_start);
+        arena_reset(&a);
+        node* n;
+        uint64_t parse_start = stats_now();
+        parse_status status = parse_line_quiet(&a, text, len, &n);
+        stats_record_since(STAT_PARSE, parse_start);
+        keep = status == PARSE_INCOMPLETE;
+        if (keep)
+        {
+            continue;
+        }
+
+        if (status != PARSE_OK || runs_alone(&a, n))
+        {
+            // A barrier: whatever it changes must not be seen by the commands before it,
+            // and everything after it must see it. A syntax error waits too, so that it is
+            // reported after the output of the lines before it
+            if (parallel_wait(&run) == -1)
+            {
+                break;
+            }
+            execute_command_text(text, len);
+            jobs_notify(0);
+            continue;
+        }
+        while (len > 0 && text[len - 1] == '\n')
+        {
+            len--;
+        }
+        if (parallel_start(&run, &a, n, text, len) == -1 && run.interrupted)
+        {
+            break;
+        }
+    }
+    if (keep)
+    {
+        parallel_wait(&run);
+        fprintf(stderr, "syntax error: unexpected end of file\n");
+    }
+
+    parallel_finish(&run);
+    arena_free(&a);
+    script_reader_free(&reader);
+    close(fd);
+    return result == -1 ? 1 : 0;
+}
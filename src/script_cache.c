@@ -0,0 +1,730 @@
+#include "script_cache.h"
+#include "arena.h"
+#include "commands.h"
+#include "jobs.h"
+#include "parser.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief FNV-1a 64 bit offset basis.
+ */
+#define FNV_OFFSET 14695981039346656037ULL
+
+/**
+ * @brief FNV-1a 64 bit prime.
+ */
+#define FNV_PRIME 1099511628211ULL
+
+/**
+ * @brief Codes allocated the first time the encoder grows.
+ */
+#define INITIAL_CODES 4096
+
+/**
+ * @brief The path stored after the header is padded to a multiple of this, so the codes are aligned.
+ */
+#define PATH_ALIGN 8
+
+/**
+ * @brief Permissions of the cache directory when the shell creates it.
+ */
+#define CACHE_DIR_PERMISSIONS 0700
+
+/**
+ * @brief Fixed part of a cache file; the script's real path and the encoded AST follow.
+ *
+ * The AST is a sequence of 32 bit codes: the number of commands, then each
+ * command's tree in preorder. Words are stored as an offset into the script
+ * and a length.
+ */
+typedef struct
+{
+    char magic[8];         /**< SCRIPT_CACHE_MAGIC without its NUL. */
+    uint64_t script_size;  /**< Size of the script when it was parsed. */
+    int64_t mtime_sec;     /**< Its modification time, seconds. */
+    int64_t mtime_nsec;    /**< Its modification time, nanoseconds. */
+    uint64_t script_hash;  /**< Hash of its content. */
+    uint64_t payload_hash; /**< Hash of the codes, to detect a corrupt cache. */
+    uint32_t path_len;     /**< Length of the real path, without padding. */
+    uint32_t num_codes;    /**< Number of codes. */
+} cache_header;
+
+/**
+ * @brief Serializes ASTs into codes.
+ */
+typedef struct
+{
+    uint32_t* codes;  /**< The codes written so far. */
+    size_t len;       /**< Number of codes in `codes`. */
+    size_t capacity;  /**< Codes allocated. */
+    const char* text; /**< The script the words point into. */
+    int failed;       /**< Set when memory ran out. */
+} encoder;
+
+/**
+ * @brief Rebuilds ASTs from codes, checking every count and offset.
+ */
+typedef struct
+{
+    const uint32_t* pos; /**< Next code. */
+    const uint32_t* end; /**< One past the last code. */
+    const char* text;    /**< The script the words point into. */
+    size_t text_len;     /**< Its length. */
+    arena* arena;        /**< Where nodes are allocated. */
+    int failed;          /**< Set when the codes do not describe a valid tree. */
+} decoder;
+
+/**
+ * @brief Hashes `len` bytes, eight at a time: every run hashes the whole script.
+ */
+static uint64_t hash_bytes(const char* data, size_t len)
+{
+    uint64_t hash = FNV_OFFSET;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+    {
+        uint64_t chunk;
+        memcpy(&chunk, data + i, sizeof(chunk));
+        hash = (hash ^ chunk) * FNV_PRIME;
+        // The multiplication only carries upwards; fold the high bits back down
+        hash ^= hash >> 32;
+    }
+    for (; i < len; i++)
+    {
+        hash = (hash ^ (unsigned char)data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static void put(encoder* e, uint32_t code)
+{
+    if (e->len == e->capacity)
+    {
+        size_t new_capacity = e->capacity == 0 ? INITIAL_CODES : e->capacity * 2;
+        uint32_t* grown = realloc(e->codes, new_capacity * sizeof(uint32_t));
+        if (grown == NULL)
+        {
+            e->failed = 1;
+            return;
+        }
+        e->codes = grown;
+        e->capacity = new_capacity;
+    }
+    e->codes[e->len++] = code;
+}
+
+static void put_word(encoder* e, const word* w)
+{
+    put(e, w->start != NULL ? (uint32_t)(w->start - e->text) : 0);
+    put(e, (uint32_t)w->len);
+}
+
+static void encode_redirections(encoder* e, const redirection* redirections, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const redirection* r = &redirections[i];
+        put(e, r->type);
+        put(e, (uint32_t)r->fd);
+        put_word(e, &r->target);
+        put_word(e, &r->body);
+        put(e, (uint32_t)r->expand);
+        put(e, (uint32_t)r->strip_tabs);
+    }
+}
+
+static void encode_node(encoder* e, const node* n);
+
+/**
+ * @brief Writes a child that may be missing, preceded by 1 if it is there, 0 if not.
+ */
+static void encode_optional(encoder* e, const node* n)
+{
+    put(e, n != NULL);
+    if (n != NULL)
+    {
+        encode_node(e, n);
+    }
+}
+
+static void encode_node(encoder* e, const node* n)
+{
+    put(e, n->type);
+    switch (n->type)
+    {
+    case NODE_SIMPLE:
+        put(e, (uint32_t)n->simple.num_words);
+        put(e, (uint32_t)n->simple.num_assignments);
+        put(e, (uint32_t)n->simple.num_redirections);
+        for (size_t i = 0; i < n->simple.num_words; i++)
+        {
+            put_word(e, &n->simple.words[i]);
+        }
+        for (size_t i = 0; i < n->simple.num_assignments; i++)
+        {
+            put_word(e, &n->simple.assignments[i]);
+        }
+        encode_redirections(e, n->simple.redirections, n->simple.num_redirections);
+        break;
+    case NODE_PIPELINE:
+        put(e, n->pipeline.timed);
+        put(e, (uint32_t)n->pipeline.num_stages);
+        for (size_t i = 0; i < n->pipeline.num_stages; i++)
+        {
+            encode_node(e, n->pipeline.stages[i]);
+        }
+        break;
+    case NODE_AND:
+    case NODE_OR:
+        encode_node(e, n->binary.left);
+        encode_node(e, n->binary.right);
+        break;
+    case NODE_LIST:
+        put(e, (uint32_t)n->list.num_items);
+        for (size_t i = 0; i < n->list.num_items; i++)
+        {
+            put(e, (uint32_t)n->list.items[i].background);
+            encode_node(e, n->list.items[i].command);
+        }
+        break;
+    default:
+        put_word(e, &n->compound.source);
+        put_word(e, &n->compound.name);
+        put(e, (uint32_t)n->compound.has_words);
+        put(e, (uint32_t)n->compound.num_words);
+        put(e, (uint32_t)n->compound.num_items);
+        put(e, (uint32_t)n->compound.num_redirections);
+        encode_optional(e, n->compound.condition);
+        encode_optional(e, n->compound.body);
+        encode_optional(e, n->compound.else_part);
+        for (size_t i = 0; i < n->compound.num_words; i++)
+        {
+            put_word(e, &n->compound.words[i]);
+        }
+        for (size_t i = 0; i < n->compound.num_items; i++)
+        {
+            const case_item* item = &n->compound.items[i];
+            put(e, (uint32_t)item->num_patterns);
+            for (size_t j = 0; j < item->num_patterns; j++)
+            {
+                put_word(e, &item->patterns[j]);
+            }
+            encode_node(e, item->body);
+        }
+        encode_redirections(e, n->compound.redirections, n->compound.num_redirections);
+        break;
+    }
+}
+
+static uint32_t get(decoder* d)
+{
+    if (d->pos == d->end)
+    {
+        d->failed = 1;
+        return 0;
+    }
+    return *d->pos++;
+}
+
+static void get_word(decoder* d, word* w)
+{
+    size_t offset = get(d);
+    size_t len = get(d);
+    if (offset + len > d->text_len)
+    {
+        d->failed = 1;
+        offset = 0;
+        len = 0;
+    }
+    w->start = d->text + offset;
+    w->len = len;
+}
+
+/**
+ * @brief Allocates an array of `count` elements read next.
+ *
+ * Every element takes at least one code, which bounds the counts of a corrupt cache.
+ */
+static void* get_array(decoder* d, size_t count, size_t size)
+{
+    if (count > (size_t)(d->end - d->pos))
+    {
+        d->failed = 1;
+        return NULL;
+    }
+    return count > 0 ? arena_alloc(d->arena, count * size) : NULL;
+}
+
+static redirection* decode_redirections(decoder* d, size_t count)
+{
+    redirection* redirections = get_array(d, count, sizeof(redirection));
+    for (size_t i = 0; i < count && !d->failed; i++)
+    {
+        redirection* r = &redirections[i];
+        r->type = (redirection_type)get(d);
+        r->fd = (int)get(d);
+        get_word(d, &r->target);
+        get_word(d, &r->body);
+        r->expand = (int)get(d);
+        r->strip_tabs = (int)get(d);
+        d->failed |= r->type > REDIR_HERESTRING;
+    }
+    return redirections;
+}
+
+static node* decode_node(decoder* d);
+
+/**
+ * @brief Reads a child written by encode_optional(); `required` ones must be there.
+ */
+static node* decode_optional(decoder* d, int required)
+{
+    if (d->failed)
+    {
+        return NULL;
+    }
+    if (get(d) == 0)
+    {
+        d->failed |= required;
+        return NULL;
+    }
+    return decode_node(d);
+}
+
+/**
+ * @brief Reads the fields of a compound command or function definition.
+ */
+static void decode_compound(decoder* d, node* n)
+{
+    get_word(d, &n->compound.source);
+    get_word(d, &n->compound.name);
+    n->compound.has_words = (int)get(d);
+    n->compound.num_words = get(d);
+    n->compound.num_items = get(d);
+    n->compound.num_redirections = get(d);
+    int conditional = n->type == NODE_IF || n->type == NODE_WHILE || n->type == NODE_UNTIL;
+    n->compound.condition = decode_optional(d, conditional);
+    n->compound.body = decode_optional(d, n->type != NODE_CASE);
+    n->compound.else_part = decode_optional(d, 0);
+
+    n->compound.words = get_array(d, n->compound.num_words, sizeof(word));
+    for (size_t i = 0; i < n->compound.num_words && !d->failed; i++)
+    {
+        get_word(d, &n->compound.words[i]);
+    }
+    n->compound.items = get_array(d, n->compound.num_items, sizeof(case_item));
+    for (size_t i = 0; i < n->compound.num_items && !d->failed; i++)
+    {
+        case_item* item = &n->compound.items[i];
+        item->num_patterns = get(d);
+        item->patterns = get_array(d, item->num_patterns, sizeof(word));
+        d->failed |= item->num_patterns == 0;
+        for (size_t j = 0; j < item->num_patterns && !d->failed; j++)
+        {
+            get_word(d, &item->patterns[j]);
+        }
+        item->body = d->failed ? NULL : decode_node(d);
+    }
+    n->compound.redirections = decode_redirections(d, n->compound.num_redirections);
+}
+
+static node* decode_node(decoder* d)
+{
+    node* n = arena_alloc(d->arena, sizeof(node));
+    memset(n, 0, sizeof(node));
+    n->type = (node_type)get(d);
+    switch (n->type)
+    {
+    case NODE_SIMPLE:
+        n->simple.num_words = get(d);
+        n->simple.num_assignments = get(d);
+        n->simple.num_redirections = get(d);
+        n->simple.words = get_array(d, n->simple.num_words, sizeof(word));
+        for (size_t i = 0; i < n->simple.num_words && !d->failed; i++)
+        {
+            get_word(d, &n->simple.words[i]);
+        }
+        n->simple.assignments = get_array(d, n->simple.num_assignments, sizeof(word));
+        for (size_t i = 0; i < n->simple.num_assignments && !d->failed; i++)
+        {
+            get_word(d, &n->simple.assignments[i]);
+        }
+        n->simple.redirections = decode_redirections(d, n->simple.num_redirections);
+        break;
+    case NODE_PIPELINE:
+        n->pipeline.timed = (time_format)get(d);
+        n->pipeline.num_stages = get(d);
+        n->pipeline.stages = get_array(d, n->pipeline.num_stages, sizeof(node*));
+        d->failed |= n->pipeline.timed > TIME_JSON || n->pipeline.num_stages == 0;
+        for (size_t i = 0; i < n->pipeline.num_stages && !d->failed; i++)
+        {
+            n->pipeline.stages[i] = decode_node(d);
+        }
+        break;
+    case NODE_AND:
+    case NODE_OR:
+        n->binary.left = decode_node(d);
+        n->binary.right = d->failed ? NULL : decode_node(d);
+        break;
+    case NODE_LIST:
+        n->list.num_items = get(d);
+        n->list.items = get_array(d, n->list.num_items, sizeof(list_item));
+        for (size_t i = 0; i < n->list.num_items && !d->failed; i++)
+        {
+            n->list.items[i].background = (int)get(d);
+            n->list.items[i].command = decode_node(d);
+        }
+        break;
+    case NODE_IF:
+    case NODE_WHILE:
+    case NODE_UNTIL:
+    case NODE_FOR:
+    case NODE_CASE:
+    case NODE_GROUP:
+    case NODE_FUNCTION:
+        decode_compound(d, n);
+        break;
+    default:
+        d->failed = 1;
+        break;
+    }
+    return d->failed ? NULL : n;
+}
+
+/**
+ * @brief Returns the end of the line starting at `start`, newline included.
+ */
+static size_t line_end(const char* text, size_t start, size_t size)
+{
+    const char* newline = memchr(text + start, '\n', size - start);
+    return newline != NULL ? (size_t)(newline - text) + 1 : size;
+}
+
+/**
+ * @brief Parses a whole script, command by command as run_script() reads it, into codes.
+ *
+ * @return int 0 on success, -1 if the script has a syntax error or ends inside a command.
+ */
+static int encode_script(encoder* e, const char* text, size_t size)
+{
+    arena a;
+    arena_init(&a);
+    put(e, 0);
+    uint32_t num_commands = 0;
+    int result = 0;
+    for (size_t start = 0, end; start < size && result == 0; start = end)
+    {
+        end = line_end(text, start, size);
+        node* root;
+        parse_status status;
+        while ((status = parse_line_quiet(&a, text + start, end - start, &root)) == PARSE_INCOMPLETE && end < size)
+        {
+            // An open quote or a here-document continues on the next line
+            arena_reset(&a);
+            end = line_end(text, end, size);
+        }
+        if (status == PARSE_OK)
+        {
+            encode_node(e, root);
+            num_commands++;
+        }
+        else if (status != PARSE_EMPTY)
+        {
+            result = -1;
+        }
+        arena_reset(&a);
+    }
+    arena_free(&a);
+    if (e->failed)
+    {
+        return -1;
+    }
+    e->codes[0] = num_commands;
+    return result;
+}
+
+/**
+ * @brief Builds the name of the cache file of a script from the hash of its real path.
+ *
+ * @return int 0 on success, -1 if the path cannot be resolved or is too long.
+ */
+static int cache_file_name(const char* path, const char* cache_dir, char* real, char* name)
+{
+    if (realpath(path, real) == NULL)
+    {
+        return -1;
+    }
+    int len = snprintf(name, PATH_MAX, "%s/%016llx%s", cache_dir, (unsigned long long)hash_bytes(real, strlen(real)),
+                       SCRIPT_CACHE_SUFFIX);
+    return len > 0 && len < PATH_MAX ? 0 : -1;
+}
+
+/**
+ * @brief Returns the offset of the codes in a cache file for a path of `path_len` bytes.
+ */
+static size_t payload_offset(size_t path_len)
+{
+    return sizeof(cache_header) + (path_len + PATH_ALIGN - 1) / PATH_ALIGN * PATH_ALIGN;
+}
+
+/**
+ * @brief Maps a cache file and checks that it describes the script as it is now.
+ *
+ * @param mapping Receives the mapping, to unmap once the script ran.
+ * @param mapping_len Receives its length.
+ * @param num_codes Receives the number of codes.
+ * @return const uint32_t* The codes, or NULL if there is no valid cache.
+ */
+static const uint32_t* load_cache(const char* name, const char* real, const struct stat* st, uint64_t script_hash,
+                                  void** mapping, size_t* mapping_len, size_t* num_codes)
+{
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    struct stat cache_st;
+    if (fstat(fd, &cache_st) == -1 || (size_t)cache_st.st_size < sizeof(cache_header))
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)cache_st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    const cache_header* h = map;
+    size_t path_len = strlen(real);
+    size_t offset = payload_offset(path_len);
+    const uint32_t* codes = (const uint32_t*)((const char*)map + offset);
+    int valid = memcmp(h->magic, SCRIPT_CACHE_MAGIC, sizeof(h->magic)) == 0 &&
+                h->script_size == (uint64_t)st->st_size && h->mtime_sec == st->st_mtim.tv_sec &&
+                h->mtime_nsec == st->st_mtim.tv_nsec && h->script_hash == script_hash && h->path_len == path_len &&
+                offset <= size && memcmp((const char*)map + sizeof(cache_header), real, path_len) == 0 &&
+                h->num_codes <= (size - offset) / sizeof(uint32_t) &&
+                hash_bytes((const char*)codes, h->num_codes * sizeof(uint32_t)) == h->payload_hash;
+    if (!valid)
+    {
+        munmap(map, size);
+        return NULL;
+    }
+    *mapping = map;
+    *mapping_len = size;
+    *num_codes = h->num_codes;
+    return codes;
+}
+
+/**
+ * @brief Writes all of `len` bytes.
+ *
+ * @return int 0 on success, -1 on error.
+ */
+static int write_all(int fd, const void* data, size_t len)
+{
+    const char* p = data;
+    while (len > 0)
+    {
+        ssize_t written = write(fd, p, len);
+        if (written == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return -1;
+        }
+        p += written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes a new cache file, replacing the old one at once so readers never see half of it.
+ *
+ * Failures are ignored: the script simply is not cached.
+ */
+static void write_cache(const char* cache_dir, const char* name, const char* real, const struct stat* st,
+                        uint64_t script_hash, const encoder* e)
+{
+    if (e->len > UINT32_MAX)
+    {
+        return;
+    }
+    mkdir(cache_dir, CACHE_DIR_PERMISSIONS);
+    char temporary[PATH_MAX];
+    if (snprintf(temporary, sizeof(temporary), "%s/.myshell-XXXXXX", cache_dir) >= (int)sizeof(temporary))
+    {
+        return;
+    }
+    int fd = mkstemp(temporary);
+    if (fd == -1)
+    {
+        return;
+    }
+
+    cache_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SCRIPT_CACHE_MAGIC, sizeof(h.magic));
+    h.script_size = (uint64_t)st->st_size;
+    h.mtime_sec = st->st_mtim.tv_sec;
+    h.mtime_nsec = st->st_mtim.tv_nsec;
+    h.script_hash = script_hash;
+    h.payload_hash = hash_bytes((const char*)e->codes, e->len * sizeof(uint32_t));
+    h.path_len = (uint32_t)strlen(real);
+    h.num_codes = (uint32_t)e->len;
+    static const char padding[PATH_ALIGN];
+    size_t padding_len = payload_offset(h.path_len) - sizeof(h) - h.path_len;
+
+    int failed = write_all(fd, &h, sizeof(h)) == -1 || write_all(fd, real, h.path_len) == -1 ||
+                 write_all(fd, padding, padding_len) == -1 ||
+                 write_all(fd, e->codes, e->len * sizeof(uint32_t)) == -1;
+    close(fd);
+    if (failed || rename(temporary, name) == -1)
+    {
+        unlink(temporary);
+    }
+}
+
+/**
+ * @brief Runs the commands encoded in `codes`, decoding each one just before it runs.
+ *
+ * @return int 0 on success, 1 if the codes turned out to be invalid.
+ */
+static int run_commands(const uint32_t* codes, size_t num_codes, const char* text, size_t size)
+{
+    arena a;
+    arena_init(&a);
+    decoder d = {codes, codes + num_codes, text, size, &a, 0};
+    uint32_t num_commands = get(&d);
+    for (uint32_t i = 0; i < num_commands && !d.failed; i++)
+    {
+        arena_reset(&a);
+        uint64_t decode_start = stats_now();
+        node* root = decode_node(&d);
+        stats_record_since(STAT_PARSE, decode_start);
+        if (root != NULL)
+        {
+            execute_command_tree(&a, root);
+            // Scripts get no notices, but finished jobs must not pile up
+            jobs_notify(0);
+        }
+    }
+    arena_free(&a);
+    if (d.failed)
+    {
+        fprintf(stderr, "script cache: invalid entry\n");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads a whole script into memory.
+ *
+ * The words of the AST point into this copy, which a command of the script
+ * cannot truncate under the shell as it could a mapping of the file.
+ *
+ * @return char* The text, or NULL on error.
+ */
+static char* read_script(int fd, size_t size)
+{
+    char* text = malloc(size);
+    if (text == NULL)
+    {
+        return NULL;
+    }
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t n = read(fd, text + done, size - done);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            free(text);
+            return NULL;
+        }
+        done += (size_t)n;
+    }
+    return text;
+}
+
+int script_cache_run(const char* path, const char* cache_dir)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+        (uint64_t)st.st_size > SCRIPT_CACHE_MAX_SIZE)
+    {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    uint64_t read_start = stats_now();
+    char* text = read_script(fd, size);
+    close(fd);
+    if (text == NULL)
+    {
+        return -1;
+    }
+    stats_record_since(STAT_READ, read_start);
+    uint64_t script_hash = hash_bytes(text, size);
+
+    char real[PATH_MAX];
+    char name[PATH_MAX];
+    int named = cache_file_name(path, cache_dir, real, name) == 0;
+    void* mapping = NULL;
+    size_t mapping_len = 0;
+    size_t num_codes = 0;
+    const uint32_t* codes = named ? load_cache(name, real, &st, script_hash, &mapping, &mapping_len, &num_codes) : NULL;
+
+    encoder e = {NULL, 0, 0, text, 0};
+    if (codes == NULL)
+    {
+        uint64_t parse_start = stats_now();
+        int parsed = encode_script(&e, text, size);
+        stats_record_since(STAT_PARSE, parse_start);
+        if (parsed == -1)
+        {
+            // Parsed again as it runs, which reports the error where it is
+            free(e.codes);
+            free(text);
+            return -1;
+        }
+        if (named)
+        {
+            write_cache(cache_dir, name, real, &st, script_hash, &e);
+        }
+        codes = e.codes;
+        num_codes = e.len;
+    }
+
+    int status = run_commands(codes, num_codes, text, size);
+    if (mapping != NULL)
+    {
+        munmap(mapping, mapping_len);
+    }
+    free(e.codes);
+    free(text);
+    return status;
+}
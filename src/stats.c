@@ -0,0 +1,235 @@
+#include "stats.h"
+#include "builtins.h"
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief Nanoseconds per second.
+ */
+#define NSEC_PER_SEC 1000000000ull
+
+/**
+ * @brief Names of the phases, in stat_phase order.
+ */
+static const char* const phase_names[STAT_PHASES] = {"read", "parse", "builtin", "spawn", "run", "prompt", "complete"};
+
+/**
+ * @brief A latency histogram. Every member is updated with relaxed atomics, so
+ * samples can be recorded from signal handlers and threads without locks.
+ */
+typedef struct
+{
+    _Atomic uint64_t buckets[STATS_BUCKETS]; /**< Samples per bucket. */
+    _Atomic uint64_t count;                  /**< Number of samples. */
+    _Atomic uint64_t sum;                    /**< Sum of the samples, in nanoseconds. */
+    _Atomic uint64_t max;                    /**< Largest sample, in nanoseconds. */
+} histogram;
+
+/**
+ * @brief One histogram per phase.
+ */
+static histogram histograms[STAT_PHASES];
+
+uint64_t stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Returns the bucket of a value: exact below STATS_SUB_BUCKETS, then
+ * STATS_SUB_BUCKETS buckets per power of two.
+ */
+static unsigned int bucket_of(uint64_t ns)
+{
+    if (ns < STATS_SUB_BUCKETS)
+    {
+        return (unsigned int)ns;
+    }
+    unsigned int exponent = 63u - (unsigned int)__builtin_clzll(ns);
+    unsigned int sub = (unsigned int)(ns >> (exponent - 2)) & (STATS_SUB_BUCKETS - 1);
+    return STATS_SUB_BUCKETS * (exponent - 1) + sub;
+}
+
+/**
+ * @brief Returns the largest value that falls in a bucket.
+ */
+static uint64_t bucket_upper_bound(unsigned int bucket)
+{
+    if (bucket < STATS_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    unsigned int exponent = bucket / STATS_SUB_BUCKETS + 1;
+    uint64_t sub = bucket % STATS_SUB_BUCKETS;
+    uint64_t width = 1ull << (exponent - 2);
+    return (STATS_SUB_BUCKETS + sub) * width + width - 1;
+}
+
+void stats_record(stat_phase phase, uint64_t ns)
+{
+    histogram* h = &histograms[phase];
+    atomic_fetch_add_explicit(&h->buckets[bucket_of(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, ns, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&h->max, &max, ns, memory_order_relaxed,
+                                                              memory_order_relaxed))
+    {
+    }
+}
+
+void stats_record_since(stat_phase phase, uint64_t start)
+{
+    stats_record(phase, stats_now() - start);
+}
+
+uint64_t stats_count(stat_phase phase)
+{
+    return atomic_load_explicit(&histograms[phase].count, memory_order_relaxed);
+}
+
+uint64_t stats_percentile(stat_phase phase, double percentile)
+{
+    const histogram* h = &histograms[phase];
+    uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    if (count == 0)
+    {
+        return 0;
+    }
+    // The rank of the sample, 1-based, rounded up
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)count);
+    if ((double)rank < percentile / 100.0 * (double)count || rank == 0)
+    {
+        rank++;
+    }
+    uint64_t seen = 0;
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    for (unsigned int i = 0; i < STATS_BUCKETS; i++)
+    {
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if (seen >= rank)
+        {
+            uint64_t bound = bucket_upper_bound(i);
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+
+void stats_reset(void)
+{
+    memset(histograms, 0, sizeof(histograms));
+}
+
+/**
+ * @brief Formats a duration with a unit suited to its size.
+ */
+static void format_duration(char* buffer, size_t size, uint64_t ns)
+{
+    if (ns < 1000)
+    {
+        snprintf(buffer, size, "%lluns", (unsigned long long)ns);
+    }
+    else if (ns < 1000000)
+    {
+        snprintf(buffer, size, "%.1fus", (double)ns / 1e3);
+    }
+    else if (ns < NSEC_PER_SEC)
+    {
+        snprintf(buffer, size, "%.1fms", (double)ns / 1e6);
+    }
+    else
+    {
+        snprintf(buffer, size, "%.2fs", (double)ns / 1e9);
+    }
+}
+
+void stats_print(FILE* out, int json)
+{
+    if (json)
+    {
+        fputc('{', out);
+    }
+    else
+    {
+        fprintf(out, "%-8s %10s %10s %10s %10s %10s\n", "phase", "count", "p50", "p99", "max", "mean");
+    }
+    for (int phase = 0; phase < STAT_PHASES; phase++)
+    {
+        const histogram* h = &histograms[phase];
+        uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+        uint64_t sum = atomic_load_explicit(&h->sum, memory_order_relaxed);
+        uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+        uint64_t p50 = stats_percentile(phase, 50);
+        uint64_t p99 = stats_percentile(phase, 99);
+        uint64_t mean = count > 0 ? sum / count : 0;
+        if (json)
+        {
+            fprintf(out,
+                    "%s\"%s\":{\"count\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,\"mean_ns\":%llu}",
+                    phase == 0 ? "" : ",", phase_names[phase], (unsigned long long)count, (unsigned long long)p50,
+                    (unsigned long long)p99, (unsigned long long)max, (unsigned long long)mean);
+            continue;
+        }
+        char p50_text[16];
+        char p99_text[16];
+        char max_text[16];
+        char mean_text[16];
+        format_duration(p50_text, sizeof(p50_text), p50);
+        format_duration(p99_text, sizeof(p99_text), p99);
+        format_duration(max_text, sizeof(max_text), max);
+        format_duration(mean_text, sizeof(mean_text), mean);
+        fprintf(out, "%-8s %10llu %10s %10s %10s %10s\n", phase_names[phase], (unsigned long long)count, p50_text,
+                p99_text, max_text, mean_text);
+    }
+    if (json)
+    {
+        fprintf(out, "}\n");
+    }
+}
+
+/**
+ * @brief shellstats [-j] [-r]: prints the latency of the shell's own phases, optionally as JSON or resetting them.
+ */
+static int shellstats_builtin(int argc, char** argv)
+{
+    int json = 0;
+    int reset = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0)
+        {
+            json = 1;
+        }
+        else if (strcmp(argv[i], "-r") == 0)
+        {
+            reset = 1;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: shellstats [-j] [-r]\n");
+            return 1;
+        }
+    }
+    stats_print(stdout, json);
+    if (reset)
+    {
+        stats_reset();
+    }
+    return 0;
+}
+
+/**
+ * @brief Builtins implemented in this module.
+ */
+static const builtin stats_builtins[] = {
+    {"shellstats", shellstats_builtin, 0, 2, BUILTIN_PIPELINE_SAFE, "shellstats [-j] [-r]"},
+};
+
+void stats_register_builtins(void)
+{
+    builtin_register(stats_builtins, sizeof(stats_builtins) / sizeof(stats_builtins[0]));
+}
@@ -0,0 +1,288 @@
+#define _GNU_SOURCE
+#include "substitute.h"
+#include "control.h"
+#include "executor.h"
+#include "jobs.h"
+#include "pipe.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @brief Holds the parsed commands; substitutions nest, so each one rewinds to where it started.
+ */
+static arena substitution_arena;
+
+/**
+ * @brief Non-zero once substitution_arena is initialized.
+ */
+static int arena_ready = 0;
+
+/**
+ * @brief The memfd builtins write to, created on first use and emptied after each capture; -1 before.
+ */
+static int capture_fd = -1;
+
+/**
+ * @brief Non-zero while a builtin writes to capture_fd.
+ */
+static int capturing = 0;
+
+/**
+ * @brief Returns the builtin a parsed substitution consists of, if it can run in the shell process.
+ *
+ * That is a single simple command, without prefixes or redirections,
+ * naming a builtin that may run in a pipeline and leaves the shell's state
+ * alone.
+ *
+ * @return const node* The simple command, or NULL if it must run in a forked shell.
+ */
+static const node* single_builtin(const node* root)
+{
+    if (root->type != NODE_LIST || root->list.num_items != 1 || root->list.items[0].background)
+    {
+        return NULL;
+    }
+    const node* pipeline = root->list.items[0].command;
+    if (pipeline->type != NODE_PIPELINE || pipeline->pipeline.num_stages != 1 ||
+        pipeline->pipeline.timed != TIME_NONE)
+    {
+        return NULL;
+    }
+    const node* command = pipeline->pipeline.stages[0];
+    if (command->type != NODE_SIMPLE || command->simple.num_words == 0 || command->simple.num_assignments > 0 ||
+        command->simple.num_redirections > 0)
+    {
+        return NULL;
+    }
+    return command;
+}
+
+/**
+ * @brief Looks up the builtin a command word names, if it can run in the shell with its output captured.
+ *
+ * Only a plain word is looked up: one that needs expanding could name
+ * anything, and expanding it here would run its expansions a second time
+ * in the forked shell.
+ *
+ * @return const builtin* The builtin, or NULL if the command must run in a forked shell.
+ */
+static const builtin* capturable_builtin(const word* name)
+{
+    for (size_t i = 0; i < name->len; i++)
+    {
+        if (strchr("$`\\'\"", name->start[i]) != NULL)
+        {
+            return NULL;
+        }
+    }
+    const builtin* cmd = builtin_find(name->start, name->len);
+    if (cmd == NULL || !(cmd->flags & BUILTIN_PIPELINE_SAFE) || (cmd->flags & BUILTIN_SHELL_STATE))
+    {
+        return NULL;
+    }
+    char* text = arena_strndup(&substitution_arena, name->start, name->len);
+    return control_find_function(text) == NULL ? cmd : NULL;
+}
+
+/**
+ * @brief Runs a builtin with its standard output captured in a memfd, then moves the output to `out`.
+ *
+ * @return int The builtin's exit status, or -1 if the output could not be captured.
+ */
+static int capture_builtin(const builtin* cmd, const node* command, char** argv, expand_buffer* out)
+{
+    if (capture_fd == -1)
+    {
+        capture_fd = memfd_create(SUBSTITUTE_MEMFD_NAME, MFD_CLOEXEC);
+        if (capture_fd == -1)
+        {
+            perror("memfd_create");
+            return -1;
+        }
+    }
+
+    fflush(stdout);
+    saved_fd saved = {STDOUT_FILENO, fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, SAVED_FD_MIN)};
+    if ((saved.saved == -1 && errno != EBADF) || dup2(capture_fd, STDOUT_FILENO) == -1)
+    {
+        perror("dup2");
+        if (saved.saved != -1)
+        {
+            close(saved.saved);
+        }
+        return -1;
+    }
+    capturing = 1;
+    int status = run_builtin(&substitution_arena, cmd, command, argv);
+    restore_shell_fds(&saved, 1);
+    capturing = 0;
+
+    off_t size = lseek(capture_fd, 0, SEEK_CUR);
+    if (size > 0)
+    {
+        expand_buffer_reserve(out, (size_t)size);
+        ssize_t n = pread(capture_fd, out->data + out->len, (size_t)size, 0);
+        out->len += n > 0 ? (size_t)n : 0;
+    }
+    // Emptied for the next capture: the pages go back to the system
+    if (ftruncate(capture_fd, 0) == -1 || lseek(capture_fd, 0, SEEK_SET) == -1)
+    {
+        perror("ftruncate");
+        close(capture_fd);
+        capture_fd = -1;
+    }
+    return status;
+}
+
+/**
+ * @brief Reads `fd` to its end, straight into the free space of `out`.
+ *
+ * @return int 0 on success, -1 on a read error.
+ */
+static int drain(int fd, expand_buffer* out)
+{
+    for (;;)
+    {
+        if (out->capacity - out->len < SUBSTITUTE_READ_MIN)
+        {
+            // Doubling keeps the number of reads logarithmic in the output size
+            expand_buffer_reserve(out, out->capacity > SUBSTITUTE_READ_MIN ? out->capacity : SUBSTITUTE_READ_MIN);
+        }
+        ssize_t n = read(fd, out->data + out->len, out->capacity - out->len - 1);
+        if (n == 0)
+        {
+            return 0;
+        }
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("read");
+            return -1;
+        }
+        out->len += (size_t)n;
+    }
+}
+
+/**
+ * @brief Runs a parsed substitution in a forked shell and reads its output from a pipe.
+ *
+ * @return int The exit status of the forked shell.
+ */
+static int capture_subshell(const node* root, expand_buffer* out)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1)
+    {
+        perror("pipe");
+        return 1;
+    }
+    pipe_set_size(fds[0], SUBSTITUTE_PIPE_SIZE);
+
+    launch_spec spec;
+    launch_spec_init(&spec, NULL);
+    launch_spec_add_dup2(&spec, fds[1], STDOUT_FILENO);
+
+    // SIGCHLD stays blocked so that the job table does not reap the child first
+    sigset_t old;
+    jobs_block_sigchld(&old);
+    uint64_t spawn_start = stats_now();
+    pid_t pid = fork_subshell(&substitution_arena, root, &spec, fds, 2);
+    stats_record_since(STAT_SPAWN, spawn_start);
+    close(fds[1]);
+
+    int status = 1;
+    if (pid != -1)
+    {
+        drain(fds[0], out);
+        int wstatus;
+        while (waitpid(pid, &wstatus, 0) == -1 && errno == EINTR)
+        {
+        }
+        status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : SIGNAL_STATUS_BASE + WTERMSIG(wstatus);
+    }
+    close(fds[0]);
+    jobs_restore_sigmask(&old);
+    return status;
+}
+
+/**
+ * @brief Removes the trailing newlines of the output appended after `mark`, and NUL bytes it cannot hold.
+ */
+static void trim_output(expand_buffer* out, size_t mark)
+{
+    while (out->len > mark && out->data[out->len - 1] == '\n')
+    {
+        out->len--;
+    }
+    char* start = out->data != NULL ? out->data + mark : NULL;
+    char* nul = start != NULL ? memchr(start, '\0', out->len - mark) : NULL;
+    if (nul != NULL)
+    {
+        // Words are NUL terminated: a NUL in the output would cut it short
+        char* kept = nul;
+        for (char* p = nul; p < out->data + out->len; p++)
+        {
+            if (*p != '\0')
+            {
+                *kept++ = *p;
+            }
+        }
+        out->len = (size_t)(kept - out->data);
+    }
+    if (out->data != NULL)
+    {
+        out->data[out->len] = '\0';
+    }
+}
+
+int substitute_command(const char* text, size_t len, expand_buffer* out)
+{
+    if (!arena_ready)
+    {
+        arena_init(&substitution_arena);
+        arena_ready = 1;
+    }
+    arena_mark mark = arena_get_mark(&substitution_arena);
+    size_t start = out->len;
+
+    node* root = NULL;
+    parse_status parsed = parse_line(&substitution_arena, text, len, &root);
+    int status = 0;
+    if (parsed == PARSE_INCOMPLETE)
+    {
+        fprintf(stderr, "syntax error: unexpected end of input\n");
+        status = 2;
+    }
+    else if (parsed != PARSE_OK)
+    {
+        status = 2;
+    }
+    else if (root->type != NODE_LIST || root->list.num_items > 0)
+    {
+        const node* command = single_builtin(root);
+        const builtin* cmd = command != NULL && !capturing ? capturable_builtin(&command->simple.words[0]) : NULL;
+        status = -1;
+        if (cmd != NULL)
+        {
+            char** argv = build_argv(&substitution_arena, command);
+            status = argv != NULL ? capture_builtin(cmd, command, argv, out) : 1;
+        }
+        if (status == -1)
+        {
+            status = capture_subshell(root, out);
+        }
+    }
+
+    trim_output(out, start);
+    arena_rewind(&substitution_arena, mark);
+    return status;
+}
@@ -0,0 +1,237 @@
+#include "timing.h"
+#include "executor.h"
+#include "jobs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/**
+ * @brief Nanoseconds per second.
+ */
+#define NSEC_PER_SEC 1e9
+
+/**
+ * @brief Microseconds per second.
+ */
+#define USEC_PER_SEC 1e6
+
+/**
+ * @brief Measurements of the whole pipeline or of one stage.
+ */
+typedef struct
+{
+    const char* command; /**< Source text of the stage or pipeline. */
+    size_t len;          /**< Length of `command`. */
+    pid_t pid;           /**< The stage's process, 0 if it ran in the shell or for the total. */
+    int status;          /**< Exit status. */
+    double real;         /**< Wall time in seconds. */
+    struct rusage usage; /**< Resources used. */
+} time_row;
+
+void time_mark_start(time_mark* mark)
+{
+    // Everything that is not the pipeline itself happens before the clock starts
+    mark->finished = jobs_finished_count();
+    getrusage(RUSAGE_SELF, &mark->self);
+    clock_gettime(CLOCK_MONOTONIC, &mark->start);
+}
+
+/**
+ * @brief Returns `end - start` in seconds.
+ */
+static double elapsed(const struct timespec* start, const struct timespec* end)
+{
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / NSEC_PER_SEC;
+}
+
+/**
+ * @brief Converts a timeval to seconds.
+ */
+static double seconds(const struct timeval* tv)
+{
+    return (double)tv->tv_sec + (double)tv->tv_usec / USEC_PER_SEC;
+}
+
+/**
+ * @brief Stores `after - before` in `delta` for the counters a stage can be charged with.
+ */
+static void usage_delta(const struct rusage* after, const struct rusage* before, struct rusage* delta)
+{
+    memset(delta, 0, sizeof(*delta));
+    timersub(&after->ru_utime, &before->ru_utime, &delta->ru_utime);
+    timersub(&after->ru_stime, &before->ru_stime, &delta->ru_stime);
+    // The high-water mark cannot be split; the shell's is all there is
+    delta->ru_maxrss = after->ru_maxrss;
+    delta->ru_minflt = after->ru_minflt - before->ru_minflt;
+    delta->ru_majflt = after->ru_majflt - before->ru_majflt;
+    delta->ru_nvcsw = after->ru_nvcsw - before->ru_nvcsw;
+    delta->ru_nivcsw = after->ru_nivcsw - before->ru_nivcsw;
+}
+
+/**
+ * @brief Adds a stage's usage to the pipeline's.
+ */
+static void usage_add(struct rusage* total, const struct rusage* usage)
+{
+    timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+    if (usage->ru_maxrss > total->ru_maxrss)
+    {
+        total->ru_maxrss = usage->ru_maxrss;
+    }
+    total->ru_minflt += usage->ru_minflt;
+    total->ru_majflt += usage->ru_majflt;
+    total->ru_nvcsw += usage->ru_nvcsw;
+    total->ru_nivcsw += usage->ru_nivcsw;
+}
+
+/**
+ * @brief Writes `len` bytes of `text` as a JSON string.
+ */
+static void write_json_string(FILE* out, const char* text, size_t len)
+{
+    fputc('"', out);
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\')
+        {
+            fputc('\\', out);
+            fputc(c, out);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(out, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * @brief Writes the members shared by the total and the stages of a JSON report.
+ */
+static void write_json_row(FILE* out, const time_row* row)
+{
+    fprintf(out, "\"command\":");
+    write_json_string(out, row->command, row->len);
+    fprintf(out,
+            ",\"status\":%d,\"real\":%.6f,\"user\":%.6f,\"sys\":%.6f,\"maxrss_kb\":%ld,\"minflt\":%ld,\"majflt\":%ld,"
+            "\"nvcsw\":%ld,\"nivcsw\":%ld",
+            row->status, row->real, seconds(&row->usage.ru_utime), seconds(&row->usage.ru_stime),
+            row->usage.ru_maxrss, row->usage.ru_minflt, row->usage.ru_majflt, row->usage.ru_nvcsw,
+            row->usage.ru_nivcsw);
+}
+
+/**
+ * @brief Writes one line of the text report.
+ */
+static void write_text_row(FILE* out, const time_row* row, const char* label)
+{
+    fprintf(out, "%9.3f %9.3f %9.3f %10ld %8ld %8ld %8ld %8ld %6d  %s%.*s\n", row->real,
+            seconds(&row->usage.ru_utime), seconds(&row->usage.ru_stime), row->usage.ru_maxrss,
+            row->usage.ru_minflt, row->usage.ru_majflt, row->usage.ru_nvcsw, row->usage.ru_nivcsw, row->status,
+            label, (int)row->len, row->command);
+}
+
+void time_report(FILE* out, const time_mark* mark, const node* pipeline, int status)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct rusage self;
+    getrusage(RUSAGE_SELF, &self);
+
+    // The pipeline's processes, if it started any and they all finished
+    size_t num_procs = 0;
+    const job_process* procs = NULL;
+    if (jobs_finished_count() != mark->finished)
+    {
+        procs = jobs_last_pipestatus(&num_procs);
+    }
+
+    size_t num_stages = pipeline->pipeline.num_stages;
+    time_row* rows = calloc(num_stages + 1, sizeof(time_row));
+    if (rows == NULL)
+    {
+        perror("calloc");
+        return;
+    }
+    time_row* total = &rows[num_stages];
+    int shell_charged = 0;
+    for (size_t i = 0; i < num_stages; i++)
+    {
+        time_row* row = &rows[i];
+        const char* start = NULL;
+        const char* end = NULL;
+        node_span(pipeline->pipeline.stages[i], &start, &end);
+        row->command = start;
+        row->len = start != NULL ? (size_t)(end - start) : 0;
+        if (i < num_procs)
+        {
+            row->pid = procs[i].pid;
+            row->status = procs[i].status;
+            row->real = elapsed(&mark->start, &procs[i].ended);
+            row->usage = procs[i].usage;
+        }
+        else
+        {
+            // A builtin run by the shell: charge it with what the shell used meanwhile
+            row->status = i == num_stages - 1 ? status : 0;
+            row->real = elapsed(&mark->start, &now);
+            if (!shell_charged)
+            {
+                usage_delta(&self, &mark->self, &row->usage);
+                shell_charged = 1;
+            }
+        }
+        usage_add(&total->usage, &row->usage);
+    }
+    const char* start = NULL;
+    const char* end = NULL;
+    node_span(pipeline, &start, &end);
+    total->command = start;
+    total->len = start != NULL ? (size_t)(end - start) : 0;
+    total->status = status;
+    total->real = elapsed(&mark->start, &now);
+
+    fflush(stdout);
+    if (pipeline->pipeline.timed == TIME_JSON)
+    {
+        fputc('{', out);
+        write_json_row(out, total);
+        fprintf(out, ",\"stages\":[");
+        for (size_t i = 0; i < num_stages; i++)
+        {
+            fprintf(out, i == 0 ? "{\"pid\":%d," : ",{\"pid\":%d,", (int)rows[i].pid);
+            write_json_row(out, &rows[i]);
+            fputc('}', out);
+        }
+        fprintf(out, "]}\n");
+    }
+    else
+    {
+        fprintf(out, "%9s %9s %9s %10s %8s %8s %8s %8s %6s  %s\n", "real", "user", "sys", "maxrss_kb", "minflt",
+                "majflt", "nvcsw", "nivcsw", "status", "command");
+        write_text_row(out, total, "");
+        // A single command is its own total
+        for (size_t i = 0; num_stages > 1 && i < num_stages; i++)
+        {
+            char label[32];
+            if (rows[i].pid != 0)
+            {
+                snprintf(label, sizeof(label), "  [%d] ", (int)rows[i].pid);
+            }
+            else
+            {
+                snprintf(label, sizeof(label), "  [shell] ");
+            }
+            write_text_row(out, &rows[i], label);
+        }
+    }
+    fflush(out);
+    free(rows);
+}
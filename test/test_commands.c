@@ -1,8 +1,26 @@
+#include "../include/arith.h"
+#include "../include/builtins.h"
 #include "../include/commands.h"
+#include "../include/conditional.h"
+#include "../include/executor.h"
+#include "../include/expand.h"
+#include "../include/heredoc.h"
+#include "../include/history.h"
+#include "../include/path_cache.h"
+#include "../include/pipe.h"
+#include "../include/policy.h"
+#include "../include/prompt.h"
+#include "../include/script.h"
+#include "../include/script_cache.h"
+#include "../include/stats.h"
+#include "../include/utils.h"
 #include "unity.h"
+#include <fcntl.h>
 #include <linux/limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdlib.h>
 
@@ -115,10 +133,907 @@ void test_echo(void)
     fclose(fp);
 }
 
+void test_builtin_lookup(void)
+{
+    const char* line = "cd /tmp";
+    const builtin* cmd = builtin_find(line, strcspn(line, " "));
+    TEST_ASSERT_NOT_NULL(cmd);
+    TEST_ASSERT_EQUAL_STRING("cd", cmd->name);
+
+    // Only whole words match
+    TEST_ASSERT_NULL(builtin_find("cdx", 3));
+    TEST_ASSERT_NULL(builtin_find("c", 1));
+    TEST_ASSERT_NULL(builtin_find("ls", 2));
+
+    // Modules register their own commands
+    TEST_ASSERT_NOT_NULL(builtin_find("status_monitor", strlen("status_monitor")));
+    TEST_ASSERT_NOT_NULL(builtin_find("list_config", strlen("list_config")));
+
+    for (size_t i = 0; i < builtin_count(); i++)
+    {
+        const builtin* entry = builtin_get(i);
+        TEST_ASSERT_EQUAL_PTR(entry, builtin_find(entry->name, strlen(entry->name)));
+    }
+}
+
+void test_pipeline_builtins(void)
+{
+    const char* out = "/tmp/myshell_test_pipeline.txt";
+    setenv("PIPE_TEST_VAR", "expanded", 1);
+
+    // A builtin stage runs in a forked shell, so echo still expands variables
+    execute_command("echo $PIPE_TEST_VAR | cat > /tmp/myshell_test_pipeline.txt");
+    FILE* fp = fopen(out, "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(fp, "Failed to open pipeline output");
+    char output[50] = "";
+    TEST_ASSERT_NOT_NULL(fgets(output, sizeof(output), fp));
+    fclose(fp);
+    remove(out);
+    TEST_ASSERT_EQUAL_STRING("expanded\n", output);
+
+    // The last stage runs in the shell itself, so its effects are visible here
+    TEST_ASSERT_NOT_NULL(path_cache_resolve("sh"));
+    execute_command("echo ignored | hash -r");
+    TEST_ASSERT_NULL(path_cache_peek("sh"));
+
+    // Its status is the last one of PIPESTATUS
+    execute_command("sh -c 'exit 1' | echo x > /dev/null");
+    TEST_ASSERT_EQUAL_STRING("1 0", getenv("PIPESTATUS"));
+    execute_command("true | sh -c 'exit 2' | test a = b");
+    TEST_ASSERT_EQUAL_STRING("0 2 1", getenv("PIPESTATUS"));
+}
+
+void test_pipe_size(void)
+{
+    TEST_ASSERT_EQUAL_INT(65536, pipe_size_parse("65536"));
+    TEST_ASSERT_EQUAL_INT(256 * 1024, pipe_size_parse("256K"));
+    TEST_ASSERT_EQUAL_INT(1024 * 1024, pipe_size_parse("1m"));
+    TEST_ASSERT_EQUAL_INT(-1, pipe_size_parse("0"));
+    TEST_ASSERT_EQUAL_INT(-1, pipe_size_parse("12Q"));
+    TEST_ASSERT_EQUAL_INT(-1, pipe_size_parse(""));
+
+    int fds[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+    // Requests above the system limit are clamped rather than refused
+    long max_size = pipe_max_size();
+    long size = pipe_set_size(fds[0], max_size > 0 ? max_size * 4 : 1024 * 1024);
+    TEST_ASSERT_GREATER_OR_EQUAL(PIPE_DEFAULT_SIZE, size);
+    if (max_size > 0)
+    {
+        TEST_ASSERT_LESS_OR_EQUAL(max_size, size);
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    // Pipelines still work with the variable set
+    const char* out = "/tmp/myshell_test_pipe_size.txt";
+    setenv(PIPE_SIZE_ENV, "256K", 1);
+    execute_command("echo sized | cat > /tmp/myshell_test_pipe_size.txt");
+    unsetenv(PIPE_SIZE_ENV);
+    FILE* fp = fopen(out, "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(fp, "Failed to open pipeline output");
+    char output[50] = "";
+    TEST_ASSERT_NOT_NULL(fgets(output, sizeof(output), fp));
+    fclose(fp);
+    remove(out);
+    TEST_ASSERT_EQUAL_STRING("sized\n", output);
+}
+
+void test_builtin_redirection_in_shell(void)
+{
+    const char* out = "/tmp/myshell_test_redirect.txt";
+    struct stat before;
+    struct stat after;
+    TEST_ASSERT_EQUAL_INT(0, fstat(STDOUT_FILENO, &before));
+
+    // The builtin's output goes to the file, and the shell's stdout is put back
+    execute_command("echo in shell > /tmp/myshell_test_redirect.txt");
+    TEST_ASSERT_EQUAL_INT(0, fstat(STDOUT_FILENO, &after));
+    TEST_ASSERT_TRUE(before.st_dev == after.st_dev && before.st_ino == after.st_ino);
+
+    FILE* fp = fopen(out, "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(fp, "Failed to open redirected output");
+    char output[50] = "";
+    TEST_ASSERT_NOT_NULL(fgets(output, sizeof(output), fp));
+    fclose(fp);
+    TEST_ASSERT_EQUAL_STRING("in shell\n", output);
+
+    // A missing input file undoes the output redirection applied before it
+    execute_command("echo lost > /tmp/myshell_test_redirect.txt < /nonexistent/input");
+    TEST_ASSERT_EQUAL_INT(0, fstat(STDOUT_FILENO, &after));
+    TEST_ASSERT_TRUE(before.st_dev == after.st_dev && before.st_ino == after.st_ino);
+    TEST_ASSERT_EQUAL_INT(-1, fcntl(SAVED_FD_MIN, F_GETFD));
+    remove(out);
+}
+
+/**
+ * @brief Number of lines in the generated script, above the old batch mode limit of 100.
+ */
+#define SCRIPT_LINES 150
+
+/**
+ * @brief Length of the argument of the long line, larger than the script read buffer.
+ */
+#define SCRIPT_LONG_WORD (SCRIPT_BUFFER_SIZE + 1000)
+
+/**
+ * @brief Counts the lines of a file, or returns -1 if it cannot be opened.
+ */
+static long count_lines(const char* path, long* bytes)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    long lines = 0;
+    int c;
+    *bytes = 0;
+    while ((c = fgetc(fp)) != EOF)
+    {
+        lines += c == '\n';
+        (*bytes)++;
+    }
+    fclose(fp);
+    return lines;
+}
+
+void test_run_script(void)
+{
+    const char* script = "/tmp/myshell_test_script.sh";
+    const char* lines_out = "/tmp/myshell_test_script_lines.txt";
+    const char* long_out = "/tmp/myshell_test_script_long.txt";
+    remove(lines_out);
+
+    FILE* fp = fopen(script, "w");
+    TEST_ASSERT_NOT_NULL_MESSAGE(fp, "Failed to create script");
+    for (int i = 0; i < SCRIPT_LINES; i++)
+    {
+        fprintf(fp, "echo line %d >> %s\n", i, lines_out);
+    }
+    // A quoted argument spanning two lines
+    fprintf(fp, "echo 'first\nsecond' >> %s\n", lines_out);
+    fprintf(fp, "echo ");
+    for (int i = 0; i < SCRIPT_LONG_WORD; i++)
+    {
+        fputc('a', fp);
+    }
+    // The last line has no trailing newline
+    fprintf(fp, " > %s", long_out);
+    fclose(fp);
+
+    TEST_ASSERT_EQUAL_INT(0, run_script(script));
+
+    long bytes;
+    TEST_ASSERT_EQUAL_INT(SCRIPT_LINES + 2, count_lines(lines_out, &bytes));
+    TEST_ASSERT_EQUAL_INT(1, count_lines(long_out, &bytes));
+    TEST_ASSERT_EQUAL_INT(SCRIPT_LONG_WORD + 1, bytes);
+
+    remove(script);
+    remove(lines_out);
+    remove(long_out);
+}
+
+/**
+ * @brief Counts the cache files in `dir`.
+ */
+static int count_cache_files(const char* dir)
+{
+    char command[PATH_MAX];
+    snprintf(command, sizeof(command), "ls %s/*%s 2>/dev/null | wc -l", dir, SCRIPT_CACHE_SUFFIX);
+    FILE* p = popen(command, "r");
+    int count = -1;
+    if (p != NULL && fscanf(p, "%d", &count) != 1)
+    {
+        count = -1;
+    }
+    if (p != NULL)
+    {
+        pclose(p);
+    }
+    return count;
+}
+
+void test_script_cache(void)
+{
+    const char* dir = "/tmp/myshell_test_script_cache";
+    const char* script = "/tmp/myshell_test_cached.sh";
+    const char* out = "/tmp/myshell_test_cached.txt";
+    char command[PATH_MAX];
+    snprintf(command, sizeof(command), "rm -rf %s", dir);
+    TEST_ASSERT_EQUAL_INT(0, system(command));
+    setenv(SCRIPT_CACHE_ENV, dir, 1);
+
+    FILE* fp = fopen(script, "w");
+    TEST_ASSERT_NOT_NULL(fp);
+    fprintf(fp, "# cached\necho 'a\nb' > %s && false || echo $? >> %s\ncat <<EOF >> %s\nbody\nEOF\n", out, out, out);
+    fclose(fp);
+
+    // The first run parses and caches the script, the second runs it from the cache
+    const char* expected = "a\nb\n1\nbody\n";
+    char text[64];
+    for (int run = 0; run < 2; run++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, run_script(script));
+        TEST_ASSERT_EQUAL_INT(1, count_cache_files(dir));
+        fp = fopen(out, "r");
+        TEST_ASSERT_NOT_NULL(fp);
+        size_t n = fread(text, 1, sizeof(text) - 1, fp);
+        fclose(fp);
+        text[n] = '\0';
+        TEST_ASSERT_EQUAL_STRING(expected, text);
+    }
+
+    // A corrupt cache is replaced silently
+    snprintf(command, sizeof(command),
+             "for f in %s/*%s; do printf XXXX | dd of=$f bs=1 seek=100 conv=notrunc 2>/dev/null; done", dir,
+             SCRIPT_CACHE_SUFFIX);
+    TEST_ASSERT_EQUAL_INT(0, system(command));
+    TEST_ASSERT_EQUAL_INT(0, run_script(script));
+    fp = fopen(out, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    size_t n = fread(text, 1, sizeof(text) - 1, fp);
+    fclose(fp);
+    text[n] = '\0';
+    TEST_ASSERT_EQUAL_STRING(expected, text);
+
+    // An edited script is parsed again, even with the same size
+    fp = fopen(script, "w");
+    TEST_ASSERT_NOT_NULL(fp);
+    fprintf(fp, "# CACHED\necho 'c\nd' > %s && false || echo $? >> %s\ncat <<EOF >> %s\nbody\nEOF\n", out, out, out);
+    fclose(fp);
+    TEST_ASSERT_EQUAL_INT(0, run_script(script));
+    fp = fopen(out, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    TEST_ASSERT_NOT_NULL(fgets(text, sizeof(text), fp));
+    fclose(fp);
+    TEST_ASSERT_EQUAL_STRING("c\n", text);
+
+    unsetenv(SCRIPT_CACHE_ENV);
+    snprintf(command, sizeof(command), "rm -rf %s", dir);
+    TEST_ASSERT_EQUAL_INT(0, system(command));
+    remove(script);
+    remove(out);
+}
+
+void test_time_report(void)
+{
+    const char* report = "/tmp/myshell_test_time.txt";
+    fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    int fd = open(report, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_ASSERT_NOT_EQUAL(-1, fd);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+    execute_command("time -j sh -c 'exit 3' | sh -c 'exit 4'");
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+
+    FILE* fp = fopen(report, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    char line[2048] = "";
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), fp));
+    fclose(fp);
+    remove(report);
+
+    // One JSON object for the pipeline, with a nested one per stage
+    TEST_ASSERT_EQUAL_INT('{', line[0]);
+    TEST_ASSERT_NOT_NULL(strstr(line, "\"command\":\"sh -c 'exit 3' | sh -c 'exit 4'\",\"status\":4,"));
+    TEST_ASSERT_NOT_NULL(strstr(line, "\"command\":\"sh -c 'exit 3'\",\"status\":3,"));
+    TEST_ASSERT_NOT_NULL(strstr(line, "\"maxrss_kb\":"));
+    TEST_ASSERT_NOT_NULL(strstr(line, "\"nivcsw\":"));
+    size_t stages = 0;
+    for (const char* p = strstr(line, "\"pid\":"); p != NULL; p = strstr(p + 1, "\"pid\":"))
+    {
+        stages++;
+    }
+    TEST_ASSERT_EQUAL_size_t(2, stages);
+}
+
+void test_shellstats(void)
+{
+    stats_reset();
+    for (uint64_t ns = 1; ns <= 1000; ns++)
+    {
+        stats_record(STAT_BUILTIN, ns * 1000);
+    }
+    TEST_ASSERT_TRUE(stats_count(STAT_BUILTIN) == 1000);
+    // A bucket spans a quarter of its power of two
+    uint64_t p50 = stats_percentile(STAT_BUILTIN, 50);
+    uint64_t p99 = stats_percentile(STAT_BUILTIN, 99);
+    TEST_ASSERT_TRUE(p50 >= 500000 && p50 <= 500000 * 5 / 4);
+    TEST_ASSERT_TRUE(p99 >= 990000 && p99 <= 1000000);
+    TEST_ASSERT_TRUE(stats_percentile(STAT_BUILTIN, 100) == 1000000);
+    TEST_ASSERT_TRUE(stats_percentile(STAT_PROMPT, 50) == 0);
+
+    // Running a command line times its parse and its spawn
+    execute_command("sh -c true");
+    TEST_ASSERT_TRUE(stats_count(STAT_PARSE) == 1);
+    TEST_ASSERT_TRUE(stats_count(STAT_SPAWN) == 1);
+    TEST_ASSERT_TRUE(stats_count(STAT_RUN) == 1);
+
+    const char* output = "/tmp/myshell_test_shellstats.txt";
+    execute_command("shellstats -j -r > /tmp/myshell_test_shellstats.txt");
+    FILE* fp = fopen(output, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    char line[2048] = "";
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), fp));
+    fclose(fp);
+    remove(output);
+    TEST_ASSERT_NOT_NULL(strstr(line, "\"builtin\":{\"count\":1000,\"p50_ns\":"));
+    TEST_ASSERT_NOT_NULL(strstr(line, "\"max_ns\":1000000,\"mean_ns\":500500}"));
+    TEST_ASSERT_NOT_NULL(strstr(line, "\"prompt\":{\"count\":0,"));
+    // -r cleared everything once printed, then the shellstats builtin itself was timed
+    TEST_ASSERT_TRUE(stats_count(STAT_PARSE) == 0);
+}
+
+void test_prompt_segments(void)
+{
+    char cwd[PATH_MAX];
+    TEST_ASSERT_NOT_NULL(getcwd(cwd, sizeof(cwd)));
+    char expected[PATH_MAX + 128];
+    char prompt[PATH_MAX + 256];
+
+    TEST_ASSERT_EQUAL_INT(0, prompt_init(NULL, "user", "host"));
+    prompt_format(prompt, sizeof(prompt));
+    snprintf(expected, sizeof(expected), COLOR_USER "user" COLOR_RESET "@" COLOR_HOST "host" COLOR_RESET
+             ":" COLOR_DIR "%s" COLOR_RESET "$ ", cwd);
+    TEST_ASSERT_EQUAL_STRING(expected, prompt);
+
+    // The directory is cached until cd says it changed
+    execute_command("cd /tmp");
+    prompt_format(prompt, sizeof(prompt));
+    TEST_ASSERT_NOT_NULL(strstr(prompt, COLOR_DIR "/tmp" COLOR_RESET));
+    TEST_ASSERT_EQUAL_INT(0, chdir(cwd));
+    prompt_format(prompt, sizeof(prompt));
+    TEST_ASSERT_NOT_NULL(strstr(prompt, COLOR_DIR "/tmp" COLOR_RESET));
+    prompt_invalidate(PROMPT_EVENT_CWD);
+
+    // Hidden segments leave no separator behind; the background ones arrive within the deadline
+    TEST_ASSERT_EQUAL_INT(0, prompt_init("status,jobs,load", "user", "host"));
+    execute_command("sh -c 'exit 7'");
+    prompt_format(prompt, sizeof(prompt));
+    TEST_ASSERT_EQUAL_STRING_LEN(COLOR_STATUS "[7]" COLOR_RESET " ", prompt, strlen(COLOR_STATUS "[7]" COLOR_RESET " "));
+    TEST_ASSERT_TRUE(prompt[strlen(COLOR_STATUS "[7]" COLOR_RESET " ")] >= '0');
+    execute_command("true");
+    prompt_format(prompt, sizeof(prompt));
+    TEST_ASSERT_NULL(strstr(prompt, COLOR_STATUS));
+
+    TEST_ASSERT_EQUAL_INT(-1, prompt_init("user,nonsense", "user", "host"));
+    prompt_shutdown();
+}
+
+void test_history(void)
+{
+    const char* path = "/tmp/myshell_test_history";
+    remove(path);
+    TEST_ASSERT_EQUAL_INT(0, history_open(path));
+    TEST_ASSERT_EQUAL_INT(0, history_add("make all", 8, 0, 1500, 100));
+    TEST_ASSERT_EQUAL_INT(0, history_add("grep -r needle src", 18, 1, 20, 101));
+    TEST_ASSERT_EQUAL_INT(0, history_add("sleep 2", 7, 0, 2000, 102));
+    history_close();
+
+    // Entries come back from the mapped file with their status and duration
+    TEST_ASSERT_EQUAL_INT(0, history_open(path));
+    TEST_ASSERT_TRUE(history_count() == 3);
+    const history_entry* entry = history_get(1);
+    TEST_ASSERT_EQUAL_STRING_LEN("grep -r needle src", entry->text, entry->len);
+    TEST_ASSERT_EQUAL_INT(1, entry->status);
+    TEST_ASSERT_TRUE(entry->duration_ms == 20 && entry->started == 101);
+    TEST_ASSERT_NULL(history_get(3));
+
+    // Indexed and short queries find the newest match before a given entry
+    TEST_ASSERT_EQUAL_INT(1, history_search("needle", 6, history_count()));
+    TEST_ASSERT_EQUAL_INT(2, history_search("e", 1, history_count()));
+    TEST_ASSERT_EQUAL_INT(0, history_search("e", 1, 1));
+    TEST_ASSERT_EQUAL_INT(-1, history_search("needle", 6, 1));
+    TEST_ASSERT_EQUAL_INT(-1, history_search("missing", 7, history_count()));
+    // Entries added after the index was built are indexed too
+    TEST_ASSERT_EQUAL_INT(0, history_add("vim needle.c", 12, 0, 0, 103));
+    TEST_ASSERT_EQUAL_INT(3, history_search("needle", 6, history_count()));
+    history_close();
+
+    // A torn record at the end is cut off and the next one follows the last good one
+    int fd = open(path, O_WRONLY | O_APPEND);
+    TEST_ASSERT_TRUE(fd != -1);
+    TEST_ASSERT_TRUE(write(fd, "torn", 4) == 4);
+    close(fd);
+    TEST_ASSERT_EQUAL_INT(0, history_open(path));
+    TEST_ASSERT_TRUE(history_count() == 4);
+    TEST_ASSERT_EQUAL_INT(0, history_add("ls", 2, 0, 0, 104));
+    history_close();
+    TEST_ASSERT_EQUAL_INT(0, history_open(path));
+    TEST_ASSERT_TRUE(history_count() == 5);
+
+    // history -s keeps the slow commands
+    const char* output = "/tmp/myshell_test_history.txt";
+    execute_command("history -s 1000 > /tmp/myshell_test_history.txt");
+    FILE* fp = fopen(output, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    char line[256];
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), fp));
+    TEST_ASSERT_EQUAL_STRING("     1    0     1.500s  make all\n", line);
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), fp));
+    TEST_ASSERT_EQUAL_STRING("     3    0     2.000s  sleep 2\n", line);
+    TEST_ASSERT_NULL(fgets(line, sizeof(line), fp));
+    fclose(fp);
+    remove(output);
+    history_close();
+    remove(path);
+}
+
+void test_heredoc(void)
+{
+    const char* script = "/tmp/myshell_test_heredoc.sh";
+    const char* small_out = "/tmp/myshell_test_heredoc_small.txt";
+    const char* large_out = "/tmp/myshell_test_heredoc_large.txt";
+    const char* string_out = "/tmp/myshell_test_heredoc_string.txt";
+    setenv("MYSHELL_TEST_NAME", "world", 1);
+
+    FILE* fp = fopen(script, "w");
+    TEST_ASSERT_NOT_NULL(fp);
+    fprintf(fp, "cat <<EOF > %s\nhello $MYSHELL_TEST_NAME ${MYSHELL_TEST_NAME}!\n\\$HOME $ \\x\nEOF\n", small_out);
+    fprintf(fp, "cat <<-'EOF' >> %s\n\t$MYSHELL_TEST_NAME\n\tEOF\n", small_out);
+    // Larger than a pipe holds before its reader starts: goes through a memfd
+    fprintf(fp, "wc -c <<EOF > %s\n", large_out);
+    for (int i = 0; i < HEREDOC_PIPE_MAX / 8; i++)
+    {
+        fprintf(fp, "%07d\n", i);
+    }
+    fprintf(fp, "EOF\n");
+    fprintf(fp, "tr a-z A-Z <<< 'here string' > %s\n", string_out);
+    fclose(fp);
+
+    TEST_ASSERT_EQUAL_INT(0, run_script(script));
+
+    char text[256] = "";
+    fp = fopen(small_out, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    size_t n = fread(text, 1, sizeof(text) - 1, fp);
+    fclose(fp);
+    text[n] = '\0';
+    TEST_ASSERT_EQUAL_STRING("hello world world!\n$HOME $ \\x\n$MYSHELL_TEST_NAME\n", text);
+
+    fp = fopen(large_out, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    TEST_ASSERT_NOT_NULL(fgets(text, sizeof(text), fp));
+    fclose(fp);
+    TEST_ASSERT_EQUAL_INT(HEREDOC_PIPE_MAX, atoi(text));
+
+    fp = fopen(string_out, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    TEST_ASSERT_NOT_NULL(fgets(text, sizeof(text), fp));
+    fclose(fp);
+    TEST_ASSERT_EQUAL_STRING("HERE STRING\n", text);
+
+    remove(script);
+    remove(small_out);
+    remove(large_out);
+    remove(string_out);
+    unsetenv("MYSHELL_TEST_NAME");
+}
+
+/**
+ * @brief Expands `text` as a word and returns the result, valid until the next call.
+ */
+static const char* expanded(const char* text)
+{
+    static expand_buffer out;
+    out.len = 0;
+    expand_word(&out, text, strlen(text));
+    return out.data;
+}
+
+void test_expand(void)
+{
+    setenv("MYSHELL_TEST_EXPORTED", "env", 1);
+    execute_command("local MYSHELL_TEST_LOCAL='a b'");
+    TEST_ASSERT_EQUAL_STRING("a b", expanded("$MYSHELL_TEST_LOCAL"));
+    TEST_ASSERT_EQUAL_STRING("[a b]env", expanded("[${MYSHELL_TEST_LOCAL}]$MYSHELL_TEST_EXPORTED"));
+    TEST_ASSERT_EQUAL_STRING("$MYSHELL_TEST_LOCAL a b", expanded("'$MYSHELL_TEST_LOCAL' \"$MYSHELL_TEST_LOCAL\""));
+    TEST_ASSERT_EQUAL_STRING("x y", expanded("${MYSHELL_TEST_UNSET:-\"x y\"}"));
+    TEST_ASSERT_EQUAL_STRING("env", expanded("${MYSHELL_TEST_EXPORTED:-x}"));
+    TEST_ASSERT_EQUAL_STRING("$ ${", expanded("$ \\${"));
+    TEST_ASSERT_NULL(getenv("MYSHELL_TEST_LOCAL"));
+
+    // An assignment keeps a local variable local
+    execute_command("MYSHELL_TEST_LOCAL=changed");
+    TEST_ASSERT_EQUAL_STRING("changed", expanded("$MYSHELL_TEST_LOCAL"));
+    TEST_ASSERT_NULL(getenv("MYSHELL_TEST_LOCAL"));
+
+    execute_command("false; MYSHELL_TEST_STATUS=$?");
+    TEST_ASSERT_EQUAL_STRING("1", getenv("MYSHELL_TEST_STATUS"));
+    char pid[32];
+    snprintf(pid, sizeof(pid), "%ld", (long)getpid());
+    TEST_ASSERT_EQUAL_STRING(pid, expanded("$$"));
+
+    execute_command("export MYSHELL_TEST_LOCAL");
+    TEST_ASSERT_EQUAL_STRING("changed", getenv("MYSHELL_TEST_LOCAL"));
+    execute_command("unset MYSHELL_TEST_LOCAL MYSHELL_TEST_EXPORTED MYSHELL_TEST_STATUS");
+    TEST_ASSERT_NULL(getenv("MYSHELL_TEST_LOCAL"));
+    TEST_ASSERT_EQUAL_STRING("", expanded("$MYSHELL_TEST_EXPORTED"));
+}
+
+void test_control_flow(void)
+{
+    // Loops and conditionals made of builtins run in the shell: nothing is spawned and the variables persist
+    uint64_t spawns = stats_count(STAT_SPAWN);
+    execute_command("MYSHELL_TEST_LOOP=; for i in 1 2 3; do MYSHELL_TEST_LOOP=$MYSHELL_TEST_LOOP$i; done");
+    TEST_ASSERT_EQUAL_STRING("123", getenv("MYSHELL_TEST_LOOP"));
+    execute_command("while true; do if true; then MYSHELL_TEST_LOOP=broken; break; fi; done");
+    TEST_ASSERT_EQUAL_STRING("broken", getenv("MYSHELL_TEST_LOOP"));
+    execute_command("for w in a b c; do\n case $w in\n a|c) continue;;\n *) MYSHELL_TEST_LOOP=$w;;\n esac\ndone");
+    TEST_ASSERT_EQUAL_STRING("b", getenv("MYSHELL_TEST_LOOP"));
+    // Quoted pattern characters match literally, unquoted ones and unquoted expansions glob
+    execute_command("MYSHELL_TEST_GLOB='a*'; MYSHELL_TEST_LOOP=\n"
+                    "for w in ab 'a*' 'a?'; do\n case $w in\n"
+                    " \"a*\") MYSHELL_TEST_LOOP=$MYSHELL_TEST_LOOP[q];;\n"
+                    " 'a?') MYSHELL_TEST_LOOP=$MYSHELL_TEST_LOOP[s];;\n"
+                    " $MYSHELL_TEST_GLOB) MYSHELL_TEST_LOOP=$MYSHELL_TEST_LOOP[g];;\n esac\ndone");
+    TEST_ASSERT_EQUAL_STRING("[g][q][s]", getenv("MYSHELL_TEST_LOOP"));
+    execute_command("case 'a\\b*' in a\\\\b\\*) MYSHELL_TEST_LOOP=escaped;; *) MYSHELL_TEST_LOOP=other;; esac");
+    TEST_ASSERT_EQUAL_STRING("escaped", getenv("MYSHELL_TEST_LOOP"));
+    execute_command("case ab in \"a\"* | \"$MYSHELL_TEST_GLOB\") MYSHELL_TEST_LOOP=mixed;; esac\n"
+                    "unset MYSHELL_TEST_GLOB");
+    TEST_ASSERT_EQUAL_STRING("mixed", getenv("MYSHELL_TEST_LOOP"));
+    execute_command("if false; then X=1; elif false; then X=2; else MYSHELL_TEST_LOOP=else; fi");
+    TEST_ASSERT_EQUAL_STRING("else", getenv("MYSHELL_TEST_LOOP"));
+    execute_command("until false; do MYSHELL_TEST_LOOP=until; break; done");
+    TEST_ASSERT_EQUAL_STRING("until", getenv("MYSHELL_TEST_LOOP"));
+    TEST_ASSERT_TRUE(spawns == stats_count(STAT_SPAWN));
+
+    // Unquoted expansions are split into fields, quoted ones are not
+    execute_command("MYSHELL_TEST_WORDS='x  y'; MYSHELL_TEST_LOOP=");
+    execute_command("for w in $MYSHELL_TEST_WORDS \"\" \"$MYSHELL_TEST_WORDS\"; do\n"
+                    " MYSHELL_TEST_LOOP=$MYSHELL_TEST_LOOP[$w]\ndone");
+    TEST_ASSERT_EQUAL_STRING("[x][y][][x  y]", getenv("MYSHELL_TEST_LOOP"));
+
+    // Functions get positional parameters and local variables, and return a status
+    execute_command("MYSHELL_TEST_V=outer; myshell_test_f() {\n local MYSHELL_TEST_V=\"$1|$2\"\n"
+                    " MYSHELL_TEST_LOOP=\"$# $MYSHELL_TEST_V\"\n return 4\n MYSHELL_TEST_LOOP=unreached\n}");
+    execute_command("myshell_test_f 'a b' c; MYSHELL_TEST_STATUS=$?");
+    TEST_ASSERT_EQUAL_STRING("2 a b|c", getenv("MYSHELL_TEST_LOOP"));
+    TEST_ASSERT_EQUAL_STRING("4", getenv("MYSHELL_TEST_STATUS"));
+    TEST_ASSERT_EQUAL_STRING("outer", getenv("MYSHELL_TEST_V"));
+
+    // Redirections of a compound command apply to its whole body; functions work as pipeline stages
+    const char* out = "/tmp/myshell_test_control.txt";
+    execute_command("for i in 1 2; do echo $i; done > /tmp/myshell_test_control.txt");
+    execute_command("myshell_test_g() { echo piped; }; myshell_test_g | cat >> /tmp/myshell_test_control.txt");
+    FILE* fp = fopen(out, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    char output[64] = "";
+    size_t n = fread(output, 1, sizeof(output) - 1, fp);
+    output[n] = '\0';
+    fclose(fp);
+    remove(out);
+    TEST_ASSERT_EQUAL_STRING("1\n2\npiped\n", output);
+
+    execute_command("unset MYSHELL_TEST_LOOP MYSHELL_TEST_WORDS MYSHELL_TEST_V MYSHELL_TEST_STATUS");
+}
+
+/**
+ * @brief Evaluates `text` as an arithmetic expression, failing the test on an error.
+ */
+static int64_t arithmetic(const char* text)
+{
+    int64_t value = 0;
+    TEST_ASSERT_EQUAL_INT(0, arith_evaluate(text, strlen(text), &value));
+    return value;
+}
+
+void test_arithmetic(void)
+{
+    TEST_ASSERT_TRUE(arithmetic("1 + 2 * 3 - 4 / 2") == 5);
+    TEST_ASSERT_TRUE(arithmetic("(1 + 2) * 3 % 4") == 1);
+    TEST_ASSERT_TRUE(arithmetic("2 ** 3 ** 2") == 512);
+    TEST_ASSERT_TRUE(arithmetic("-2 + ~0 + !0 + !5") == -2);
+    TEST_ASSERT_TRUE(arithmetic("0x10 | 010 ^ 1 << 2") == 28);
+    TEST_ASSERT_TRUE(arithmetic("3 > 2 && 2 >= 2 && 1 != 2 && !(1 == 2)") == 1);
+    TEST_ASSERT_TRUE(arithmetic("0 ? 1 : 2 ? 3 : 4") == 3);
+    TEST_ASSERT_TRUE(arithmetic("9223372036854775807 + 1") == INT64_MIN);
+    TEST_ASSERT_TRUE(arithmetic("-9223372036854775807 - 1 == (-9223372036854775807 - 1) / -1") == 1);
+    TEST_ASSERT_TRUE(arithmetic("") == 0);
+
+    // Variables hold expressions; assignments go to the shell, skipped operands assign nothing
+    execute_command("MYSHELL_TEST_A=6; MYSHELL_TEST_B='MYSHELL_TEST_A + 1'");
+    TEST_ASSERT_TRUE(arithmetic("MYSHELL_TEST_B * 2 + MYSHELL_TEST_UNSET") == 14);
+    TEST_ASSERT_TRUE(arithmetic("MYSHELL_TEST_A += 4, MYSHELL_TEST_A++, MYSHELL_TEST_A") == 11);
+    TEST_ASSERT_TRUE(arithmetic("1 || (MYSHELL_TEST_A = 0), 0 && MYSHELL_TEST_A++, 1 || 1 / 0") == 1);
+    TEST_ASSERT_EQUAL_STRING("11", getenv("MYSHELL_TEST_A"));
+
+    int64_t value;
+    TEST_ASSERT_EQUAL_INT(-1, arith_evaluate("1 / 0", 5, &value));
+    TEST_ASSERT_EQUAL_INT(-1, arith_evaluate("1 +", 3, &value));
+    TEST_ASSERT_EQUAL_INT(-1, arith_evaluate("(1", 2, &value));
+    TEST_ASSERT_EQUAL_INT(-1, arith_evaluate("09", 2, &value));
+
+    // $(( )) expands like a parameter, nested and inside quotes
+    TEST_ASSERT_EQUAL_STRING("x14y", expanded("x$(( $((MYSHELL_TEST_A + 1)) + 2 ))y"));
+    TEST_ASSERT_EQUAL_STRING("22 2", expanded("\"$(( MYSHELL_TEST_A * 2 )) $(( (1) + (1) ))\""));
+    execute_command("MYSHELL_TEST_A=0\nwhile [ $MYSHELL_TEST_A -lt 5 ]; do\n"
+                    " MYSHELL_TEST_A=$((MYSHELL_TEST_A + 1))\ndone");
+    TEST_ASSERT_EQUAL_STRING("5", getenv("MYSHELL_TEST_A"));
+
+    // A failed expansion fails its command without running it
+    execute_command("MYSHELL_TEST_B=$(echo $((1/0)) ran); MYSHELL_TEST_A=$?");
+    TEST_ASSERT_EQUAL_STRING("", getenv("MYSHELL_TEST_B"));
+    TEST_ASSERT_EQUAL_STRING("1", getenv("MYSHELL_TEST_A"));
+    execute_command("MYSHELL_TEST_B=$(sh -c 'echo ran' $((1/0)) | cat; echo $? next)");
+    TEST_ASSERT_EQUAL_STRING("1 next", getenv("MYSHELL_TEST_B"));
+    execute_command("MYSHELL_TEST_A=$((1/0)) MYSHELL_TEST_B=set; MYSHELL_TEST_A=$?$MYSHELL_TEST_B");
+    TEST_ASSERT_EQUAL_STRING("11 next", getenv("MYSHELL_TEST_A"));
+    execute_command("unset MYSHELL_TEST_A MYSHELL_TEST_B");
+}
+
+/**
+ * @brief Runs `test` on the words of `text`, split at spaces.
+ */
+static int test_words(const char* text, int extended)
+{
+    char copy[256];
+    char* words[32];
+    int count = 0;
+    snprintf(copy, sizeof(copy), "%s", text);
+    for (char* w = strtok(copy, " "); w != NULL; w = strtok(NULL, " "))
+    {
+        words[count++] = w;
+    }
+    return conditional_evaluate("test", count, words, extended);
+}
+
+void test_conditional(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, test_words("-f /etc/passwd", 0));
+    TEST_ASSERT_EQUAL_INT(1, test_words("-d /etc/passwd", 0));
+    TEST_ASSERT_EQUAL_INT(0, test_words("-d /tmp -a -w /tmp", 0));
+    TEST_ASSERT_EQUAL_INT(1, test_words("-e /nonexistent/file", 0));
+    TEST_ASSERT_EQUAL_INT(0, test_words("! -s /nonexistent/file", 0));
+    TEST_ASSERT_EQUAL_INT(0, test_words("abc != abd -o 1 -gt 2", 0));
+    TEST_ASSERT_EQUAL_INT(0, test_words("( 10 -lt 9 -o 010 -eq 10 ) -a abc", 0));
+    TEST_ASSERT_EQUAL_INT(0, test_words("-n = -n", 0));
+    TEST_ASSERT_EQUAL_INT(0, test_words("-n word", 0));
+    TEST_ASSERT_EQUAL_INT(0, test_words("!", 0));
+    TEST_ASSERT_EQUAL_INT(1, test_words("", 0));
+    TEST_ASSERT_EQUAL_INT(CONDITIONAL_ERROR, test_words("1 -lt x", 0));
+    TEST_ASSERT_EQUAL_INT(CONDITIONAL_ERROR, test_words("a b", 0));
+
+    // The extended form matches patterns and regular expressions
+    TEST_ASSERT_EQUAL_INT(0, test_words("main.c == *.c && abc < abd", 1));
+    TEST_ASSERT_EQUAL_INT(1, test_words("main.c != m*", 1));
+    TEST_ASSERT_EQUAL_INT(0, test_words("id42 =~ ^[a-z]+[0-9]+$ || -e /nonexistent", 1));
+
+    // The builtins run in the shell; [[ does not split and takes && and < as words
+    uint64_t spawns = stats_count(STAT_SPAWN);
+    execute_command("MYSHELL_TEST_C=; [ -d /tmp ] && test abc = abc && MYSHELL_TEST_C=both");
+    TEST_ASSERT_EQUAL_STRING("both", getenv("MYSHELL_TEST_C"));
+    execute_command("MYSHELL_TEST_E=''; [[ -z $MYSHELL_TEST_E && a < b ]] && MYSHELL_TEST_C=extended");
+    TEST_ASSERT_EQUAL_STRING("extended", getenv("MYSHELL_TEST_C"));
+    execute_command("MYSHELL_TEST_E='a*'; [[ abc == \"a*\" ]]; MYSHELL_TEST_C=$?; [[ 'a*' == \"a\"* ]]\n"
+                    "MYSHELL_TEST_C=$MYSHELL_TEST_C$?; [[ abc != a\\* && abc == $MYSHELL_TEST_E ]]\n"
+                    "MYSHELL_TEST_C=$MYSHELL_TEST_C$?; [[ abc = \"$MYSHELL_TEST_E\" ]]\n"
+                    "MYSHELL_TEST_C=$MYSHELL_TEST_C$?");
+    TEST_ASSERT_EQUAL_STRING("1001", getenv("MYSHELL_TEST_C"));
+    execute_command("[ 1 = 1; MYSHELL_TEST_C=$?");
+    TEST_ASSERT_EQUAL_STRING("2", getenv("MYSHELL_TEST_C"));
+    execute_command("[ -n \"\" ]; MYSHELL_TEST_C=$?; test -n word; MYSHELL_TEST_C=$MYSHELL_TEST_C$?");
+    TEST_ASSERT_EQUAL_STRING("10", getenv("MYSHELL_TEST_C"));
+    execute_command("[[ -n $MYSHELL_TEST_UNSET ]]; MYSHELL_TEST_C=$?\n"
+                    "[[ -n $MYSHELL_TEST_C && ! -n $MYSHELL_TEST_UNSET ]]; MYSHELL_TEST_C=$MYSHELL_TEST_C$?");
+    TEST_ASSERT_EQUAL_STRING("10", getenv("MYSHELL_TEST_C"));
+    TEST_ASSERT_TRUE(spawns == stats_count(STAT_SPAWN));
+    execute_command("unset MYSHELL_TEST_C MYSHELL_TEST_E");
+}
+
+void test_command_substitution(void)
+{
+    // Builtins are captured in the shell process
+    uint64_t spawns = stats_count(STAT_SPAWN);
+    execute_command("MYSHELL_TEST_S=$(echo a   b)");
+    TEST_ASSERT_EQUAL_STRING("a b", getenv("MYSHELL_TEST_S"));
+    execute_command("MYSHELL_TEST_S=\"[$(type echo)]$(echo $(echo nested))\"");
+    TEST_ASSERT_EQUAL_STRING("[echo is a shell builtin]nested", getenv("MYSHELL_TEST_S"));
+    execute_command("MYSHELL_TEST_S=$(test 1 = 2); MYSHELL_TEST_STATUS=$?");
+    TEST_ASSERT_EQUAL_STRING("1", getenv("MYSHELL_TEST_STATUS"));
+    execute_command("MYSHELL_TEST_S=; for w in $(echo 1 2) \"$(echo '3  4')\"; do\n"
+                    " MYSHELL_TEST_S=$MYSHELL_TEST_S[$w]\ndone");
+    TEST_ASSERT_EQUAL_STRING("[1][2][3  4]", getenv("MYSHELL_TEST_S"));
+    TEST_ASSERT_TRUE(spawns == stats_count(STAT_SPAWN));
+
+    // Anything else runs in a forked shell; trailing newlines are dropped, changes stay in the child
+    execute_command("MYSHELL_TEST_S=$(printf 'x\\n\\ny\\n\\n'; cd /)");
+    TEST_ASSERT_EQUAL_STRING("x\n\ny", getenv("MYSHELL_TEST_S"));
+    TEST_ASSERT_TRUE(spawns < stats_count(STAT_SPAWN));
+    char cwd[PATH_MAX];
+    TEST_ASSERT_NOT_NULL(getcwd(cwd, sizeof(cwd)));
+    TEST_ASSERT_NOT_EQUAL(0, strcmp(cwd, "/"));
+    execute_command("MYSHELL_TEST_S=$(sh -c 'exit 3'); MYSHELL_TEST_STATUS=$?");
+    TEST_ASSERT_EQUAL_STRING("3", getenv("MYSHELL_TEST_STATUS"));
+
+    // Output larger than the pipe is read whole
+    execute_command("local MYSHELL_TEST_BIG=\"$(seq 1 300000)\"");
+    const char* big = expanded("$MYSHELL_TEST_BIG");
+    TEST_ASSERT_EQUAL_size_t(1988894, strlen(big));
+    TEST_ASSERT_EQUAL_STRING("299999\n300000", big + strlen(big) - 13);
+
+    // A background builtin or function runs with the words expanded once, in the shell
+    const char* log = "/tmp/myshell_test_substitution.txt";
+    remove(log);
+    execute_command("f() { echo \"$@\" >> /tmp/myshell_test_substitution.txt; }\n"
+                    "MYSHELL_TEST_S=0; echo $(echo x >> /tmp/myshell_test_substitution.txt) > /dev/null & wait\n"
+                    "f $((MYSHELL_TEST_S = MYSHELL_TEST_S + 1)) & wait; unset -f f");
+    long bytes;
+    TEST_ASSERT_EQUAL_INT(2, count_lines(log, &bytes));
+    TEST_ASSERT_EQUAL_INT(4, bytes);
+    remove(log);
+    execute_command("unset MYSHELL_TEST_S MYSHELL_TEST_STATUS MYSHELL_TEST_BIG");
+}
+
+void test_scheduling_prefixes(void)
+{
+    execute_command("MYSHELL_TEST_S=$(nice 3 sh -c nice; nice sh -c nice; nice -n 2 nice 1 sh -c nice)");
+    TEST_ASSERT_EQUAL_STRING("3\n10\n3", getenv("MYSHELL_TEST_S"));
+    execute_command("MYSHELL_TEST_S=$(pin 0 ionice idle sh -c 'grep Cpus_allowed_list /proc/self/status; ionice')");
+    TEST_ASSERT_EQUAL_STRING("Cpus_allowed_list:\t0\nidle", getenv("MYSHELL_TEST_S"));
+
+    // Each pipeline stage has its own policy; builtins and functions with one are forked
+    execute_command("MYSHELL_TEST_S=$(nice 4 echo a | nice 2 sh -c 'cat; nice')");
+    TEST_ASSERT_EQUAL_STRING("a\n2", getenv("MYSHELL_TEST_S"));
+    execute_command("f() { MYSHELL_TEST_F=set; nice; }; MYSHELL_TEST_S=$(nice 6 f; echo [$MYSHELL_TEST_F])");
+    TEST_ASSERT_EQUAL_STRING("6\n[]", getenv("MYSHELL_TEST_S"));
+    execute_command("nice 5 cd /");
+    char cwd[PATH_MAX];
+    TEST_ASSERT_NOT_NULL(getcwd(cwd, sizeof(cwd)));
+    TEST_ASSERT_NOT_EQUAL(0, strcmp(cwd, "/"));
+
+    // Invalid prefixes fail; a prefix without a command is the command itself
+    execute_command("pin 2-1 true; MYSHELL_TEST_S=$?; ionice realtime:8 true; MYSHELL_TEST_S=$MYSHELL_TEST_S$?");
+    TEST_ASSERT_EQUAL_STRING("22", getenv("MYSHELL_TEST_S"));
+    execute_command("nice -n x true; MYSHELL_TEST_S=$?");
+    TEST_ASSERT_EQUAL_STRING("2", getenv("MYSHELL_TEST_S"));
+    execute_command("MYSHELL_TEST_S=$(nice)");
+    TEST_ASSERT_EQUAL_STRING("0", getenv("MYSHELL_TEST_S"));
+
+    // Background jobs take the default policy, under their own prefixes
+    setenv(POLICY_BACKGROUND_ENV, "nice 9 ionice idle", 1);
+    execute_command("sh -c 'nice; ionice' > /tmp/myshell_test_policy.txt & wait; "
+                    "nice 1 sh -c nice >> /tmp/myshell_test_policy.txt & wait; "
+                    "{ nice; } >> /tmp/myshell_test_policy.txt & wait; "
+                    "MYSHELL_TEST_S=$(cat /tmp/myshell_test_policy.txt)");
+    remove("/tmp/myshell_test_policy.txt");
+    TEST_ASSERT_EQUAL_STRING("9\nidle\n1\n9", getenv("MYSHELL_TEST_S"));
+    unsetenv(POLICY_BACKGROUND_ENV);
+    execute_command("unset MYSHELL_TEST_S; unset -f f");
+}
+
+void test_run_script_concurrently(void)
+{
+    const char* script = "/tmp/myshell_test_concurrent.sh";
+    const char* out = "/tmp/myshell_test_concurrent.txt";
+    FILE* fp = fopen(script, "w");
+    TEST_ASSERT_NOT_NULL_MESSAGE(fp, "Failed to create script");
+    fprintf(fp, "sh -c 'sleep 0.3; echo first'\n");
+    fprintf(fp, "sh -c 'sleep 0.3; echo second'\n");
+    // An assignment is a barrier, and the commands after it see it
+    fprintf(fp, "MYSHELL_TEST_CONCURRENT=after\n");
+    fprintf(fp, "sh -c 'echo $MYSHELL_TEST_CONCURRENT'\n");
+    fclose(fp);
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_ASSERT_NOT_EQUAL(-1, fd);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int status = run_script_concurrently(script, 4);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    TEST_ASSERT_EQUAL_INT(0, status);
+
+    // Both sleeps overlapped, and the output is in script order
+    TEST_ASSERT_TRUE((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9 < 0.55);
+    fp = fopen(out, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    char output[64] = "";
+    size_t n = fread(output, 1, sizeof(output) - 1, fp);
+    output[n] = '\0';
+    fclose(fp);
+    TEST_ASSERT_EQUAL_STRING("first\nsecond\nafter\n", output);
+
+    unsetenv("MYSHELL_TEST_CONCURRENT");
+    remove(script);
+    remove(out);
+}
+
+void test_run_script_concurrently_syntax_error(void)
+{
+    const char* script = "/tmp/myshell_test_concurrent_error.sh";
+    const char* out = "/tmp/myshell_test_concurrent_error.txt";
+    FILE* fp = fopen(script, "w");
+    TEST_ASSERT_NOT_NULL_MESSAGE(fp, "Failed to create script");
+    fprintf(fp, "sh -c 'sleep 0.2; echo first'\n");
+    fprintf(fp, "echo )\n");
+    fprintf(fp, "sh -c 'sleep 0.2; echo second'\n");
+    fprintf(fp, "if true\n");
+    fclose(fp);
+
+    // Diagnostics come out in script order with the output
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_ASSERT_NOT_EQUAL(-1, fd);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+    int status = run_script_concurrently(script, 4);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+    TEST_ASSERT_EQUAL_INT(0, status);
+
+    fp = fopen(out, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    char output[256] = "";
+    size_t n = fread(output, 1, sizeof(output) - 1, fp);
+    output[n] = '\0';
+    fclose(fp);
+    TEST_ASSERT_EQUAL_STRING("first\nsyntax error near unexpected token `)'\nsecond\n"
+                             "syntax error: unexpected end of file\n",
+                             output);
+    remove(script);
+    remove(out);
+}
+
+void test_run_script_concurrently_substitution(void)
+{
+    const char* script = "/tmp/myshell_test_concurrent_subst.sh";
+    const char* count = "/tmp/myshell_test_concurrent_subst.txt";
+    remove(count);
+    FILE* fp = fopen(script, "w");
+    TEST_ASSERT_NOT_NULL_MESSAGE(fp, "Failed to create script");
+    // Classifying the line must not run its substitutions a second time
+    fprintf(fp, "echo $(echo x >> %s) $((1 + 1)) > /dev/null\n", count);
+    fprintf(fp, "true\n");
+    fclose(fp);
+
+    TEST_ASSERT_EQUAL_INT(0, run_script_concurrently(script, 2));
+    long bytes;
+    TEST_ASSERT_EQUAL_INT(1, count_lines(count, &bytes));
+    remove(script);
+    remove(count);
+}
+
 int main(void)
 {
     UNITY_BEGIN();
     RUN_TEST(test_cd);
     RUN_TEST(test_echo);
+    RUN_TEST(test_builtin_lookup);
+    RUN_TEST(test_pipeline_builtins);
+    RUN_TEST(test_builtin_redirection_in_shell);
+    RUN_TEST(test_pipe_size);
+    RUN_TEST(test_run_script);
+    RUN_TEST(test_script_cache);
+    RUN_TEST(test_heredoc);
+    RUN_TEST(test_expand);
+    RUN_TEST(test_control_flow);
+    RUN_TEST(test_arithmetic);
+    RUN_TEST(test_conditional);
+    RUN_TEST(test_command_substitution);
+    RUN_TEST(test_scheduling_prefixes);
+    RUN_TEST(test_run_script_concurrently);
+    RUN_TEST(test_run_script_concurrently_syntax_error);
+    RUN_TEST(test_run_script_concurrently_substitution);
+    RUN_TEST(test_time_report);
+    RUN_TEST(test_shellstats);
+    RUN_TEST(test_prompt_segments);
+    RUN_TEST(test_history);
     return UNITY_END();
 }
@@ -0,0 +1,139 @@
+#include "../include/complete.h"
+#include "../include/path_cache.h"
+#include "../include/stats.h"
+#include "unity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Directory standing in for a `PATH` entry.
+ */
+#define TEST_BIN_DIR "/tmp/myshell_complete_bin"
+
+/**
+ * @brief Directory whose files are completed.
+ */
+#define TEST_FILES_DIR "/tmp/myshell_complete_files"
+
+/**
+ * @brief Creates a file, executable or not.
+ */
+static void create_file(const char* path, mode_t mode)
+{
+    FILE* file = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(file);
+    fprintf(file, "#!/bin/sh\n");
+    fclose(file);
+    chmod(path, mode);
+}
+
+/**
+ * @brief Completes `line` at its end and returns where the completed word starts.
+ */
+static size_t complete_at_end(const char* line, complete_list* list)
+{
+    complete_list_free(list);
+    complete_list_init(list);
+    return complete(line, strlen(line), list);
+}
+
+void setUp(void)
+{
+    mkdir(TEST_BIN_DIR, 0755);
+    create_file(TEST_BIN_DIR "/zzmyshell_tool", 0755);
+    create_file(TEST_BIN_DIR "/zzmyshell_data", 0644);
+    setenv("PATH", TEST_BIN_DIR, 1);
+}
+
+void tearDown(void)
+{
+    remove(TEST_BIN_DIR "/zzmyshell_tool");
+    remove(TEST_BIN_DIR "/zzmyshell_data");
+    remove(TEST_BIN_DIR "/zzmyshell_new");
+    rmdir(TEST_BIN_DIR);
+    complete_shutdown();
+}
+
+void test_complete_commands(void)
+{
+    complete_list list;
+    complete_list_init(&list);
+
+    // Only executables are offered, and the index is built once
+    TEST_ASSERT_EQUAL_INT(0, (int)complete_at_end("zzmyshell", &list));
+    TEST_ASSERT_EQUAL_INT(1, (int)list.count);
+    TEST_ASSERT_EQUAL_STRING("zzmyshell_tool", list.items[0]);
+    unsigned long scans = complete_path_scans();
+    complete_at_end("zzmyshell", &list);
+    TEST_ASSERT_TRUE(complete_path_scans() == scans);
+
+    // inotify reports a new executable, which the next lookup picks up
+    create_file(TEST_BIN_DIR "/zzmyshell_new", 0755);
+    TEST_ASSERT_EQUAL_INT(4, (int)complete_at_end("ls; zzmyshell", &list));
+    TEST_ASSERT_EQUAL_INT(2, (int)list.count);
+    TEST_ASSERT_EQUAL_STRING("zzmyshell_new", list.items[0]);
+    TEST_ASSERT_EQUAL_STRING("zzmyshell_tool", list.items[1]);
+    TEST_ASSERT_TRUE(complete_path_scans() == scans + 1);
+
+    // So does a file made executable
+    chmod(TEST_BIN_DIR "/zzmyshell_data", 0755);
+    complete_at_end("echo a | zzmyshell_d", &list);
+    TEST_ASSERT_EQUAL_INT(1, (int)list.count);
+    TEST_ASSERT_EQUAL_STRING("zzmyshell_data", list.items[0]);
+
+    // Builtins come along with the executables
+    complete_at_end("shellst", &list);
+    TEST_ASSERT_EQUAL_INT(1, (int)list.count);
+    TEST_ASSERT_EQUAL_STRING("shellstats", list.items[0]);
+
+    // Completing is well under a millisecond once the index exists
+    uint64_t start = stats_now();
+    complete_at_end("zz", &list);
+    TEST_ASSERT_TRUE(stats_now() - start < 1000000);
+    complete_list_free(&list);
+}
+
+void test_complete_files(void)
+{
+    mkdir(TEST_FILES_DIR, 0755);
+    mkdir(TEST_FILES_DIR "/subdir", 0755);
+    create_file(TEST_FILES_DIR "/notes.txt", 0644);
+    create_file(TEST_FILES_DIR "/.hidden", 0644);
+
+    complete_list list;
+    complete_list_init(&list);
+    // Arguments complete to files; directories end with a slash
+    TEST_ASSERT_EQUAL_INT(4, (int)complete_at_end("cat " TEST_FILES_DIR "/", &list));
+    TEST_ASSERT_EQUAL_INT(2, (int)list.count);
+    TEST_ASSERT_EQUAL_STRING(TEST_FILES_DIR "/notes.txt", list.items[0]);
+    TEST_ASSERT_EQUAL_STRING(TEST_FILES_DIR "/subdir/", list.items[1]);
+
+    // Hidden files need a leading dot; a word with a slash is a file even in command position
+    complete_at_end(TEST_FILES_DIR "/.h", &list);
+    TEST_ASSERT_EQUAL_INT(1, (int)list.count);
+    TEST_ASSERT_EQUAL_STRING(TEST_FILES_DIR "/.hidden", list.items[0]);
+
+    // Redirections break words
+    TEST_ASSERT_EQUAL_INT(9, (int)complete_at_end("echo hi >" TEST_FILES_DIR "/no", &list));
+    TEST_ASSERT_EQUAL_INT(1, (int)list.count);
+
+    complete_at_end("cat " TEST_FILES_DIR "/missing/", &list);
+    TEST_ASSERT_EQUAL_INT(0, (int)list.count);
+    complete_list_free(&list);
+
+    remove(TEST_FILES_DIR "/notes.txt");
+    remove(TEST_FILES_DIR "/.hidden");
+    rmdir(TEST_FILES_DIR "/subdir");
+    rmdir(TEST_FILES_DIR);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_complete_commands);
+    RUN_TEST(test_complete_files);
+    return UNITY_END();
+}
@@ -0,0 +1,194 @@
+#include "../include/builtins.h"
+#include "../include/jobs.h"
+#include "unity.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+static sigset_t saved_mask;
+
+void setUp(void)
+{
+    jobs_block_sigchld(&saved_mask);
+}
+
+void tearDown(void)
+{
+    jobs_forget_all();
+    jobs_restore_sigmask(&saved_mask);
+}
+
+/**
+ * @brief Forks a child that exits with `status` after `delay_ms` milliseconds.
+ */
+static pid_t start_child(int status, int delay_ms)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        usleep((useconds_t)delay_ms * 1000);
+        _exit(status);
+    }
+    TEST_ASSERT_GREATER_THAN(0, pid);
+    return pid;
+}
+
+/**
+ * @brief Runs a registered builtin with the given arguments.
+ */
+static int run(int argc, char** argv)
+{
+    const builtin* cmd = builtin_find(argv[0], strlen(argv[0]));
+    TEST_ASSERT_NOT_NULL(cmd);
+    return builtin_run(cmd, argc, argv);
+}
+
+void test_numbering_and_lookup(void)
+{
+    job* first = job_create("sleep 1", 7, 0);
+    job* second = job_create("sleep 2", 7, 0);
+    TEST_ASSERT_EQUAL_INT(1, first->id);
+    TEST_ASSERT_EQUAL_INT(2, second->id);
+    TEST_ASSERT_EQUAL_STRING("sleep 2", second->command);
+
+    job_add_process(first, 1000001, 0);
+    job_add_process(second, 1000002, 0);
+    job_add_process(second, 1000003, 0);
+    TEST_ASSERT_EQUAL_PTR(second, job_find_by_pid(1000003));
+    TEST_ASSERT_EQUAL_PTR(first, job_find_by_pid(1000001));
+    TEST_ASSERT_NULL(job_find_by_pid(1000004));
+
+    TEST_ASSERT_EQUAL_PTR(second, job_from_spec("%%"));
+    TEST_ASSERT_EQUAL_PTR(first, job_from_spec("%-"));
+    TEST_ASSERT_EQUAL_PTR(first, job_from_spec("%1"));
+    TEST_ASSERT_EQUAL_PTR(second, job_from_spec("1000002"));
+
+    // Numbers continue from the highest one still in use
+    job_remove(first);
+    TEST_ASSERT_NULL(job_find_by_pid(1000001));
+    job* third = job_create("true", 4, 0);
+    TEST_ASSERT_EQUAL_INT(3, third->id);
+    job_remove(third);
+    job_remove(second);
+    TEST_ASSERT_EQUAL_size_t(0, jobs_count());
+    TEST_ASSERT_EQUAL_INT(1, job_create("x", 1, 0)->id);
+}
+
+void test_many_jobs(void)
+{
+    for (int i = 0; i < 500; i++)
+    {
+        job* j = job_create("cmd", 3, 0);
+        job_add_process(j, 2000000 + i, 0);
+    }
+    TEST_ASSERT_EQUAL_size_t(500, jobs_count());
+    for (int i = 0; i < 500; i += 2)
+    {
+        job_remove(job_find_by_pid(2000000 + i));
+    }
+    for (int i = 1; i < 500; i += 2)
+    {
+        job* j = job_find_by_pid(2000000 + i);
+        TEST_ASSERT_NOT_NULL(j);
+        TEST_ASSERT_EQUAL_INT(i + 1, j->id);
+    }
+}
+
+void test_foreground_wait(void)
+{
+    job* j = job_create("exit 3", 6, 1);
+    job_add_process(j, start_child(0, 0), 0);
+    job_add_process(j, start_child(3, 20), 0);
+    // The status of a pipeline is the one of its last process
+    TEST_ASSERT_EQUAL_INT(3, job_wait(j));
+    TEST_ASSERT_EQUAL_size_t(0, jobs_count());
+}
+
+void test_foreground_wait_keeps_background_status(void)
+{
+    job* background = job_create("bg", 2, 0);
+    job_add_process(background, start_child(9, 0), 0);
+    job* foreground = job_create("fg | fg", 7, 1);
+    job_add_process(foreground, start_child(4, 50), 0);
+    job_add_process(foreground, start_child(0, 30), 0);
+
+    TEST_ASSERT_EQUAL_INT(0, job_wait(foreground));
+    size_t count;
+    const job_process* procs = jobs_last_pipestatus(&count);
+    TEST_ASSERT_EQUAL_size_t(2, count);
+    TEST_ASSERT_EQUAL_INT(4, procs[0].status);
+    TEST_ASSERT_EQUAL_INT(0, procs[1].status);
+    TEST_ASSERT_EQUAL_STRING("4 0", getenv("PIPESTATUS"));
+
+    // The background job's status was recorded, not lost to the foreground wait
+    TEST_ASSERT_EQUAL_INT(JOB_DONE, background->state);
+    TEST_ASSERT_EQUAL_INT(9, background->status);
+}
+
+void test_finished_stage_in_pipestatus(void)
+{
+    job* j = job_create("fg | builtin", 12, 1);
+    job_add_process(j, start_child(1, 30), 0);
+    job_add_finished(j, 0);
+
+    TEST_ASSERT_EQUAL_INT(0, job_wait(j));
+    size_t count;
+    const job_process* procs = jobs_last_pipestatus(&count);
+    TEST_ASSERT_EQUAL_size_t(2, count);
+    TEST_ASSERT_EQUAL_INT(getpid(), procs[1].pid);
+    TEST_ASSERT_EQUAL_STRING("1 0", getenv("PIPESTATUS"));
+    TEST_ASSERT_EQUAL_size_t(0, jobs_count());
+}
+
+void test_wait_builtins(void)
+{
+    job* slow = job_create("slow", 4, 0);
+    job_add_process(slow, start_child(5, 100), 0);
+    job* fast = job_create("fast", 4, 0);
+    job_add_process(fast, start_child(7, 10), 0);
+
+    char* wait_next[] = {"wait", "-n", NULL};
+    TEST_ASSERT_EQUAL_INT(7, run(2, wait_next));
+    TEST_ASSERT_EQUAL_size_t(1, jobs_count());
+
+    char* wait_job[] = {"wait", "%1", NULL};
+    TEST_ASSERT_EQUAL_INT(5, run(2, wait_job));
+    TEST_ASSERT_EQUAL_size_t(0, jobs_count());
+}
+
+void test_stop_and_continue(void)
+{
+    job* j = job_create("sleeper", 7, 0);
+    pid_t pid = start_child(0, 200);
+    job_add_process(j, pid, 0);
+
+    char* stop[] = {"kill", "-STOP", "%1", NULL};
+    TEST_ASSERT_EQUAL_INT(0, run(3, stop));
+    while (j->state != JOB_STOPPED)
+    {
+        jobs_reap(1);
+    }
+
+    char* bg[] = {"bg", NULL};
+    TEST_ASSERT_EQUAL_INT(0, run(1, bg));
+    TEST_ASSERT_EQUAL_INT(JOB_RUNNING, j->state);
+
+    char* fg[] = {"fg", "%1", NULL};
+    TEST_ASSERT_EQUAL_INT(0, run(2, fg));
+    TEST_ASSERT_NULL(job_find_by_pid(pid));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_numbering_and_lookup);
+    RUN_TEST(test_many_jobs);
+    RUN_TEST(test_foreground_wait);
+    RUN_TEST(test_foreground_wait_keeps_background_status);
+    RUN_TEST(test_finished_stage_in_pipestatus);
+    RUN_TEST(test_wait_builtins);
+    RUN_TEST(test_stop_and_continue);
+    return UNITY_END();
+}
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include "../include/forkserver.h"
+#include "../include/launcher.h"
+#include "unity.h"
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void setUp(void)
+{
+    launch_set_backend(LAUNCH_BACKEND_POSIX_SPAWN);
+}
+
+void tearDown(void)
+{
+    launch_set_backend(LAUNCH_BACKEND_POSIX_SPAWN);
+}
+
+/**
+ * @brief Runs `echo launched` through the active backend and checks its piped output.
+ */
+static void check_echo_through_pipe(void)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1)
+    {
+        perror("pipe2");
+        TEST_FAIL_MESSAGE("Failed to create pipe");
+    }
+
+    char* argv[] = {"echo", "launched", NULL};
+    launch_spec spec;
+    launch_spec_init(&spec, argv);
+    TEST_ASSERT_EQUAL_INT(0, launch_spec_add_dup2(&spec, fds[1], STDOUT_FILENO));
+
+    pid_t pid = launch_command(&spec);
+    close(fds[1]);
+    TEST_ASSERT_TRUE(pid > 0);
+
+    char output[64] = "";
+    ssize_t total = 0;
+    ssize_t n;
+    while ((n = read(fds[0], output + total, sizeof(output) - 1 - total)) > 0)
+    {
+        total += n;
+    }
+    output[total] = '\0';
+    close(fds[0]);
+
+    int status;
+    TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+    TEST_ASSERT_TRUE(WIFEXITED(status));
+    TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+    TEST_ASSERT_EQUAL_STRING("launched\n", output);
+}
+
+void test_posix_spawn_backend(void)
+{
+    check_echo_through_pipe();
+}
+
+void test_vfork_backend(void)
+{
+    launch_set_backend(LAUNCH_BACKEND_VFORK);
+    check_echo_through_pipe();
+}
+
+void test_fork_backend(void)
+{
+    launch_set_backend(LAUNCH_BACKEND_FORK);
+    check_echo_through_pipe();
+}
+
+void test_forkserver_backend(void)
+{
+    launch_set_backend(LAUNCH_BACKEND_FORKSERVER);
+    TEST_ASSERT_EQUAL_INT(0, forkserver_start());
+    TEST_ASSERT_TRUE(forkserver_running());
+    // The child is the caller's, not the server's, so it can be waited for
+    check_echo_through_pipe();
+
+    // Joining a new process group, with the caller's environment
+    char* argv[] = {"sh", "-c", "test \"$(ps -o pgid= -p $$ | tr -d ' ')\" = $$ && test \"$LAUNCH_TEST\" = yes", NULL};
+    char* envp[] = {"LAUNCH_TEST=yes", "PATH=/usr/bin:/bin", NULL};
+    launch_spec spec;
+    launch_spec_init(&spec, argv);
+    spec.envp = envp;
+    spec.pgid = 0;
+    pid_t pid = launch_command(&spec);
+    TEST_ASSERT_TRUE(pid > 0);
+    int status;
+    TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+    TEST_ASSERT_TRUE(WIFEXITED(status));
+    TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+
+    // A failed exec is reported and leaves nothing to wait for
+    char* missing[] = {"/nonexistent/myshell-no-such-command", NULL};
+    launch_spec_init(&spec, missing);
+    TEST_ASSERT_EQUAL_INT(-1, launch_command(&spec));
+
+    forkserver_stop();
+    TEST_ASSERT_FALSE(forkserver_running());
+    TEST_ASSERT_EQUAL_INT(-1, waitpid(-1, NULL, WNOHANG));
+}
+
+void test_missing_command(void)
+{
+    char* argv[] = {"myshell-no-such-command", NULL};
+    launch_spec spec;
+    launch_spec_init(&spec, argv);
+    TEST_ASSERT_EQUAL_INT(-1, launch_command(&spec));
+
+    launch_set_backend(LAUNCH_BACKEND_VFORK);
+    TEST_ASSERT_EQUAL_INT(-1, launch_command(&spec));
+}
+
+/**
+ * @brief Launches `spec` with its standard output sent to a pipe, and reads that output.
+ */
+static void read_launch_output(launch_spec* spec, char* output, size_t size)
+{
+    int fds[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe2(fds, O_CLOEXEC));
+    TEST_ASSERT_EQUAL_INT(0, launch_spec_add_dup2(spec, fds[1], STDOUT_FILENO));
+    pid_t pid = launch_command(spec);
+    close(fds[1]);
+    TEST_ASSERT_TRUE(pid > 0);
+    size_t total = 0;
+    ssize_t n;
+    while ((n = read(fds[0], output + total, size - 1 - total)) > 0)
+    {
+        total += (size_t)n;
+    }
+    output[total] = '\0';
+    close(fds[0]);
+    TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, NULL, 0));
+}
+
+void test_policy(void)
+{
+    char* argv[] = {"sh", "-c", "nice; grep Cpus_allowed_list /proc/self/status", NULL};
+    launch_policy policy = {LAUNCH_POLICY_NICE | LAUNCH_POLICY_CPUS, {1}, 5, 0};
+    launch_spec spec;
+    launch_spec_init(&spec, argv);
+    spec.policy = &policy;
+
+    // posix_spawn cannot apply the policy: the launch falls back to vfork
+    char output[128];
+    read_launch_output(&spec, output, sizeof(output));
+    TEST_ASSERT_EQUAL_STRING("5\nCpus_allowed_list:\t0\n", output);
+}
+
+void test_forkserver_directory_and_umask(void)
+{
+    launch_set_backend(LAUNCH_BACKEND_FORKSERVER);
+    TEST_ASSERT_EQUAL_INT(0, forkserver_start());
+    char started[PATH_MAX];
+    TEST_ASSERT_NOT_NULL(getcwd(started, sizeof(started)));
+
+    // The server stays where it started; the child follows the caller
+    TEST_ASSERT_EQUAL_INT(0, chdir("/"));
+    mode_t old_mask = umask(027);
+    char* argv[] = {"sh", "-c", "pwd; umask", NULL};
+    launch_spec spec;
+    launch_spec_init(&spec, argv);
+    char output[128];
+    read_launch_output(&spec, output, sizeof(output));
+    umask(old_mask);
+    TEST_ASSERT_EQUAL_INT(0, chdir(started));
+    forkserver_stop();
+    TEST_ASSERT_EQUAL_STRING("/\n0027\n", output);
+}
+
+void test_backend_names(void)
+{
+    launch_backend backend;
+    TEST_ASSERT_EQUAL_INT(0, launch_backend_from_name("vfork", &backend));
+    TEST_ASSERT_EQUAL_INT(LAUNCH_BACKEND_VFORK, backend);
+    TEST_ASSERT_EQUAL_INT(0, launch_backend_from_name("posix_spawn", &backend));
+    TEST_ASSERT_EQUAL_INT(LAUNCH_BACKEND_POSIX_SPAWN, backend);
+    TEST_ASSERT_EQUAL_INT(0, launch_backend_from_name("forkserver", &backend));
+    TEST_ASSERT_EQUAL_INT(LAUNCH_BACKEND_FORKSERVER, backend);
+    TEST_ASSERT_EQUAL_INT(-1, launch_backend_from_name("clone3", &backend));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_posix_spawn_backend);
+    RUN_TEST(test_vfork_backend);
+    RUN_TEST(test_fork_backend);
+    RUN_TEST(test_forkserver_backend);
+    RUN_TEST(test_missing_command);
+    RUN_TEST(test_policy);
+    RUN_TEST(test_forkserver_directory_and_umask);
+    RUN_TEST(test_backend_names);
+    return UNITY_END();
+}
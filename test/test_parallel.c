@@ -0,0 +1,143 @@
+#include "../include/builtins.h"
+#include "../include/jobs.h"
+#include "../include/parallel.h"
+#include "unity.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief File the standard output of `parallel` is captured in.
+ */
+#define OUTPUT_FILE "/tmp/myshell_test_parallel.txt"
+
+void setUp(void)
+{
+    // No setup needed for these tests
+}
+
+void tearDown(void)
+{
+    remove(OUTPUT_FILE);
+}
+
+/**
+ * @brief Runs `parallel` with its standard output in OUTPUT_FILE and reads the file back.
+ */
+static int run_captured(int argc, char** argv, char* output, size_t size)
+{
+    const builtin* cmd = builtin_find("parallel", strlen("parallel"));
+    TEST_ASSERT_NOT_NULL(cmd);
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int fd = open(OUTPUT_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_ASSERT_NOT_EQUAL(-1, fd);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    int status = builtin_run(cmd, argc, argv);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    FILE* fp = fopen(OUTPUT_FILE, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+    size_t n = fread(output, 1, size - 1, fp);
+    output[n] = '\0';
+    fclose(fp);
+    return status;
+}
+
+/**
+ * @brief Returns the monotonic time in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void test_keep_order(void)
+{
+    char* argv[] = {"parallel", "-j", "3", "-k", "sh -c 'sleep $0; echo $0'", ":::", "0.3", "0.1", "0.2", NULL};
+    char output[256];
+    TEST_ASSERT_EQUAL_INT(0, run_captured(9, argv, output, sizeof(output)));
+    TEST_ASSERT_EQUAL_STRING("0.3\n0.1\n0.2\n", output);
+}
+
+void test_runs_concurrently(void)
+{
+    char* argv[] = {"parallel", "-j", "4", "sleep", ":::", "0.2", "0.2", "0.2", "0.2", NULL};
+    char output[64];
+    double start = now();
+    TEST_ASSERT_EQUAL_INT(0, run_captured(9, argv, output, sizeof(output)));
+    TEST_ASSERT_TRUE(now() - start < 0.6);
+}
+
+void test_output_not_interleaved(void)
+{
+    // Each task writes its lines slowly; captured output comes out in one piece per task
+    char* argv[] = {"parallel", "-j", "2", "sh -c 'for i in 1 2 3; do echo $0; sleep 0.05; done'", ":::", "a", "b",
+                    NULL};
+    char output[64];
+    TEST_ASSERT_EQUAL_INT(0, run_captured(7, argv, output, sizeof(output)));
+    TEST_ASSERT_TRUE(strcmp(output, "a\na\na\nb\nb\nb\n") == 0 || strcmp(output, "b\nb\nb\na\na\na\n") == 0);
+}
+
+void test_failures_and_timeout(void)
+{
+    char* argv[] = {"parallel", "-t", "0.2", "sleep", ":::", "5", "0.01", NULL};
+    char output[64];
+    double start = now();
+    // The timed out task is the only failure
+    TEST_ASSERT_EQUAL_INT(1, run_captured(7, argv, output, sizeof(output)));
+    TEST_ASSERT_TRUE(now() - start < 2.0);
+
+    char* failing[] = {"parallel", "sh -c 'exit $0'", ":::", "0", "3", "4", NULL};
+    TEST_ASSERT_EQUAL_INT(2, run_captured(6, failing, output, sizeof(output)));
+    TEST_ASSERT_EQUAL_size_t(0, jobs_count());
+}
+
+void test_items_from_stdin(void)
+{
+    int fds[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+    const char* items = "one\n\nit's two\n";
+    TEST_ASSERT_EQUAL_INT((int)strlen(items), (int)write(fds[1], items, strlen(items)));
+    close(fds[1]);
+    int saved = dup(STDIN_FILENO);
+    dup2(fds[0], STDIN_FILENO);
+    close(fds[0]);
+
+    char* argv[] = {"parallel", "-k", "echo [{}]", NULL};
+    char output[64];
+    int status = run_captured(3, argv, output, sizeof(output));
+    dup2(saved, STDIN_FILENO);
+    close(saved);
+    TEST_ASSERT_EQUAL_INT(0, status);
+    TEST_ASSERT_EQUAL_STRING("[one]\n[it's two]\n", output);
+}
+
+void test_usage(void)
+{
+    const builtin* cmd = builtin_find("parallel", strlen("parallel"));
+    char* zero_jobs[] = {"parallel", "-j", "0", "echo", ":::", "a", NULL};
+    TEST_ASSERT_EQUAL_INT(1, builtin_run(cmd, 6, zero_jobs));
+    char* no_separator[] = {"parallel", "echo", "a", NULL};
+    TEST_ASSERT_EQUAL_INT(1, builtin_run(cmd, 3, no_separator));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_keep_order);
+    RUN_TEST(test_runs_concurrently);
+    RUN_TEST(test_output_not_interleaved);
+    RUN_TEST(test_failures_and_timeout);
+    RUN_TEST(test_items_from_stdin);
+    RUN_TEST(test_usage);
+    return UNITY_END();
+}
@@ -0,0 +1,290 @@
+#include "../include/lexer.h"
+#include "../include/parser.h"
+#include "unity.h"
+#include <string.h>
+
+static arena test_arena;
+
+void setUp(void)
+{
+    arena_init(&test_arena);
+}
+
+void tearDown(void)
+{
+    arena_free(&test_arena);
+}
+
+/**
+ * @brief Parses `text`, expecting PARSE_OK, and returns the root list.
+ */
+static node* parse_ok(const char* text)
+{
+    node* root = NULL;
+    TEST_ASSERT_EQUAL_INT(PARSE_OK, parse_line(&test_arena, text, strlen(text), &root));
+    TEST_ASSERT_NOT_NULL(root);
+    TEST_ASSERT_EQUAL_INT(NODE_LIST, root->type);
+    return root;
+}
+
+/**
+ * @brief Returns the unquoted text of a word.
+ */
+static char* word_text(const word* w)
+{
+    return lexer_unquote(&test_arena, w->start, w->len);
+}
+
+void test_simple_command(void)
+{
+    node* root = parse_ok("ls -l  /tmp");
+    TEST_ASSERT_EQUAL_size_t(1, root->list.num_items);
+    node* pipeline = root->list.items[0].command;
+    TEST_ASSERT_EQUAL_INT(NODE_PIPELINE, pipeline->type);
+    TEST_ASSERT_EQUAL_size_t(1, pipeline->pipeline.num_stages);
+    node* simple = pipeline->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_size_t(3, simple->simple.num_words);
+    TEST_ASSERT_EQUAL_STRING("ls", word_text(&simple->simple.words[0]));
+    TEST_ASSERT_EQUAL_STRING("/tmp", word_text(&simple->simple.words[2]));
+}
+
+void test_list_and_or(void)
+{
+    node* root = parse_ok("a && b || c ; d &");
+    TEST_ASSERT_EQUAL_size_t(2, root->list.num_items);
+    TEST_ASSERT_FALSE(root->list.items[0].background);
+    TEST_ASSERT_TRUE(root->list.items[1].background);
+
+    // `&&` and `||` are left associative: (a && b) || c
+    node* or_node = root->list.items[0].command;
+    TEST_ASSERT_EQUAL_INT(NODE_OR, or_node->type);
+    TEST_ASSERT_EQUAL_INT(NODE_AND, or_node->binary.left->type);
+    TEST_ASSERT_EQUAL_INT(NODE_PIPELINE, or_node->binary.right->type);
+}
+
+void test_pipeline_stages(void)
+{
+    node* root = parse_ok("cat file | grep x |\n wc -l");
+    node* pipeline = root->list.items[0].command;
+    TEST_ASSERT_EQUAL_size_t(3, pipeline->pipeline.num_stages);
+    TEST_ASSERT_EQUAL_STRING("wc", word_text(&pipeline->pipeline.stages[2]->simple.words[0]));
+}
+
+void test_quotes_and_escapes(void)
+{
+    node* root = parse_ok("echo 'a b' \"c|d\" e\\ f");
+    node* simple = root->list.items[0].command->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_size_t(4, simple->simple.num_words);
+    TEST_ASSERT_EQUAL_STRING("a b", word_text(&simple->simple.words[1]));
+    TEST_ASSERT_EQUAL_STRING("c|d", word_text(&simple->simple.words[2]));
+    TEST_ASSERT_EQUAL_STRING("e f", word_text(&simple->simple.words[3]));
+
+    // The default of a parameter expansion may hold blanks and operators
+    root = parse_ok("echo ${X:-a b|c} ${Y:-${Z:-d e}}");
+    simple = root->list.items[0].command->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_size_t(3, simple->simple.num_words);
+    TEST_ASSERT_EQUAL_STRING("${X:-a b|c}", word_text(&simple->simple.words[1]));
+}
+
+void test_redirections(void)
+{
+    node* root = parse_ok("cmd <in >out 2>> err 3>x");
+    node* simple = root->list.items[0].command->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_size_t(1, simple->simple.num_words);
+    TEST_ASSERT_EQUAL_size_t(4, simple->simple.num_redirections);
+
+    redirection* r = simple->simple.redirections;
+    TEST_ASSERT_EQUAL_INT(REDIR_INPUT, r[0].type);
+    TEST_ASSERT_EQUAL_INT(0, r[0].fd);
+    TEST_ASSERT_EQUAL_INT(REDIR_OUTPUT, r[1].type);
+    TEST_ASSERT_EQUAL_INT(1, r[1].fd);
+    TEST_ASSERT_EQUAL_INT(REDIR_APPEND, r[2].type);
+    TEST_ASSERT_EQUAL_INT(2, r[2].fd);
+    TEST_ASSERT_EQUAL_STRING("err", word_text(&r[2].target));
+    TEST_ASSERT_EQUAL_INT(3, r[3].fd);
+}
+
+void test_assignments(void)
+{
+    node* root = parse_ok("A=1 B='x y' env C=2");
+    node* simple = root->list.items[0].command->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_size_t(2, simple->simple.num_assignments);
+    // Assignments after the command name are ordinary arguments
+    TEST_ASSERT_EQUAL_size_t(2, simple->simple.num_words);
+    TEST_ASSERT_EQUAL_STRING("C=2", word_text(&simple->simple.words[1]));
+}
+
+void test_empty_and_comments(void)
+{
+    node* root = NULL;
+    TEST_ASSERT_EQUAL_INT(PARSE_EMPTY, parse_line(&test_arena, "", 0, &root));
+    TEST_ASSERT_EQUAL_INT(PARSE_EMPTY, parse_line(&test_arena, "   # only a comment", 19, &root));
+}
+
+void test_incomplete(void)
+{
+    node* root = NULL;
+    TEST_ASSERT_EQUAL_INT(PARSE_INCOMPLETE, parse_line(&test_arena, "echo 'open", 10, &root));
+    TEST_ASSERT_EQUAL_INT(PARSE_INCOMPLETE, parse_line(&test_arena, "ls |", 4, &root));
+    TEST_ASSERT_EQUAL_INT(PARSE_INCOMPLETE, parse_line(&test_arena, "true &&", 7, &root));
+    TEST_ASSERT_EQUAL_INT(PARSE_INCOMPLETE, parse_line(&test_arena, "echo ${X:-a", 11, &root));
+}
+
+void test_syntax_error(void)
+{
+    node* root = NULL;
+    TEST_ASSERT_EQUAL_INT(PARSE_ERROR, parse_line(&test_arena, "echo ;; x", 9, &root));
+    TEST_ASSERT_EQUAL_INT(PARSE_ERROR, parse_line(&test_arena, "| ls", 4, &root));
+    TEST_ASSERT_EQUAL_INT(PARSE_ERROR, parse_line(&test_arena, "ls > | wc", 9, &root));
+}
+
+void test_arena_reuse(void)
+{
+    parse_ok("one | two && three");
+    size_t mallocs = test_arena.mallocs;
+    for (int i = 0; i < 100; i++)
+    {
+        arena_reset(&test_arena);
+        parse_ok("one | two && three");
+    }
+    // A reset arena keeps its block, so steady-state parsing does not call malloc
+    TEST_ASSERT_EQUAL_size_t(mallocs, test_arena.mallocs);
+}
+
+void test_time_keyword(void)
+{
+    node* pipeline = parse_ok("time -j sort | uniq -c")->list.items[0].command;
+    TEST_ASSERT_EQUAL_INT(TIME_JSON, pipeline->pipeline.timed);
+    TEST_ASSERT_EQUAL_size_t(2, pipeline->pipeline.num_stages);
+    TEST_ASSERT_EQUAL_STRING("sort", word_text(&pipeline->pipeline.stages[0]->simple.words[0]));
+
+    pipeline = parse_ok("time ls && ls")->list.items[0].command->binary.left;
+    TEST_ASSERT_EQUAL_INT(TIME_TEXT, pipeline->pipeline.timed);
+
+    // Only the first word of a pipeline is the keyword, and only if a command follows
+    pipeline = parse_ok("echo time")->list.items[0].command;
+    TEST_ASSERT_EQUAL_INT(TIME_NONE, pipeline->pipeline.timed);
+    pipeline = parse_ok("time")->list.items[0].command;
+    TEST_ASSERT_EQUAL_INT(TIME_NONE, pipeline->pipeline.timed);
+    TEST_ASSERT_EQUAL_STRING("time", word_text(&pipeline->pipeline.stages[0]->simple.words[0]));
+    pipeline = parse_ok("'time' ls")->list.items[0].command;
+    TEST_ASSERT_EQUAL_INT(TIME_NONE, pipeline->pipeline.timed);
+}
+
+void test_heredocs(void)
+{
+    const char* text = "cat <<EOF | tr a b <<-'END' && cat <<<'x y'\nbody $HOME\nEOF\n\tquoted\n\tEND\nls";
+    node* root = parse_ok(text);
+    TEST_ASSERT_EQUAL_size_t(2, root->list.num_items);
+    node* pipeline = root->list.items[0].command->binary.left;
+    redirection* first = &pipeline->pipeline.stages[0]->simple.redirections[0];
+    TEST_ASSERT_EQUAL_INT(REDIR_HEREDOC, first->type);
+    TEST_ASSERT_EQUAL_INT(0, first->fd);
+    TEST_ASSERT_TRUE(first->expand);
+    TEST_ASSERT_FALSE(first->strip_tabs);
+    TEST_ASSERT_EQUAL_STRING_LEN("body $HOME\n", first->body.start, first->body.len);
+    TEST_ASSERT_EQUAL_size_t(11, first->body.len);
+
+    // Bodies follow in the order of their operators; a quoted delimiter disables expansion
+    redirection* second = &pipeline->pipeline.stages[1]->simple.redirections[0];
+    TEST_ASSERT_FALSE(second->expand);
+    TEST_ASSERT_TRUE(second->strip_tabs);
+    TEST_ASSERT_EQUAL_STRING_LEN("\tquoted\n", second->body.start, second->body.len);
+
+    redirection* string = &root->list.items[0].command->binary.right->pipeline.stages[0]->simple.redirections[0];
+    TEST_ASSERT_EQUAL_INT(REDIR_HERESTRING, string->type);
+    TEST_ASSERT_EQUAL_STRING("x y", word_text(&string->target));
+
+    // The command after the bodies is parsed as usual
+    node* last = root->list.items[1].command->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_STRING("ls", word_text(&last->simple.words[0]));
+
+    // Until the delimiter line is seen more input is needed
+    node* incomplete = NULL;
+    TEST_ASSERT_EQUAL_INT(PARSE_INCOMPLETE, parse_line(&test_arena, "cat <<EOF", 9, &incomplete));
+    TEST_ASSERT_EQUAL_INT(PARSE_INCOMPLETE, parse_line(&test_arena, "cat <<EOF\nEOFX\n", 15, &incomplete));
+    parse_ok("cat <<EOF\nEOF");
+}
+
+void test_compound_commands(void)
+{
+    node* root = parse_ok("if a; then b; elif c\nthen d; else e; fi > out");
+    node* n = root->list.items[0].command->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_INT(NODE_IF, n->type);
+    TEST_ASSERT_EQUAL_size_t(1, n->compound.num_redirections);
+    TEST_ASSERT_EQUAL_INT(NODE_IF, n->compound.else_part->type);
+    TEST_ASSERT_EQUAL_INT(NODE_LIST, n->compound.else_part->compound.else_part->type);
+    TEST_ASSERT_EQUAL_STRING_LEN("if a; then b; elif c\nthen d; else e; fi", n->compound.source.start,
+                                 n->compound.source.len);
+
+    n = parse_ok("for x in a \"b c\"; do echo $x; done")->list.items[0].command->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_INT(NODE_FOR, n->type);
+    TEST_ASSERT_EQUAL_STRING("x", word_text(&n->compound.name));
+    TEST_ASSERT_TRUE(n->compound.has_words);
+    TEST_ASSERT_EQUAL_size_t(2, n->compound.num_words);
+    n = parse_ok("for x\ndo :; done")->list.items[0].command->pipeline.stages[0];
+    TEST_ASSERT_FALSE(n->compound.has_words);
+
+    n = parse_ok("case $1 in\n(a|b) x;;\n*) ;;\nc) y\nesac")->list.items[0].command->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_INT(NODE_CASE, n->type);
+    TEST_ASSERT_EQUAL_size_t(3, n->compound.num_items);
+    TEST_ASSERT_EQUAL_size_t(2, n->compound.items[0].num_patterns);
+    TEST_ASSERT_EQUAL_size_t(0, n->compound.items[1].body->list.num_items);
+
+    // Function definitions, and reserved words only count in command position
+    root = parse_ok("f() { echo if then fi; }; function g { while x; do y | z; done; }; echo done");
+    TEST_ASSERT_EQUAL_size_t(3, root->list.num_items);
+    n = root->list.items[0].command->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_INT(NODE_FUNCTION, n->type);
+    TEST_ASSERT_EQUAL_INT(NODE_GROUP, n->compound.body->type);
+    TEST_ASSERT_EQUAL_STRING("g", word_text(&root->list.items[1].command->pipeline.stages[0]->compound.name));
+
+    // An unfinished compound command needs more input; a stray or missing reserved word is an error
+    node* unused = NULL;
+    TEST_ASSERT_EQUAL_INT(PARSE_INCOMPLETE, parse_line(&test_arena, "while true; do", 14, &unused));
+    TEST_ASSERT_EQUAL_INT(PARSE_INCOMPLETE, parse_line(&test_arena, "case x in a)", 12, &unused));
+    TEST_ASSERT_EQUAL_INT(PARSE_ERROR, parse_line(&test_arena, "fi", 2, &unused));
+    TEST_ASSERT_EQUAL_INT(PARSE_ERROR, parse_line(&test_arena, "if true; fi", 11, &unused));
+    TEST_ASSERT_EQUAL_INT(PARSE_ERROR, parse_line(&test_arena, "for 1x in a; do :; done", 23, &unused));
+}
+
+void test_conditional_and_arithmetic(void)
+{
+    // Between [[ and ]], && || < > ( ) are words; after ]] they are operators again
+    node* root = parse_ok("[[ ( a < b ) || c > d ]] && echo \"$(( (1 + 2) * 3 ))\"$((4))");
+    TEST_ASSERT_EQUAL_INT(NODE_AND, root->list.items[0].command->type);
+    node* n = root->list.items[0].command->binary.left->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_size_t(11, n->simple.num_words);
+    TEST_ASSERT_EQUAL_size_t(0, n->simple.num_redirections);
+    TEST_ASSERT_EQUAL_STRING("||", word_text(&n->simple.words[6]));
+    n = root->list.items[0].command->binary.right->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_size_t(2, n->simple.num_words);
+    TEST_ASSERT_EQUAL_STRING_LEN("\"$(( (1 + 2) * 3 ))\"$((4))", n->simple.words[1].start, n->simple.words[1].len);
+
+    // [ takes < as a redirection, as in other shells
+    n = parse_ok("[ a < b ]")->list.items[0].command->pipeline.stages[0];
+    TEST_ASSERT_EQUAL_size_t(1, n->simple.num_redirections);
+
+    node* unused = NULL;
+    TEST_ASSERT_EQUAL_INT(PARSE_INCOMPLETE, parse_line(&test_arena, "echo $(( 1 +", 12, &unused));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_simple_command);
+    RUN_TEST(test_list_and_or);
+    RUN_TEST(test_pipeline_stages);
+    RUN_TEST(test_quotes_and_escapes);
+    RUN_TEST(test_redirections);
+    RUN_TEST(test_assignments);
+    RUN_TEST(test_empty_and_comments);
+    RUN_TEST(test_incomplete);
+    RUN_TEST(test_syntax_error);
+    RUN_TEST(test_arena_reuse);
+    RUN_TEST(test_time_keyword);
+    RUN_TEST(test_heredocs);
+    RUN_TEST(test_compound_commands);
+    RUN_TEST(test_conditional_and_arithmetic);
+    return UNITY_END();
+}
@@ -0,0 +1,85 @@
+#include "../include/path_cache.h"
+#include "unity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Directory holding the fake executable used by the tests.
+ */
+#define TEST_BIN_DIR "/tmp/myshell_path_cache_test"
+
+/**
+ * @brief Full path of the fake executable.
+ */
+#define TEST_BIN TEST_BIN_DIR "/fake_command"
+
+void setUp(void)
+{
+    mkdir(TEST_BIN_DIR, 0755);
+    FILE* file = fopen(TEST_BIN, "w");
+    if (file == NULL)
+    {
+        perror("fopen");
+        TEST_FAIL_MESSAGE("Failed to create fake executable");
+    }
+    fprintf(file, "#!/bin/sh\n");
+    fclose(file);
+    chmod(TEST_BIN, 0755);
+    setenv("PATH", "/nonexistent:" TEST_BIN_DIR ":/usr/bin:/bin", 1);
+    path_cache_clear();
+}
+
+void tearDown(void)
+{
+    remove(TEST_BIN);
+    rmdir(TEST_BIN_DIR);
+}
+
+void test_resolve_and_hit(void)
+{
+    unsigned long misses = path_cache_misses();
+    unsigned long hits = path_cache_hits();
+
+    TEST_ASSERT_EQUAL_STRING(TEST_BIN, path_cache_resolve("fake_command"));
+    TEST_ASSERT_EQUAL_INT(misses + 1, path_cache_misses());
+
+    TEST_ASSERT_EQUAL_STRING(TEST_BIN, path_cache_resolve("fake_command"));
+    TEST_ASSERT_EQUAL_INT(hits + 1, path_cache_hits());
+    TEST_ASSERT_EQUAL_STRING(TEST_BIN, path_cache_peek("fake_command"));
+}
+
+void test_names_with_slash_bypass_cache(void)
+{
+    TEST_ASSERT_EQUAL_STRING("./fake_command", path_cache_resolve("./fake_command"));
+    TEST_ASSERT_NULL(path_cache_peek("./fake_command"));
+}
+
+void test_path_change_invalidates(void)
+{
+    TEST_ASSERT_NOT_NULL(path_cache_resolve("fake_command"));
+    setenv("PATH", "/usr/bin:/bin", 1);
+    TEST_ASSERT_NULL(path_cache_peek("fake_command"));
+    TEST_ASSERT_NULL(path_cache_resolve("fake_command"));
+}
+
+void test_forget(void)
+{
+    TEST_ASSERT_NOT_NULL(path_cache_resolve("fake_command"));
+    TEST_ASSERT_NOT_NULL(path_cache_resolve("sh"));
+    path_cache_forget("fake_command");
+    TEST_ASSERT_NULL(path_cache_peek("fake_command"));
+    TEST_ASSERT_NOT_NULL(path_cache_peek("sh"));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_resolve_and_hit);
+    RUN_TEST(test_names_with_slash_bypass_cache);
+    RUN_TEST(test_path_change_invalidates);
+    RUN_TEST(test_forget);
+    return UNITY_END();
+}